@@ -15,10 +15,43 @@
 #include <iostream>
 #include <GL/glut.h>
 #include <fstream>
-#include "windows.h"
+#include "platform.h"
 #include <string>
+#include <algorithm>
+#include <sstream>
+#include <thread>
 #include "math.h"
 #include "vector3.h"
+#include "vector3batch.h"
+#include "glloader.h"
+#include "meshcache.h"
+#include "meshopt.h"
+#include "meshgen.h"
+#include "vertexpack.h"
+#include "framestats.h"
+#include "headless.h"
+#include "benchmark.h"
+#include "bmploader.h"
+#include "lod.h"
+#include "culling.h"
+#include "scenefile.h"
+#include "instancing.h"
+#include "shaders.h"
+#include "renderstate.h"
+#include "softraster.h"
+#include "raytrace.h"
+#include "bvh.h"
+#include "threadpool.h"
+#include "texcook.h"
+#include "assetstream.h"
+#include "shadowmap.h"
+#include "lightbake.h"
+#include "transform.h"
+#include "golden.h"
+#include "arena.h"
+#include "animation.h"
+#include "pixelshading.h"
+#include "instrument.h" // last, it wraps the GL calls when instrumentation is compiled in
 
 #define SILVER 0
 #define GOLD 1
@@ -26,6 +59,7 @@
 #define EMERALD 3
 #define RUBY 4
 #define PEARL 5
+#define MATERIAL_COUNT 6
 
 #define TOP 0
 #define BOTTOM 1
@@ -34,10 +68,18 @@
 #define FRONT 4
 #define BACK 5
 
+#define HOUSE 0
+#define CAR 1
+#define TREE 2
+#define ROCKET 3
+#define BENCH 4
+#define MODEL_COUNT 5
+
 using namespace std;
 
 // viewer
 vector3 viewer(7.0, 7.0, 7.0);
+vector3 viewTarget(0.0, 0.0, 0.0); // the point the viewer looks at, the free camera moves both
 
 // Light properties
 GLfloat light0_position[] = { -30.0, 10.0, 20.0, 0.0 };
@@ -56,43 +98,31 @@ GLfloat sunlight_specular[] = { 1.0, 0.95, 0.8, 1.0 };
 
 GLfloat lmodel_ambient[] = { 0.1, 0.1, 0.1, 1.0 };
 
-// silver color
-GLfloat silver_ambient[] = { 0.19225, 0.19225, 0.19225, 1.0 };
-GLfloat silver_diffuse[] = { 0.50754, 0.50754, 0.50754, 1.0 };
-GLfloat silver_specular[] = { 0.508273, 0.508273, 0.508273, 1.0 };
-GLfloat silver_shininess[] = { 51.2 };
-
-// gold color
-GLfloat gold_ambient[] = { 0.24725, 0.1995, 0.0745, 1.0 };
-GLfloat gold_diffuse[] = { 0.75164, 0.60648, 0.22658, 1.0 };
-GLfloat gold_specular[] = { 0.628281, 0.555802, 0.366065, 1.0 };
-GLfloat gold_shininess[] = { 51.2 };
-
-// emerald color
-GLfloat emerald_ambient[] = { 0.0215, 0.1745, 0.0215, 1.0 };
-GLfloat emerald_diffuse[] = { 0.07568, 0.61424, 0.07568, 1.0 };
-GLfloat emerald_specular[] = { 0.633, 0.727811, 0.633, 1.0 };
-GLfloat emerald_shininess[] = { 76.8 };
-
-// ruby color
-GLfloat ruby_ambient[] = { 0.1745, 0.01175, 0.01175, 1.0 };
-GLfloat ruby_diffuse[] = { 0.61424, 0.04136, 0.04136, 1.0 };
-GLfloat ruby_specular[] = { 0.727811, 0.626959, 0.626959, 1.0 };
-GLfloat ruby_shininess[] = { 76.8 };
-
-// pearl color
-GLfloat pearl_ambient[] = { 0.25, 0.20725, 0.20725, 1.0 };
-GLfloat pearl_diffuse[] = { 1.0, 0.829, 0.829, 1.0 };
-GLfloat pearl_specular[] = { 0.296648, 0.296648, 0.296648, 1.0 };
-GLfloat pearl_shininess[] = { 11.264 };
-
-// polished bronze
-GLfloat bronze_ambient[] = { 0.25, 0.148, 0.06475, 1.0 };
-GLfloat bronze_diffuse[] = { 0.4, 0.2368, 0.1036, 1.0 };
-GLfloat bronze_specular[] = { 0.774597, 0.458561, 0.200621, 1.0 };
-GLfloat bronze_shininess[] = { 76.8 };
-
-typedef GLdouble vertex3[3];
+// the material table, in the order of the handles above
+Material materials[MATERIAL_COUNT] = {
+    // silver color
+    { { 0.19225, 0.19225, 0.19225, 1.0 }, { 0.50754, 0.50754, 0.50754, 1.0 }, { 0.508273, 0.508273, 0.508273, 1.0 }, 51.2 },
+
+    // gold color
+    { { 0.24725, 0.1995, 0.0745, 1.0 }, { 0.75164, 0.60648, 0.22658, 1.0 }, { 0.628281, 0.555802, 0.366065, 1.0 }, 51.2 },
+
+    // polished bronze
+    { { 0.25, 0.148, 0.06475, 1.0 }, { 0.4, 0.2368, 0.1036, 1.0 }, { 0.774597, 0.458561, 0.200621, 1.0 }, 76.8 },
+
+    // emerald color
+    { { 0.0215, 0.1745, 0.0215, 1.0 }, { 0.07568, 0.61424, 0.07568, 1.0 }, { 0.633, 0.727811, 0.633, 1.0 }, 76.8 },
+
+    // ruby color
+    { { 0.1745, 0.01175, 0.01175, 1.0 }, { 0.61424, 0.04136, 0.04136, 1.0 }, { 0.727811, 0.626959, 0.626959, 1.0 }, 76.8 },
+
+    // pearl color
+    { { 0.25, 0.20725, 0.20725, 1.0 }, { 1.0, 0.829, 0.829, 1.0 }, { 0.296648, 0.296648, 0.296648, 1.0 }, 11.264 }
+};
+
+// share of the color a material takes from what it mirrors, only the ray-traced mode shows it
+GLfloat materialReflectivity[MATERIAL_COUNT] = { 0.5f, 0.35f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+typedef GLfloat vertex3[3];
 
 // defining the vertices of the ground
 vertex3 back_left = { -8.0, -0.1, -8.0 };
@@ -107,13 +137,40 @@ vertex3 back_left_height = { -8.0, 10.0, -8.0 };
 vertex3 back_right_height = { 8.0, 10.0, -8.0 };
 
 // image
-GLubyte* image;
-GLubyte* l_texture;
-BITMAPFILEHEADER fileheader;
-BITMAPINFOHEADER infoheader;
-RGBTRIPLE rgb;
+const char* cookedTextureFile = "bg.ctex"; // used instead of bg.bmp when present, see --cook-texture
 GLuint texName;
 
+// files are loaded on these threads while the first frames draw with placeholders
+AssetStreamer assetStreamer(2);
+double uploadBudgetMs = 2.0; // upload time per frame for streamed assets
+double startupTime = 0; // when initialize() started
+double firstFrameTime = -1; // milliseconds after startupTime, -1 until it happens
+double loadedTime = -1; // when the first frame with every streamed asset in place was presented
+bool assetsStreamed = false; // every asset uploaded, waiting for a frame to show them
+
+// the window's animation loop: tick() steps the simulation and the camera at a fixed rate while
+// anything moves, and a frame is only drawn when a step changed something, see animation.h
+#define SIMULATION_HZ 60
+SceneAnimator animator;
+FixedTimestep simulationClock(1.0 / SIMULATION_HZ, 8);
+FreeCamera camera;
+CameraInput cameraInput = { 0, 0, 0, 0, 0 };
+bool animationRunning = true; // 'p' pauses the cars and rockets
+bool ticking = false; // a tick() is scheduled
+bool sceneBvhStale = false; // objects moved since sceneBvh was last built or refitted
+
+// what the loop did since the last CPU usage report
+struct LoopStats {
+    long ticks;
+    long framesDrawn;
+    long ticksSkipped; // nothing changed, so nothing was drawn
+    long steps;
+    double wallStart; // milliseconds
+    double cpuStart;
+};
+
+LoopStats loopStats;
+
 
 // defining the vertices of the cube
 vertex3 wall_pt[8] = {
@@ -143,108 +200,213 @@ vertex3 top_floor_pt[4] = {
     {1.2, 1.0, -0.2} // back right
 };
 
-GLuint houseList, carList, treeList, rocketList, benchList;
+// a composite object, compiled once per level of detail both as a display list and into the mesh cache
+struct Model {
+    void (*draw)();
+    int paint; // the main material, replaced by an object's paint material
+    GLuint lists[LOD_LEVELS];
+    Mesh meshes[LOD_LEVELS];
+};
+
+Model models[MODEL_COUNT];
+
+// names used for the models and materials in scene files, in the order of their #defines
+const char* const modelNames[MODEL_COUNT] = { "house", "car", "tree", "rocket", "bench" };
+const char* const materialNames[] = { "silver", "gold", "bronze", "emerald", "ruby", "pearl" };
+const SceneVocabulary vocabulary = { modelNames, MODEL_COUNT, materialNames, MATERIAL_COUNT };
+
+// the layout used when no scene file is found, the same one default.scene describes
+SceneInstance builtInInstances[] = {
+    // a house with 3 triangles as hat, 4 quads as walls, 1 quad as floors.
+    { HOUSE, { -5.0, 0.0, -5.0 }, 2.0, 0.0, -1 },
+    // a rocket with 1 cylinder as body, 1 cylinder as top cone, 3 triangles as fins.
+    { ROCKET, { -5.0, 0.0, 1.0 }, 1.0, 0.0, -1 },
+    // a car with 1 cube as body, 1 cube as roof, 4 spheres as wheels.
+    { CAR, { 3.0, 1.0, -2.5 }, 1.5, 0.0, -1 },
+    // a tree with 4 spheres as foliages and a cylinder as body.
+    { TREE, { 2.0, 0.0, 4.0 }, 1.0, 0.0, -1 },
+    // a bench with 1 cube as seat and 4 cylinders as legs.
+    { BENCH, { 2.5, 0.0, 5.5 }, 1.25, 0.0, -1 }
+};
+
+// the scene being drawn: placed objects, lights and fog
+Scene scene;
+
+// where the instrumentation trace is written, see instrument.h
+string tracePath = "scene-trace.json";
+bool traceRequested = false;
+
+// draw the objects from the mesh cache, or from the display lists when false
+bool useMeshCache = true;
+
+// weld and reorder the captured meshes for the vertex cache and overdraw, see meshopt.h
+bool useMeshOptimization = true;
+
+// upload the meshes as 12-byte packed vertices while the instanced renderer draws them, see vertexpack.h;
+// off by default, llvmpipe fetches the 16-bit attributes more slowly than the floats they replace
+bool usePackedVertices = false;
+
+// true while the mesh cache's vertex buffers hold packed vertices
+bool meshesPacked = false;
+
+// pick a level of detail per object, or always draw level 0 when false
+bool useLod = true;
+
+// skip objects outside the view frustum
+bool useCulling = true;
+
+// draw all copies of a model with one instanced call per material, needs the mesh cache and GLSL
+bool useInstancing = true;
+
+// the visible objects of the current frame, grouped by model and level for the instanced path
+InstanceList instanceLists[MODEL_COUNT][LOD_LEVELS];
+
+// the material drawObject() repaints and what it becomes, -1 when the object is not painted
+int paintFrom = -1;
+int paintTo = -1;
+
+// draw the mesh cache batches of all objects sorted by material instead of object by object
+bool useMaterialSort = true;
+
+// one material batch of a visible object, queued for the sorted mesh cache path
+struct DrawItem {
+    int material;
+    const Mesh* mesh;
+    size_t batch;
+    int node; // the object's node in transforms
+};
+
+// scratch memory of the current frame, reset at the end of renderFrame(); the lists below that
+// live in it are restarted with restartArenaVector() before each frame fills them
+LinearArena frameArena;
+
+ArenaVector<DrawItem> drawItems{ ArenaAllocator<DrawItem>(frameArena) };
+
+// the placed objects as a transform hierarchy: node 0 is the land, which every object stands on,
+// and object i is node i + 1
+TransformHierarchy transforms;
+
+// objects cast shadows on the land from every directional light
+bool useShadows = true;
+
+// reuse the shadow maps until a light or a caster moves, when false they are rendered every frame
+bool useShadowCache = true;
+
+ShadowMaps shadowMaps;
+
+// light and fog every fragment with GLSL instead of the fixed-function pipeline, see pixelshading.h
+bool usePixelShading = false;
+
+// with usePixelShading, fog that thins out with height instead of GL_EXP2, and the rate it thins at
+bool useHeightFog = false;
+GLfloat heightFogFalloff = 0.2f;
+
+// where the linked GLSL programs are kept as binaries between runs, empty to always compile them
+string programCacheDirectory = "shader-cache";
+
+// models that never move once placed, their lighting can be baked; in the order of their #defines
+const bool modelIsStatic[MODEL_COUNT] = { true, false, true, false, true };
+
+// draw the static objects with their baked lighting instead of lighting them every frame, needs the mesh cache
+bool useBakedLighting = false;
+
+// the baked vertex colours of one placed object per level of detail, empty when its model is not static
+struct BakedObject {
+    vector<uint32_t> colors[LOD_LEVELS];
+    GLuint buffers[LOD_LEVELS]; // 0 when the colours are drawn from client memory
+};
+
+vector<BakedObject> bakedObjects; // one per scene.instances entry once baked
+vector3 bakedViewer, bakedViewTarget; // the view the colours were baked for, the lights follow the camera
+ArenaVector<pair<size_t, int> > bakedDraws{ ArenaAllocator<pair<size_t, int> >(frameArena) }; // the visible baked objects of the current frame and their levels
+
+// the full-detail triangles of every placed object in world space, for picking and other hit tests
+Bvh sceneBvh;
+vector<int> sceneTriangleObjects; // the scene.instances index of each triangle
+
+// the window size, for turning mouse positions into rays
+int windowWidth = 500;
+int windowHeight = 500;
+
+void setMaterial(int color);
 
 // This function is responsible for drawing the background texture
 void drawBackgroundTexture() {
 
-    glEnable(GL_TEXTURE_2D); // enable texture mapping
+    setCapability(GL_TEXTURE_2D, true); // enable texture mapping
     // drawing the landscape texture.
-    glBindTexture(GL_TEXTURE_2D, texName);
+    bindTexture(texName);
 
     // left half of the background
     glBegin(GL_QUADS);
 
     glTexCoord2d(0.0, 0.0); // bottom left
-    glVertex3dv(front_left); // frontLeft of the ground
+    glVertex3fv(front_left); // frontLeft of the ground
 
     glTexCoord2d(0.5, 0.0); // bottom right
-    glVertex3dv(back_left); // backLeft of the ground
+    glVertex3fv(back_left); // backLeft of the ground
 
     glTexCoord2d(0.5, 1.0); // top right
-    glVertex3dv(back_left_height);
+    glVertex3fv(back_left_height);
 
     glTexCoord2d(0.0, 1.0); // top left
-    glVertex3dv(front_left_height);
+    glVertex3fv(front_left_height);
 
     glEnd();
+    countDraw(2);
 
 
     // right half of the background
     glBegin(GL_QUADS);
 
     glTexCoord2d(0.5, 0.0); // bottom left
-    glVertex3dv(back_left); // backLeft of the ground
+    glVertex3fv(back_left); // backLeft of the ground
 
     glTexCoord2d(1.0, 0.0); // bottom right
-    glVertex3dv(back_right); // backRight of the ground
+    glVertex3fv(back_right); // backRight of the ground
 
     glTexCoord2d(1.0, 1.0); // top right
-    glVertex3dv(back_right_height); // X, Z at backRight of the ground
+    glVertex3fv(back_right_height); // X, Z at backRight of the ground
 
     glTexCoord2d(0.5, 1.0); // top left
-    glVertex3dv(back_left_height); // X, Z at backLeft of the ground
+    glVertex3fv(back_left_height); // X, Z at backLeft of the ground
 
     glEnd();
+    countDraw(2);
 
-    glDisable(GL_TEXTURE_2D);
+    setCapability(GL_TEXTURE_2D, false);
 }
 
 
 // This function is responsible for drawing the main landscape
 void drawLand() {
     // draw the town land
-    
+
+    // the land used to pick up whichever material the previous frame ended with, which was
+    // the bench's bronze; it is set explicitly so the draw order of the objects does not matter
+    setMaterial(BRONZE);
+
     glBegin(GL_QUADS);
     glNormal3f(0, 1, 0);
-    glVertex3dv(back_left); // backLeft
-    glVertex3dv(front_left); // frontLeft
-    glVertex3dv(front_right); // frontRight
-    glVertex3dv(back_right); // backRight
+    glVertex3fv(back_left); // backLeft
+    glVertex3fv(front_left); // frontLeft
+    glVertex3fv(front_right); // frontRight
+    glVertex3fv(back_right); // backRight
     glEnd();
+    countDraw(2);
     
 }
 
 // Loads the texture from a bitmap file
+// The loader threads map the file and the texture is filled in by updateStreaming() a few frames later
 void makeImage(void) {
-
-    int i, j = 0;
-    FILE* l_file;
     string fn = "bg.bmp";
 
-    const char* filename = fn.c_str();
-    // open image file, return if error
-
-    fopen_s(&l_file, filename, "rb");
-
-    if (l_file == NULL) return;
-
-    // read file header and header info
-
-    fread(&fileheader, sizeof(fileheader), 1, l_file);
-    fseek(l_file, sizeof(fileheader), SEEK_SET);
-    fread(&infoheader, sizeof(infoheader), 1, l_file);
-
-    // allocate space for the image file
-
-    l_texture = (GLubyte*)malloc(infoheader.biWidth * infoheader.biHeight * 4);
-    memset(l_texture, 0, infoheader.biWidth * infoheader.biHeight * 4);
-
-    // read da data
-
-    j = 0;
-
-    for (i = 0; i < infoheader.biWidth * infoheader.biHeight; i++)
-    {
-        fread(&rgb, sizeof(rgb), 1, l_file);
-        l_texture[j + 0] = (GLubyte)rgb.rgbtRed; // Red component
-        l_texture[j + 1] = (GLubyte)rgb.rgbtGreen; // Green component
-        l_texture[j + 2] = (GLubyte)rgb.rgbtBlue; // Blue component
-        l_texture[j + 3] = (GLubyte)255; // Alpha value
-        j += 4; // Go to the next position
-    }
-
-    fclose(l_file); // Closes the file stream
+    // a cooked texture next to the BMP brings its own mip levels, and may be BC1 compressed
+    if (ifstream(cookedTextureFile).good())
+        assetStreamer.requestTexture(texName, cookedTextureFile, fn);
+    else
+        assetStreamer.requestTexture(texName, fn);
 }
 
 // Setting the light model, light position, and light color
@@ -252,19 +414,15 @@ void setLight() {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_LIGHTING);
 
-    glEnable(GL_LIGHT0);
-    glEnable(GL_LIGHT1);
-
-    glLightfv(GL_LIGHT0, GL_POSITION, light0_position);
-    glLightfv(GL_LIGHT0, GL_AMBIENT, white_light);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, white_light);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, white_light);
-
-    
-    glLightfv(GL_LIGHT1, GL_POSITION, light1_position);
-    glLightfv(GL_LIGHT1, GL_AMBIENT, sunlight_ambient);
-    glLightfv(GL_LIGHT1, GL_DIFFUSE, sunlight_diffuse);
-    glLightfv(GL_LIGHT1, GL_SPECULAR, sunlight_specular);
+    // the scene's lights in order, OpenGL has at least eight
+    for (size_t i = 0; i < scene.lights.size() && i < 8; i++) {
+        GLenum light = (GLenum)(GL_LIGHT0 + i);
+        glEnable(light);
+        glLightfv(light, GL_POSITION, scene.lights[i].position);
+        glLightfv(light, GL_AMBIENT, scene.lights[i].ambient);
+        glLightfv(light, GL_DIFFUSE, scene.lights[i].diffuse);
+        glLightfv(light, GL_SPECULAR, scene.lights[i].specular);
+    }
 
     // set light model 
     glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient);
@@ -284,104 +442,96 @@ void loadTexture() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, infoheader.biWidth, infoheader.biHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, l_texture);
+    // a flat sky colour until makeImage()'s file has been streamed in
+    const unsigned char placeholder[4] = { 170, 200, 230, 255 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+}
+
+// This function is responsible for uploading streamed assets within the frame's budget and noting when the last one arrived
+void updateStreaming() {
+    if (assetsStreamed)
+        return;
+    assetStreamer.uploadPending(uploadBudgetMs);
+    if (!assetStreamer.busy())
+        assetsStreamed = true;
+}
+
+// This function is responsible for the startup times, once a frame is on the screen;
+// the assets only count as loaded when a presented frame shows them
+void framePresented() {
+    double now = nowMilliseconds() - startupTime;
+    if (firstFrameTime < 0)
+        firstFrameTime = now;
+    if (assetsStreamed && loadedTime < 0)
+        loadedTime = now;
+}
+
+// This function is responsible for waiting until every streamed asset is in place, for runs that must not see placeholders
+void finishStreaming() {
+    assetStreamer.finish();
+    updateStreaming();
 }
 
 // This function is responsible for setting the fog over the house area on the scene
 void initializeFog() {
-    GLfloat fogColor[] = { 0.7, 0.7, 0.9, 1.0 }; // pale blue 
-    GLfloat fogDensity = 0.04;
+    if (!scene.fog.enabled) {
+        glDisable(GL_FOG);
+        return;
+    }
 
     glEnable(GL_FOG);
     glFogi(GL_FOG_MODE, GL_EXP2);
-    glFogfv(GL_FOG_COLOR, fogColor);
-    glFogf(GL_FOG_DENSITY, fogDensity);
+    glFogfv(GL_FOG_COLOR, scene.fog.color);
+    glFogf(GL_FOG_DENSITY, scene.fog.density);
     glHint(GL_FOG_HINT, GL_DONT_CARE);
-    glFogf(GL_FOG_START, 0.0);
-    glFogf(GL_FOG_END, 5.0);
 }
 
 // This function is responsible for setting the material of the object
 void setMaterial(int color) {
 
-    if (color == SILVER) {
-        glMaterialfv(GL_FRONT, GL_AMBIENT, silver_ambient);
-        glMaterialfv(GL_FRONT, GL_DIFFUSE, silver_diffuse);
-        glMaterialfv(GL_FRONT, GL_SPECULAR, silver_specular);
-        glMaterialfv(GL_FRONT, GL_SHININESS, silver_shininess);
-    }
-    else if (color == GOLD)
-    {
-        glMaterialfv(GL_FRONT, GL_AMBIENT, gold_ambient);
-        glMaterialfv(GL_FRONT, GL_DIFFUSE, gold_diffuse);
-        glMaterialfv(GL_FRONT, GL_SPECULAR, gold_specular);
-        glMaterialfv(GL_FRONT, GL_SHININESS, gold_shininess);
-    }
-    else if (color == BRONZE) {
-		glMaterialfv(GL_FRONT, GL_AMBIENT, bronze_ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, bronze_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, bronze_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, bronze_shininess);
-	}
-    else if (color == EMERALD) {
-		glMaterialfv(GL_FRONT, GL_AMBIENT, emerald_ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, emerald_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, emerald_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, emerald_shininess);
-	}
-    else if (color == RUBY) {
-		glMaterialfv(GL_FRONT, GL_AMBIENT, ruby_ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, ruby_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, ruby_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, ruby_shininess);
-	}
-    else if (color == PEARL) {
-		glMaterialfv(GL_FRONT, GL_AMBIENT, pearl_ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, pearl_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, pearl_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, pearl_shininess);
-    }
-    else {
-        glMaterialfv(GL_FRONT, GL_AMBIENT, white_light);
-        glMaterialfv(GL_FRONT, GL_DIFFUSE, white_light);
-        glMaterialfv(GL_FRONT, GL_SPECULAR, white_light);
-        glMaterialfv(GL_FRONT, GL_SHININESS, white_light);
+    // while an object is being captured into the mesh cache the material only tags its triangles
+    if (isCapturingMesh()) {
+        meshMaterial(color);
+        return;
     }
+
+    // the tracker skips the glMaterial calls when the material is already set
+    bindMaterial(color);
 }
 
 // This function is responsible for drawing the top cone of the house
 void top_hat() {
-    GLdouble hatTopPoint[3] = { 0.5, 1.5, 0.5 }; // the point where all the triangle's tops will meet
+    GLfloat hatTopPoint[3] = { 0.5, 1.5, 0.5 }; // the point where all the triangle's tops will meet
 
     setMaterial(GOLD);
 
-    glBegin(GL_TRIANGLES);
+    meshBegin(GL_TRIANGLES);
 
     // triangle 1
-    glNormal3f(-1, 0, 0);
-    glVertex3dv(top_floor_pt[0]);
-    glVertex3dv(top_floor_pt[1]);
-    glVertex3dv(hatTopPoint);
+    meshNormal3f(-1, 0, 0);
+    meshVertex3fv(top_floor_pt[0]);
+    meshVertex3fv(top_floor_pt[1]);
+    meshVertex3fv(hatTopPoint);
 
     // triangle 2
-    glNormal3f(0, 0, -1);
-    glVertex3dv(top_floor_pt[1]);
-    glVertex3dv(top_floor_pt[2]);
-    glVertex3dv(hatTopPoint);
+    meshNormal3f(0, 0, -1);
+    meshVertex3fv(top_floor_pt[1]);
+    meshVertex3fv(top_floor_pt[2]);
+    meshVertex3fv(hatTopPoint);
 
     // triangle 3
-    glNormal3f(1, 0, 0);
-    glVertex3dv(top_floor_pt[2]);
-    glVertex3dv(top_floor_pt[3]);
-    glVertex3dv(hatTopPoint);
+    meshNormal3f(1, 0, 0);
+    meshVertex3fv(top_floor_pt[2]);
+    meshVertex3fv(top_floor_pt[3]);
+    meshVertex3fv(hatTopPoint);
 
     // triangle 4
-    glNormal3f(0, 0, 1);
-    glVertex3dv(top_floor_pt[3]);
-    glVertex3dv(top_floor_pt[0]);
-    glVertex3dv(hatTopPoint);
+    meshNormal3f(0, 0, 1);
+    meshVertex3fv(top_floor_pt[3]);
+    meshVertex3fv(top_floor_pt[0]);
+    meshVertex3fv(hatTopPoint);
 
-    glEnd();
+    meshEnd();
 
 }
 
@@ -393,13 +543,13 @@ to draw a floor.
 */
 void floor() {
     setMaterial(EMERALD);
-    glBegin(GL_QUADS);
-    glNormal3f(0, 1, 0);
-    glVertex3dv(floor_pt[0]);
-    glVertex3dv(floor_pt[1]);
-    glVertex3dv(floor_pt[2]);
-    glVertex3dv(floor_pt[3]);
-    glEnd();
+    meshBegin(GL_QUADS);
+    meshNormal3f(0, 1, 0);
+    meshVertex3fv(floor_pt[0]);
+    meshVertex3fv(floor_pt[1]);
+    meshVertex3fv(floor_pt[2]);
+    meshVertex3fv(floor_pt[3]);
+    meshEnd();
 }
 
 /**
@@ -409,38 +559,38 @@ It is called by the allWalls() function to draw all the walls of the house.
 */
 void wall(GLint n1, GLint n2, GLint n3, GLint n4, int face) {
 
-    glBegin(GL_QUADS);
+    meshBegin(GL_QUADS);
 
     if (face == RIGHT) {
         // Right face
-        glNormal3f(1, 0, 0);
+        meshNormal3f(1, 0, 0);
     }
     else if (face == LEFT) {
         // Left face
-        glNormal3f(-1, 0, 0);
+        meshNormal3f(-1, 0, 0);
     }
     else if (face == TOP) {
         // Top face
-        glNormal3f(0, 1, 0);
+        meshNormal3f(0, 1, 0);
     }
     else if (face == BOTTOM) {
         // Bottom face
-        glNormal3f(0, -1, 0);
+        meshNormal3f(0, -1, 0);
     }
     else if (face == BACK) {
 		// Back face
-		glNormal3f(0, 0, 1);
+		meshNormal3f(0, 0, 1);
     }
     else {
 		// Front face
-		glNormal3f(0, 0, -1);
+		meshNormal3f(0, 0, -1);
 	}
 
-    glVertex3dv(wall_pt[n1]);
-    glVertex3dv(wall_pt[n2]);
-    glVertex3dv(wall_pt[n3]);
-    glVertex3dv(wall_pt[n4]);
-    glEnd();
+    meshVertex3fv(wall_pt[n1]);
+    meshVertex3fv(wall_pt[n2]);
+    meshVertex3fv(wall_pt[n3]);
+    meshVertex3fv(wall_pt[n4]);
+    meshEnd();
 
 }
 
@@ -477,105 +627,50 @@ void drawRocket() {
     GLfloat stacks = 20;
 
     // Draw the rocket body (cylinder)
-    GLUquadric* body = gluNewQuadric();
     setMaterial(RUBY); // Set the material color of the rocket body
-    glPushMatrix();
-    glTranslatef(0.0, rocketBodyStarts, 0.0);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(body, rocketRadius, rocketRadius, rocketBodyHeight, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(0.0, rocketBodyStarts, 0.0);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(rocketRadius, rocketRadius, rocketBodyHeight, slices, stacks);
+    meshPopMatrix();
 
     // Draw the rocket cone (tip)
-    GLUquadric* cone = gluNewQuadric();
     setMaterial(GOLD); // Set the material color of the rocket cone
-    glPushMatrix();
-    glTranslatef(0.0, rocketBodyStarts + rocketBodyHeight, 0.0);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(cone, rocketRadius, 0.0, tipHeight, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(0.0, rocketBodyStarts + rocketBodyHeight, 0.0);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(rocketRadius, 0.0, tipHeight, slices, stacks);
+    meshPopMatrix();
 
     // Draw the rocket fins (triangles)
     setMaterial(BRONZE); // Set the material color of the rocket fins
     
-    glBegin(GL_TRIANGLES);
+    meshBegin(GL_TRIANGLES);
         // Fin 1
-        glVertex3f(-0.5, rocketBodyStarts, 0.0);
-        glVertex3f(-1.5, 0.0, 0.0);
-        glVertex3f(-0.5, 0.0, 0.0);
+        meshVertex3f(-0.5, rocketBodyStarts, 0.0);
+        meshVertex3f(-1.5, 0.0, 0.0);
+        meshVertex3f(-0.5, 0.0, 0.0);
 
         // Fin 2
-        glVertex3f(0.5, rocketBodyStarts, 0.0);
-        glVertex3f(1.5, 0.0, 0.0);
-        glVertex3f(0.5, 0.0, 0.0);
+        meshVertex3f(0.5, rocketBodyStarts, 0.0);
+        meshVertex3f(1.5, 0.0, 0.0);
+        meshVertex3f(0.5, 0.0, 0.0);
 
         // Fin 3
-        glVertex3f(0.0, rocketBodyStarts, -0.5);
-        glVertex3f(0.0, 0.0, -1.5);
-        glVertex3f(0.0, 0.0, -0.5);
+        meshVertex3f(0.0, rocketBodyStarts, -0.5);
+        meshVertex3f(0.0, 0.0, -1.5);
+        meshVertex3f(0.0, 0.0, -0.5);
 
         // Fin 4
-        glVertex3f(0.0, rocketBodyStarts, 0.5);
-        glVertex3f(0.0, 0.0, 1.5);
-        glVertex3f(0.0, 0.0, 0.5);
-    glEnd();
-
-    gluDeleteQuadric(body);
-    gluDeleteQuadric(cone);
+        meshVertex3f(0.0, rocketBodyStarts, 0.5);
+        meshVertex3f(0.0, 0.0, 1.5);
+        meshVertex3f(0.0, 0.0, 0.5);
+    meshEnd();
 }
 
 // draw a cube
 void drawCube(GLfloat width, GLfloat height, GLfloat depth) {
-    GLfloat w = width / 2;
-    GLfloat h = height / 2;
-    GLfloat d = depth / 2;
-
-    glPushMatrix();
-    glBegin(GL_QUADS);
-
-    // Front face
-    glNormal3f(0, 0, -1);
-    glVertex3f(-w, -h, d);
-    glVertex3f(w, -h, d);
-    glVertex3f(w, h, d);
-    glVertex3f(-w, h, d);
-
-    // Back face
-    glNormal3f(0, 0, 1);
-    glVertex3f(-w, -h, -d);
-    glVertex3f(-w, h, -d);
-    glVertex3f(w, h, -d);
-    glVertex3f(w, -h, -d);
-
-    // Left face
-    glNormal3f(-1, 0, 0);
-    glVertex3f(-w, -h, -d);
-    glVertex3f(-w, -h, d);
-    glVertex3f(-w, h, d);
-    glVertex3f(-w, h, -d);
-
-    // Right face
-    glNormal3f(1, 0, 0);
-    glVertex3f(w, -h, -d);
-    glVertex3f(w, h, -d);
-    glVertex3f(w, h, d);
-    glVertex3f(w, -h, d);
-
-    // Top face
-    glNormal3f(0, 1, 0);
-    glVertex3f(-w, h, -d);
-    glVertex3f(-w, h, d);
-    glVertex3f(w, h, d);
-    glVertex3f(w, h, -d);
-
-    // Bottom face
-    glNormal3f(0, -1, 0);
-    glVertex3f(-w, -h, -d);
-    glVertex3f(w, -h, -d);
-    glVertex3f(w, -h, d);
-    glVertex3f(-w, -h, d);
-
-    glEnd();
-    glPopMatrix();
+    meshBox(width, height, depth);
 }
 
 // draw the car wheel
@@ -589,10 +684,10 @@ void drawWheel() {
     // Draw the wheel
     setMaterial(SILVER);
 
-    glPushMatrix();
-    glTranslatef(0.0, 0.0, wheelHeight / 2);
-    glutSolidSphere(wheelRadius, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(0.0, 0.0, wheelHeight / 2);
+    meshSphere(wheelRadius, slices, stacks);
+    meshPopMatrix();
 
 }
 
@@ -601,39 +696,41 @@ void drawCar() {
     
     // Car body
     setMaterial(RUBY);
-    glPushMatrix();
-    glTranslatef(0.0, 0.25, 0.0);
+    meshPushMatrix();
+    meshTranslatef(0.0, 0.25, 0.0);
     drawCube(1.75, 0.45, 1.0);
-    glPopMatrix();
+    meshPopMatrix();
 
     // Car roof
     setMaterial(PEARL);
-    glColor3f(0.0, 0.0, 0.5);
-    glPushMatrix();
-    glTranslatef(0.0, 0.6, 0.0);
+    // the captures run on worker threads without a GL context, and the mesh cache has no vertex colours
+    if (!isCapturingMesh())
+        glColor3f(0.0, 0.0, 0.5);
+    meshPushMatrix();
+    meshTranslatef(0.0, 0.6, 0.0);
     drawCube(1.0, 0.3, 0.8);
-    glPopMatrix();
+    meshPopMatrix();
 
     // Wheels
-    glPushMatrix();
-    glTranslatef(-0.5, 0.1, -0.5);
+    meshPushMatrix();
+    meshTranslatef(-0.5, 0.1, -0.5);
     drawWheel();
-    glPopMatrix();
+    meshPopMatrix();
 
-    glPushMatrix();
-    glTranslatef(-0.5, 0.1, 0.5);
+    meshPushMatrix();
+    meshTranslatef(-0.5, 0.1, 0.5);
     drawWheel();
-    glPopMatrix();
+    meshPopMatrix();
 
-    glPushMatrix();
-    glTranslatef(0.5, 0.1, -0.5);
+    meshPushMatrix();
+    meshTranslatef(0.5, 0.1, -0.5);
     drawWheel();
-    glPopMatrix();
+    meshPopMatrix();
 
-    glPushMatrix();
-    glTranslatef(0.5, 0.1, 0.5);
+    meshPushMatrix();
+    meshTranslatef(0.5, 0.1, 0.5);
     drawWheel();
-    glPopMatrix();
+    meshPopMatrix();
 }
 
 // draw the tree
@@ -644,42 +741,39 @@ void drawTree() {
     GLint stacks = 20;
     // tree body (cylinder)
     setMaterial(BRONZE);
-    GLUquadricObj* body = gluNewQuadric();
-    glPushMatrix();
-    glTranslatef(0.0, 0.0, 0.0);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(body, 0.2, 0.2, bodyHeight, slices, stacks);
-    glPopMatrix();
-
-    gluDeleteQuadric(body);
+    meshPushMatrix();
+    meshTranslatef(0.0, 0.0, 0.0);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(0.2, 0.2, bodyHeight, slices, stacks);
+    meshPopMatrix();
 
     // tree foliages (spheres)
     
     setMaterial(EMERALD);
 
     // Center foliage (spheres)
-    glPushMatrix();
-    glTranslatef(0.0, bodyHeight, 0.0);
-    glutSolidSphere(0.7, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(0.0, bodyHeight, 0.0);
+    meshSphere(0.7, slices, stacks);
+    meshPopMatrix();
 
     // Second foliage (spheres)
-    glPushMatrix();
-    glTranslatef(0.0, bodyHeight + 0.5, 0.0);
-    glutSolidSphere(0.5, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(0.0, bodyHeight + 0.5, 0.0);
+    meshSphere(0.5, slices, stacks);
+    meshPopMatrix();
 
     // Third foliage (sphere)
-    glPushMatrix();
-    glTranslatef(0.5, bodyHeight + 0.2, 0.0);
-    glutSolidSphere(0.5, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(0.5, bodyHeight + 0.2, 0.0);
+    meshSphere(0.5, slices, stacks);
+    meshPopMatrix();
 
     // Fourth foliage (sphere)
-    glPushMatrix();
-    glTranslatef(-0.5, bodyHeight + 0.2, 0.0);
-    glutSolidSphere(0.5, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(-0.5, bodyHeight + 0.2, 0.0);
+    meshSphere(0.5, slices, stacks);
+    meshPopMatrix();
 }
 
 
@@ -692,159 +786,2172 @@ void drawBench() {
     setMaterial(BRONZE);
 
     // Seat (cube)
-    glPushMatrix();
-    glTranslatef(0.0, 0.85, 0.0);
+    meshPushMatrix();
+    meshTranslatef(0.0, 0.85, 0.0);
     drawCube(2.0, 0.2, 0.5);
-    glPopMatrix();
+    meshPopMatrix();
 
     // Legs (cylinders)
-    GLUquadricObj* leg = gluNewQuadric();
-
-    glPushMatrix();
-    glTranslatef(-1.0, 0.1, 0.2);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(leg, legRadius, legRadius, legHeight, slices, stacks);
-    glPopMatrix();
+    meshPushMatrix();
+    meshTranslatef(-1.0, 0.1, 0.2);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(legRadius, legRadius, legHeight, slices, stacks);
+    meshPopMatrix();
+
+    meshPushMatrix();
+    meshTranslatef(1.0, 0.1, 0.2);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(legRadius, legRadius, legHeight, slices, stacks);
+    meshPopMatrix();
+
+    meshPushMatrix();
+    meshTranslatef(-1.0, 0.1, -0.2);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(legRadius, legRadius, legHeight, slices, stacks);
+    meshPopMatrix();
+
+    meshPushMatrix();
+    meshTranslatef(1.0, 0.1, -0.2);
+    meshRotatef(-90, 1.0, 0.0, 0.0);
+    meshCylinder(legRadius, legRadius, legHeight, slices, stacks);
+    meshPopMatrix();
 
-    glPushMatrix();
-    glTranslatef(1.0, 0.1, 0.2);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(leg, legRadius, legRadius, legHeight, slices, stacks);
-    glPopMatrix();
+}
 
-    glPushMatrix();
-    glTranslatef(-1.0, 0.1, -0.2);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(leg, legRadius, legRadius, legHeight, slices, stacks);
-    glPopMatrix();
+// this function is responsible for setting up the draw function and main material of every model
+void initModels() {
 
-    glPushMatrix();
-    glTranslatef(1.0, 0.1, -0.2);
-    glRotatef(-90, 1.0, 0.0, 0.0);
-    gluCylinder(leg, legRadius, legRadius, legHeight, slices, stacks);
-    glPopMatrix();
+    models[HOUSE].draw = drawHouse;
+    models[CAR].draw = drawCar;
+    models[TREE].draw = drawTree;
+    models[ROCKET].draw = drawRocket;
+    models[BENCH].draw = drawBench;
 
+    models[HOUSE].paint = RUBY;
+    models[CAR].paint = RUBY;
+    models[TREE].paint = EMERALD;
+    models[ROCKET].paint = RUBY;
+    models[BENCH].paint = BRONZE;
 }
 
-// this function is responsible for initializing the display lists
+// this function is responsible for initializing the display lists, one per object and level of detail
 void initDisplayLists() {
-    
-    houseList = glGenLists(1);
-    glNewList(houseList, GL_COMPILE);
-    drawHouse();
-    glEndList();
+    for (int i = 0; i < MODEL_COUNT; i++) {
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            setMeshDetail(lodPixelsPerUnit(level));
+            models[i].lists[level] = glGenLists(1);
+
+            // tracked from a clean state so repeated materials are left out of the list, then
+            // forgotten again because compiling does not change the live state
+            invalidateRenderState();
+            glNewList(models[i].lists[level], GL_COMPILE);
+            models[i].draw();
+            glEndList();
+            invalidateRenderState();
+        }
+    }
+    setMeshDetail(0.0f);
+}
+
+// This function is responsible for capturing and optimizing every model at every level of detail, one mesh per task;
+// the capture state is per thread, so the meshes are built side by side
+void captureModels(ThreadPool& pool) {
+    pool.parallelFor(MODEL_COUNT * LOD_LEVELS, [](int index, int worker) {
+        int model = index / LOD_LEVELS, level = index % LOD_LEVELS;
+        Mesh& mesh = models[model].meshes[level];
+
+        setMeshDetail(lodPixelsPerUnit(level));
+        beginMeshCapture(&mesh);
+        models[model].draw();
+        endMeshCapture();
+        setMeshDetail(0.0f);
+        if (useMeshOptimization)
+            optimizeMesh(mesh);
+    });
+}
+
+bool instancingActive();
+
+// This function is responsible for uploading the vertex buffers of every model again, packed or as floats
+void uploadModelMeshes(bool packed) {
+    for (int i = 0; i < MODEL_COUNT; i++) {
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            deleteMesh(models[i].meshes[level]);
+            uploadMesh(models[i].meshes[level], packed);
+        }
+    }
+    meshesPacked = packed;
+}
+
+// this function is responsible for building the mesh cache from the same draw functions as the display lists,
+// on all threads, then uploading it from this one
+void initMeshCache() {
+    ThreadPool pool(hardwareThreads());
+    captureModels(pool);
+
+    uploadModelMeshes(usePackedVertices && instancingActive());
+}
+
+// setMaterial() for the mesh cache batches, swapping in the object's paint
+void setPaintedMaterial(int color) {
+    setMaterial(color == paintFrom && paintTo >= 0 ? paintTo : color);
+}
+
+// true when the frame is drawn through the instanced renderer
+bool instancingActive() {
+    return useInstancing && useMeshCache && instancingAvailable();
+}
+
+// true when the surfaces are lit and fogged per pixel
+bool pixelShadingActive() {
+    return usePixelShading && pixelShadingAvailable();
+}
+
+// draws one composite object through whichever path is selected, display lists keep their own materials
+void drawObject(const Model& model, int level, int paint) {
+    const Mesh& mesh = model.meshes[level];
+
+    if (useMeshCache) {
+        paintFrom = model.paint;
+        paintTo = paint;
+        drawMesh(mesh, setPaintedMaterial);
+    }
+    else {
+        glCallList(model.lists[level]);
+        countDraw((long)mesh.indices.size() / 3);
+        invalidateRenderState(); // the list set its own materials
+    }
+}
+
+// world space bounds of a placed model, the box is widened so it stays axis aligned under the rotation
+void instanceBounds(const SceneInstance& object, const Mesh& mesh, GLfloat center[3], GLfloat& radius, GLfloat low[3], GLfloat high[3]) {
+    GLfloat angle = object.rotation * 3.14159265f / 180.0f;
+    GLfloat c = cosf(angle), s = sinf(angle);
+    GLfloat half[3];
+
+    for (int k = 0; k < 3; k++)
+        half[k] = (mesh.boundsMax[k] - mesh.boundsMin[k]) * 0.5f * object.scale;
+
+    // same rotation as glRotatef(rotation, 0, 1, 0)
+    GLfloat x = mesh.center[0] * object.scale, z = mesh.center[2] * object.scale;
+    center[0] = object.position[0] + c * x + s * z;
+    center[1] = object.position[1] + mesh.center[1] * object.scale;
+    center[2] = object.position[2] - s * x + c * z;
+
+    GLfloat extent[3] = { fabsf(c) * half[0] + fabsf(s) * half[2], half[1], fabsf(s) * half[0] + fabsf(c) * half[2] };
+    for (int k = 0; k < 3; k++) {
+        low[k] = center[k] - extent[k];
+        high[k] = center[k] + extent[k];
+    }
+    radius = mesh.radius * object.scale;
+}
+
+// the modelview matrix of an object, what glTranslatef, glRotatef and glScaled build on top of the view
+void objectMatrix(const GLfloat view[16], const SceneInstance& object, GLfloat matrix[16]) {
+    GLfloat angle = object.rotation * 3.14159265f / 180.0f;
+    GLfloat c = cosf(angle) * object.scale, s = sinf(angle) * object.scale;
+    const GLfloat local[16] = {
+        c, 0.0f, -s, 0.0f,
+        0.0f, object.scale, 0.0f, 0.0f,
+        s, 0.0f, c, 0.0f,
+        object.position[0], object.position[1], object.position[2], 1.0f
+    };
+
+    // both are column major
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            GLfloat sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += view[k * 4 + row] * local[column * 4 + k];
+            matrix[column * 4 + row] = sum;
+        }
+    }
+}
+
+int objectNode(size_t object) {
+    return (int)object + 1;
+}
+
+// This function is responsible for bringing the hierarchy in line with the scene and recomputing what moved
+void updateTransforms(const GLfloat view[16]) {
+    if (transforms.size() != (int)scene.instances.size() + 1) {
+        transforms.clear();
+        transforms.addNode(-1);
+        for (size_t i = 0; i < scene.instances.size(); i++)
+            transforms.addNode(0);
+    }
+
+    // only a node whose values differ is marked, a still object costs this comparison
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& object = scene.instances[i];
+        transforms.setLocal(objectNode(i), object.position, object.rotation, object.scale);
+    }
+    frameStats.transformsUpdated += transforms.update();
+    transforms.concatenate(view);
+}
 
-    carList = glGenLists(1);
-    glNewList(carList, GL_COMPILE);
-    drawCar();
-    glEndList();
+// queues every batch of an object's mesh for drawSortedObjects(), with its paint applied
+void queueObject(int node, const SceneInstance& object, const Model& model, int level) {
+    const Mesh& mesh = model.meshes[level];
 
-    treeList = glGenLists(1);
-    glNewList(treeList, GL_COMPILE);
-    drawTree();
-    glEndList();
+    for (size_t i = 0; i < mesh.batches.size(); i++) {
+        int material = mesh.batches[i].material;
+        if (material == model.paint && object.material >= 0)
+            material = object.material;
+        DrawItem item = { material, &mesh, i, node };
+        drawItems.push_back(item);
+    }
+}
 
-    rocketList = glGenLists(1);
-    glNewList(rocketList, GL_COMPILE);
-    drawRocket();
-    glEndList();
+bool drawItemOrder(const DrawItem& a, const DrawItem& b) {
+    if (a.material != b.material)
+        return a.material < b.material;
+    if (a.mesh != b.mesh)
+        return a.mesh < b.mesh;
+    return a.node < b.node;
+}
 
-    benchList = glGenLists(1);
-    glNewList(benchList, GL_COMPILE);
-    drawBench();
-    glEndList();
+// This function is responsible for drawing the queued batches sorted by material, then mesh,
+// so each material is set once per frame and consecutive batches often share their vertex arrays
+void drawSortedObjects(const GLfloat view[16]) {
+    sort(drawItems.begin(), drawItems.end(), drawItemOrder);
+
+    const Mesh* boundMesh = NULL;
+    int loadedNode = -1;
+
+    for (size_t i = 0; i < drawItems.size(); i++) {
+        const DrawItem& item = drawItems[i];
+        if (item.mesh != boundMesh) {
+            bindMesh(*item.mesh);
+            boundMesh = item.mesh;
+        }
+        if (item.node != loadedNode) {
+            glLoadMatrixf(transforms.modelview(item.node));
+            loadedNode = item.node;
+        }
+        bindMaterial(item.material);
+        drawMeshBatch(*item.mesh, item.batch);
+    }
+
+    if (boundMesh)
+        unbindMesh();
+    glLoadMatrixf(view);
+}
+
+// tests the object's bounding sphere, then its box, against the frustum
+bool objectVisible(const Frustum& frustum, const GLfloat center[3], GLfloat radius, const GLfloat low[3], const GLfloat high[3]) {
+    bool contained = false;
+
+    if (!sphereInFrustum(frustum, center, radius, &contained))
+        return false;
+    return contained || boxInFrustum(frustum, low, high);
+}
+
+// This function is responsible for listing each directional light's shadow casters and re-rendering the maps that changed
+void updateShadowMaps() {
+    // the lights were positioned with an identity modelview, so they follow the camera; their world
+    // direction is the eye direction turned back by the view's rotation
+    GLfloat view[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    const GLfloat receiverLow[3] = { back_left[0], 0.0f, back_left[2] };
+    const GLfloat receiverHigh[3] = { front_right[0], 0.0f, front_right[2] };
+
+    if (!useShadowCache)
+        shadowMaps.invalidate();
+
+    for (int i = 0; i < shadowMaps.lights(); i++) {
+        const GLfloat* eye = scene.lights[i].position;
+        if (eye[3] != 0.0f)
+            continue; // only directional lights have shadow maps
+
+        GLfloat direction[3];
+        for (int k = 0; k < 3; k++)
+            direction[k] = view[k * 4 + 0] * eye[0] + view[k * 4 + 1] * eye[1] + view[k * 4 + 2] * eye[2];
+
+        // the objects drawn into this light's map
+        shadowMaps.beginCasters(i, direction, receiverLow, receiverHigh);
+        ArenaVector<int> casters{ ArenaAllocator<int>(frameArena) };
+        casters.reserve(scene.instances.size());
+        for (size_t o = 0; o < scene.instances.size(); o++) {
+            const SceneInstance& object = scene.instances[o];
+            GLfloat center[3], radius, low[3], high[3];
+            instanceBounds(object, models[object.model].meshes[0], center, radius, low, high);
+            if (shadowMaps.addCaster(i, center, radius, &object, sizeof(object)))
+                casters.push_back((int)o);
+        }
+        frameStats.shadowCasters += (long)casters.size();
+
+        if (!shadowMaps.endCasters(i))
+            continue;
+
+        // a rare pass, so it is waited for to measure it
+        double start = nowMilliseconds();
+        shadowMaps.beginRender(i);
+        for (size_t c = 0; c < casters.size(); c++) {
+            const SceneInstance& object = scene.instances[casters[c]];
+            glPushMatrix();
+            glMultMatrixf(transforms.world(objectNode(casters[c])));
+            drawMeshDepth(models[object.model].meshes[0]);
+            glPopMatrix();
+        }
+        shadowMaps.endRender(i);
+        glFinish();
+        frameStats.shadowMapsRendered++;
+        frameStats.shadowMs += nowMilliseconds() - start;
+    }
+}
 
+// true when the baked colours belong to the current scene and view
+bool bakeCurrent() {
+    bool sameView = viewer.x == bakedViewer.x && viewer.y == bakedViewer.y && viewer.z == bakedViewer.z
+        && viewTarget.x == bakedViewTarget.x && viewTarget.y == bakedViewTarget.y && viewTarget.z == bakedViewTarget.z;
+    return !bakedObjects.empty() && bakedObjects.size() == scene.instances.size() && sameView;
+}
+
+// true when the static objects are drawn with the colours baked for the current scene; while the
+// camera flies away from the baked view they are lit like the others until they are baked again
+bool bakedActive() {
+    return useBakedLighting && useMeshCache && bakeCurrent();
+}
+
+// This function is responsible for drawing the queued static objects unlit, in their baked colours
+void drawBakedObjects(const GLfloat view[16]) {
+    setCapability(GL_LIGHTING, false);
+    for (size_t i = 0; i < bakedDraws.size(); i++) {
+        const SceneInstance& object = scene.instances[bakedDraws[i].first];
+        const BakedObject& baked = bakedObjects[bakedDraws[i].first];
+        int level = bakedDraws[i].second;
+
+        glLoadMatrixf(transforms.modelview(objectNode(bakedDraws[i].first)));
+        drawMeshBaked(models[object.model].meshes[level], baked.buffers[level], (const GLubyte*)baked.colors[level].data());
+    }
+    glLoadMatrixf(view);
+    setCapability(GL_LIGHTING, true);
 }
 
 // renders the scene
 void render() {
 
+    // the camera is in the modelview matrix; the objects' matrices are only rebuilt where something moved
+    GLfloat view[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    updateTransforms(view);
+
+    // only the instancing shader unpacks packed vertices, every other path gets the floats back
+    bool packed = usePackedVertices && instancingActive();
+    if (packed != meshesPacked && hasBufferObjects)
+        uploadModelMeshes(packed);
+
+    bool perPixel = pixelShadingActive();
+    if (perPixel)
+        setPixelView(view);
+
+    // bring the shadow maps up to date before anything is drawn with them
+    bool shadows = useShadows && shadowMaps.ready();
+    if (shadows) {
+        INSTRUMENT_SCOPE("shadow maps");
+        updateShadowMaps();
+    }
+
     // draw the background texture
-    drawBackgroundTexture();
+    {
+        INSTRUMENT_SCOPE("background");
+        if (perPixel)
+            bindPixelShading(PIXEL_TEXTURED);
+        drawBackgroundTexture();
+    }
 
     // draw the land
-    drawLand();
+    {
+        INSTRUMENT_SCOPE("land");
+        if (perPixel)
+            bindPixelShading(PIXEL_LIT);
+        drawLand();
+    }
 
-    // a house with 3 triangles as hat, 4 quads as walls, 1 quad as floors.
-    glPushMatrix();
-    glTranslatef(-5.0, 0.0, -5.0);
-    glScaled(2.0, 2.0, 2.0);
-    glCallList(houseList);
-    glPopMatrix();
+    // take each light back out of the land where the objects hide it; the receiver passes are
+    // fixed-function, the land's directional lighting is the same at every pixel either way
+    if (shadows) {
+        INSTRUMENT_SCOPE("land shadows");
+        if (perPixel)
+            unbindPixelShading();
+        for (int i = 0; i < shadowMaps.lights(); i++) {
+            if (scene.lights[i].position[3] != 0.0f)
+                continue;
+            shadowMaps.beginReceivers(i);
+            drawLand();
+            shadowMaps.endReceivers(i);
+        }
+        if (perPixel)
+            bindPixelShading(PIXEL_LIT);
+    }
 
-    // a rocket with 1 cylinder as body, 1 cylinder as top cone, 3 triangles as fins.
-    glPushMatrix();
-    glTranslatef(-5.0, 0.0, 1.0);
-    glCallList(rocketList);
-    glPopMatrix();
+    INSTRUMENT_SCOPE("objects");
 
-    // a car with 1 cube as body, 1 cube as roof, 4 spheres as wheels.
-    glPushMatrix();
-    glTranslatef(3.0, 1.0, -2.5);
-    glScaled(1.5, 1.5, 1.5);
-    glCallList(carList);
-    glPopMatrix();
+    // the frustum from reshape() and gluLookAt, in world space
+    Frustum frustum;
+    if (useCulling)
+        extractFrustumFromGL(frustum);
 
-    // a tree with 4 spheres as foliages and a cylinder as body.
-    glPushMatrix();
-    glTranslatef(2.0, 0.0, 4.0);
-    glCallList(treeList);
-    glPopMatrix();
-    
-    // a bench with 1 cube as seat and 4 cylinders as legs.
-    glPushMatrix();
-    glTranslatef(2.5, 0.0, 5.5);
-    glScaled(1.25, 1.25, 1.25);
-    glCallList(benchList);
-    glPopMatrix();
+    bool instanced = instancingActive();
+    bool sorted = !instanced && useMeshCache && useMaterialSort;
+    bool baked = bakedActive();
+    restartArenaVector(bakedDraws);
+    if (baked)
+        bakedDraws.reserve(scene.instances.size());
+    bool objectMatrixLoaded = false;
+
+    if (sorted)
+        restartArenaVector(drawItems);
+
+    if (instanced) {
+        for (int m = 0; m < MODEL_COUNT; m++)
+            for (int level = 0; level < LOD_LEVELS; level++)
+                instanceLists[m][level].instances.clear();
+    }
+
+    // draw the composite objects, or collect them into the instance lists
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& object = scene.instances[i];
+        const Model& model = models[object.model];
+        GLfloat center[3], radius, low[3], high[3];
+
+        instanceBounds(object, model.meshes[0], center, radius, low, high);
+
+        if (useCulling && !objectVisible(frustum, center, radius, low, high)) {
+            frameStats.objectsCulled++;
+            continue;
+        }
+        frameStats.objectsDrawn++;
+
+        int level = useLod ? selectLod(center, radius, object.scale) : 0;
+
+        if (baked && modelIsStatic[object.model]) {
+            bakedDraws.push_back(make_pair(i, level));
+            continue;
+        }
+
+        if (instanced) {
+            InstanceList& list = instanceLists[object.model][level];
+            list.instances.resize(list.instances.size() + 1);
+            makeInstance(object.position, object.scale, object.rotation, object.material, list.instances.back());
+            continue;
+        }
+
+        if (sorted) {
+            queueObject(objectNode(i), object, model, level);
+            continue;
+        }
+
+        INSTRUMENT_SCOPE(modelNames[object.model]);
+        glLoadMatrixf(transforms.modelview(objectNode(i)));
+        objectMatrixLoaded = true;
+        drawObject(model, level, object.material);
+    }
+    if (objectMatrixLoaded)
+        glLoadMatrixf(view);
+
+    if (sorted) {
+        INSTRUMENT_SCOPE("sorted batches");
+        drawSortedObjects(view);
+    }
+
+    if (instanced) {
+        beginInstancedDraw(perPixel);
+        for (int m = 0; m < MODEL_COUNT; m++) {
+            INSTRUMENT_SCOPE(modelNames[m]);
+            for (int level = 0; level < LOD_LEVELS; level++)
+                drawInstances(models[m].meshes[level], instanceLists[m][level], models[m].paint);
+        }
+        endInstancedDraw();
+    }
+
+    if (!bakedDraws.empty()) {
+        INSTRUMENT_SCOPE("baked objects");
+        if (perPixel)
+            bindPixelShading(PIXEL_UNLIT);
+        drawBakedObjects(view);
+    }
+
+    if (perPixel)
+        unbindPixelShading();
 }
 
 
+// fills the scene with the layout, lights and fog this program has always had
+void loadBuiltInScene() {
+    SceneLight light0, light1;
+    memcpy(light0.position, light0_position, sizeof(light0.position));
+    memcpy(light0.ambient, white_light, sizeof(light0.ambient));
+    memcpy(light0.diffuse, white_light, sizeof(light0.diffuse));
+    memcpy(light0.specular, white_light, sizeof(light0.specular));
+    memcpy(light1.position, light1_position, sizeof(light1.position));
+    memcpy(light1.ambient, sunlight_ambient, sizeof(light1.ambient));
+    memcpy(light1.diffuse, sunlight_diffuse, sizeof(light1.diffuse));
+    memcpy(light1.specular, sunlight_specular, sizeof(light1.specular));
+
+    // pale blue fog
+    SceneFog fog = { 1, 0.04f, { 0.7f, 0.7f, 0.9f, 1.0f } };
+
+    scene.viewer[0] = viewer.x;
+    scene.viewer[1] = viewer.y;
+    scene.viewer[2] = viewer.z;
+    scene.fog = fog;
+    scene.lights.assign(1, light0);
+    scene.lights.push_back(light1);
+    scene.materials.clear();
+    scene.instances.assign(builtInInstances, builtInInstances + sizeof(builtInInstances) / sizeof(builtInInstances[0]));
+}
+
+// copies the scene's viewer and material overrides into the globals the drawing code reads
+void applyScene() {
+    viewer = vector3(scene.viewer[0], scene.viewer[1], scene.viewer[2]);
+
+    for (size_t i = 0; i < scene.materials.size(); i++) {
+        const SceneMaterial& material = scene.materials[i];
+        Material& entry = materials[material.material];
+        memcpy(entry.ambient, material.ambient, sizeof(entry.ambient));
+        memcpy(entry.diffuse, material.diffuse, sizeof(entry.diffuse));
+        memcpy(entry.specular, material.specular, sizeof(entry.specular));
+        entry.shininess = material.shininess;
+    }
+}
+
+// This function is responsible for putting the placed objects' triangles into sceneBvh; with refit the
+// triangles already there are moved to the objects' current placement and the boxes refitted instead
+void updateSceneBvh(bool refit) {
+    const GLfloat identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    vector<GLfloat> positions;
+    int triangle = 0;
+
+    if (!refit) {
+        sceneBvh.clear();
+        sceneTriangleObjects.clear();
+    }
+
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const Mesh& mesh = models[scene.instances[i].model].meshes[0];
+        GLfloat matrix[16];
+        objectMatrix(identity, scene.instances[i], matrix);
+
+        positions.resize(mesh.vertices.size() * 3);
+        for (size_t v = 0; v < mesh.vertices.size(); v++) {
+            const GLfloat* p = mesh.vertices[v].position;
+            for (int k = 0; k < 3; k++)
+                positions[v * 3 + k] = matrix[k] * p[0] + matrix[4 + k] * p[1] + matrix[8 + k] * p[2] + matrix[12 + k];
+        }
+
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            const GLfloat* a = &positions[mesh.indices[t] * 3];
+            const GLfloat* b = &positions[mesh.indices[t + 1] * 3];
+            const GLfloat* c = &positions[mesh.indices[t + 2] * 3];
+            if (refit)
+                sceneBvh.updateTriangle(triangle++, a, b, c);
+            else {
+                sceneBvh.addTriangle(a, b, c);
+                sceneTriangleObjects.push_back((int)i);
+            }
+        }
+    }
+
+    if (refit)
+        sceneBvh.refit();
+    else
+        sceneBvh.build();
+}
+
+// the world space ray through a point of the viewport, for the camera renderFrame() sets up
+void viewportRay(GLfloat x, GLfloat y, int width, int height, GLfloat origin[3], GLfloat direction[3]) {
+    vector3 eye = viewer;
+    vector3 forward = viewTarget.subtract(eye).normalize();
+    vector3 side = forward.cross(vector3(0.0, 1.0, 0.0)).normalize();
+    vector3 upward = side.cross(forward);
+
+    // glFrustum(-1, 1, -1, 1, 1.5, ...) puts the viewport edges at +-1 on the near plane
+    GLfloat ndcX = x / width * 2.0f - 1.0f;
+    GLfloat ndcY = y / height * 2.0f - 1.0f;
+    vector3 ray = side.scalar(ndcX).add(upward.scalar(ndcY)).add(forward.scalar(1.5f)).normalize();
+
+    origin[0] = eye.x;
+    origin[1] = eye.y;
+    origin[2] = eye.z;
+    direction[0] = ray.x;
+    direction[1] = ray.y;
+    direction[2] = ray.z;
+}
+
+// the scene.instances index of the object under a window position, -1 for none
+int pickObject(int x, int y) {
+    GLfloat origin[3], direction[3];
+    BvhHit hit;
+
+    // window rows count from the top, the viewport's from the bottom
+    viewportRay(x + 0.5f, windowHeight - y - 0.5f, windowWidth, windowHeight, origin, direction);
+    if (!sceneBvh.raycast(origin, direction, 1e30f, hit))
+        return -1;
+    return sceneTriangleObjects[hit.triangle];
+}
+
+void bakeLighting();
+BakeStats bakeStaticLighting(int threads);
+
 // initializing the program with setting the background color and enabling the depth test and lighting, Also setting the light model, light position, and light color
 void initialize() {
+    startupTime = nowMilliseconds();
+
     // set background color
     glClearColor(0.0, 0.0, 0.0, 1.0);
 
     // set the lights
     setLight();
 
-    // get the image
-    makeImage();
+    // look up the buffer object entry points, and whether compressed textures can be uploaded
+    loadGLExtensions();
+
+    // every GLSL program built from here on is loaded from, or saved to, the binary cache
+    setProgramCache(programCacheDirectory);
+
+    // a depth map per light for the shadows
+    if (!shadowMaps.init((int)scene.lights.size(), 1024) && useShadows)
+        cout << "shadow maps are not supported, drawing without shadows" << endl;
 
     // set the texture
     loadTexture();
 
-    // initialize the display lists
+    // get the image
+    makeImage();
+
+    // the materials setMaterial() selects from
+    setMaterialTable(materials, MATERIAL_COUNT);
+
+    // the instanced renderer reads the same material table as setMaterial()
+    setInstanceMaterials(materials, MATERIAL_COUNT);
+    if (!initInstancing() && useInstancing)
+        cout << "instancing is not supported, drawing one object at a time" << endl;
+
+    // initialize the models and their display lists
+    initModels();
     initDisplayLists();
 
+    // build the mesh cache from the same objects, packed when the instanced renderer draws it
+    initMeshCache();
+
+    // the hit-test hierarchy over the placed objects
+    updateSceneBvh(false);
+
+    // the static objects' lighting, when they are drawn baked
+    if (useBakedLighting)
+        bakeLighting();
+
     // set the fog
     initializeFog();
+
+    // the per-pixel programs read the lights and fog set above
+    setHeightFog(useHeightFog, heightFogFalloff);
+    if (usePixelShading && !initPixelShading())
+        cout << "GLSL is not supported, lighting and fog stay per vertex" << endl;
+}
+
+// clears the color and depth buffers, sets camera position and orientation and calls the render function
+void renderFrame() {
+    INSTRUMENT_FRAME_BEGIN();
+    {
+        INSTRUMENT_SCOPE("frame");
+        updateStreaming();
+        resetFrameStats();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glLoadIdentity(); // reset the modelview matrix
+        gluLookAt(viewer.x, viewer.y, viewer.z, viewTarget.x, viewTarget.y, viewTarget.z, 0.0, 1.0, 0.0); // set the camera position and orientation
+        render(); // render the scene
+    }
+
+    // everything the frame put in its arena goes at once
+    ArenaStats arena = frameArena.stats();
+    frameStats.arenaAllocations = arena.allocations;
+    frameStats.arenaBytes = (long)arena.bytes;
+    INSTRUMENT_ARENA(arena.allocations, (long)arena.bytes);
+    INSTRUMENT_FRAME_END();
+    frameArena.reset();
 }
 
-// display registry, clears the color and depth buffers, sets camera position and orientation and calls the render function 
+// display registry, renders a frame and shows it
 void display(void) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity(); // reset the modelview matrix
-    gluLookAt(viewer.x, viewer.y, viewer.z, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0); // set the camera position and orientation
-    render(); // render the scene
+    renderFrame();
     glutSwapBuffers(); //Swap the front and back buffers
+    loopStats.framesDrawn++;
+    framePresented();
+
+    // keep drawing while assets stream in, then report how long it took once
+    static bool loadReported = false;
+    if (loadedTime < 0)
+        glutPostRedisplay();
+    else if (!loadReported) {
+        loadReported = true;
+        AssetStreamStats streamed = assetStreamer.stats();
+        cout << "first frame after " << firstFrameTime << " ms, assets loaded after " << loadedTime << " ms ("
+            << streamed.arenaAllocations << " images converted in " << streamed.arenaPeakBytes << " arena bytes)" << endl;
+    }
 }
 
 // reshape registry
 // called when window is resized to change the viewport
 
 void reshape(int w, int h) {
+    windowWidth = w;
+    windowHeight = h;
     glViewport(0, 0, (GLsizei)w, (GLsizei)h); //set the viewport to the client window area
     glMatrixMode(GL_PROJECTION); // set the projection matrix mode
     glLoadIdentity(); // reset the projection matri
     glFrustum(-1.0, 1.0, -1.0, 1.0, 1.5, 200.0); // set the projection frustum
     glMatrixMode(GL_MODELVIEW); // set the modelview matrix mode
+
+    setLodView(viewer, 1.5f, h); // near / top of the frustum above
+}
+
+
+
+// animation loop
+
+// This function is responsible for stepping the simulation and the camera up to now (in seconds)
+// and telling whether anything a frame shows has changed
+bool updateSimulation(double now) {
+    int steps = simulationClock.advance(now);
+    bool cameraMoved = false;
+    for (int i = 0; i < steps; i++) {
+        if (animationRunning)
+            animator.step(simulationClock.step());
+        cameraMoved |= camera.step(cameraInput, simulationClock.step());
+    }
+    loopStats.ticks++;
+    loopStats.steps += steps;
+
+    // a paused animation keeps the placement it was stopped at
+    bool objectsMoved = animationRunning && animator.apply(scene.instances, simulationClock.alpha());
+    if (objectsMoved)
+        sceneBvhStale = true;
+
+    if (cameraMoved) {
+        viewer = camera.eye;
+        viewTarget = camera.target;
+        setLodView(viewer, 1.5f, windowHeight);
+    }
+
+    bool damaged = objectsMoved || cameraMoved;
+    if (!damaged)
+        loopStats.ticksSkipped++;
+    return damaged;
+}
+
+void tick(int value);
+
+// This function is responsible for keeping tick() scheduled while anything moves; once everything
+// stands still the loop stops and the window waits for events without using the CPU
+void scheduleTick() {
+    bool moving = (animationRunning && !animator.empty()) || FreeCamera::active(cameraInput);
+    if (ticking || !moving)
+        return;
+    ticking = true;
+    glutTimerFunc(1000 / SIMULATION_HZ, tick, 0);
+}
+
+// starts the loop again after it stopped, without simulating the time it was stopped for
+void resumeTicking() {
+    if (!ticking)
+        simulationClock.restart(nowMilliseconds() / 1000.0);
+    scheduleTick();
+}
+
+// timer registry, one step of the loop: a frame is only requested when something changed
+void tick(int value) {
+    ticking = false;
+    if (updateSimulation(nowMilliseconds() / 1000.0))
+        glutPostRedisplay();
+    scheduleTick();
+}
+
+void resetLoopStats() {
+    loopStats = LoopStats();
+    loopStats.wallStart = nowMilliseconds();
+    loopStats.cpuStart = processCpuMilliseconds();
+}
+
+// This function is responsible for printing how much CPU the loop used since the last report
+void reportLoopStats() {
+    double wall = nowMilliseconds() - loopStats.wallStart;
+    double cpu = processCpuMilliseconds() - loopStats.cpuStart;
+    cout << "cpu " << (wall > 0 ? cpu / wall * 100.0 : 0.0) << "% of one core over " << wall / 1000.0 << " s: "
+        << loopStats.framesDrawn << " frames drawn, " << loopStats.ticksSkipped << " of " << loopStats.ticks << " ticks unchanged, "
+        << loopStats.steps << " simulation steps" << endl;
+    resetLoopStats();
+}
+
+// keyboard registry
+// 'l' switches between the mesh cache and the display lists, 'd' turns the level of detail on and off,
+// 'c' turns frustum culling on and off, 'i' switches instancing on and off, 's' switches material sorting on and off,
+// 'h' turns the shadows on and off, 'b' switches the static objects to baked lighting and back, 't' writes the instrumentation trace,
+// 'p' pauses and resumes the animation, 'u' prints the CPU usage since the last time, 'g' switches per-pixel lighting and fog on and off
+void keyboard(unsigned char key, int x, int y) {
+    if (key == 'l' || key == 'L') {
+        useMeshCache = !useMeshCache;
+        cout << (useMeshCache ? "drawing from the mesh cache" : "drawing from display lists") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 'c' || key == 'C') {
+        useCulling = !useCulling;
+        cout << (useCulling ? "frustum culling on" : "frustum culling off") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 'd' || key == 'D') {
+        useLod = !useLod;
+        cout << (useLod ? "level of detail on" : "level of detail off") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 's' || key == 'S') {
+        useMaterialSort = !useMaterialSort;
+        cout << (useMaterialSort ? "material sorting on" : "material sorting off") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 'h' || key == 'H') {
+        useShadows = !useShadows;
+        cout << (useShadows ? "shadows on" : "shadows off") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 'b' || key == 'B') {
+        useBakedLighting = !useBakedLighting;
+        if (useBakedLighting && !bakeCurrent())
+            bakeLighting();
+        cout << (bakedActive() ? "baked lighting on" : "baked lighting off") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 't' || key == 'T') {
+        if (!writeInstrumentTrace(tracePath.c_str()))
+            cout << "built without SCENE_INSTRUMENT, there is no trace to write" << endl;
+    }
+    else if (key == 'i' || key == 'I') {
+        useInstancing = !useInstancing;
+        cout << (instancingActive() ? "instanced drawing on" : "instanced drawing off") << endl;
+        glutPostRedisplay();
+    }
+    else if (key == 'p' || key == 'P') {
+        animationRunning = !animationRunning;
+        cout << (animationRunning ? "animation running" : "animation paused") << endl;
+        resumeTicking();
+    }
+    else if (key == 'u' || key == 'U')
+        reportLoopStats();
+    else if (key == 'g' || key == 'G') {
+        usePixelShading = !usePixelShading;
+        if (usePixelShading && !pixelShadingAvailable())
+            initPixelShading();
+        cout << (pixelShadingActive() ? "per-pixel lighting and fog on" : "per-pixel lighting and fog off") << endl;
+        glutPostRedisplay();
+    }
+}
+
+// This function is responsible for turning a special key going down (held 1) or up (held 0) into camera input:
+// up and down fly forward and back, left and right turn (or move sideways with shift), page up and page down
+// rise and sink, home and end look up and down
+void setCameraKey(int key, int held) {
+    switch (key) {
+    case GLUT_KEY_UP: cameraInput.forward = held; break;
+    case GLUT_KEY_DOWN: cameraInput.forward = -held; break;
+    case GLUT_KEY_PAGE_UP: cameraInput.up = held; break;
+    case GLUT_KEY_PAGE_DOWN: cameraInput.up = -held; break;
+    case GLUT_KEY_HOME: cameraInput.pitch = held; break;
+    case GLUT_KEY_END: cameraInput.pitch = -held; break;
+    case GLUT_KEY_LEFT:
+    case GLUT_KEY_RIGHT: {
+        int direction = key == GLUT_KEY_LEFT ? 1 : -1;
+        bool sideways = held && (glutGetModifiers() & GLUT_ACTIVE_SHIFT);
+        cameraInput.turn = sideways ? 0 : held * direction;
+        cameraInput.right = sideways ? -direction : 0;
+        break;
+    }
+    default: return;
+    }
+    resumeTicking();
+}
+
+// special key registries, the camera moves while a key is held
+void specialKey(int key, int x, int y) {
+    setCameraKey(key, 1);
+}
+
+// once the camera stops, the static objects are baked again for where it stopped
+void specialKeyUp(int key, int x, int y) {
+    setCameraKey(key, 0);
+    if (!FreeCamera::active(cameraInput) && useBakedLighting && useMeshCache && !bakeCurrent()) {
+        bakeLighting();
+        glutPostRedisplay();
+    }
+}
+
+// mouse registry
+// a left click prints the object under the cursor
+void mouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+        return;
+
+    // the moving objects' triangles follow them only when something is picked
+    if (sceneBvhStale) {
+        updateSceneBvh(true);
+        sceneBvhStale = false;
+    }
+
+    int object = pickObject(x, y);
+    if (object < 0)
+        cout << "nothing picked" << endl;
+    else
+        cout << "picked object " << object << ", a " << modelNames[scene.instances[object].model] << endl;
+}
+
+// resizes the offscreen surface and the viewport for the benchmark
+bool resizeHeadless(int w, int h) {
+    if (!resizeHeadlessSurface(w, h))
+        return false;
+    reshape(w, h);
+    return true;
+}
+
+// names the selected drawing path and options for the benchmark reports
+string renderPathName() {
+    string name = instancingActive() ? "instanced" : useMeshCache ? "mesh-cache" : "display-lists";
+    if (!instancingActive() && useMeshCache && !useMaterialSort)
+        name += ",no-sort";
+    if (useMeshCache && !useMeshOptimization)
+        name += ",no-mesh-opt";
+    if (usePackedVertices && instancingActive())
+        name += ",packed";
+    if (!useLod)
+        name += ",no-lod";
+    if (!useCulling)
+        name += ",no-cull";
+    if (bakedActive())
+        name += ",baked";
+    if (pixelShadingActive())
+        name += useHeightFog ? ",per-pixel,height-fog" : ",per-pixel";
+    if (!useShadows || !shadowMaps.ready())
+        name += ",no-shadows";
+    return name;
+}
+
+// renders the scene without a window and reports frame times, see README for the options
+int runHeadless(BenchmarkOptions& options, int* argc, char** argv) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 }); // same size as the window
+
+    if (!createHeadlessContext(options.sizes[0].width, options.sizes[0].height, argc, argv))
+        return EXIT_FAILURE;
+
+    initialize();
+
+    // the first frame is drawn as soon as it can be, the timed ones with everything loaded
+    renderFrame();
+    glFinish();
+    framePresented();
+    options.firstFrameMs = firstFrameTime;
+    finishStreaming();
+    if (loadedTime < 0) {
+        renderFrame();
+        glFinish();
+        framePresented();
+    }
+    options.loadedMs = loadedTime;
+    AssetStreamStats streamed = assetStreamer.stats();
+    options.loadArenaAllocations = streamed.arenaAllocations;
+    options.loadArenaPeakBytes = (long)streamed.arenaPeakBytes;
+    options.loadPoolPeakBytes = (long)streamed.poolPeakBytes;
+    ProgramBuildStats programs = programBuildStats();
+    options.programsCompiled = programs.compiled;
+    options.programsLoaded = programs.loaded;
+    options.programMs = programs.milliseconds;
+
+    options.renderPath = renderPathName();
+    int result = runFrameBenchmark(options, resizeHeadless, renderFrame);
+    if (traceRequested && !writeInstrumentTrace(tracePath.c_str()))
+        cerr << "built without SCENE_INSTRUMENT, --trace has nothing to write" << endl;
+    destroyHeadlessContext();
+    return result;
+}
+
+
+// the viewer positions of the golden images: the window's, the other side, low over the land, behind and from above
+const GLfloat goldenEyes[][3] = {
+    { 7.0f, 7.0f, 7.0f },
+    { -7.0f, 7.0f, 7.0f },
+    { 9.0f, 2.0f, -3.0f },
+    { -6.0f, 5.0f, -8.0f },
+    { 0.5f, 12.0f, 0.5f }
+};
+
+// This function is responsible for rendering every golden view, then storing the images and frame times or checking them
+int runGoldenSuite(BenchmarkOptions& options, const string& directory, bool record, double tolerance, double maxDifferentShare, double maxSlowdown, int* argc, char** argv) {
+    GoldenManifest manifest;
+    if (record)
+        makeGoldenDirectory(directory);
+    else if (!loadGoldenManifest(goldenManifestPath(directory), manifest))
+        return EXIT_FAILURE;
+
+    // a check renders at the recorded size unless told otherwise
+    BenchmarkSize size = { 500, 500 };
+    if (!options.sizes.empty())
+        size = options.sizes[0];
+    else if (!record)
+        size = { manifest.width, manifest.height };
+
+    if (!createHeadlessContext(size.width, size.height, argc, argv))
+        return EXIT_FAILURE;
+
+    initialize();
+    finishStreaming();
+    reshape(size.width, size.height);
+
+    string path = renderPathName();
+    bool comparable = record || (size.width == manifest.width && size.height == manifest.height && path == manifest.renderPath);
+    if (!comparable) {
+        bool sameSize = size.width == manifest.width && size.height == manifest.height;
+        cerr << "golden: recorded as " << manifest.renderPath << " at " << manifest.width << "x" << manifest.height
+            << ", rendering " << path << " at " << size.width << "x" << size.height << "; the frame times are not compared"
+            << (sameSize ? "" : " and the views fail, their images differ in size") << endl;
+    }
+
+    const size_t viewCount = sizeof(goldenEyes) / sizeof(goldenEyes[0]);
+    vector3 originalViewer = viewer;
+    bool passed = true;
+    stringstream json;
+    json << "{\n  \"benchmark\": \"golden\",\n  \"mode\": \"" << (record ? "record" : "check") << "\",\n";
+    json << "  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n  \"render_path\": \"" << path << "\",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n  \"frames\": " << options.frames << ",\n";
+    if (!record)
+        json << "  \"tolerance\": " << tolerance << ",\n  \"max_different_share\": " << maxDifferentShare << ",\n  \"max_slowdown\": " << maxSlowdown << ",\n";
+    json << "  \"views\": [";
+
+    for (size_t v = 0; v < viewCount; v++) {
+        viewer = vector3(goldenEyes[v][0], goldenEyes[v][1], goldenEyes[v][2]);
+        reshape(size.width, size.height); // the level of detail follows the viewer
+
+        // the baked colours and the shadow maps hold for one view, both are redone here, untimed
+        if (useBakedLighting)
+            bakeStaticLighting(hardwareThreads());
+        for (int i = 0; i < options.warmupFrames + 1; i++)
+            renderFrame();
+        glFinish();
+
+        vector<unsigned char> pixels((size_t)size.width * size.height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, size.width, size.height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+        vector<double> timings;
+        for (int i = 0; i < options.frames; i++) {
+            double start = nowMilliseconds();
+            renderFrame();
+            glFinish();
+            timings.push_back(nowMilliseconds() - start);
+        }
+        TimingSummary summary = summarizeTimings(timings);
+
+        json << (v ? "," : "") << "\n    { \"eye\": [" << goldenEyes[v][0] << ", " << goldenEyes[v][1] << ", " << goldenEyes[v][2] << "], \"median_ms\": " << summary.median;
+
+        if (record) {
+            GoldenView view = { { goldenEyes[v][0], goldenEyes[v][1], goldenEyes[v][2] }, summary.median };
+            manifest.views.push_back(view);
+            if (!writeImage(goldenImagePath(directory, v), size.width, size.height, &pixels[0], 3))
+                passed = false;
+            json << " }";
+            continue;
+        }
+
+        // the image
+        int goldenWidth = 0, goldenHeight = 0;
+        vector<unsigned char> golden;
+        bool imagePassed = false;
+        if (v >= manifest.views.size() || !readImage(goldenImagePath(directory, v), goldenWidth, goldenHeight, golden))
+            json << ", \"image\": \"missing\"";
+        else if (goldenWidth != size.width || goldenHeight != size.height)
+            json << ", \"image\": \"size differs\"";
+        else {
+            vector<unsigned char> diff;
+            ImageDifference difference = compareImages(&golden[0], &pixels[0], size.width, size.height, tolerance, &diff);
+            double share = (double)difference.differentPixels / difference.pixels;
+            imagePassed = share <= maxDifferentShare;
+            json << ", \"different_pixels\": " << difference.differentPixels << ", \"max_delta\": " << difference.maxDelta
+                << ", \"image\": \"" << (imagePassed ? "pass" : "fail") << "\"";
+
+            // what changed is saved next to the golden image for a look
+            if (!imagePassed)
+                writeImage(goldenDiffPath(directory, v), size.width, size.height, &diff[0], 3);
+        }
+
+        // the frame time, only against a baseline of the same path and size
+        bool timePassed = true;
+        if (comparable && v < manifest.views.size()) {
+            double baseline = manifest.views[v].medianMs;
+            double slowdown = baseline > 0.0 ? summary.median / baseline - 1.0 : 0.0;
+            timePassed = slowdown <= maxSlowdown;
+            json << ", \"baseline_ms\": " << baseline << ", \"slowdown\": " << slowdown << ", \"time\": \"" << (timePassed ? "pass" : "fail") << "\"";
+        }
+        json << " }";
+
+        if (!imagePassed || !timePassed)
+            passed = false;
+    }
+    json << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}";
+
+    if (record) {
+        manifest.width = size.width;
+        manifest.height = size.height;
+        manifest.frames = options.frames;
+        manifest.renderPath = path;
+        if (!saveGoldenManifest(goldenManifestPath(directory), manifest))
+            passed = false;
+    }
+
+    viewer = originalViewer;
+    destroyHeadlessContext();
+    bool written = writeReport(options.jsonPath, json.str());
+    return passed && written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// This function is responsible for timing generated towns of every count, drawn one object at a time and instanced
+int runInstanceBenchmark(BenchmarkOptions& options, const vector<int>& counts, int* argc, char** argv) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 });
+    const BenchmarkSize& size = options.sizes[0];
+
+    if (!createHeadlessContext(size.width, size.height, argc, argv))
+        return EXIT_FAILURE;
+
+    initialize();
+    finishStreaming();
+    reshape(size.width, size.height);
+
+    if (!instancingAvailable()) {
+        cerr << "benchmark: instancing is not supported by " << (const char*)glGetString(GL_RENDERER) << endl;
+        destroyHeadlessContext();
+        return EXIT_FAILURE;
+    }
+
+    // every object is submitted, so the comparison measures the draw calls and not the culling
+    useCulling = false;
+    useMeshCache = true;
+
+    Scene original = scene;
+    stringstream json;
+    json << "{\n  \"benchmark\": \"instancing\",\n  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n  \"frames\": " << options.frames << ",\n";
+    json << "  \"results\": [";
+
+    for (size_t c = 0; c < counts.size(); c++) {
+        generateTown(vocabulary, original, counts[c], 3.0f, scene);
+
+        for (int instanced = 0; instanced < 2; instanced++) {
+            useInstancing = instanced != 0;
+
+            for (int i = 0; i < options.warmupFrames; i++)
+                renderFrame();
+            glFinish();
+
+            // submit time is spent on the CPU issuing the frame, before waiting for the rasterizer
+            vector<double> timings, submitTimings;
+            for (int i = 0; i < options.frames; i++) {
+                double start = nowMilliseconds();
+                renderFrame();
+                submitTimings.push_back(nowMilliseconds() - start);
+                glFinish();
+                timings.push_back(nowMilliseconds() - start);
+            }
+
+            TimingSummary summary = summarizeTimings(timings);
+            TimingSummary submit = summarizeTimings(submitTimings);
+            json << (c || instanced ? "," : "") << "\n    { \"instances\": " << counts[c] << ", \"path\": \"" << renderPathName()
+                << "\", \"frame_ms\": { \"min\": " << summary.min << ", \"median\": " << summary.median << ", \"p99\": " << summary.p99
+                << " }, \"submit_ms\": " << submit.median << ", \"draw_calls\": " << frameStats.drawCalls << ", \"triangles\": " << frameStats.triangles
+                << ", \"state_changes\": " << frameStats.stateChanges << ", \"state_changes_skipped\": " << frameStats.stateChangesSkipped << " }";
+        }
+    }
+    json << "\n  ]\n}";
+
+    scene = original;
+    destroyHeadlessContext();
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 
+// This function is responsible for timing generated towns of every count drawn instanced, from float and from packed vertices
+int runVertexFormatBenchmark(BenchmarkOptions& options, const vector<int>& counts, int* argc, char** argv) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 });
+    const BenchmarkSize& size = options.sizes[0];
+
+    if (!createHeadlessContext(size.width, size.height, argc, argv))
+        return EXIT_FAILURE;
+
+    initialize();
+    finishStreaming();
+    reshape(size.width, size.height);
+
+    if (!instancingAvailable() || !hasBufferObjects) {
+        cerr << "benchmark: packed vertices need instancing, which " << (const char*)glGetString(GL_RENDERER) << " does not support" << endl;
+        destroyHeadlessContext();
+        return EXIT_FAILURE;
+    }
+
+    // every object is submitted, the comparison is about the vertices and not the culling
+    useCulling = false;
+    useMeshCache = true;
+    useInstancing = true;
+
+    Scene original = scene;
+    stringstream json;
+    json << "{\n  \"benchmark\": \"vertex-format\",\n  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n  \"frames\": " << options.frames << ",\n";
+    json << "  \"results\": [";
+
+    for (size_t c = 0; c < counts.size(); c++) {
+        generateTown(vocabulary, original, counts[c], 3.0f, scene);
+
+        for (int packed = 0; packed < 2; packed++) {
+            // the same meshes again in the other format
+            size_t vertexBytes = 0, vertices = 0;
+            usePackedVertices = packed != 0;
+            uploadModelMeshes(usePackedVertices);
+            for (int m = 0; m < MODEL_COUNT; m++)
+                for (int level = 0; level < LOD_LEVELS; level++)
+                    vertices += models[m].meshes[level].vertices.size();
+            vertexBytes = vertices * (packed ? sizeof(PackedVertex) : sizeof(MeshVertex));
+
+            for (int i = 0; i < options.warmupFrames; i++)
+                renderFrame();
+            glFinish();
+
+            vector<double> timings;
+            for (int i = 0; i < options.frames; i++) {
+                double start = nowMilliseconds();
+                renderFrame();
+                glFinish();
+                timings.push_back(nowMilliseconds() - start);
+            }
+
+            TimingSummary summary = summarizeTimings(timings);
+            json << (c || packed ? "," : "") << "\n    { \"instances\": " << counts[c] << ", \"format\": \"" << (packed ? "packed" : "float")
+                << "\", \"vertex_bytes\": " << vertexBytes << ", \"bytes_per_vertex\": " << (packed ? sizeof(PackedVertex) : sizeof(MeshVertex))
+                << ", \"frame_ms\": { \"min\": " << summary.min << ", \"median\": " << summary.median << ", \"p99\": " << summary.p99
+                << " }, \"triangles\": " << frameStats.triangles << ", \"triangles_per_second\": " << (long)(frameStats.triangles / (summary.median / 1000.0)) << " }";
+        }
+    }
+    json << "\n  ]\n}";
+
+    scene = original;
+    destroyHeadlessContext();
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// This function is responsible for running the window's loop without a window for the given seconds, once with the
+// scene moving and once standing still, and reporting the frames drawn and the CPU used; the still run keeps ticking
+// to measure what the damage check costs, where the window would stop its timer altogether
+int runAnimationBenchmark(BenchmarkOptions& options, double seconds, int* argc, char** argv) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 });
+    const BenchmarkSize& size = options.sizes[0];
+
+    if (!createHeadlessContext(size.width, size.height, argc, argv))
+        return EXIT_FAILURE;
+
+    initialize();
+    finishStreaming();
+    reshape(size.width, size.height);
+    camera.lookAt(viewer, viewTarget);
+    animator.attach(scene.instances, CAR, ROCKET);
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"animation\",\n  \"render_path\": \"" << renderPathName() << "\",\n";
+    json << "  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n  \"tick_hz\": " << SIMULATION_HZ << ",\n";
+    json << "  \"animated_objects\": " << animator.size() << ",\n";
+    json << "  \"results\": [";
+
+    const char* const phases[2] = { "active", "idle" };
+    for (int phase = 0; phase < 2; phase++) {
+        animationRunning = phase == 0;
+        vector<double> timings;
+
+        resetLoopStats();
+        double start = loopStats.wallStart;
+        double nextTick = start;
+        simulationClock.restart(start / 1000.0);
+
+        while (nowMilliseconds() - start < seconds * 1000.0) {
+            nextTick += 1000.0 / SIMULATION_HZ;
+            double wait = nextTick - nowMilliseconds();
+            if (wait > 0)
+                this_thread::sleep_for(chrono::duration<double, milli>(wait));
+
+            if (updateSimulation(nowMilliseconds() / 1000.0)) {
+                double frameStart = nowMilliseconds();
+                renderFrame();
+                glFinish();
+                timings.push_back(nowMilliseconds() - frameStart);
+                loopStats.framesDrawn++;
+            }
+        }
+
+        double wall = nowMilliseconds() - loopStats.wallStart;
+        double cpu = processCpuMilliseconds() - loopStats.cpuStart;
+        TimingSummary summary = summarizeTimings(timings);
+        json << (phase ? "," : "") << "\n    { \"phase\": \"" << phases[phase] << "\", \"wall_ms\": " << wall << ", \"cpu_ms\": " << cpu
+            << ", \"cpu_percent\": " << cpu / wall * 100.0 << ", \"ticks\": " << loopStats.ticks << ", \"frames_drawn\": " << loopStats.framesDrawn
+            << ", \"ticks_unchanged\": " << loopStats.ticksSkipped << ", \"simulation_steps\": " << loopStats.steps
+            << ", \"frame_ms\": { \"median\": " << summary.median << ", \"p99\": " << summary.p99 << " } }";
+    }
+    json << "\n  ]\n}";
+
+    destroyHeadlessContext();
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// the background image for the CPU rasterizer, which keeps its own copy instead of a texture object
+SoftTexture softBackground;
+
+// This function is responsible for loading the background image as RGBA for the CPU rasterizer
+void makeSoftTexture() {
+    BmpImage image;
+    if (!loadBmp("bg.bmp", image, true))
+        return;
+
+    softBackground.width = image.width;
+    softBackground.height = image.height;
+    softBackground.texels.resize((size_t)image.width * image.height);
+    memcpy(&softBackground.texels[0], image.pixels, softBackground.texels.size() * sizeof(uint32_t));
+    releaseBmp(image);
+}
+
+void softCorner(const vertex3 corner, GLfloat out[3]) {
+    for (int k = 0; k < 3; k++)
+        out[k] = corner[k];
+}
+
+// the two halves of the background as drawBackgroundTexture() draws them, for the CPU renderers
+const GLfloat backgroundTexcoords[2][4][2] = {
+    { { 0.0f, 0.0f }, { 0.5f, 0.0f }, { 0.5f, 1.0f }, { 0.0f, 1.0f } },
+    { { 0.5f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.5f, 1.0f } }
+};
+
+void backgroundCorners(GLfloat corners[2][4][3]) {
+    softCorner(front_left, corners[0][0]);
+    softCorner(back_left, corners[0][1]);
+    softCorner(back_left_height, corners[0][2]);
+    softCorner(front_left_height, corners[0][3]);
+    softCorner(back_left, corners[1][0]);
+    softCorner(back_right, corners[1][1]);
+    softCorner(back_right_height, corners[1][2]);
+    softCorner(back_left_height, corners[1][3]);
+}
+
+// the land as drawLand() draws it
+const GLfloat landNormal[3] = { 0.0f, 1.0f, 0.0f };
+
+void landCorners(GLfloat corners[4][3]) {
+    softCorner(back_left, corners[0]);
+    softCorner(front_left, corners[1]);
+    softCorner(front_right, corners[2]);
+    softCorner(back_right, corners[3]);
+}
+
+// the lights, materials and fog the OpenGL path sets up; setLight() stores the light positions
+// under an identity modelview, so they are in eye space
+SoftLighting sceneLighting() {
+    SoftLighting lighting;
+    lighting.lights = scene.lights.empty() ? NULL : &scene.lights[0];
+    lighting.lightCount = (int)min(scene.lights.size(), (size_t)8);
+    memcpy(lighting.globalAmbient, lmodel_ambient, sizeof(lighting.globalAmbient));
+    lighting.materials = materials;
+    lighting.materialCount = MATERIAL_COUNT;
+    lighting.fog = scene.fog;
+    return lighting;
+}
+
+// This function is responsible for deleting the baked colours and their buffers
+void releaseBakedLighting() {
+    for (size_t i = 0; i < bakedObjects.size(); i++) {
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            if (bakedObjects[i].buffers[level])
+                pglDeleteBuffers(1, &bakedObjects[i].buffers[level]);
+        }
+    }
+    bakedObjects.clear();
+}
+
+// This function is responsible for baking the lighting of every static object, at every level of detail,
+// as seen from the current viewer; the static objects and the land occlude. Returns the totals of all bakes
+BakeStats bakeStaticLighting(int threads) {
+    const GLfloat identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    double start = nowMilliseconds();
+    releaseBakedLighting();
+
+    LightBaker baker;
+    baker.setThreads(threads);
+
+    GLfloat land[4][3];
+    landCorners(land);
+    baker.addOccluder(land[0], land[1], land[2]);
+    baker.addOccluder(land[0], land[2], land[3]);
+
+    // moving objects would leave their shadows behind, so only the static ones occlude
+    vector<GLfloat> positions;
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& object = scene.instances[i];
+        if (!modelIsStatic[object.model])
+            continue;
+
+        const Mesh& mesh = models[object.model].meshes[0];
+        GLfloat matrix[16];
+        objectMatrix(identity, object, matrix);
+
+        positions.resize(mesh.vertices.size() * 3);
+        for (size_t v = 0; v < mesh.vertices.size(); v++) {
+            const GLfloat* p = mesh.vertices[v].position;
+            for (int k = 0; k < 3; k++)
+                positions[v * 3 + k] = matrix[k] * p[0] + matrix[4 + k] * p[1] + matrix[8 + k] * p[2] + matrix[12 + k];
+        }
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+            baker.addOccluder(&positions[mesh.indices[t] * 3], &positions[mesh.indices[t + 1] * 3], &positions[mesh.indices[t + 2] * 3]);
+    }
+    baker.build();
+
+    // the camera of renderFrame(), the lights follow it
+    GLfloat eye[3] = { (GLfloat)viewer.x, (GLfloat)viewer.y, (GLfloat)viewer.z };
+    GLfloat center[3] = { viewTarget.x, viewTarget.y, viewTarget.z };
+    GLfloat up[3] = { 0.0f, 1.0f, 0.0f };
+    GLfloat view[16];
+    softLookAtMatrix(eye, center, up, view);
+    baker.setLighting(sceneLighting(), view);
+
+    BakeStats total = { 0, 0, 0, 0.0 };
+    bakedObjects.resize(scene.instances.size());
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& object = scene.instances[i];
+        const Model& model = models[object.model];
+        BakedObject& baked = bakedObjects[i];
+        for (int level = 0; level < LOD_LEVELS; level++)
+            baked.buffers[level] = 0;
+        if (!modelIsStatic[object.model])
+            continue;
+
+        GLfloat matrix[16];
+        objectMatrix(identity, object, matrix);
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            BakeStats stats = baker.bake(model.meshes[level], matrix, model.paint, object.material, baked.colors[level]);
+            total.vertices += stats.vertices;
+            total.occlusionRays += stats.occlusionRays;
+            total.shadowRays += stats.shadowRays;
+
+            if (hasBufferObjects && !baked.colors[level].empty()) {
+                pglGenBuffers(1, &baked.buffers[level]);
+                pglBindBuffer(GL_ARRAY_BUFFER, baked.buffers[level]);
+                pglBufferData(GL_ARRAY_BUFFER, baked.colors[level].size() * sizeof(uint32_t), &baked.colors[level][0], GL_STATIC_DRAW);
+                pglBindBuffer(GL_ARRAY_BUFFER, 0);
+            }
+        }
+    }
+    bakedViewer = viewer;
+    bakedViewTarget = viewTarget;
+    total.milliseconds = nowMilliseconds() - start;
+    return total;
+}
+
+// bakes on every hardware thread and says how long it took
+void bakeLighting() {
+    BakeStats stats = bakeStaticLighting(hardwareThreads());
+    cout << "baked the lighting of " << stats.vertices << " static vertices in " << stats.milliseconds << " ms" << endl;
+}
+
+// This function is responsible for recording what renderFrame() draws into the CPU rasterizer and rendering it
+void renderSoftFrame(SoftRasterizer& rasterizer, int width, int height) {
+    GLfloat projection[16], view[16];
+    GLfloat eye[3] = { (GLfloat)viewer.x, (GLfloat)viewer.y, (GLfloat)viewer.z };
+    GLfloat center[3] = { viewTarget.x, viewTarget.y, viewTarget.z };
+    GLfloat up[3] = { 0.0f, 1.0f, 0.0f };
+
+    // the same matrices reshape() and renderFrame() set up
+    softFrustumMatrix(-1.0f, 1.0f, -1.0f, 1.0f, 1.5f, 200.0f, projection);
+    softLookAtMatrix(eye, center, up, view);
+
+    GLfloat clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    rasterizer.beginFrame(width, height, clearColor, projection, sceneLighting());
+
+    if (!softBackground.texels.empty()) {
+        GLfloat background[2][4][3];
+        backgroundCorners(background);
+        rasterizer.drawTexturedQuad(background[0], backgroundTexcoords[0], view, softBackground);
+        rasterizer.drawTexturedQuad(background[1], backgroundTexcoords[1], view, softBackground);
+    }
+
+    GLfloat land[4][3];
+    landCorners(land);
+    rasterizer.drawQuad(land, landNormal, view, BRONZE);
+
+    Frustum frustum;
+    if (useCulling)
+        extractFrustum(projection, view, frustum);
+
+    // the objects get the same culling, level of detail and matrices as in render()
+    updateTransforms(view);
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& object = scene.instances[i];
+        const Model& model = models[object.model];
+        GLfloat objectCenter[3], radius, low[3], high[3];
+
+        instanceBounds(object, model.meshes[0], objectCenter, radius, low, high);
+        if (useCulling && !objectVisible(frustum, objectCenter, radius, low, high))
+            continue;
+
+        int level = useLod ? selectLod(objectCenter, radius, object.scale) : 0;
+        rasterizer.drawMesh(model.meshes[level], transforms.modelview(objectNode(i)), model.paint, object.material);
+    }
+
+    rasterizer.endFrame();
+}
+
+// This function is responsible for timing the CPU rasterizer at every thread count, no OpenGL context is needed
+int runSoftBenchmark(BenchmarkOptions& options, vector<int> threadCounts) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 });
+    const BenchmarkSize& size = options.sizes[0];
+
+    // 1, 2, 4, ... up to every hardware thread
+    int hardware = hardwareThreads();
+    if (threadCounts.empty()) {
+        for (int threads = 1; threads < hardware; threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(hardware);
+    }
+
+    // the meshes are captured on the CPU, uploading them is skipped without buffer objects
+    initModels();
+    initMeshCache();
+    makeSoftTexture();
+    setLodView(viewer, 1.5f, size.height);
+
+    SoftRasterizer rasterizer;
+    stringstream json;
+    json << "{\n  \"benchmark\": \"soft-raster\",\n  \"hardware_threads\": " << hardware << ",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n  \"frames\": " << options.frames << ",\n";
+    json << "  \"results\": [";
+
+    double baseline = 0.0;
+    for (size_t t = 0; t < threadCounts.size(); t++) {
+        rasterizer.setThreads(threadCounts[t]);
+
+        for (int i = 0; i < options.warmupFrames; i++)
+            renderSoftFrame(rasterizer, size.width, size.height);
+
+        vector<double> timings;
+        for (int i = 0; i < options.frames; i++) {
+            double start = nowMilliseconds();
+            renderSoftFrame(rasterizer, size.width, size.height);
+            timings.push_back(nowMilliseconds() - start);
+        }
+
+        // every thread count renders the same image, the first one is kept
+        if (t == 0 && !options.screenshotPath.empty())
+            writeImage(options.screenshotPath, rasterizer.width(), rasterizer.height(), (const unsigned char*)rasterizer.pixels(), 4);
+
+        // scaling is measured against the first thread count, 1 unless --threads says otherwise
+        TimingSummary summary = summarizeTimings(timings);
+        if (t == 0)
+            baseline = summary.median;
+        double speedup = baseline / summary.median;
+        json << (t ? "," : "") << "\n    { \"threads\": " << rasterizer.threads() << ", \"frame_ms\": { \"min\": " << summary.min
+            << ", \"median\": " << summary.median << ", \"p99\": " << summary.p99 << " }, \"triangles\": " << rasterizer.triangles()
+            << ", \"speedup\": " << speedup << ", \"efficiency\": " << speedup * threadCounts[0] / threadCounts[t] << " }";
+    }
+    json << "\n  ]\n}";
+
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// This function is responsible for ray tracing the scene with progressive passes and reporting the ray rates
+int runRayTrace(BenchmarkOptions& options, const vector<int>& threadCounts, int passes) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 });
+    const BenchmarkSize& size = options.sizes[0];
+
+    initModels();
+    initMeshCache();
+    makeSoftTexture();
+
+    RayTracer tracer;
+    tracer.setThreads(threadCounts.empty() ? hardwareThreads() : threadCounts[0]);
+
+    // every object at full detail, reflections can see what the camera cannot
+    double buildStart = nowMilliseconds();
+    GLfloat identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    if (!softBackground.texels.empty()) {
+        GLfloat background[2][4][3];
+        backgroundCorners(background);
+        tracer.addTexturedQuad(background[0], backgroundTexcoords[0], softBackground);
+        tracer.addTexturedQuad(background[1], backgroundTexcoords[1], softBackground);
+    }
+    GLfloat land[4][3];
+    landCorners(land);
+    tracer.addQuad(land, landNormal, BRONZE);
+
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& object = scene.instances[i];
+        const Model& model = models[object.model];
+        GLfloat matrix[16];
+        objectMatrix(identity, object, matrix);
+        tracer.addMesh(model.meshes[0], matrix, model.paint, object.material);
+    }
+    tracer.build();
+    double buildTime = nowMilliseconds() - buildStart;
+
+    // the camera of reshape() and renderFrame()
+    GLfloat eye[3] = { (GLfloat)viewer.x, (GLfloat)viewer.y, (GLfloat)viewer.z };
+    GLfloat center[3] = { viewTarget.x, viewTarget.y, viewTarget.z };
+    GLfloat up[3] = { 0.0f, 1.0f, 0.0f };
+    GLfloat view[16];
+    softLookAtMatrix(eye, center, up, view);
+    tracer.setCamera(eye, center, up, 1.0f, 1.0f, 1.5f);
+    tracer.setLighting(sceneLighting(), view);
+    tracer.setReflectivity(materialReflectivity, MATERIAL_COUNT);
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"raytrace\",\n  \"threads\": " << tracer.threads() << ",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n";
+    json << "  \"triangles\": " << tracer.triangles() << ",\n  \"bvh_nodes\": " << tracer.nodes() << ",\n  \"build_ms\": " << buildTime << ",\n";
+    json << "  \"passes\": [";
+
+    long totalRays = 0;
+    double totalTime = 0.0;
+    tracer.beginImage(size.width, size.height);
+    for (int pass = 0; pass < passes; pass++) {
+        RayPassStats stats = tracer.renderPass();
+        long rays = stats.primaryRays + stats.shadowRays + stats.reflectionRays;
+        totalRays += rays;
+        totalTime += stats.milliseconds;
+
+        json << (pass ? "," : "") << "\n    { \"pass\": " << pass + 1 << ", \"ms\": " << stats.milliseconds << ", \"primary_rays\": " << stats.primaryRays
+            << ", \"shadow_rays\": " << stats.shadowRays << ", \"reflection_rays\": " << stats.reflectionRays
+            << ", \"rays_per_second\": " << (long)(rays / (stats.milliseconds / 1000.0)) << " }";
+
+        // the screenshot is rewritten after every pass, so it can be watched while it refines
+        if (!options.screenshotPath.empty())
+            writeImage(options.screenshotPath, tracer.width(), tracer.height(), (const unsigned char*)tracer.pixels(), 4);
+    }
+    json << "\n  ],\n  \"rays_per_second\": " << (long)(totalRays / (totalTime / 1000.0)) << "\n}";
+
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// a repeatable value in [0, 1) for the query benchmark
+GLfloat benchmarkRandom(unsigned int& seed) {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// This function is responsible for capturing every model at every level and reporting what the mesh optimization does to it
+int runMeshReport(const char* jsonPath) {
+    initModels();
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"mesh-optimization\",\n  \"meshes\": [";
+
+    double totalMs = 0.0;
+    for (int i = 0; i < MODEL_COUNT; i++) {
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            Mesh mesh;
+            setMeshDetail(lodPixelsPerUnit(level));
+            beginMeshCapture(&mesh);
+            models[i].draw();
+            endMeshCapture();
+
+            size_t vertices = mesh.vertices.size();
+            GLfloat before16 = meshAcmr(mesh, 16), before32 = meshAcmr(mesh, 32);
+
+            double start = nowMilliseconds();
+            optimizeMesh(mesh);
+            double elapsed = nowMilliseconds() - start;
+            totalMs += elapsed;
+
+            json << (i || level ? "," : "") << "\n    { \"model\": \"" << modelNames[i] << "\", \"level\": " << level
+                << ", \"triangles\": " << mesh.indices.size() / 3 << ", \"vertices\": { \"before\": " << vertices << ", \"after\": " << mesh.vertices.size()
+                << " }, \"acmr_16\": { \"before\": " << before16 << ", \"after\": " << meshAcmr(mesh, 16)
+                << " }, \"acmr_32\": { \"before\": " << before32 << ", \"after\": " << meshAcmr(mesh, 32) << " }, \"ms\": " << elapsed << " }";
+        }
+    }
+    setMeshDetail(0.0f);
+    json << "\n  ],\n  \"total_ms\": " << totalMs << "\n}";
+
+    return writeReport(jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// This function is responsible for timing the shape generators and the start-up capture of every model and level on each thread count
+int runMeshGenerationBenchmark(int rounds, vector<int> threadCounts, const char* jsonPath) {
+    initModels();
+    if (threadCounts.empty()) {
+        for (int threads = 1; threads < hardwareThreads(); threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(hardwareThreads());
+    }
+
+    // one of each shape at the full detail of the models
+    const GLint slices = 20, stacks = 20;
+    ShapeSize cylinder = cylinderSize(slices, stacks), sphere = sphereSize(slices, stacks), box = boxSize();
+    size_t shapeVertices = cylinder.vertices * 2 + sphere.vertices + box.vertices;
+    size_t shapeIndices = cylinder.indices * 2 + sphere.indices + box.indices;
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"mesh-generation\",\n  \"rounds\": " << rounds << ",\n";
+    json << "  \"shapes_per_round\": 4,\n  \"vertices_per_round\": " << shapeVertices << ",\n  \"results\": [";
+
+    double firstGenerate = 0.0, firstCapture = 0.0;
+    for (size_t t = 0; t < threadCounts.size(); t++) {
+        ThreadPool pool(threadCounts[t]);
+
+        // every round writes a cylinder, a cone, a sphere and a box into its own part of the arrays
+        const int roundsPerTask = 64;
+        int tasks = (rounds + roundsPerTask - 1) / roundsPerTask;
+        vector<ShapeArrays> arrays(pool.size());
+        for (size_t w = 0; w < arrays.size(); w++)
+            arrays[w].resize(shapeVertices * roundsPerTask, shapeIndices * roundsPerTask);
+
+        double start = nowMilliseconds();
+        pool.parallelFor(tasks, [&](int task, int worker) {
+            ShapeArrays& out = arrays[worker];
+            int count = min(roundsPerTask, rounds - task * roundsPerTask);
+            size_t vertex = 0, index = 0;
+            for (int r = 0; r < count; r++) {
+                generateCylinder(0.5, 0.5, 2.0, slices, stacks, out, vertex, index);
+                vertex += cylinder.vertices;
+                index += cylinder.indices;
+                generateCone(0.5, 1.5, slices, stacks, out, vertex, index);
+                vertex += cylinder.vertices;
+                index += cylinder.indices;
+                generateSphere(0.7, slices, stacks, out, vertex, index);
+                vertex += sphere.vertices;
+                index += sphere.indices;
+                generateBox(2.0f, 0.2f, 0.5f, out, vertex, index);
+                vertex += box.vertices;
+                index += box.indices;
+            }
+        });
+        double generateMs = nowMilliseconds() - start;
+
+        start = nowMilliseconds();
+        captureModels(pool);
+        double captureMs = nowMilliseconds() - start;
+
+        if (t == 0) {
+            firstGenerate = generateMs;
+            firstCapture = captureMs;
+        }
+        json << (t ? "," : "") << "\n    { \"threads\": " << threadCounts[t] << ", \"generate_ms\": " << generateMs
+            << ", \"shapes_per_second\": " << (long)(rounds * 4 / (generateMs / 1000.0))
+            << ", \"vertices_per_second\": " << (long)(rounds * shapeVertices / (generateMs / 1000.0))
+            << ", \"generate_speedup\": " << firstGenerate / generateMs
+            << ", \"capture_models_ms\": " << captureMs << ", \"capture_speedup\": " << firstCapture / captureMs << " }";
+    }
+    json << "\n  ],\n  \"meshes_captured\": " << MODEL_COUNT * LOD_LEVELS << "\n}";
+
+    return writeReport(jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// This function is responsible for timing the hierarchy's build, refit and queries on a generated town of at least count triangles
+int runBvhBenchmark(int count, const char* jsonPath) {
+    initModels();
+    initMeshCache();
+
+    long perModel = 0;
+    for (int m = 0; m < MODEL_COUNT; m++)
+        perModel += (long)models[m].meshes[0].indices.size() / 3;
+    int objects = (int)((count * (long)MODEL_COUNT + perModel - 1) / perModel);
+
+    // the models are picked at random, so the town grows until it has enough triangles
+    Scene original = scene;
+    for (;;) {
+        generateTown(vocabulary, original, objects, 3.0f, scene);
+        long triangles = 0;
+        for (size_t i = 0; i < scene.instances.size(); i++)
+            triangles += (long)models[scene.instances[i].model].meshes[0].indices.size() / 3;
+        if (triangles >= count)
+            break;
+        objects += (int)((count - triangles) * MODEL_COUNT / perModel) + 1;
+    }
+
+    double start = nowMilliseconds();
+    updateSceneBvh(false);
+    double buildTime = nowMilliseconds() - start;
+
+    // every object moves up a little, as an animation would move it
+    for (size_t i = 0; i < scene.instances.size(); i++)
+        scene.instances[i].position[1] += 0.1f;
+    start = nowMilliseconds();
+    updateSceneBvh(true);
+    double refitTime = nowMilliseconds() - start;
+
+    int side = 1;
+    while (side * side < objects)
+        side++;
+    GLfloat extent = side * 3.0f * 0.5f;
+    unsigned int seed = 1;
+    const int queries = 100000;
+    long hits = 0;
+
+    // rays from above the town down at random points on the ground
+    start = nowMilliseconds();
+    for (int i = 0; i < queries; i++) {
+        GLfloat origin[3] = { (benchmarkRandom(seed) * 2.0f - 1.0f) * extent, 20.0f, (benchmarkRandom(seed) * 2.0f - 1.0f) * extent };
+        vector3 target((benchmarkRandom(seed) * 2.0f - 1.0f) * extent, 0.0f, (benchmarkRandom(seed) * 2.0f - 1.0f) * extent);
+        vector3 ray = target.subtract(vector3(origin[0], origin[1], origin[2])).normalize();
+        GLfloat direction[3] = { ray.x, ray.y, ray.z };
+        BvhHit hit;
+        hits += sceneBvh.raycast(origin, direction, 1e30f, hit) ? 1 : 0;
+    }
+    double rayTime = nowMilliseconds() - start;
+
+    // boxes about the size of a person
+    vector<int> found;
+    long overlaps = 0;
+    start = nowMilliseconds();
+    for (int i = 0; i < queries; i++) {
+        GLfloat center[3] = { (benchmarkRandom(seed) * 2.0f - 1.0f) * extent, benchmarkRandom(seed) * 2.0f, (benchmarkRandom(seed) * 2.0f - 1.0f) * extent };
+        GLfloat low[3] = { center[0] - 0.25f, center[1] - 0.9f, center[2] - 0.25f };
+        GLfloat high[3] = { center[0] + 0.25f, center[1] + 0.9f, center[2] + 0.25f };
+        found.clear();
+        sceneBvh.overlap(low, high, found);
+        overlaps += (long)found.size();
+    }
+    double boxTime = nowMilliseconds() - start;
+
+    start = nowMilliseconds();
+    long nearestFound = 0;
+    for (int i = 0; i < queries; i++) {
+        GLfloat point[3] = { (benchmarkRandom(seed) * 2.0f - 1.0f) * extent, benchmarkRandom(seed) * 3.0f, (benchmarkRandom(seed) * 2.0f - 1.0f) * extent };
+        BvhNearest nearest;
+        nearestFound += sceneBvh.nearest(point, 3.0f, nearest) ? 1 : 0;
+    }
+    double nearestTime = nowMilliseconds() - start;
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"bvh\",\n  \"objects\": " << objects << ",\n  \"triangles\": " << sceneBvh.triangles() << ",\n";
+    json << "  \"nodes\": " << sceneBvh.nodes() << ",\n  \"sah_cost\": " << sceneBvh.cost() << ",\n";
+    json << "  \"build_ms\": " << buildTime << ",\n  \"refit_ms\": " << refitTime << ",\n";
+    json << "  \"ray\": { \"queries_per_second\": " << (long)(queries / (rayTime / 1000.0)) << ", \"hits\": " << hits << " },\n";
+    json << "  \"box\": { \"queries_per_second\": " << (long)(queries / (boxTime / 1000.0)) << ", \"triangles_found\": " << overlaps << " },\n";
+    json << "  \"nearest\": { \"queries_per_second\": " << (long)(queries / (nearestTime / 1000.0)) << ", \"found\": " << nearestFound << " }\n}";
+
+    scene = original;
+    return writeReport(jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// This function is responsible for timing the background texture uploads, which needs a context but no scene
+int runTextureUploadBenchmark(const BenchmarkOptions& options, int* argc, char** argv) {
+    if (!createHeadlessContext(64, 64, argc, argv))
+        return EXIT_FAILURE;
+
+    loadGLExtensions();
+    int result = runTextureBenchmark("bg.bmp", options.jsonPath.c_str());
+    destroyHeadlessContext();
+    return result;
+}
+
+// This function is responsible for timing the lighting bake at every thread count, then frames with the static objects lit and baked
+int runBakeBenchmark(BenchmarkOptions& options, vector<int> threadCounts, int* argc, char** argv) {
+    if (options.sizes.empty())
+        options.sizes.push_back({ 500, 500 });
+    const BenchmarkSize& size = options.sizes[0];
+    if (threadCounts.empty())
+        threadCounts.push_back(hardwareThreads());
+
+    if (!createHeadlessContext(size.width, size.height, argc, argv))
+        return EXIT_FAILURE;
+
+    useBakedLighting = false;
+    initialize();
+    finishStreaming();
+    reshape(size.width, size.height);
+
+    int staticObjects = 0;
+    for (size_t i = 0; i < scene.instances.size(); i++)
+        staticObjects += modelIsStatic[scene.instances[i].model] ? 1 : 0;
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"bake\",\n  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n";
+    json << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n  \"frames\": " << options.frames << ",\n";
+    json << "  \"static_objects\": " << staticObjects << ",\n  \"bakes\": [";
+
+    for (size_t t = 0; t < threadCounts.size(); t++) {
+        BakeStats stats = bakeStaticLighting(threadCounts[t]);
+        long rays = stats.occlusionRays + stats.shadowRays;
+        json << (t ? "," : "") << "\n    { \"threads\": " << threadCounts[t] << ", \"ms\": " << stats.milliseconds << ", \"vertices\": " << stats.vertices
+            << ", \"occlusion_rays\": " << stats.occlusionRays << ", \"shadow_rays\": " << stats.shadowRays
+            << ", \"rays_per_second\": " << (long)(rays / (stats.milliseconds / 1000.0)) << " }";
+    }
+    json << "\n  ],\n  \"results\": [";
+
+    for (int baked = 0; baked < 2; baked++) {
+        useBakedLighting = baked != 0;
+
+        for (int i = 0; i < options.warmupFrames; i++)
+            renderFrame();
+        glFinish();
+
+        vector<double> timings, submitTimings;
+        for (int i = 0; i < options.frames; i++) {
+            double start = nowMilliseconds();
+            renderFrame();
+            submitTimings.push_back(nowMilliseconds() - start);
+            glFinish();
+            timings.push_back(nowMilliseconds() - start);
+        }
+
+        // the screenshot shows the baked frame
+        if (baked && !options.screenshotPath.empty())
+            writeScreenshot(options.screenshotPath, size.width, size.height);
+
+        TimingSummary summary = summarizeTimings(timings);
+        TimingSummary submit = summarizeTimings(submitTimings);
+        json << (baked ? "," : "") << "\n    { \"path\": \"" << renderPathName() << "\", \"frame_ms\": { \"min\": " << summary.min << ", \"median\": " << summary.median
+            << ", \"p99\": " << summary.p99 << " }, \"submit_ms\": " << submit.median << ", \"draw_calls\": " << frameStats.drawCalls
+            << ", \"triangles\": " << frameStats.triangles << ", \"state_changes\": " << frameStats.stateChanges << " }";
+    }
+    json << "\n  ]\n}";
+
+    releaseBakedLighting();
+    destroyHeadlessContext();
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 // main program 
 int main(int argc, char** argv)
 {
+    bool headless = false;
+    BenchmarkOptions benchmark;
+    string sceneFile = "default.scene";
+    bool sceneFileGiven = false;
+    string cookedSceneFile;
+    vector<int> instanceBenchmarkCounts;
+    vector<int> vertexFormatBenchmarkCounts;
+    int sceneBenchmarkCount = 0;
+    int bvhBenchmarkCount = 0;
+    vector<BenchmarkSize> bmpBenchmarkSize;
+    long vectorBenchmarkCount = 0;
+    bool soft = false;
+    int rayTracePasses = 0;
+    vector<int> softThreadCounts;
+    string cookedTexturePath;
+    TextureFormat textureFormat = TEXTURE_RGBA8;
+    MipFilter mipFilter = MIP_KAISER;
+    bool textureBenchmark = false;
+    bool bakeBenchmark = false;
+    bool meshReport = false;
+    int meshGenerationRounds = 0;
+    double animationBenchmarkSeconds = 0;
+    string goldenDirectory;
+    bool goldenRecord = false;
+    double goldenTolerance = 0.1, goldenMaxDifferent = 0.001, goldenMaxSlowdown = 0.25;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--display-lists")
+            useMeshCache = false;
+        else if (arg == "--no-mesh-opt")
+            useMeshOptimization = false;
+        else if (arg == "--packed-vertices")
+            usePackedVertices = true;
+        else if (arg == "--mesh-report")
+            meshReport = true;
+        else if (arg == "--bench-meshgen" && hasValue)
+            meshGenerationRounds = atoi(argv[++i]);
+        else if (arg == "--bench-animation" && hasValue)
+            animationBenchmarkSeconds = atof(argv[++i]);
+        else if (arg == "--no-lod")
+            useLod = false;
+        else if (arg == "--no-cull")
+            useCulling = false;
+        else if (arg == "--no-instancing")
+            useInstancing = false;
+        else if (arg == "--no-material-sort")
+            useMaterialSort = false;
+        else if (arg == "--no-shadows")
+            useShadows = false;
+        else if (arg == "--no-shadow-cache")
+            useShadowCache = false;
+        else if (arg == "--baked")
+            useBakedLighting = true;
+        else if (arg == "--pixel-shading")
+            usePixelShading = true;
+        else if (arg == "--height-fog" && hasValue) {
+            usePixelShading = true;
+            useHeightFog = true;
+            heightFogFalloff = (GLfloat)atof(argv[++i]);
+        }
+        else if (arg == "--shader-cache" && hasValue)
+            programCacheDirectory = argv[++i];
+        else if (arg == "--no-shader-cache")
+            programCacheDirectory.clear();
+        else if (arg == "--bench-bake")
+            bakeBenchmark = true;
+        else if (arg == "--soft")
+            soft = true;
+        else if (arg == "--raytrace" && hasValue)
+            rayTracePasses = atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue) {
+            if (!parseBenchmarkCounts(argv[++i], softThreadCounts)) {
+                cerr << "invalid --threads, expected N[,N...]" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--scene" && hasValue) {
+            sceneFile = argv[++i];
+            sceneFileGiven = true;
+        }
+        else if (arg == "--cook-scene" && hasValue)
+            cookedSceneFile = argv[++i];
+        else if (arg == "--bench-scene" && hasValue)
+            sceneBenchmarkCount = atoi(argv[++i]);
+        else if (arg == "--cook-texture" && hasValue)
+            cookedTexturePath = argv[++i];
+        else if (arg == "--texture-format" && hasValue) {
+            string name = argv[++i];
+            if (name != "rgba" && name != "bc1") {
+                cerr << "invalid --texture-format, expected rgba or bc1" << endl;
+                return EXIT_FAILURE;
+            }
+            textureFormat = name == "bc1" ? TEXTURE_BC1 : TEXTURE_RGBA8;
+        }
+        else if (arg == "--mip-filter" && hasValue) {
+            string name = argv[++i];
+            if (name != "box" && name != "kaiser") {
+                cerr << "invalid --mip-filter, expected box or kaiser" << endl;
+                return EXIT_FAILURE;
+            }
+            mipFilter = name == "box" ? MIP_BOX : MIP_KAISER;
+        }
+        else if (arg == "--bench-texture")
+            textureBenchmark = true;
+        else if (arg == "--bench-bvh" && hasValue)
+            bvhBenchmarkCount = atoi(argv[++i]);
+        else if (arg == "--headless")
+            headless = true;
+        else if ((arg == "--golden-record" || arg == "--golden-check") && hasValue) {
+            goldenDirectory = argv[++i];
+            goldenRecord = arg == "--golden-record";
+        }
+        else if (arg == "--golden-tolerance" && hasValue)
+            goldenTolerance = atof(argv[++i]);
+        else if (arg == "--golden-max-pixels" && hasValue)
+            goldenMaxDifferent = atof(argv[++i]) / 100.0;
+        else if (arg == "--max-slowdown" && hasValue)
+            goldenMaxSlowdown = atof(argv[++i]) / 100.0;
+        else if (arg == "--frames" && hasValue)
+            benchmark.frames = atoi(argv[++i]);
+        else if (arg == "--warmup" && hasValue)
+            benchmark.warmupFrames = atoi(argv[++i]);
+        else if (arg == "--json" && hasValue)
+            benchmark.jsonPath = argv[++i];
+        else if (arg == "--trace" && hasValue) {
+            tracePath = argv[++i];
+            traceRequested = true;
+        }
+        else if (arg == "--screenshot" && hasValue)
+            benchmark.screenshotPath = argv[++i];
+        else if (arg == "--bench-vector3" && hasValue)
+            vectorBenchmarkCount = atol(argv[++i]);
+        else if (arg == "--bench-bmp" && hasValue) {
+            if (!parseBenchmarkSizes(argv[++i], bmpBenchmarkSize) || bmpBenchmarkSize.size() != 1) {
+                cerr << "invalid --bench-bmp, expected WxH" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--bench-vertex-format" && hasValue) {
+            if (!parseBenchmarkCounts(argv[++i], vertexFormatBenchmarkCounts)) {
+                cerr << "invalid --bench-vertex-format, expected N[,N...]" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--bench-instances" && hasValue) {
+            if (!parseBenchmarkCounts(argv[++i], instanceBenchmarkCounts)) {
+                cerr << "invalid --bench-instances, expected N[,N...]" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--size" && hasValue) {
+            if (!parseBenchmarkSizes(argv[++i], benchmark.sizes)) {
+                cerr << "invalid --size, expected WxH[,WxH...]" << endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // the built-in layout stays when default.scene is missing, a scene given with --scene must load
+    loadBuiltInScene();
+    if (sceneFileGiven || ifstream(sceneFile.c_str()).good()) {
+        if (!loadScene(sceneFile.c_str(), vocabulary, scene))
+            return EXIT_FAILURE;
+    }
+    applyScene();
+
+    if (!cookedSceneFile.empty())
+        return saveSceneBinary(cookedSceneFile.c_str(), scene) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (!cookedTexturePath.empty())
+        return cookTexture("bg.bmp", cookedTexturePath.c_str(), textureFormat, mipFilter) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (sceneBenchmarkCount > 0)
+        return runSceneBenchmark(vocabulary, scene, sceneBenchmarkCount, benchmark.jsonPath.c_str());
+
+    if (meshReport)
+        return runMeshReport(benchmark.jsonPath.c_str());
+
+    if (meshGenerationRounds > 0)
+        return runMeshGenerationBenchmark(meshGenerationRounds, softThreadCounts, benchmark.jsonPath.c_str());
+
+    if (bvhBenchmarkCount > 0)
+        return runBvhBenchmark(bvhBenchmarkCount, benchmark.jsonPath.c_str());
+
+    if (vectorBenchmarkCount > 0)
+        return runVector3Benchmark((size_t)vectorBenchmarkCount, benchmark.jsonPath.c_str());
+
+    if (!bmpBenchmarkSize.empty())
+        return runBmpBenchmark(bmpBenchmarkSize[0].width, bmpBenchmarkSize[0].height, benchmark.jsonPath.c_str());
+
+    if (textureBenchmark)
+        return runTextureUploadBenchmark(benchmark, &argc, argv);
+
+    if (rayTracePasses > 0)
+        return runRayTrace(benchmark, softThreadCounts, rayTracePasses);
+
+    if (soft)
+        return runSoftBenchmark(benchmark, softThreadCounts);
+
+    if (bakeBenchmark)
+        return runBakeBenchmark(benchmark, softThreadCounts, &argc, argv);
+
+    if (!instanceBenchmarkCounts.empty())
+        return runInstanceBenchmark(benchmark, instanceBenchmarkCounts, &argc, argv);
+
+    if (!vertexFormatBenchmarkCounts.empty())
+        return runVertexFormatBenchmark(benchmark, vertexFormatBenchmarkCounts, &argc, argv);
+
+    if (animationBenchmarkSeconds > 0)
+        return runAnimationBenchmark(benchmark, animationBenchmarkSeconds, &argc, argv);
+
+    if (!goldenDirectory.empty())
+        return runGoldenSuite(benchmark, goldenDirectory, goldenRecord, goldenTolerance, goldenMaxDifferent, goldenMaxSlowdown, &argc, argv);
+
+    if (headless)
+        return runHeadless(benchmark, &argc, argv);
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH); // set the display mode
     glutInitWindowSize(500, 500); //set display-window width and height
@@ -855,8 +2962,19 @@ int main(int argc, char** argv)
 
     glutDisplayFunc(display); //call display function
     glutReshapeFunc(reshape); // call reshape function
+    glutKeyboardFunc(keyboard); // call keyboard function
+    glutSpecialFunc(specialKey); // the camera keys
+    glutSpecialUpFunc(specialKeyUp);
+    glutIgnoreKeyRepeat(1);
+    glutMouseFunc(mouse); // call mouse function
 
     initialize(); // initialize OpenGL
+
+    // the cars drive and the rockets launch from where the scene put them
+    camera.lookAt(viewer, viewTarget);
+    animator.attach(scene.instances, CAR, ROCKET);
+    resetLoopStats();
+    resumeTicking();
     glutMainLoop(); //display everything and wait
 
     return EXIT_SUCCESS;
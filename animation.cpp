@@ -0,0 +1,189 @@
+#include <math.h>
+#include "animation.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// the car's circle and its speed along it
+#define DRIVE_RADIUS 2.5
+#define DRIVE_SPEED 2.0
+
+// seconds on the pad, upward acceleration and the height at which the rocket goes back to the pad
+#define LAUNCH_WAIT 3.0
+#define LAUNCH_ACCELERATION 3.0
+#define LAUNCH_HEIGHT 15.0
+
+// the camera's speed in units and degrees per second
+#define CAMERA_MOVE_SPEED 5.0
+#define CAMERA_TURN_SPEED 90.0
+
+// the camera stops this many degrees short of looking straight up or down
+#define CAMERA_PITCH_MARGIN 5.0
+
+FixedTimestep::FixedTimestep(double step, int maxSteps)
+    : stepLength(step), maxSteps(maxSteps), lastTime(0.0), accumulated(0.0), droppedTime(0.0), started(false) {
+}
+
+void FixedTimestep::restart(double now) {
+    lastTime = now;
+    accumulated = 0.0;
+    started = true;
+}
+
+int FixedTimestep::advance(double now) {
+    if (!started)
+        restart(now);
+
+    accumulated += now - lastTime;
+    lastTime = now;
+
+    int steps = (int)(accumulated / stepLength);
+    if (steps > maxSteps) {
+        droppedTime += (steps - maxSteps) * stepLength;
+        steps = maxSteps;
+        accumulated = fmod(accumulated, stepLength);
+    }
+    else
+        accumulated -= steps * stepLength;
+    return steps;
+}
+
+
+
+// scene animation
+
+void SceneAnimator::attach(const std::vector<SceneInstance>& instances, int driveModel, int launchModel) {
+    objects.clear();
+    for (size_t i = 0; i < instances.size(); i++) {
+        const SceneInstance& instance = instances[i];
+        if (instance.model != driveModel && instance.model != launchModel)
+            continue;
+
+        Animated object;
+        object.instance = i;
+        object.launches = instance.model == launchModel;
+        for (int k = 0; k < 3; k++)
+            object.start.position[k] = instance.position[k];
+        object.start.rotation = instance.rotation;
+        object.time = 0.0;
+        object.previous = object.start;
+        object.current = object.start;
+        objects.push_back(object);
+    }
+}
+
+// This function is responsible for moving every animated object one step along its motion
+void SceneAnimator::step(double seconds) {
+    for (size_t i = 0; i < objects.size(); i++) {
+        Animated& object = objects[i];
+        object.previous = object.current;
+        object.time += seconds;
+        Pose& pose = object.current;
+
+        if (object.launches) {
+            double flight = object.time - LAUNCH_WAIT;
+            double height = flight > 0.0 ? 0.5 * LAUNCH_ACCELERATION * flight * flight : 0.0;
+            if (height > LAUNCH_HEIGHT) {
+                // back on the pad, without sliding down from the top in between
+                object.time = 0.0;
+                height = 0.0;
+                object.previous = object.start;
+            }
+            pose = object.start;
+            pose.position[1] = (float)(object.start.position[1] + height);
+            continue;
+        }
+
+        // the model faces +x, so at rotation r it drives towards (cos r, 0, -sin r) and turns left
+        // around a centre DRIVE_RADIUS to its left; the circle passes through where it was placed
+        double start = object.start.rotation * M_PI / 180.0;
+        double turned = DRIVE_SPEED / DRIVE_RADIUS * object.time;
+        double heading = start + turned;
+        pose.position[0] = (float)(object.start.position[0] + DRIVE_RADIUS * (sin(heading) - sin(start)));
+        pose.position[1] = object.start.position[1];
+        pose.position[2] = (float)(object.start.position[2] + DRIVE_RADIUS * (cos(heading) - cos(start)));
+        pose.rotation = (float)fmod(heading * 180.0 / M_PI, 360.0);
+
+        // a lap is a whole turn, starting over keeps the time small
+        if (turned >= 2.0 * M_PI)
+            object.time -= 2.0 * M_PI * DRIVE_RADIUS / DRIVE_SPEED;
+    }
+}
+
+bool SceneAnimator::apply(std::vector<SceneInstance>& instances, double alpha) const {
+    bool changed = false;
+    float t = (float)alpha;
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        const Animated& object = objects[i];
+        if (object.instance >= instances.size())
+            continue;
+        SceneInstance& instance = instances[object.instance];
+
+        Pose pose;
+        for (int k = 0; k < 3; k++)
+            pose.position[k] = object.previous.position[k] + (object.current.position[k] - object.previous.position[k]) * t;
+
+        // the short way round when the rotation wraps past 360
+        float turn = object.current.rotation - object.previous.rotation;
+        if (turn > 180.0f)
+            turn -= 360.0f;
+        else if (turn < -180.0f)
+            turn += 360.0f;
+        pose.rotation = object.previous.rotation + turn * t;
+
+        for (int k = 0; k < 3; k++) {
+            changed |= instance.position[k] != pose.position[k];
+            instance.position[k] = pose.position[k];
+        }
+        changed |= instance.rotation != pose.rotation;
+        instance.rotation = pose.rotation;
+    }
+    return changed;
+}
+
+
+
+// free camera
+
+void FreeCamera::lookAt(const vector3& eye, const vector3& target) {
+    this->eye = eye;
+    this->target = target;
+}
+
+bool FreeCamera::active(const CameraInput& input) {
+    return input.forward || input.right || input.up || input.turn || input.pitch;
+}
+
+// This function is responsible for flying the camera; turning swings the target around the eye,
+// moving carries both along
+bool FreeCamera::step(const CameraInput& input, double seconds) {
+    if (!active(input))
+        return false;
+
+    vector3 view = target.subtract(eye);
+    float distance = view.distance(vector3(0.0f, 0.0f, 0.0f));
+    vector3 forward = view.normalize();
+
+    if (input.turn) {
+        float angle = (float)(input.turn * CAMERA_TURN_SPEED * seconds * M_PI / 180.0);
+        float c = cosf(angle), s = sinf(angle);
+        forward = vector3(forward.x * c + forward.z * s, forward.y, -forward.x * s + forward.z * c);
+    }
+
+    if (input.pitch) {
+        float limit = (float)((90.0 - CAMERA_PITCH_MARGIN) * M_PI / 180.0);
+        float pitch = asinf(forward.y) + (float)(input.pitch * CAMERA_TURN_SPEED * seconds * M_PI / 180.0);
+        pitch = pitch > limit ? limit : pitch < -limit ? -limit : pitch;
+        float horizontal = sqrtf(forward.x * forward.x + forward.z * forward.z);
+        float scale = horizontal > 0.0f ? cosf(pitch) / horizontal : 0.0f;
+        forward = vector3(forward.x * scale, sinf(pitch), forward.z * scale);
+    }
+
+    vector3 side = forward.cross(vector3(0.0f, 1.0f, 0.0f)).normalize();
+    float move = (float)(CAMERA_MOVE_SPEED * seconds);
+    eye = eye.add(forward.scalar(input.forward * move)).add(side.scalar(input.right * move)).add(vector3(0.0f, input.up * move, 0.0f));
+    target = eye.add(forward.scalar(distance));
+    return true;
+}
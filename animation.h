@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "scenefile.h"
+#include "vector3.h"
+
+/*
+    Animation and camera
+
+    The window runs a fixed-timestep simulation: FixedTimestep turns the wall clock into
+    whole steps of the same length, so the motion does not depend on the frame rate, and
+    leaves the fraction of a step that is left over for interpolation. When the program
+    falls far behind (a breakpoint, a dragged window) at most maxSteps are run and the
+    rest of the time is dropped instead of spiralling.
+
+    SceneAnimator moves the cars and rockets of the scene: a car drives in a circle that
+    starts where it was placed, a rocket waits on its pad, launches with a constant
+    acceleration and returns to the pad once it is out of sight. Each step keeps the
+    previous placement, and apply() writes the one in between the last two steps into the
+    scene, so the objects move smoothly however the frames fall between the steps.
+
+    FreeCamera flies the viewer: it moves along its view direction and sideways, rises
+    and sinks, turns and looks up and down. It keeps the point it looks at rather than
+    angles, so the starting view is exactly the gluLookAt one it was given.
+
+    Each of them reports whether it changed anything, which is what decides whether a
+    frame is drawn at all.
+*/
+
+class FixedTimestep {
+
+public:
+
+    // step is in seconds, at most maxSteps are run per advance()
+    FixedTimestep(double step, int maxSteps);
+
+    // the next advance() counts from now, in seconds, without running the time before it
+    void restart(double now);
+
+    // returns how many steps are due at now and keeps the rest for the next call
+    int advance(double now);
+
+    // how far the time left over reaches into the next step, 0 to 1
+    double alpha() const { return accumulated / stepLength; }
+
+    double step() const { return stepLength; }
+
+    // seconds thrown away because more than maxSteps were due
+    double dropped() const { return droppedTime; }
+
+private:
+
+    double stepLength;
+    int maxSteps;
+    double lastTime;
+    double accumulated;
+    double droppedTime;
+    bool started;
+
+};
+
+class SceneAnimator {
+
+public:
+
+    // takes the instances of driveModel and launchModel as they are placed now as the start of
+    // their motion; the others are left alone
+    void attach(const std::vector<SceneInstance>& instances, int driveModel, int launchModel);
+
+    // advances every animated object by one step of the given length in seconds
+    void step(double seconds);
+
+    // writes the placement alpha (0 to 1) of the way from the previous step to the last one into
+    // instances, true when any of them changed
+    bool apply(std::vector<SceneInstance>& instances, double alpha) const;
+
+    bool empty() const { return objects.empty(); }
+
+    size_t size() const { return objects.size(); }
+
+private:
+
+    // a placement: position and rotation about y in degrees
+    struct Pose {
+        float position[3];
+        float rotation;
+    };
+
+    struct Animated {
+        size_t instance;
+        bool launches; // a rocket, otherwise a car
+        Pose start;
+        double time; // seconds since the motion (re)started
+        Pose previous;
+        Pose current;
+    };
+
+    std::vector<Animated> objects;
+
+};
+
+// what the held keys ask the camera to do, each -1, 0 or 1
+struct CameraInput {
+    int forward;
+    int right;
+    int up;
+    int turn; // 1 turns left
+    int pitch; // 1 looks up
+};
+
+class FreeCamera {
+
+public:
+
+    void lookAt(const vector3& eye, const vector3& target);
+
+    // moves for seconds with the input held, true when the camera moved
+    bool step(const CameraInput& input, double seconds);
+
+    // true while any key is held
+    static bool active(const CameraInput& input);
+
+    vector3 eye;
+    vector3 target;
+
+};
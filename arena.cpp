@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include "arena.h"
+
+LinearArena::LinearArena(size_t blockSize) : blockSize(blockSize), first(NULL), current(NULL), offset(0), usedBefore(0) {
+    counters = ArenaStats();
+}
+
+LinearArena::~LinearArena() {
+    release();
+}
+
+// the usable bytes of a block start right after its header
+static unsigned char* blockData(void* block, size_t header) {
+    return static_cast<unsigned char*>(block) + header;
+}
+
+// the header rounded up so the data of a fresh block is 16 byte aligned
+#define BLOCK_HEADER ((sizeof(Block) + 15) & ~(size_t)15)
+
+void* LinearArena::allocate(size_t bytes, size_t alignment) {
+    if (current == NULL)
+        nextBlock(bytes, alignment);
+
+    uintptr_t data = (uintptr_t)blockData(current, BLOCK_HEADER);
+    size_t start = (size_t)(((data + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - data);
+    if (start + bytes > current->size) {
+        nextBlock(bytes, alignment);
+        data = (uintptr_t)blockData(current, BLOCK_HEADER);
+        start = (size_t)(((data + alignment - 1) & ~(uintptr_t)(alignment - 1)) - data);
+    }
+
+    offset = start + bytes;
+    counters.allocations++;
+    counters.bytes = usedBefore + offset;
+    if (counters.bytes > counters.peakBytes)
+        counters.peakBytes = counters.bytes;
+    return (void*)(data + start);
+}
+
+// This function is responsible for finding room for an allocation after the current block,
+// reusing the blocks a previous round left behind before adding a new one
+void LinearArena::nextBlock(size_t bytes, size_t alignment) {
+    size_t needed = bytes + (alignment > 16 ? alignment : 0);
+
+    if (current)
+        usedBefore += offset;
+    Block* previous = current;
+    Block* candidate = current ? current->next : first;
+
+    // a kept block that is too small for this allocation is skipped, it is used again next round
+    while (candidate && candidate->size < needed) {
+        previous = candidate;
+        candidate = candidate->next;
+    }
+
+    if (candidate == NULL) {
+        size_t size = needed > blockSize ? needed : blockSize;
+        candidate = static_cast<Block*>(::operator new(BLOCK_HEADER + size));
+        candidate->size = size;
+        candidate->next = NULL;
+        if (previous)
+            previous->next = candidate;
+        else
+            first = candidate;
+        counters.reserved += size;
+    }
+
+    current = candidate;
+    offset = 0;
+}
+
+void LinearArena::reset() {
+    current = first;
+    offset = 0;
+    usedBefore = 0;
+    counters.allocations = 0;
+    counters.bytes = 0;
+}
+
+void LinearArena::release() {
+    while (first) {
+        Block* next = first->next;
+        ::operator delete(first);
+        first = next;
+    }
+    current = NULL;
+    offset = 0;
+    usedBefore = 0;
+    counters.allocations = 0;
+    counters.bytes = 0;
+    counters.reserved = 0;
+}
+
+ArenaStats LinearArena::stats() const {
+    return counters;
+}
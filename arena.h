@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+/*
+    Arena and pool allocators
+
+    LinearArena hands out memory by bumping an offset through a chain of large blocks and
+    never frees single allocations: reset() rewinds to the first block in O(1) and keeps
+    the blocks for the next round, release() gives them back. The frame uses one for its
+    scratch lists (reset at the end of every frame), the asset streamer one per loader
+    thread for converted pixels (released once everything is uploaded). Neither kind of
+    data outlives its round, so nothing is freed one by one.
+
+    ArenaAllocator lets a std::vector live in an arena. Its deallocate() does nothing, so a
+    vector that grows leaves its old storage behind until the reset; a vector must be
+    emptied with restartArenaVector() before the first use after a reset, or it would keep
+    writing into storage the arena hands out again.
+
+    PoolAllocator keeps objects of one type in blocks of fixed-size slots and recycles the
+    freed slots through a free list, for nodes that are created and destroyed one at a time.
+
+    None of them lock, each one belongs to a single thread or to the caller's lock.
+*/
+
+// what an allocator has done, bytes are the ones handed out including alignment padding
+struct ArenaStats {
+    long allocations; // since the last reset
+    size_t bytes; // in use since the last reset
+    size_t peakBytes; // the most bytes in use at once
+    size_t reserved; // held in blocks
+};
+
+class LinearArena {
+
+public:
+
+    // blocks are at least blockSize bytes, larger allocations get a block of their own size
+    explicit LinearArena(size_t blockSize = 64 * 1024);
+
+    ~LinearArena();
+
+    LinearArena(const LinearArena&) = delete;
+
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    // alignment must be a power of two; never returns NULL, a failed block allocation throws std::bad_alloc
+    void* allocate(size_t bytes, size_t alignment = 16);
+
+    template <class T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // makes every allocation invalid and starts again at the first block, which is kept
+    void reset();
+
+    // like reset(), and frees the blocks too
+    void release();
+
+    ArenaStats stats() const;
+
+private:
+
+    struct Block {
+        Block* next;
+        size_t size; // usable bytes after the header
+    };
+
+    // moves on to the next block that fits bytes, allocating one when none does
+    void nextBlock(size_t bytes, size_t alignment);
+
+    size_t blockSize;
+    Block* first;
+    Block* current;
+    size_t offset; // into current
+    size_t usedBefore; // bytes used in the blocks before current
+    ArenaStats counters;
+
+};
+
+// a std::vector allocator that takes its storage from a LinearArena
+template <class T>
+class ArenaAllocator {
+
+public:
+
+    typedef T value_type;
+
+    explicit ArenaAllocator(LinearArena& arena) : arena(&arena) {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocateArray<T>(count); }
+
+    // the memory goes back with the arena's next reset
+    void deallocate(T*, size_t) {}
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+
+    template <class U>
+    friend class ArenaAllocator;
+
+    LinearArena* arena;
+
+};
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+// empties the vector and lets go of its storage without touching it, for the first use after a reset
+template <class T>
+void restartArenaVector(ArenaVector<T>& vector) {
+    ArenaVector<T>(vector.get_allocator()).swap(vector);
+}
+
+// fixed-size slots for one type, freed slots are reused before a new block is taken
+template <class T>
+class PoolAllocator {
+
+public:
+
+    explicit PoolAllocator(size_t slotsPerBlock = 64) : slotsPerBlock(slotsPerBlock), freeList(NULL) {
+        counters = ArenaStats();
+    }
+
+    ~PoolAllocator() {
+        // the objects still alive are the owner's to destroy first
+        for (size_t i = 0; i < blocks.size(); i++)
+            ::operator delete(blocks[i]);
+    }
+
+    PoolAllocator(const PoolAllocator&) = delete;
+
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    template <class... Args>
+    T* create(Args&&... args) {
+        if (freeList == NULL)
+            addBlock();
+        Slot* slot = freeList;
+        freeList = slot->next;
+
+        counters.allocations++;
+        counters.bytes += sizeof(Slot);
+        if (counters.bytes > counters.peakBytes)
+            counters.peakBytes = counters.bytes;
+        return new (slot->storage) T(static_cast<Args&&>(args)...);
+    }
+
+    // destroys an object create() returned and puts its slot on the free list, NULL is ignored
+    void destroy(T* object) {
+        if (object == NULL)
+            return;
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->next = freeList;
+        freeList = slot;
+        counters.bytes -= sizeof(Slot);
+    }
+
+    // allocations counts every create(), bytes the live slots
+    ArenaStats stats() const { return counters; }
+
+private:
+
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void addBlock() {
+        Slot* block = static_cast<Slot*>(::operator new(sizeof(Slot) * slotsPerBlock));
+        blocks.push_back(block);
+        for (size_t i = 0; i < slotsPerBlock; i++) {
+            block[i].next = freeList;
+            freeList = &block[i];
+        }
+        counters.reserved += sizeof(Slot) * slotsPerBlock;
+    }
+
+    size_t slotsPerBlock;
+    Slot* freeList;
+    std::vector<Slot*> blocks;
+    ArenaStats counters;
+
+};
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <iostream>
+#include "glloader.h"
+#include "bmploader.h"
+#include "texcook.h"
+#include "renderstate.h"
+#include "benchmark.h"
+#include "assetstream.h"
+
+using namespace std;
+
+// one request on its way from the file to the texture
+struct StreamedTexture {
+    GLuint texture = 0;
+    string path;
+    string fallback;
+
+    bool cooked = false;
+    CookedTexture cookedTexture;
+    BmpImage image;
+    int nextLevel = 0; // cooked levels go up from the smallest, this counts down to 0
+    bool failed = false;
+
+    ~StreamedTexture() {
+        closeCookedTexture(cookedTexture);
+        releaseBmp(image);
+    }
+};
+
+static bool isCookedTexture(const string& path) {
+    return path.size() > 5 && path.compare(path.size() - 5, 5, ".ctex") == 0;
+}
+
+// reads one byte of every page, so the upload copies from memory instead of waiting on the disk
+static void touchPages(const unsigned char* data, size_t size) {
+    volatile unsigned int sum = 0;
+    for (size_t i = 0; i < size; i += 4096)
+        sum += data[i];
+}
+
+// This function is responsible for mapping and validating a requested file on a loader thread
+static bool loadStreamedTexture(StreamedTexture& item, const string& path, LinearArena& arena) {
+    if (isCookedTexture(path)) {
+        if (!openCookedTexture(path.c_str(), item.cookedTexture))
+            return false;
+        item.cooked = true;
+        item.nextLevel = (int)item.cookedTexture.levels.size() - 1;
+        touchPages(item.cookedTexture.file.data, item.cookedTexture.file.size);
+        return true;
+    }
+
+    if (!loadBmp(path.c_str(), item.image, false, &arena))
+        return false;
+    item.cooked = false;
+    touchPages(item.image.file.data, item.image.file.size);
+    return true;
+}
+
+AssetStreamer::AssetStreamer(int threads) : threadCount(max(threads, 1)), outstanding(0), stopping(false) {
+    counters = AssetStreamStats();
+}
+
+AssetStreamer::~AssetStreamer() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < loaders.size(); i++)
+        loaders[i].join();
+
+    for (size_t i = 0; i < requests.size(); i++)
+        requestPool.destroy(requests[i]);
+    for (size_t i = 0; i < ready.size(); i++)
+        requestPool.destroy(ready[i]);
+}
+
+void AssetStreamer::requestTexture(GLuint texture, const string& path, const string& fallback) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        StreamedTexture* item = requestPool.create();
+        item->texture = texture;
+        item->path = path;
+        item->fallback = fallback;
+        requests.push_back(item);
+        outstanding++;
+        counters.requested++;
+    }
+    wake.notify_one();
+
+    if (loaders.empty()) {
+        for (int i = 0; i < threadCount; i++)
+            loadArenas.push_back(unique_ptr<LinearArena>(new LinearArena(1024 * 1024)));
+        for (int i = 0; i < threadCount; i++)
+            loaders.push_back(thread(&AssetStreamer::loaderLoop, this, i));
+    }
+}
+
+void AssetStreamer::loaderLoop(int index) {
+    LinearArena& arena = *loadArenas[index];
+
+    for (;;) {
+        StreamedTexture* item;
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+            if (stopping)
+                return;
+            item = requests.front();
+            requests.pop_front();
+        }
+
+        double start = nowMilliseconds();
+        bool ok = loadStreamedTexture(*item, item->path, arena) || (!item->fallback.empty() && loadStreamedTexture(*item, item->fallback, arena));
+        double elapsed = nowMilliseconds() - start;
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            counters.loadMs += elapsed;
+            if (ok)
+                ready.push_back(item);
+            else {
+                // the texture keeps its placeholder
+                requestPool.destroy(item);
+                counters.failed++;
+                if (--outstanding == 0)
+                    releaseLoadArenas();
+            }
+        }
+        loaded.notify_all();
+    }
+}
+
+// This function is responsible for recording what the loader arenas held and freeing them; with
+// nothing outstanding no loader is working, so none of them is touching its arena
+void AssetStreamer::releaseLoadArenas() {
+    size_t bytes = 0;
+    for (size_t i = 0; i < loadArenas.size(); i++) {
+        ArenaStats arena = loadArenas[i]->stats();
+        counters.arenaAllocations += arena.allocations;
+        bytes += arena.peakBytes;
+        loadArenas[i]->release();
+    }
+    counters.arenaPeakBytes = max(counters.arenaPeakBytes, bytes);
+}
+
+// This function is responsible for uploading one level of the oldest loaded file into its texture
+bool AssetStreamer::uploadLevel() {
+    StreamedTexture* item;
+    {
+        // only this thread pops the ready queue, so the front stays put while it is uploaded
+        lock_guard<mutex> lock(stateMutex);
+        if (ready.empty())
+            return false;
+        item = ready.front();
+    }
+
+    bindTexture(item->texture);
+    size_t bytes;
+    bool finished;
+
+    if (item->cooked) {
+        int level = item->nextLevel--;
+        int levels = (int)item->cookedTexture.levels.size();
+        uploadCookedLevel(item->cookedTexture, level);
+        bytes = item->cookedTexture.levels[level].size;
+
+        // the texture is complete from the base level down at every step
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        finished = level == 0;
+    }
+    else {
+        const BmpImage& image = item->image;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, image.rowAlignment);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, image.format, GL_UNSIGNED_BYTE, image.pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        bytes = (size_t)image.width * image.height * (image.format == GL_BGR ? 3 : 4);
+        finished = true;
+    }
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+        counters.bytesUploaded += bytes;
+        if (finished) {
+            // OpenGL has its own copy now, the mapping and the node can go
+            ready.pop_front();
+            requestPool.destroy(item);
+            counters.uploaded++;
+            if (--outstanding == 0)
+                releaseLoadArenas();
+        }
+    }
+    return true;
+}
+
+int AssetStreamer::uploadPending(double budgetMs) {
+    double start = nowMilliseconds();
+    int levels = 0;
+    while ((levels == 0 || nowMilliseconds() - start < budgetMs) && uploadLevel())
+        levels++;
+
+    if (levels) {
+        lock_guard<mutex> lock(stateMutex);
+        counters.uploadMs += nowMilliseconds() - start;
+    }
+    return levels;
+}
+
+void AssetStreamer::finish() {
+    for (;;) {
+        uploadPending(1e30);
+
+        unique_lock<mutex> lock(stateMutex);
+        if (outstanding == 0)
+            return;
+        loaded.wait(lock, [this]() { return !ready.empty() || outstanding == 0; });
+    }
+}
+
+bool AssetStreamer::busy() const {
+    lock_guard<mutex> lock(stateMutex);
+    return outstanding > 0;
+}
+
+AssetStreamStats AssetStreamer::stats() const {
+    lock_guard<mutex> lock(stateMutex);
+    AssetStreamStats stats = counters;
+    stats.poolPeakBytes = requestPool.stats().peakBytes;
+    return stats;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glut.h>
+#include "arena.h"
+
+/*
+    Asset streaming
+
+    Loading files no longer holds up the first frame. requestTexture() queues a file for
+    a few loader threads, which map and validate it and fault its pages in, so the bytes
+    sit in memory ready to copy (the staging data). The texture object already exists and
+    is drawn with whatever placeholder the caller gave it meanwhile.
+
+    OpenGL calls stay on the thread that owns the context: uploadPending(), called once a
+    frame, moves finished files into their textures and stops starting new uploads once
+    its time budget is spent. Cooked textures go up one mip level at a time from the
+    smallest, with GL_TEXTURE_BASE_LEVEL following, so a large texture sharpens over a few
+    frames instead of stalling one. A BMP is a single level and goes up in one step.
+
+    Each request is a fixed-size node from a pool, so requests recycle their slots instead
+    of going through the heap. A BMP that has to be converted is converted into the
+    loading thread's arena; the arenas are released in one go once nothing is left to
+    upload, instead of every image freeing its own copy.
+*/
+
+// what has been streamed so far, times in milliseconds
+struct AssetStreamStats {
+    int requested;
+    int uploaded;
+    int failed;
+    size_t bytesUploaded;
+    double loadMs; // spent on the loader threads
+    double uploadMs; // spent in uploadPending()
+    long arenaAllocations; // converted images put in the loader arenas
+    size_t arenaPeakBytes; // the most the loader arenas held before a release
+    size_t poolPeakBytes; // the most request nodes alive at once, in bytes
+};
+
+struct StreamedTexture;
+
+class AssetStreamer {
+
+public:
+
+    explicit AssetStreamer(int threads);
+
+    ~AssetStreamer();
+
+    AssetStreamer(const AssetStreamer&) = delete;
+
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    // queues a file whose levels go into the texture once loaded, .ctex files are cooked
+    // textures and anything else is read as a BMP; fallback is tried when path cannot be used.
+    // The loader threads start on the first request
+    void requestTexture(GLuint texture, const std::string& path, const std::string& fallback = "");
+
+    // on the GL thread: uploads loaded files until budgetMs is spent, at least one level per
+    // call so streaming always moves; returns the number of levels uploaded
+    int uploadPending(double budgetMs);
+
+    // on the GL thread: waits for the loaders and uploads everything that is left
+    void finish();
+
+    // true while any request is not uploaded yet
+    bool busy() const;
+
+    AssetStreamStats stats() const;
+
+private:
+
+    void loaderLoop(int index);
+
+    // gives the loader arenas' memory back once everything is uploaded, with stateMutex held
+    void releaseLoadArenas();
+
+    // uploads the next level of the front of the ready queue, false when it is empty
+    bool uploadLevel();
+
+    int threadCount;
+    std::vector<std::thread> loaders;
+    std::vector<std::unique_ptr<LinearArena> > loadArenas; // one per loader, only its loader allocates
+
+    mutable std::mutex stateMutex;
+    std::condition_variable wake; // a request was queued or the streamer is stopping
+    std::condition_variable loaded; // a request moved to the ready queue
+    PoolAllocator<StreamedTexture> requestPool; // the nodes below, used with stateMutex held
+    std::deque<StreamedTexture*> requests;
+    std::deque<StreamedTexture*> ready;
+    int outstanding; // requested but not finished uploading
+    bool stopping;
+    AssetStreamStats counters;
+
+};
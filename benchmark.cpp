@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#include "platform.h"
+#else
+#include <sys/resource.h>
+#endif
+#include <GL/glut.h>
+#include "benchmark.h"
+#include "framestats.h"
+
+using namespace std;
+
+double nowMilliseconds() {
+    return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double processCpuMilliseconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0.0;
+    // 100 ns units
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (double)(k.QuadPart + u.QuadPart) / 1.0e4;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#endif
+}
+
+TimingSummary summarizeTimings(vector<double> timings) {
+    TimingSummary summary = { 0, 0, 0, 0, 0 };
+    if (timings.empty())
+        return summary;
+
+    sort(timings.begin(), timings.end());
+    size_t n = timings.size();
+    double total = 0;
+    for (size_t i = 0; i < n; i++)
+        total += timings[i];
+
+    summary.min = timings[0];
+    summary.max = timings[n - 1];
+    summary.median = (n % 2) ? timings[n / 2] : (timings[n / 2 - 1] + timings[n / 2]) / 2.0;
+    summary.p99 = timings[min(n - 1, (size_t)(0.99 * (n - 1) + 0.5))];
+    summary.mean = total / n;
+    return summary;
+}
+
+bool parseBenchmarkSizes(const string& text, vector<BenchmarkSize>& sizes) {
+    stringstream list(text);
+    string entry;
+
+    while (getline(list, entry, ',')) {
+        BenchmarkSize size;
+        char separator = 0;
+        stringstream parser(entry);
+        if (!(parser >> size.width >> separator >> size.height) || separator != 'x' || size.width <= 0 || size.height <= 0)
+            return false;
+        sizes.push_back(size);
+    }
+    return true;
+}
+
+bool parseBenchmarkCounts(const string& text, vector<int>& counts) {
+    stringstream list(text);
+    string entry;
+
+    while (getline(list, entry, ',')) {
+        int count = 0;
+        stringstream parser(entry);
+        if (!(parser >> count) || count <= 0 || !parser.eof())
+            return false;
+        counts.push_back(count);
+    }
+    return !counts.empty();
+}
+
+bool writeReport(const string& path, const string& json) {
+    if (path.empty()) {
+        cout << json << endl;
+        return true;
+    }
+
+    ofstream file(path.c_str());
+    if (!file) {
+        cerr << "benchmark: cannot write " << path << endl;
+        return false;
+    }
+    file << json << endl;
+    return true;
+}
+
+bool writeScreenshot(const string& path, int width, int height) {
+    vector<unsigned char> pixels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    return writeImage(path, width, height, &pixels[0], 3);
+}
+
+bool writeImage(const string& path, int width, int height, const unsigned char* pixels, int channels) {
+    ofstream file(path.c_str(), ios::binary);
+    if (!file) {
+        cerr << "benchmark: cannot write " << path << endl;
+        return false;
+    }
+
+    // PPM rows go top to bottom, the pixels come bottom up like OpenGL returns them
+    file << "P6\n" << width << " " << height << "\n255\n";
+    vector<unsigned char> row(width * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        const unsigned char* source = pixels + (size_t)y * width * channels;
+        for (int x = 0; x < width; x++)
+            for (int c = 0; c < 3; c++)
+                row[x * 3 + c] = source[x * channels + c];
+        file.write((const char*)&row[0], width * 3);
+    }
+    return true;
+}
+
+bool readImage(const string& path, int& width, int& height, vector<unsigned char>& pixels) {
+    ifstream file(path.c_str(), ios::binary);
+    string magic;
+    int maximum = 0;
+    if (!file || !(file >> magic >> width >> height >> maximum) || magic != "P6" || maximum != 255 || width <= 0 || height <= 0) {
+        cerr << "benchmark: cannot read " << path << " as a binary PPM" << endl;
+        return false;
+    }
+    file.get(); // the single whitespace after the header
+
+    // back to bottom up, the order glReadPixels returns
+    pixels.resize((size_t)width * height * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        if (!file.read((char*)&pixels[(size_t)y * width * 3], width * 3)) {
+            cerr << "benchmark: " << path << " is cut short" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// This function is responsible for timing every frame at every size and reporting the results as JSON
+int runFrameBenchmark(const BenchmarkOptions& options, bool (*resize)(int, int), void (*renderFrame)()) {
+    stringstream json;
+    json << "{\n  \"benchmark\": \"scene\",\n  \"render_path\": \"" << options.renderPath << "\",\n";
+    json << "  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n";
+    if (options.firstFrameMs >= 0) {
+        json << "  \"startup_ms\": { \"first_frame\": " << options.firstFrameMs << ", \"fully_loaded\": " << options.loadedMs << " },\n";
+        json << "  \"load_memory\": { \"arena_allocations\": " << options.loadArenaAllocations << ", \"arena_peak_bytes\": " << options.loadArenaPeakBytes
+            << ", \"pool_peak_bytes\": " << options.loadPoolPeakBytes << " },\n";
+        json << "  \"shader_programs\": { \"compiled\": " << options.programsCompiled << ", \"loaded\": " << options.programsLoaded
+            << ", \"ms\": " << options.programMs << " },\n";
+    }
+    json << "  \"results\": [";
+
+    for (size_t s = 0; s < options.sizes.size(); s++) {
+        const BenchmarkSize& size = options.sizes[s];
+        if (!resize(size.width, size.height)) {
+            cerr << "benchmark: cannot render at " << size.width << "x" << size.height << endl;
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 0; i < options.warmupFrames; i++)
+            renderFrame();
+        glFinish();
+
+        vector<double> timings;
+        timings.reserve(options.frames);
+        long shadowRenders = 0, transformUpdates = 0, arenaPeak = 0;
+        double shadowTime = 0;
+
+        for (int i = 0; i < options.frames; i++) {
+            double start = nowMilliseconds();
+            renderFrame();
+            glFinish(); // wait for the software rasterizer so the time covers the whole frame
+            timings.push_back(nowMilliseconds() - start);
+            shadowRenders += frameStats.shadowMapsRendered;
+            shadowTime += frameStats.shadowMs;
+            transformUpdates += frameStats.transformsUpdated;
+            arenaPeak = max(arenaPeak, frameStats.arenaBytes);
+        }
+
+        if (s == 0 && !options.screenshotPath.empty())
+            writeScreenshot(options.screenshotPath, size.width, size.height);
+
+        // the counters are identical every frame, so the last frame's are reported
+        TimingSummary summary = summarizeTimings(timings);
+
+        json << (s ? "," : "") << "\n    {\n";
+        json << "      \"width\": " << size.width << ",\n";
+        json << "      \"height\": " << size.height << ",\n";
+        json << "      \"frames\": " << options.frames << ",\n";
+        json << "      \"frame_ms\": { \"min\": " << summary.min << ", \"median\": " << summary.median
+            << ", \"p99\": " << summary.p99 << ", \"mean\": " << summary.mean << ", \"max\": " << summary.max << " },\n";
+        json << "      \"draw_calls\": " << frameStats.drawCalls << ",\n";
+        json << "      \"triangles\": " << frameStats.triangles << ",\n";
+        json << "      \"objects_drawn\": " << frameStats.objectsDrawn << ",\n";
+        json << "      \"objects_culled\": " << frameStats.objectsCulled << ",\n";
+        json << "      \"state_changes\": " << frameStats.stateChanges << ",\n";
+        json << "      \"state_changes_skipped\": " << frameStats.stateChangesSkipped << ",\n";
+        json << "      \"shadow_casters\": " << frameStats.shadowCasters << ",\n";
+        json << "      \"shadow_maps_rendered\": " << shadowRenders << ",\n";
+        json << "      \"shadow_map_ms\": " << (shadowRenders ? shadowTime / shadowRenders : 0.0) << ",\n";
+        json << "      \"transforms_updated\": " << transformUpdates << ",\n";
+        json << "      \"arena_allocations\": " << frameStats.arenaAllocations << ",\n";
+        json << "      \"arena_peak_bytes\": " << arenaPeak << "\n";
+        json << "    }";
+    }
+
+    json << "\n  ]\n}";
+    return writeReport(options.jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
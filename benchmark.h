@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+    Frame-time benchmark harness for the headless mode, plus the timing helpers the
+    other benchmarks share. Results are written as JSON so CI can diff them.
+*/
+
+struct BenchmarkSize {
+    int width;
+    int height;
+};
+
+struct BenchmarkOptions {
+    int frames = 100;
+    int warmupFrames = 5;
+    std::vector<BenchmarkSize> sizes;
+    std::string jsonPath; // empty writes to stdout
+    std::string renderPath; // recorded in the report, e.g. "mesh-cache"
+    std::string screenshotPath; // last frame of the first size as a PPM, empty for none
+    double firstFrameMs = -1; // startup times recorded in the report when set
+    double loadedMs = -1;
+    long loadArenaAllocations = 0; // what loading put in the asset streamer's arenas and pool, with the startup times
+    long loadArenaPeakBytes = 0;
+    long loadPoolPeakBytes = 0;
+    int programsCompiled = 0; // GLSL programs built by then, from source and from cached binaries
+    int programsLoaded = 0;
+    double programMs = 0;
+};
+
+// summary of a series of timings, all in milliseconds
+struct TimingSummary {
+    double min;
+    double median;
+    double p99;
+    double mean;
+    double max;
+};
+
+// monotonic wall clock
+double nowMilliseconds();
+
+// CPU time the process has used on all its threads, user and system
+double processCpuMilliseconds();
+
+TimingSummary summarizeTimings(std::vector<double> timings);
+
+// parses "640x480" or "640x480,1280x720" into sizes, false on a malformed entry
+bool parseBenchmarkSizes(const std::string& text, std::vector<BenchmarkSize>& sizes);
+
+// parses "10,100,1000" into positive counts, false on a malformed entry
+bool parseBenchmarkCounts(const std::string& text, std::vector<int>& counts);
+
+// renders the configured frames at every size and writes the report, returns the process exit code
+int runFrameBenchmark(const BenchmarkOptions& options, bool (*resize)(int, int), void (*renderFrame)());
+
+// reads back the current framebuffer and writes it as a binary PPM
+bool writeScreenshot(const std::string& path, int width, int height);
+
+// writes bottom-up RGB or RGBA pixels (channels 3 or 4) as a binary PPM
+bool writeImage(const std::string& path, int width, int height, const unsigned char* pixels, int channels);
+
+// reads a binary PPM written by writeImage() back into bottom-up RGB pixels, false when it cannot
+bool readImage(const std::string& path, int& width, int& height, std::vector<unsigned char>& pixels);
+
+// writes a report to the path, or stdout when the path is empty
+bool writeReport(const std::string& path, const std::string& json);
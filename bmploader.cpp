@@ -0,0 +1,350 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "platform.h"
+#include "bmploader.h"
+#include "cpufeatures.h"
+#include "benchmark.h"
+
+#ifdef SCENE_X86
+#include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+void convertBGRToRGBAScalar(const unsigned char* source, unsigned char* destination, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        destination[0] = source[2];
+        destination[1] = source[1];
+        destination[2] = source[0];
+        destination[3] = 255;
+        source += 3;
+        destination += 4;
+    }
+}
+
+static void convertBGRAToRGBAScalar(const unsigned char* source, unsigned char* destination, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++) {
+        destination[0] = source[2];
+        destination[1] = source[1];
+        destination[2] = source[0];
+        destination[3] = source[3];
+        source += 4;
+        destination += 4;
+    }
+}
+
+#ifdef SCENE_X86
+
+// 16 pixels per iteration: four 16 byte loads at 12 byte steps each hold four whole BGR pixels,
+// one shuffle spreads them to RGBA and the alpha bytes are or'ed in
+// returns how many pixels were converted, the rest is left for the scalar loop
+SIMD_TARGET("ssse3")
+static size_t convertBGRToRGBASSSE3(const unsigned char* source, unsigned char* destination, size_t pixelCount) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    size_t i = 0;
+
+    // the last load of a block reads 4 bytes past its 48, so keep two pixels of slack
+    for (; i + 18 <= pixelCount; i += 16) {
+        const unsigned char* s = source + i * 3;
+        __m128i* d = (__m128i*)(destination + i * 4);
+
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(s + 0));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(s + 12));
+        __m128i p2 = _mm_loadu_si128((const __m128i*)(s + 24));
+        __m128i p3 = _mm_loadu_si128((const __m128i*)(s + 36));
+
+        _mm_storeu_si128(d + 0, _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), alpha));
+    }
+    return i;
+}
+
+SIMD_TARGET("ssse3")
+static size_t convertBGRAToRGBASSSE3(const unsigned char* source, unsigned char* destination, size_t pixelCount) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(source + i * 4));
+        _mm_storeu_si128((__m128i*)(destination + i * 4), _mm_shuffle_epi8(p, shuffle));
+    }
+    return i;
+}
+
+#endif
+
+void convertBGRToRGBA(const unsigned char* source, unsigned char* destination, size_t pixelCount) {
+    size_t done = 0;
+#ifdef SCENE_X86
+    if (cpuHasSSSE3())
+        done = convertBGRToRGBASSSE3(source, destination, pixelCount);
+#endif
+    convertBGRToRGBAScalar(source + done * 3, destination + done * 4, pixelCount - done);
+}
+
+void convertBGRAToRGBA(const unsigned char* source, unsigned char* destination, size_t pixelCount) {
+    size_t done = 0;
+#ifdef SCENE_X86
+    if (cpuHasSSSE3())
+        done = convertBGRAToRGBASSSE3(source, destination, pixelCount);
+#endif
+    convertBGRAToRGBAScalar(source + done * 4, destination + done * 4, pixelCount - done);
+}
+
+static bool fail(const char* filename, const char* reason) {
+    cerr << filename << ": " << reason << endl;
+    return false;
+}
+
+static unsigned int readU32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// This function is responsible for mapping a BMP file and describing its pixels for glTexImage2D
+bool loadBmp(const char* filename, BmpImage& image, bool forceRGBA, LinearArena* arena) {
+    image = BmpImage();
+
+    if (!mapFile(filename, image.file))
+        return fail(filename, "cannot open");
+
+    const unsigned char* data = image.file.data;
+    size_t size = image.file.size;
+    BITMAPFILEHEADER fileheader;
+    BITMAPINFOHEADER infoheader;
+
+    if (size < sizeof(fileheader) + sizeof(infoheader)) {
+        releaseBmp(image);
+        return fail(filename, "file too small for the BMP headers");
+    }
+    memcpy(&fileheader, data, sizeof(fileheader));
+    memcpy(&infoheader, data + sizeof(fileheader), sizeof(infoheader));
+
+    const char* error = NULL;
+    if (fileheader.bfType != 0x4D42)
+        error = "not a BMP file";
+    else if (infoheader.biSize < sizeof(infoheader))
+        error = "unsupported BMP header";
+    else if (infoheader.biWidth <= 0 || infoheader.biHeight == 0 || infoheader.biPlanes != 1)
+        error = "invalid image dimensions";
+    else if (infoheader.biBitCount != 24 && infoheader.biBitCount != 32)
+        error = "only 24 and 32 bit BMP files are supported";
+    else if (infoheader.biCompression != BI_RGB && !(infoheader.biCompression == BI_BITFIELDS && infoheader.biBitCount == 32))
+        error = "compressed BMP files are not supported";
+
+    // bitfields are only accepted when they describe plain BGRA
+    if (!error && infoheader.biCompression == BI_BITFIELDS) {
+        size_t masks = sizeof(fileheader) + sizeof(infoheader);
+        if (size < masks + 12 || readU32(data + masks) != 0x00FF0000 || readU32(data + masks + 4) != 0x0000FF00 || readU32(data + masks + 8) != 0x000000FF)
+            error = "unsupported BMP channel masks";
+    }
+
+    if (error) {
+        releaseBmp(image);
+        return fail(filename, error);
+    }
+
+    int width = infoheader.biWidth;
+    bool topDown = infoheader.biHeight < 0;
+    int height = topDown ? -infoheader.biHeight : infoheader.biHeight;
+    int bytesPerPixel = infoheader.biBitCount / 8;
+    size_t stride = ((size_t)width * bytesPerPixel + 3) & ~(size_t)3; // rows are padded to 4 bytes
+
+    if (fileheader.bfOffBits > size || stride * height > size - fileheader.bfOffBits) {
+        releaseBmp(image);
+        return fail(filename, "pixel data runs past the end of the file");
+    }
+
+    const unsigned char* pixels = data + fileheader.bfOffBits;
+    image.width = width;
+    image.height = height;
+
+    // bottom-up rows are already in OpenGL order, the padding is what GL_UNPACK_ALIGNMENT 4 expects
+    if (!topDown && !forceRGBA) {
+        image.pixels = pixels;
+        image.format = bytesPerPixel == 3 ? GL_BGR : GL_BGRA;
+        image.rowAlignment = 4;
+        image.zeroCopy = true;
+        return true;
+    }
+
+    unsigned char* converted;
+    if (arena)
+        converted = arena->allocateArray<unsigned char>((size_t)width * height * 4);
+    else {
+        converted = (unsigned char*)malloc((size_t)width * height * 4);
+        if (converted == NULL) {
+            releaseBmp(image);
+            return fail(filename, "out of memory");
+        }
+        image.converted = converted;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char* sourceRow = pixels + stride * (topDown ? height - 1 - y : y);
+        unsigned char* destinationRow = converted + (size_t)width * 4 * y;
+        if (bytesPerPixel == 3)
+            convertBGRToRGBA(sourceRow, destinationRow, width);
+        else
+            convertBGRAToRGBA(sourceRow, destinationRow, width);
+    }
+
+    // the converted copy no longer needs the mapping
+    unmapFile(image.file);
+    image.pixels = converted;
+    image.format = GL_RGBA;
+    image.rowAlignment = 1;
+    image.zeroCopy = false;
+    return true;
+}
+
+void releaseBmp(BmpImage& image) {
+    unmapFile(image.file);
+    free(image.converted);
+    image = BmpImage();
+}
+
+// writes a synthetic 24 bit BMP for the benchmark, negative height for a top-down file
+static bool writeTestBmp(const char* filename, int width, int height) {
+    int rows = height < 0 ? -height : height;
+    size_t stride = ((size_t)width * 3 + 3) & ~(size_t)3;
+    BITMAPFILEHEADER fileheader;
+    BITMAPINFOHEADER infoheader;
+
+    memset(&fileheader, 0, sizeof(fileheader));
+    memset(&infoheader, 0, sizeof(infoheader));
+    fileheader.bfType = 0x4D42;
+    fileheader.bfOffBits = sizeof(fileheader) + sizeof(infoheader);
+    fileheader.bfSize = (unsigned int)(fileheader.bfOffBits + stride * rows);
+    infoheader.biSize = sizeof(infoheader);
+    infoheader.biWidth = width;
+    infoheader.biHeight = height;
+    infoheader.biPlanes = 1;
+    infoheader.biBitCount = 24;
+    infoheader.biCompression = BI_RGB;
+
+    FILE* file;
+    if (fopen_s(&file, filename, "wb") != 0)
+        return false;
+    fwrite(&fileheader, sizeof(fileheader), 1, file);
+    fwrite(&infoheader, sizeof(infoheader), 1, file);
+
+    vector<unsigned char> row(stride, 0);
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < width * 3; x++)
+            row[x] = (unsigned char)(x * 7 + y * 13);
+        fwrite(&row[0], 1, stride, file);
+    }
+    fclose(file);
+    return true;
+}
+
+// the loader makeImage() used to have, one fread per pixel into a malloc'd RGBA buffer
+static unsigned char* legacyLoad(const char* filename, int& width, int& height) {
+    FILE* file;
+    BITMAPFILEHEADER fileheader;
+    BITMAPINFOHEADER infoheader;
+    RGBTRIPLE rgb;
+
+    if (fopen_s(&file, filename, "rb") != 0)
+        return NULL;
+    fread(&fileheader, sizeof(fileheader), 1, file);
+    fread(&infoheader, sizeof(infoheader), 1, file);
+    width = infoheader.biWidth;
+    height = infoheader.biHeight;
+
+    unsigned char* texture = (unsigned char*)malloc((size_t)width * height * 4);
+    memset(texture, 0, (size_t)width * height * 4);
+    for (size_t i = 0, j = 0; i < (size_t)width * height; i++, j += 4) {
+        fread(&rgb, sizeof(rgb), 1, file);
+        texture[j + 0] = rgb.rgbtRed;
+        texture[j + 1] = rgb.rgbtGreen;
+        texture[j + 2] = rgb.rgbtBlue;
+        texture[j + 3] = 255;
+    }
+    fclose(file);
+    return texture;
+}
+
+// runs one variant a few times and returns the best time in milliseconds
+template <typename Load>
+static double bestOf(int runs, Load load) {
+    vector<double> timings;
+    for (int i = 0; i < runs; i++) {
+        double start = nowMilliseconds();
+        load();
+        timings.push_back(nowMilliseconds() - start);
+    }
+    return summarizeTimings(timings).min;
+}
+
+// This function is responsible for comparing the old per-pixel loader with the mapped loader on a large image
+int runBmpBenchmark(int width, int height, const char* jsonPath) {
+    const char* bottomUp = "bench_bottom_up.bmp";
+    const char* topDown = "bench_top_down.bmp";
+    const int runs = 5;
+
+    if (!writeTestBmp(bottomUp, width, height) || !writeTestBmp(topDown, width, -height)) {
+        cerr << "bmp benchmark: cannot write the test images" << endl;
+        return EXIT_FAILURE;
+    }
+
+    double megapixels = (double)width * height / 1e6;
+    vector<unsigned char> source((size_t)width * height * 3 + 64), destination((size_t)width * height * 4);
+    for (size_t i = 0; i < source.size(); i++)
+        source[i] = (unsigned char)i;
+
+    struct Result {
+        const char* name;
+        double ms;
+    };
+    vector<Result> results;
+
+    results.push_back({ "legacy_fread_per_pixel", bestOf(runs, [&]() {
+        int w, h;
+        free(legacyLoad(bottomUp, w, h));
+    }) });
+    results.push_back({ "mapped_zero_copy", bestOf(runs, [&]() {
+        BmpImage image;
+        if (loadBmp(bottomUp, image)) {
+            // touch every page so the time includes reading the file, like an upload would
+            volatile unsigned int sum = 0;
+            for (size_t i = 0; i < image.file.size; i += 4096)
+                sum += image.file.data[i];
+        }
+        releaseBmp(image);
+    }) });
+    results.push_back({ "mapped_convert_rgba", bestOf(runs, [&]() {
+        BmpImage image;
+        loadBmp(bottomUp, image, true);
+        releaseBmp(image);
+    }) });
+    results.push_back({ "mapped_top_down", bestOf(runs, [&]() {
+        BmpImage image;
+        loadBmp(topDown, image);
+        releaseBmp(image);
+    }) });
+    results.push_back({ "convert_scalar_in_memory", bestOf(runs, [&]() {
+        convertBGRToRGBAScalar(&source[0], &destination[0], (size_t)width * height);
+    }) });
+    results.push_back({ "convert_simd_in_memory", bestOf(runs, [&]() {
+        convertBGRToRGBA(&source[0], &destination[0], (size_t)width * height);
+    }) });
+
+    remove(bottomUp);
+    remove(topDown);
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"bmp_loader\",\n  \"width\": " << width << ",\n  \"height\": " << height
+        << ",\n  \"megapixels\": " << megapixels << ",\n  \"ssse3\": " << (cpuHasSSSE3() ? "true" : "false") << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        json << (i ? "," : "") << "\n    { \"name\": \"" << results[i].name << "\", \"best_ms\": " << results[i].ms
+            << ", \"megapixels_per_s\": " << megapixels / (results[i].ms / 1000.0) << " }";
+    }
+    json << "\n  ]\n}";
+
+    return writeReport(jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
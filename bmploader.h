@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <GL/glut.h>
+#include "mappedfile.h"
+#include "arena.h"
+
+/*
+    Memory-mapped BMP loader.
+
+    The file is mapped instead of read, the headers are validated against the file size,
+    and the pixels are handed out in the layout glTexImage2D wants (bottom row first).
+    An uncompressed bottom-up 24 or 32 bit file already is that layout once the BGR(A)
+    order and the 4 byte row padding are described to OpenGL, so it is passed through as
+    a view into the mapping without touching a single pixel. Everything else (top-down
+    files, or callers that ask for RGBA) is converted to tightly packed RGBA in one pass.
+*/
+
+#ifndef GL_BGR
+#define GL_BGR 0x80E0
+#endif
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+
+struct BmpImage {
+    int width = 0;
+    int height = 0;
+    const unsigned char* pixels = NULL; // bottom row first
+    GLenum format = GL_RGBA; // GL_BGR, GL_BGRA or GL_RGBA
+    int rowAlignment = 1; // value for GL_UNPACK_ALIGNMENT
+    bool zeroCopy = false; // pixels point into the mapped file
+
+    MappedFile file;
+    unsigned char* converted = NULL; // malloc'd pixels, NULL when there are none or an arena owns them
+};
+
+// maps and validates the file, forceRGBA converts even when a zero-copy view is possible;
+// converted pixels come from arena when it is given and stay valid until it is reset
+bool loadBmp(const char* filename, BmpImage& image, bool forceRGBA = false, LinearArena* arena = NULL);
+
+// unmaps the file and frees any converted pixels that did not come from an arena
+void releaseBmp(BmpImage& image);
+
+// converts packed BGR (24 bit) or BGRA (32 bit) pixels to RGBA with alpha 255
+void convertBGRToRGBA(const unsigned char* source, unsigned char* destination, size_t pixelCount);
+void convertBGRAToRGBA(const unsigned char* source, unsigned char* destination, size_t pixelCount);
+
+// scalar version of convertBGRToRGBA, kept for the benchmark
+void convertBGRToRGBAScalar(const unsigned char* source, unsigned char* destination, size_t pixelCount);
+
+// loader throughput on a generated image of the given size, writes JSON like the frame benchmark
+// (to stdout when jsonPath is empty)
+int runBmpBenchmark(int width, int height, const char* jsonPath);
@@ -0,0 +1,498 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "bvh.h"
+
+using namespace std;
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 8
+#define BVH_STACK 128 // build() stops splitting at depth BVH_STACK - 1, so a traversal never needs more
+#define BVH_TRAVERSAL_COST 1.0f // of visiting a node, relative to one triangle test
+
+// a box as low[3] and high[3] side by side
+struct BvhBox {
+    GLfloat low[3] = { 1e30f, 1e30f, 1e30f };
+    GLfloat high[3] = { -1e30f, -1e30f, -1e30f };
+
+    void grow(const GLfloat* boxLow, const GLfloat* boxHigh) {
+        for (int k = 0; k < 3; k++) {
+            low[k] = min(low[k], boxLow[k]);
+            high[k] = max(high[k], boxHigh[k]);
+        }
+    }
+
+    GLfloat area() const {
+        GLfloat x = high[0] - low[0], y = high[1] - low[1], z = high[2] - low[2];
+        return x < 0.0f ? 0.0f : 2.0f * (x * y + y * z + z * x);
+    }
+};
+
+static void cornerBounds(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3], GLfloat low[3], GLfloat high[3]) {
+    for (int k = 0; k < 3; k++) {
+        low[k] = min(a[k], min(b[k], c[k]));
+        high[k] = max(a[k], max(b[k], c[k]));
+    }
+}
+
+
+
+// building
+
+void Bvh::clear() {
+    tree.clear();
+    data.clear();
+    masks.clear();
+    order.clear();
+    slots.clear();
+}
+
+int Bvh::addTriangle(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3], uint32_t mask) {
+    int index = (int)order.size();
+    Triangle triangle;
+    for (int k = 0; k < 3; k++) {
+        triangle.vertex[k] = a[k];
+        triangle.edge1[k] = b[k] - a[k];
+        triangle.edge2[k] = c[k] - a[k];
+    }
+    data.push_back(triangle);
+    masks.push_back(mask);
+    order.push_back(index);
+    slots.push_back(index);
+    tree.clear(); // needs build() again
+    return index;
+}
+
+// This function is responsible for splitting slots [first, first + count) where the binned surface area heuristic is lowest
+int Bvh::buildNode(int first, int count, int depth, vector<GLfloat>& bounds, vector<GLfloat>& centroids) {
+    int index = (int)tree.size();
+    tree.push_back(Node());
+
+    BvhBox box, centroidBox;
+    for (int i = first; i < first + count; i++) {
+        box.grow(&bounds[i * 6], &bounds[i * 6 + 3]);
+        centroidBox.grow(&centroids[i * 3], &centroids[i * 3]);
+    }
+    memcpy(tree[index].low, box.low, sizeof(box.low));
+    memcpy(tree[index].high, box.high, sizeof(box.high));
+    tree[index].offset = first;
+    tree[index].count = count;
+
+    // a node this deep stays a leaf however many triangles it has, the traversal stacks have room for no more
+    if (count <= 2 || depth >= BVH_STACK - 1)
+        return index;
+
+    // the best plane over all axes, between bins of the centroid box
+    GLfloat bestCost = 1e30f;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        GLfloat extent = centroidBox.high[axis] - centroidBox.low[axis];
+        if (extent <= 0.0f)
+            continue;
+        GLfloat scale = BVH_BINS / extent;
+
+        BvhBox bins[BVH_BINS];
+        int binCounts[BVH_BINS] = { 0 };
+        for (int i = first; i < first + count; i++) {
+            int bin = min((int)((centroids[i * 3 + axis] - centroidBox.low[axis]) * scale), BVH_BINS - 1);
+            bins[bin].grow(&bounds[i * 6], &bounds[i * 6 + 3]);
+            binCounts[bin]++;
+        }
+
+        // areas and counts left of every plane, then swept from the right
+        GLfloat leftArea[BVH_BINS - 1];
+        int leftCount[BVH_BINS - 1];
+        BvhBox sweep;
+        int total = 0;
+        for (int i = 0; i < BVH_BINS - 1; i++) {
+            sweep.grow(bins[i].low, bins[i].high);
+            total += binCounts[i];
+            leftArea[i] = sweep.area();
+            leftCount[i] = total;
+        }
+
+        sweep = BvhBox();
+        total = 0;
+        for (int i = BVH_BINS - 1; i > 0; i--) {
+            sweep.grow(bins[i].low, bins[i].high);
+            total += binCounts[i];
+            if (leftCount[i - 1] == 0 || total == 0)
+                continue;
+            GLfloat cost = leftArea[i - 1] * leftCount[i - 1] + sweep.area() * total;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = i;
+            }
+        }
+    }
+
+    // a leaf is cheaper than any split, or no split separates the centroids
+    GLfloat leafCost = box.area() * count;
+    bestCost = BVH_TRAVERSAL_COST * box.area() + bestCost;
+    if (bestAxis < 0 || (bestCost >= leafCost && count <= BVH_MAX_LEAF))
+        return index;
+
+    // partition the slots, with their bounds and centroids, around the plane
+    GLfloat scale = BVH_BINS / (centroidBox.high[bestAxis] - centroidBox.low[bestAxis]);
+    int middle = first;
+    for (int i = first; i < first + count; i++) {
+        int bin = min((int)((centroids[i * 3 + bestAxis] - centroidBox.low[bestAxis]) * scale), BVH_BINS - 1);
+        if (bin >= bestBin)
+            continue;
+        swap(data[i], data[middle]);
+        swap(masks[i], masks[middle]);
+        swap(order[i], order[middle]);
+        swap_ranges(&bounds[i * 6], &bounds[i * 6 + 6], &bounds[middle * 6]);
+        swap_ranges(&centroids[i * 3], &centroids[i * 3 + 3], &centroids[middle * 3]);
+        middle++;
+    }
+
+    buildNode(first, middle - first, depth + 1, bounds, centroids);
+    int second = buildNode(middle, first + count - middle, depth + 1, bounds, centroids);
+    tree[index].offset = second;
+    tree[index].count = 0;
+    return index;
+}
+
+void Bvh::build() {
+    int count = (int)data.size();
+    tree.clear();
+    if (count == 0)
+        return;
+
+    vector<GLfloat> bounds(count * 6);
+    vector<GLfloat> centroids(count * 3);
+    for (int i = 0; i < count; i++) {
+        const Triangle& triangle = data[i];
+        GLfloat b[3], c[3];
+        for (int k = 0; k < 3; k++) {
+            b[k] = triangle.vertex[k] + triangle.edge1[k];
+            c[k] = triangle.vertex[k] + triangle.edge2[k];
+        }
+        cornerBounds(triangle.vertex, b, c, &bounds[i * 6], &bounds[i * 6 + 3]);
+        for (int k = 0; k < 3; k++)
+            centroids[i * 3 + k] = (bounds[i * 6 + k] + bounds[i * 6 + 3 + k]) * 0.5f;
+    }
+
+    tree.reserve(count / 2 + 1);
+    buildNode(0, count, 0, bounds, centroids);
+
+    for (int i = 0; i < count; i++)
+        slots[order[i]] = i;
+}
+
+void Bvh::updateTriangle(int triangle, const GLfloat a[3], const GLfloat b[3], const GLfloat c[3]) {
+    Triangle& slot = data[slots[triangle]];
+    for (int k = 0; k < 3; k++) {
+        slot.vertex[k] = a[k];
+        slot.edge1[k] = b[k] - a[k];
+        slot.edge2[k] = c[k] - a[k];
+    }
+}
+
+// This function is responsible for recomputing every box from the current triangles, children first
+void Bvh::refit() {
+    // children always follow their parent in the array, so walking it backwards visits them first
+    for (int i = (int)tree.size() - 1; i >= 0; i--) {
+        Node& node = tree[i];
+        BvhBox box;
+
+        if (node.count > 0) {
+            for (int t = node.offset; t < node.offset + node.count; t++) {
+                const Triangle& triangle = data[t];
+                GLfloat b[3], c[3], low[3], high[3];
+                for (int k = 0; k < 3; k++) {
+                    b[k] = triangle.vertex[k] + triangle.edge1[k];
+                    c[k] = triangle.vertex[k] + triangle.edge2[k];
+                }
+                cornerBounds(triangle.vertex, b, c, low, high);
+                box.grow(low, high);
+            }
+        } else {
+            box.grow(tree[i + 1].low, tree[i + 1].high);
+            box.grow(tree[node.offset].low, tree[node.offset].high);
+        }
+
+        memcpy(node.low, box.low, sizeof(box.low));
+        memcpy(node.high, box.high, sizeof(box.high));
+    }
+}
+
+GLfloat Bvh::cost() const {
+    if (tree.empty())
+        return 0.0f;
+
+    GLfloat sum = 0.0f;
+    for (size_t i = 0; i < tree.size(); i++) {
+        BvhBox box;
+        box.grow(tree[i].low, tree[i].high);
+        sum += tree[i].count > 0 ? box.area() * tree[i].count : box.area() * BVH_TRAVERSAL_COST;
+    }
+    BvhBox root;
+    root.grow(tree[0].low, tree[0].high);
+    return root.area() > 0.0f ? sum / root.area() : 0.0f;
+}
+
+
+
+// queries
+
+// Moller-Trumbore, both sides of the triangle are hit
+static inline bool intersectTriangle(const GLfloat vertex[3], const GLfloat e1[3], const GLfloat e2[3], const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, GLfloat& t, GLfloat& u, GLfloat& v) {
+    GLfloat p[3] = {
+        direction[1] * e2[2] - direction[2] * e2[1],
+        direction[2] * e2[0] - direction[0] * e2[2],
+        direction[0] * e2[1] - direction[1] * e2[0]
+    };
+    GLfloat determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (fabsf(determinant) < 1e-12f)
+        return false;
+    GLfloat inverse = 1.0f / determinant;
+
+    GLfloat s[3] = { origin[0] - vertex[0], origin[1] - vertex[1], origin[2] - vertex[2] };
+    u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    GLfloat q[3] = {
+        s[1] * e1[2] - s[2] * e1[1],
+        s[2] * e1[0] - s[0] * e1[2],
+        s[0] * e1[1] - s[1] * e1[0]
+    };
+    v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+    return t > 1e-4f && t < tMax;
+}
+
+// distance along the ray where it enters the box, negative when it misses before tMax
+static inline GLfloat enterBox(const GLfloat low[3], const GLfloat high[3], const GLfloat origin[3], const GLfloat inverseDirection[3], GLfloat tMax) {
+    GLfloat tNear = 0.0f;
+    GLfloat tFar = tMax;
+    for (int k = 0; k < 3; k++) {
+        GLfloat t0 = (low[k] - origin[k]) * inverseDirection[k];
+        GLfloat t1 = (high[k] - origin[k]) * inverseDirection[k];
+        if (t0 > t1)
+            swap(t0, t1);
+        tNear = max(tNear, t0);
+        tFar = min(tFar, t1);
+        if (tNear > tFar)
+            return -1.0f;
+    }
+    return tNear;
+}
+
+// This function is responsible for the ray traversal, visiting the child the ray enters first before the other
+bool Bvh::traverse(const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, bool anyHit, uint32_t mask, BvhHit& hit) const {
+    hit.triangle = -1;
+    hit.t = tMax;
+    if (tree.empty())
+        return false;
+
+    GLfloat inverseDirection[3];
+    for (int k = 0; k < 3; k++)
+        inverseDirection[k] = direction[k] != 0.0f ? 1.0f / direction[k] : 1e30f;
+    if (enterBox(tree[0].low, tree[0].high, origin, inverseDirection, tMax) < 0.0f)
+        return false;
+
+    int stack[BVH_STACK];
+    int depth = 0;
+    int current = 0;
+
+    for (;;) {
+        const Node& node = tree[current];
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                if (!(masks[i] & mask))
+                    continue;
+                const Triangle& triangle = data[i];
+                GLfloat t, u, v;
+                if (!intersectTriangle(triangle.vertex, triangle.edge1, triangle.edge2, origin, direction, hit.t, t, u, v))
+                    continue;
+                hit.t = t;
+                hit.u = u;
+                hit.v = v;
+                hit.triangle = order[i];
+                if (anyHit)
+                    return true;
+            }
+        } else {
+            int nearChild = current + 1;
+            int farChild = node.offset;
+            GLfloat tNear = enterBox(tree[nearChild].low, tree[nearChild].high, origin, inverseDirection, hit.t);
+            GLfloat tFar = enterBox(tree[farChild].low, tree[farChild].high, origin, inverseDirection, hit.t);
+            if (tFar >= 0.0f && (tNear < 0.0f || tFar < tNear)) {
+                swap(nearChild, farChild);
+                swap(tNear, tFar);
+            }
+
+            if (tNear >= 0.0f) {
+                if (tFar >= 0.0f)
+                    stack[depth++] = farChild;
+                current = nearChild;
+                continue;
+            }
+        }
+
+        // the next node that is still in front of the nearest hit
+        bool found = false;
+        while (depth > 0 && !found) {
+            current = stack[--depth];
+            found = enterBox(tree[current].low, tree[current].high, origin, inverseDirection, hit.t) >= 0.0f;
+        }
+        if (!found)
+            break;
+    }
+    return hit.triangle >= 0;
+}
+
+bool Bvh::raycast(const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, BvhHit& hit, uint32_t mask) const {
+    return traverse(origin, direction, tMax, false, mask, hit);
+}
+
+bool Bvh::occluded(const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, uint32_t mask) const {
+    BvhHit hit;
+    return traverse(origin, direction, tMax, true, mask, hit);
+}
+
+static inline bool boxesOverlap(const GLfloat lowA[3], const GLfloat highA[3], const GLfloat lowB[3], const GLfloat highB[3]) {
+    return lowA[0] <= highB[0] && highA[0] >= lowB[0]
+        && lowA[1] <= highB[1] && highA[1] >= lowB[1]
+        && lowA[2] <= highB[2] && highA[2] >= lowB[2];
+}
+
+void Bvh::overlap(const GLfloat low[3], const GLfloat high[3], vector<int>& triangles) const {
+    if (tree.empty())
+        return;
+
+    int stack[BVH_STACK];
+    int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree[stack[--depth]];
+        if (!boxesOverlap(node.low, node.high, low, high))
+            continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                const Triangle& triangle = data[i];
+                GLfloat b[3], c[3], triangleLow[3], triangleHigh[3];
+                for (int k = 0; k < 3; k++) {
+                    b[k] = triangle.vertex[k] + triangle.edge1[k];
+                    c[k] = triangle.vertex[k] + triangle.edge2[k];
+                }
+                cornerBounds(triangle.vertex, b, c, triangleLow, triangleHigh);
+                if (boxesOverlap(triangleLow, triangleHigh, low, high))
+                    triangles.push_back(order[i]);
+            }
+        } else {
+            stack[depth++] = node.offset;
+            stack[depth++] = (int)(&node - &tree[0]) + 1;
+        }
+    }
+}
+
+// squared distance from a point to a box, 0 inside
+static inline GLfloat boxDistanceSquared(const GLfloat low[3], const GLfloat high[3], const GLfloat point[3]) {
+    GLfloat sum = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        GLfloat d = max(max(low[k] - point[k], 0.0f), point[k] - high[k]);
+        sum += d * d;
+    }
+    return sum;
+}
+
+// This function is responsible for the closest point on a triangle (Ericson, Real-Time Collision Detection 5.1.5)
+static void closestPointOnTriangle(const GLfloat p[3], const GLfloat a[3], const GLfloat ab[3], const GLfloat ac[3], GLfloat out[3]) {
+    GLfloat ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    GLfloat d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+    GLfloat d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+    GLfloat s = 0.0f, t = 0.0f;
+
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        // vertex a
+    } else {
+        GLfloat bp[3] = { ap[0] - ab[0], ap[1] - ab[1], ap[2] - ab[2] };
+        GLfloat d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+        GLfloat d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+        GLfloat cp[3] = { ap[0] - ac[0], ap[1] - ac[1], ap[2] - ac[2] };
+        GLfloat d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+        GLfloat d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+        GLfloat vc = d1 * d4 - d3 * d2;
+        GLfloat vb = d5 * d2 - d1 * d6;
+        GLfloat va = d3 * d6 - d5 * d4;
+
+        if (d3 >= 0.0f && d4 <= d3)
+            s = 1.0f; // vertex b
+        else if (d6 >= 0.0f && d5 <= d6)
+            t = 1.0f; // vertex c
+        else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            s = d1 / (d1 - d3); // edge ab
+        else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            t = d2 / (d2 - d6); // edge ac
+        else if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+            t = (d4 - d3) / ((d4 - d3) + (d5 - d6)); // edge bc
+            s = 1.0f - t;
+        } else {
+            GLfloat denominator = 1.0f / (va + vb + vc); // inside the face
+            s = vb * denominator;
+            t = vc * denominator;
+        }
+    }
+
+    for (int k = 0; k < 3; k++)
+        out[k] = a[k] + ab[k] * s + ac[k] * t;
+}
+
+// This function is responsible for the nearest-point search, pruning every node farther than the best point so far
+bool Bvh::nearest(const GLfloat point[3], GLfloat maxDistance, BvhNearest& result) const {
+    result.triangle = -1;
+    if (tree.empty())
+        return false;
+
+    GLfloat best = maxDistance * maxDistance;
+    int stack[BVH_STACK];
+    int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree[stack[--depth]];
+        if (boxDistanceSquared(node.low, node.high, point) > best)
+            continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                const Triangle& triangle = data[i];
+                GLfloat closest[3];
+                closestPointOnTriangle(point, triangle.vertex, triangle.edge1, triangle.edge2, closest);
+                GLfloat dx = closest[0] - point[0], dy = closest[1] - point[1], dz = closest[2] - point[2];
+                GLfloat distance = dx * dx + dy * dy + dz * dz;
+                if (distance <= best) {
+                    best = distance;
+                    memcpy(result.point, closest, sizeof(closest));
+                    result.triangle = order[i];
+                }
+            }
+            continue;
+        }
+
+        // the closer child is popped first
+        int first = (int)(&node - &tree[0]) + 1;
+        int second = node.offset;
+        if (boxDistanceSquared(tree[first].low, tree[first].high, point) > boxDistanceSquared(tree[second].low, tree[second].high, point))
+            swap(first, second);
+        stack[depth++] = second;
+        stack[depth++] = first;
+    }
+
+    if (result.triangle < 0)
+        return false;
+    result.distance = sqrtf(best);
+    return true;
+}
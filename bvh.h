@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <GL/glut.h>
+
+/*
+    Bounding volume hierarchy over triangles
+
+    The spatial index for hit tests against the scene: mouse picking, the ray-traced mode,
+    collision and proximity queries. Triangles are added in any order and keep the index
+    addTriangle() returned; build() sorts them into leaf order behind the scenes.
+
+    The tree is built top-down with the surface area heuristic, evaluated over 16 centroid
+    bins per axis, and stored depth first in one array of 32-byte nodes, so an inner
+    node's first child is the next node and a traversal walks memory mostly forwards.
+    Splitting stops 127 levels down, whatever the heuristic would prefer, so the queries
+    walk the tree with a fixed stack; odd geometry gets a large leaf instead of a deeper tree.
+    When triangles move, updateTriangle() followed by refit() recomputes the boxes bottom
+    up without rebuilding; the tree stays valid but gets looser as the geometry drifts
+    from where it was built, so build() again after large changes.
+
+    Every triangle carries a mask and each ray query only sees triangles whose mask shares
+    a bit with the query's, so for example the background can be left out of shadow rays.
+*/
+
+#define BVH_ALL 0xffffffffu
+
+struct BvhHit {
+    GLfloat t;
+    GLfloat u; // barycentric weights of the second and third vertex
+    GLfloat v;
+    int triangle;
+};
+
+struct BvhNearest {
+    GLfloat point[3];
+    GLfloat distance;
+    int triangle;
+};
+
+class Bvh {
+
+public:
+
+    void clear();
+
+    // returns the index the queries report for this triangle
+    int addTriangle(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3], uint32_t mask = BVH_ALL);
+
+    void build();
+
+    // moves a triangle, refit() must follow before the next query
+    void updateTriangle(int triangle, const GLfloat a[3], const GLfloat b[3], const GLfloat c[3]);
+
+    void refit();
+
+
+
+    // queries, all in the space the triangles were given in
+
+    // nearest hit along the ray closer than tMax, both sides of a triangle count
+    bool raycast(const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, BvhHit& hit, uint32_t mask = BVH_ALL) const;
+
+    // true as soon as any triangle is hit closer than tMax, for shadow and line-of-sight tests
+    bool occluded(const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, uint32_t mask = BVH_ALL) const;
+
+    // appends every triangle whose bounding box overlaps the box
+    void overlap(const GLfloat low[3], const GLfloat high[3], std::vector<int>& triangles) const;
+
+    // closest point on any triangle within maxDistance, false when there is none
+    bool nearest(const GLfloat point[3], GLfloat maxDistance, BvhNearest& nearest) const;
+
+
+
+    int triangles() const { return (int)order.size(); }
+
+    int nodes() const { return (int)tree.size(); }
+
+    // the sum of node areas the heuristic minimizes, relative to the root; lower is a better tree
+    GLfloat cost() const;
+
+private:
+
+    struct Node {
+        GLfloat low[3];
+        int offset; // first triangle of a leaf, second child of an inner node
+        GLfloat high[3];
+        int count; // triangles of a leaf, 0 for inner nodes
+    };
+
+    // the part intersection tests read, vertex and two edges
+    struct Triangle {
+        GLfloat vertex[3];
+        GLfloat edge1[3];
+        GLfloat edge2[3];
+    };
+
+    int buildNode(int first, int count, int depth, std::vector<GLfloat>& bounds, std::vector<GLfloat>& centroids);
+
+    bool traverse(const GLfloat origin[3], const GLfloat direction[3], GLfloat tMax, bool anyHit, uint32_t mask, BvhHit& hit) const;
+
+    std::vector<Node> tree;
+    std::vector<Triangle> data; // in leaf order after build()
+    std::vector<uint32_t> masks; // in leaf order
+    std::vector<int> order; // the triangle index of each slot
+    std::vector<int> slots; // the slot of each triangle index
+
+};
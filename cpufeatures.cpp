@@ -0,0 +1,79 @@
+#include "cpufeatures.h"
+
+#ifdef SCENE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+struct CpuFeatures {
+    bool ssse3;
+    bool sse41;
+    bool avx2;
+};
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+#if defined(SCENE_X86) && defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = (unsigned int)r[i];
+#elif defined(SCENE_X86)
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+// reads the feature bits once, the OS must also save the AVX registers for AVX2 to be usable
+static CpuFeatures detect() {
+    CpuFeatures features = { false, false, false };
+    unsigned int regs[4];
+
+    cpuid(0, 0, regs);
+    unsigned int maxLeaf = regs[0];
+    if (maxLeaf < 1)
+        return features;
+
+    cpuid(1, 0, regs);
+    features.ssse3 = (regs[2] & (1u << 9)) != 0;
+    features.sse41 = (regs[2] & (1u << 19)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+
+    if (osxsave && avx && maxLeaf >= 7) {
+#if defined(SCENE_X86) && defined(_MSC_VER)
+        unsigned long long xcr0 = _xgetbv(0);
+#elif defined(SCENE_X86)
+        unsigned int eax, edx;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#else
+        unsigned long long xcr0 = 0;
+#endif
+        if ((xcr0 & 6) == 6) {
+            cpuid(7, 0, regs);
+            features.avx2 = (regs[1] & (1u << 5)) != 0;
+        }
+    }
+    return features;
+}
+
+static const CpuFeatures& features() {
+    static CpuFeatures cached = detect();
+    return cached;
+}
+
+bool cpuHasSSSE3() {
+    return features().ssse3;
+}
+
+bool cpuHasSSE41() {
+    return features().sse41;
+}
+
+bool cpuHasAVX2() {
+    return features().avx2;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+    Runtime CPU feature checks for the SIMD code paths.
+
+    MSVC lets any function use SSE/AVX intrinsics, GCC and Clang need the function to be
+    compiled for that instruction set, which SIMD_TARGET does. The caller must check the
+    matching cpuHas* function before calling such a function.
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SCENE_X86 1
+#endif
+
+#if defined(SCENE_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+bool cpuHasSSSE3();
+bool cpuHasSSE41();
+bool cpuHasAVX2();
@@ -0,0 +1,71 @@
+#include <math.h>
+#include "culling.h"
+
+// This function is responsible for taking the six clip planes out of the combined matrix
+void extractFrustum(const GLfloat projection[16], const GLfloat modelview[16], Frustum& frustum) {
+    GLfloat clip[16];
+
+    // clip = projection * modelview, column-major
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            GLfloat sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += projection[k * 4 + row] * modelview[col * 4 + k];
+            clip[col * 4 + row] = sum;
+        }
+    }
+
+    // row i of the matrix is clip[i], clip[4 + i], clip[8 + i], clip[12 + i]
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 4; k++) {
+            GLfloat w = clip[k * 4 + 3];
+            GLfloat r = clip[k * 4 + i];
+            frustum.planes[i * 2][k] = w + r; // left, bottom, near
+            frustum.planes[i * 2 + 1][k] = w - r; // right, top, far
+        }
+    }
+
+    for (int p = 0; p < 6; p++) {
+        GLfloat* plane = frustum.planes[p];
+        GLfloat length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for (int k = 0; k < 4; k++)
+            plane[k] /= length;
+    }
+}
+
+void extractFrustumFromGL(Frustum& frustum) {
+    GLfloat projection[16], modelview[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    extractFrustum(projection, modelview, frustum);
+}
+
+bool sphereInFrustum(const Frustum& frustum, const GLfloat center[3], GLfloat radius, bool* contained) {
+    bool inside = true;
+
+    for (int p = 0; p < 6; p++) {
+        const GLfloat* plane = frustum.planes[p];
+        GLfloat distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+        if (distance < -radius)
+            return false;
+        if (distance < radius)
+            inside = false;
+    }
+
+    if (contained)
+        *contained = inside;
+    return true;
+}
+
+// only the corner furthest along each plane normal needs testing
+bool boxInFrustum(const Frustum& frustum, const GLfloat low[3], const GLfloat high[3]) {
+    for (int p = 0; p < 6; p++) {
+        const GLfloat* plane = frustum.planes[p];
+        GLfloat x = plane[0] >= 0.0f ? high[0] : low[0];
+        GLfloat y = plane[1] >= 0.0f ? high[1] : low[1];
+        GLfloat z = plane[2] >= 0.0f ? high[2] : low[2];
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <GL/glut.h>
+
+/*
+    View-frustum culling.
+
+    The six planes are pulled out of projection * modelview (Gribb/Hartmann), so they are in
+    whatever space the modelview maps from; with the matrix right after gluLookAt that is
+    world space. Planes point inwards and are normalized, so plane . point is a distance.
+*/
+
+struct Frustum {
+    GLfloat planes[6][4];
+};
+
+// builds the frustum from column-major OpenGL matrices
+void extractFrustum(const GLfloat projection[16], const GLfloat modelview[16], Frustum& frustum);
+
+// reads both matrices back from OpenGL and builds the frustum
+void extractFrustumFromGL(Frustum& frustum);
+
+// false when the sphere is completely outside, sets *contained when it is completely inside
+bool sphereInFrustum(const Frustum& frustum, const GLfloat center[3], GLfloat radius, bool* contained);
+
+// false when the box is completely outside
+bool boxInFrustum(const Frustum& frustum, const GLfloat low[3], const GLfloat high[3]);
@@ -0,0 +1,18 @@
+#include "framestats.h"
+
+FrameStats frameStats = { 0, 0, 0, 0, 0, 0, 0, 0, 0.0, 0, 0, 0 };
+
+void resetFrameStats() {
+    frameStats.drawCalls = 0;
+    frameStats.triangles = 0;
+    frameStats.objectsDrawn = 0;
+    frameStats.objectsCulled = 0;
+    frameStats.stateChanges = 0;
+    frameStats.stateChangesSkipped = 0;
+    frameStats.shadowCasters = 0;
+    frameStats.shadowMapsRendered = 0;
+    frameStats.shadowMs = 0.0;
+    frameStats.transformsUpdated = 0;
+    frameStats.arenaAllocations = 0;
+    frameStats.arenaBytes = 0;
+}
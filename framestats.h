@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+    Cheap per-frame counters, always compiled in. They are reset at the start of every
+    frame and read back by the benchmark harness.
+*/
+
+struct FrameStats {
+    long drawCalls;
+    long triangles;
+    long objectsDrawn;
+    long objectsCulled;
+    long stateChanges; // material, texture and enable changes issued through the tracker
+    long stateChangesSkipped; // the ones it found redundant
+    long shadowCasters; // casters listed for all shadow maps
+    long shadowMapsRendered; // maps that were out of date, 0 when the cached ones were reused
+    double shadowMs; // rendering those maps, GPU included
+    long transformsUpdated; // world matrices recomputed, 0 when nothing moved
+    long arenaAllocations; // taken from the frame arena
+    long arenaBytes; // the frame arena held when the frame ended
+};
+
+extern FrameStats frameStats;
+
+void resetFrameStats();
+
+// records a single draw call of the given number of triangles
+inline void countDraw(long triangles) {
+    frameStats.drawCalls++;
+    frameStats.triangles += triangles;
+}
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include <GL/freeglut.h>
+#include "glloader.h"
+
+GenBuffersProc pglGenBuffers = NULL;
+DeleteBuffersProc pglDeleteBuffers = NULL;
+BindBufferProc pglBindBuffer = NULL;
+BufferDataProc pglBufferData = NULL;
+
+CreateShaderProc pglCreateShader = NULL;
+ShaderSourceProc pglShaderSource = NULL;
+CompileShaderProc pglCompileShader = NULL;
+GetShaderivProc pglGetShaderiv = NULL;
+GetShaderInfoLogProc pglGetShaderInfoLog = NULL;
+DeleteShaderProc pglDeleteShader = NULL;
+CreateProgramProc pglCreateProgram = NULL;
+AttachShaderProc pglAttachShader = NULL;
+BindAttribLocationProc pglBindAttribLocation = NULL;
+LinkProgramProc pglLinkProgram = NULL;
+GetProgramivProc pglGetProgramiv = NULL;
+GetProgramInfoLogProc pglGetProgramInfoLog = NULL;
+DeleteProgramProc pglDeleteProgram = NULL;
+UseProgramProc pglUseProgram = NULL;
+GetUniformLocationProc pglGetUniformLocation = NULL;
+Uniform1iProc pglUniform1i = NULL;
+Uniform1fvProc pglUniform1fv = NULL;
+Uniform3fvProc pglUniform3fv = NULL;
+Uniform4fvProc pglUniform4fv = NULL;
+EnableVertexAttribArrayProc pglEnableVertexAttribArray = NULL;
+DisableVertexAttribArrayProc pglDisableVertexAttribArray = NULL;
+VertexAttribPointerProc pglVertexAttribPointer = NULL;
+
+VertexAttribDivisorProc pglVertexAttribDivisor = NULL;
+DrawElementsInstancedProc pglDrawElementsInstanced = NULL;
+
+GenQueriesProc pglGenQueries = NULL;
+DeleteQueriesProc pglDeleteQueries = NULL;
+QueryCounterProc pglQueryCounter = NULL;
+GetQueryObjectivProc pglGetQueryObjectiv = NULL;
+GetQueryObjectui64vProc pglGetQueryObjectui64v = NULL;
+
+CompressedTexImage2DProc pglCompressedTexImage2D = NULL;
+
+GenFramebuffersProc pglGenFramebuffers = NULL;
+DeleteFramebuffersProc pglDeleteFramebuffers = NULL;
+BindFramebufferProc pglBindFramebuffer = NULL;
+FramebufferTexture2DProc pglFramebufferTexture2D = NULL;
+CheckFramebufferStatusProc pglCheckFramebufferStatus = NULL;
+BlendEquationProc pglBlendEquation = NULL;
+
+GetProgramBinaryProc pglGetProgramBinary = NULL;
+ProgramBinaryProc pglProgramBinary = NULL;
+ProgramParameteriProc pglProgramParameteri = NULL;
+
+bool hasBufferObjects = false;
+bool hasShaders = false;
+bool hasInstancing = false;
+bool hasTimerQueries = false;
+bool hasS3TC = false;
+bool hasShadowMaps = false;
+bool hasProgramBinaries = false;
+
+static void* glutLoader(const char* name) {
+    return (void*)glutGetProcAddress(name);
+}
+
+static ProcLoader procLoader = glutLoader;
+
+void setGLProcLoader(ProcLoader loader) {
+    procLoader = loader;
+}
+
+// looks up a single entry point, trying the ARB name when the core one is missing
+static void* getProc(const char* name, const char* arbName) {
+    void* proc = procLoader(name);
+    if (proc == NULL && arbName != NULL)
+        proc = procLoader(arbName);
+    return proc;
+}
+
+void loadGLExtensions() {
+    pglGenBuffers = (GenBuffersProc)getProc("glGenBuffers", "glGenBuffersARB");
+    pglDeleteBuffers = (DeleteBuffersProc)getProc("glDeleteBuffers", "glDeleteBuffersARB");
+    pglBindBuffer = (BindBufferProc)getProc("glBindBuffer", "glBindBufferARB");
+    pglBufferData = (BufferDataProc)getProc("glBufferData", "glBufferDataARB");
+
+    hasBufferObjects = pglGenBuffers && pglDeleteBuffers && pglBindBuffer && pglBufferData;
+
+    pglCreateShader = (CreateShaderProc)getProc("glCreateShader", NULL);
+    pglShaderSource = (ShaderSourceProc)getProc("glShaderSource", NULL);
+    pglCompileShader = (CompileShaderProc)getProc("glCompileShader", NULL);
+    pglGetShaderiv = (GetShaderivProc)getProc("glGetShaderiv", NULL);
+    pglGetShaderInfoLog = (GetShaderInfoLogProc)getProc("glGetShaderInfoLog", NULL);
+    pglDeleteShader = (DeleteShaderProc)getProc("glDeleteShader", NULL);
+    pglCreateProgram = (CreateProgramProc)getProc("glCreateProgram", NULL);
+    pglAttachShader = (AttachShaderProc)getProc("glAttachShader", NULL);
+    pglBindAttribLocation = (BindAttribLocationProc)getProc("glBindAttribLocation", NULL);
+    pglLinkProgram = (LinkProgramProc)getProc("glLinkProgram", NULL);
+    pglGetProgramiv = (GetProgramivProc)getProc("glGetProgramiv", NULL);
+    pglGetProgramInfoLog = (GetProgramInfoLogProc)getProc("glGetProgramInfoLog", NULL);
+    pglDeleteProgram = (DeleteProgramProc)getProc("glDeleteProgram", NULL);
+    pglUseProgram = (UseProgramProc)getProc("glUseProgram", NULL);
+    pglGetUniformLocation = (GetUniformLocationProc)getProc("glGetUniformLocation", NULL);
+    pglUniform1i = (Uniform1iProc)getProc("glUniform1i", NULL);
+    pglUniform1fv = (Uniform1fvProc)getProc("glUniform1fv", NULL);
+    pglUniform3fv = (Uniform3fvProc)getProc("glUniform3fv", NULL);
+    pglUniform4fv = (Uniform4fvProc)getProc("glUniform4fv", NULL);
+    pglEnableVertexAttribArray = (EnableVertexAttribArrayProc)getProc("glEnableVertexAttribArray", NULL);
+    pglDisableVertexAttribArray = (DisableVertexAttribArrayProc)getProc("glDisableVertexAttribArray", NULL);
+    pglVertexAttribPointer = (VertexAttribPointerProc)getProc("glVertexAttribPointer", NULL);
+
+    hasShaders = pglCreateShader && pglShaderSource && pglCompileShader && pglGetShaderiv && pglGetShaderInfoLog
+        && pglDeleteShader && pglCreateProgram && pglAttachShader && pglBindAttribLocation && pglLinkProgram
+        && pglGetProgramiv && pglGetProgramInfoLog && pglDeleteProgram && pglUseProgram && pglGetUniformLocation
+        && pglUniform1i && pglUniform1fv && pglUniform3fv && pglUniform4fv && pglEnableVertexAttribArray && pglDisableVertexAttribArray
+        && pglVertexAttribPointer;
+
+    pglVertexAttribDivisor = (VertexAttribDivisorProc)getProc("glVertexAttribDivisor", "glVertexAttribDivisorARB");
+    pglDrawElementsInstanced = (DrawElementsInstancedProc)getProc("glDrawElementsInstanced", "glDrawElementsInstancedARB");
+
+    hasInstancing = hasBufferObjects && hasShaders && pglVertexAttribDivisor && pglDrawElementsInstanced;
+
+    pglGenQueries = (GenQueriesProc)getProc("glGenQueries", "glGenQueriesARB");
+    pglDeleteQueries = (DeleteQueriesProc)getProc("glDeleteQueries", "glDeleteQueriesARB");
+    pglQueryCounter = (QueryCounterProc)getProc("glQueryCounter", NULL);
+    pglGetQueryObjectiv = (GetQueryObjectivProc)getProc("glGetQueryObjectiv", "glGetQueryObjectivARB");
+    pglGetQueryObjectui64v = (GetQueryObjectui64vProc)getProc("glGetQueryObjectui64v", NULL);
+
+    // the timer query entry points have no ARB names, so the extension or OpenGL 3.3 is checked instead
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    const char* dot = version ? strchr(version, '.') : NULL;
+    int major = dot ? atoi(version) : 0;
+    int minor = dot ? atoi(dot + 1) : 0;
+    bool timerQueries = (extensions && strstr(extensions, "GL_ARB_timer_query")) || major > 3 || (major == 3 && minor >= 3);
+    hasTimerQueries = timerQueries && pglGenQueries && pglDeleteQueries && pglQueryCounter && pglGetQueryObjectiv && pglGetQueryObjectui64v;
+
+    pglCompressedTexImage2D = (CompressedTexImage2DProc)getProc("glCompressedTexImage2D", "glCompressedTexImage2DARB");
+    hasS3TC = pglCompressedTexImage2D && extensions && strstr(extensions, "GL_EXT_texture_compression_s3tc");
+
+    pglGenFramebuffers = (GenFramebuffersProc)getProc("glGenFramebuffers", "glGenFramebuffersEXT");
+    pglDeleteFramebuffers = (DeleteFramebuffersProc)getProc("glDeleteFramebuffers", "glDeleteFramebuffersEXT");
+    pglBindFramebuffer = (BindFramebufferProc)getProc("glBindFramebuffer", "glBindFramebufferEXT");
+    pglFramebufferTexture2D = (FramebufferTexture2DProc)getProc("glFramebufferTexture2D", "glFramebufferTexture2DEXT");
+    pglCheckFramebufferStatus = (CheckFramebufferStatusProc)getProc("glCheckFramebufferStatus", "glCheckFramebufferStatusEXT");
+    pglBlendEquation = (BlendEquationProc)getProc("glBlendEquation", "glBlendEquationEXT");
+
+    // depth textures and the compare mode are core in OpenGL 1.4
+    bool depthCompare = major > 1 || (major == 1 && minor >= 4) || (extensions && strstr(extensions, "GL_ARB_shadow") && strstr(extensions, "GL_ARB_depth_texture"));
+    hasShadowMaps = depthCompare && pglGenFramebuffers && pglDeleteFramebuffers && pglBindFramebuffer && pglFramebufferTexture2D
+        && pglCheckFramebufferStatus && pglBlendEquation;
+
+    pglGetProgramBinary = (GetProgramBinaryProc)getProc("glGetProgramBinary", NULL);
+    pglProgramBinary = (ProgramBinaryProc)getProc("glProgramBinary", NULL);
+    pglProgramParameteri = (ProgramParameteriProc)getProc("glProgramParameteri", NULL);
+
+    // the entry points can exist while the driver offers no binary format to save in
+    GLint binaryFormats = 0;
+    bool programBinaries = hasShaders && pglGetProgramBinary && pglProgramBinary && pglProgramParameteri;
+    if (programBinaries)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    hasProgramBinaries = programBinaries && binaryFormats > 0;
+}
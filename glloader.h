@@ -0,0 +1,227 @@
+#pragma once
+
+#include <GL/glut.h>
+
+/*
+    Loader for the OpenGL entry points newer than 1.1.
+
+    opengl32.lib on Windows only exports OpenGL 1.1, so everything newer has to be
+    looked up at runtime once a context is current. The pointers are prefixed with
+    "p" so they never clash with prototypes from a system glext.h.
+*/
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#endif
+
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+#ifndef GL_TIMESTAMP
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#define GL_TIMESTAMP 0x8E28
+#endif
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_TEXTURE_BASE_LEVEL
+#define GL_TEXTURE_BASE_LEVEL 0x813C
+#endif
+
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+#ifndef GL_GENERATE_MIPMAP
+#define GL_GENERATE_MIPMAP 0x8191
+#endif
+
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+
+#ifndef GL_TEXTURE_COMPARE_MODE
+#define GL_DEPTH_TEXTURE_MODE 0x884B
+#define GL_TEXTURE_COMPARE_MODE 0x884C
+#define GL_TEXTURE_COMPARE_FUNC 0x884D
+#define GL_COMPARE_R_TO_TEXTURE 0x884E
+#endif
+
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+#ifndef GL_FUNC_REVERSE_SUBTRACT
+#define GL_FUNC_ADD 0x8006
+#define GL_FUNC_REVERSE_SUBTRACT 0x800B
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#include <stddef.h>
+
+typedef ptrdiff_t GLsizeiptrValue;
+typedef char GLcharValue;
+typedef unsigned long long GLuint64Value;
+
+typedef void (APIENTRY* GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY* DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY* BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY* BufferDataProc)(GLenum target, GLsizeiptrValue size, const void* data, GLenum usage);
+
+// GLSL programs, OpenGL 2.0
+typedef GLuint (APIENTRY* CreateShaderProc)(GLenum type);
+typedef void (APIENTRY* ShaderSourceProc)(GLuint shader, GLsizei count, const GLcharValue* const* strings, const GLint* lengths);
+typedef void (APIENTRY* CompileShaderProc)(GLuint shader);
+typedef void (APIENTRY* GetShaderivProc)(GLuint shader, GLenum name, GLint* value);
+typedef void (APIENTRY* GetShaderInfoLogProc)(GLuint shader, GLsizei size, GLsizei* length, GLcharValue* log);
+typedef void (APIENTRY* DeleteShaderProc)(GLuint shader);
+typedef GLuint (APIENTRY* CreateProgramProc)();
+typedef void (APIENTRY* AttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY* BindAttribLocationProc)(GLuint program, GLuint index, const GLcharValue* name);
+typedef void (APIENTRY* LinkProgramProc)(GLuint program);
+typedef void (APIENTRY* GetProgramivProc)(GLuint program, GLenum name, GLint* value);
+typedef void (APIENTRY* GetProgramInfoLogProc)(GLuint program, GLsizei size, GLsizei* length, GLcharValue* log);
+typedef void (APIENTRY* DeleteProgramProc)(GLuint program);
+typedef void (APIENTRY* UseProgramProc)(GLuint program);
+typedef GLint (APIENTRY* GetUniformLocationProc)(GLuint program, const GLcharValue* name);
+typedef void (APIENTRY* Uniform1iProc)(GLint location, GLint value);
+typedef void (APIENTRY* Uniform1fvProc)(GLint location, GLsizei count, const GLfloat* value);
+typedef void (APIENTRY* Uniform3fvProc)(GLint location, GLsizei count, const GLfloat* value);
+typedef void (APIENTRY* Uniform4fvProc)(GLint location, GLsizei count, const GLfloat* value);
+typedef void (APIENTRY* EnableVertexAttribArrayProc)(GLuint index);
+typedef void (APIENTRY* DisableVertexAttribArrayProc)(GLuint index);
+typedef void (APIENTRY* VertexAttribPointerProc)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+
+// instanced drawing, OpenGL 3.3 or ARB_draw_instanced and ARB_instanced_arrays
+typedef void (APIENTRY* VertexAttribDivisorProc)(GLuint index, GLuint divisor);
+typedef void (APIENTRY* DrawElementsInstancedProc)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances);
+
+// GPU timestamps, OpenGL 3.3 or ARB_timer_query
+typedef void (APIENTRY* GenQueriesProc)(GLsizei n, GLuint* ids);
+typedef void (APIENTRY* DeleteQueriesProc)(GLsizei n, const GLuint* ids);
+typedef void (APIENTRY* QueryCounterProc)(GLuint id, GLenum target);
+typedef void (APIENTRY* GetQueryObjectivProc)(GLuint id, GLenum name, GLint* value);
+typedef void (APIENTRY* GetQueryObjectui64vProc)(GLuint id, GLenum name, GLuint64Value* value);
+
+// compressed textures, OpenGL 1.3
+typedef void (APIENTRY* CompressedTexImage2DProc)(GLenum target, GLint level, GLenum format, GLsizei width, GLsizei height, GLint border, GLsizei size, const void* data);
+
+// framebuffer objects (OpenGL 3.0 or EXT_framebuffer_object) and glBlendEquation (OpenGL 1.4)
+typedef void (APIENTRY* GenFramebuffersProc)(GLsizei n, GLuint* framebuffers);
+typedef void (APIENTRY* DeleteFramebuffersProc)(GLsizei n, const GLuint* framebuffers);
+typedef void (APIENTRY* BindFramebufferProc)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY* FramebufferTexture2DProc)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+typedef GLenum (APIENTRY* CheckFramebufferStatusProc)(GLenum target);
+typedef void (APIENTRY* BlendEquationProc)(GLenum mode);
+
+// linked programs saved and restored as driver binaries, OpenGL 4.1 or ARB_get_program_binary
+typedef void (APIENTRY* GetProgramBinaryProc)(GLuint program, GLsizei size, GLsizei* length, GLenum* format, void* binary);
+typedef void (APIENTRY* ProgramBinaryProc)(GLuint program, GLenum format, const void* binary, GLsizei length);
+typedef void (APIENTRY* ProgramParameteriProc)(GLuint program, GLenum name, GLint value);
+
+extern GenBuffersProc pglGenBuffers;
+extern DeleteBuffersProc pglDeleteBuffers;
+extern BindBufferProc pglBindBuffer;
+extern BufferDataProc pglBufferData;
+
+extern CreateShaderProc pglCreateShader;
+extern ShaderSourceProc pglShaderSource;
+extern CompileShaderProc pglCompileShader;
+extern GetShaderivProc pglGetShaderiv;
+extern GetShaderInfoLogProc pglGetShaderInfoLog;
+extern DeleteShaderProc pglDeleteShader;
+extern CreateProgramProc pglCreateProgram;
+extern AttachShaderProc pglAttachShader;
+extern BindAttribLocationProc pglBindAttribLocation;
+extern LinkProgramProc pglLinkProgram;
+extern GetProgramivProc pglGetProgramiv;
+extern GetProgramInfoLogProc pglGetProgramInfoLog;
+extern DeleteProgramProc pglDeleteProgram;
+extern UseProgramProc pglUseProgram;
+extern GetUniformLocationProc pglGetUniformLocation;
+extern Uniform1iProc pglUniform1i;
+extern Uniform1fvProc pglUniform1fv;
+extern Uniform3fvProc pglUniform3fv;
+extern Uniform4fvProc pglUniform4fv;
+extern EnableVertexAttribArrayProc pglEnableVertexAttribArray;
+extern DisableVertexAttribArrayProc pglDisableVertexAttribArray;
+extern VertexAttribPointerProc pglVertexAttribPointer;
+
+extern VertexAttribDivisorProc pglVertexAttribDivisor;
+extern DrawElementsInstancedProc pglDrawElementsInstanced;
+
+extern GenQueriesProc pglGenQueries;
+extern DeleteQueriesProc pglDeleteQueries;
+extern QueryCounterProc pglQueryCounter;
+extern GetQueryObjectivProc pglGetQueryObjectiv;
+extern GetQueryObjectui64vProc pglGetQueryObjectui64v;
+
+extern CompressedTexImage2DProc pglCompressedTexImage2D;
+
+extern GenFramebuffersProc pglGenFramebuffers;
+extern DeleteFramebuffersProc pglDeleteFramebuffers;
+extern BindFramebufferProc pglBindFramebuffer;
+extern FramebufferTexture2DProc pglFramebufferTexture2D;
+extern CheckFramebufferStatusProc pglCheckFramebufferStatus;
+extern BlendEquationProc pglBlendEquation;
+
+extern GetProgramBinaryProc pglGetProgramBinary;
+extern ProgramBinaryProc pglProgramBinary;
+extern ProgramParameteriProc pglProgramParameteri;
+
+// true once the vertex/index buffer entry points have been found
+extern bool hasBufferObjects;
+
+// true when GLSL programs can be built
+extern bool hasShaders;
+
+// true when per-instance attributes and instanced draws are available (needs the two above)
+extern bool hasInstancing;
+
+// true when GL_TIMESTAMP queries can be issued
+extern bool hasTimerQueries;
+
+// true when BC1 (DXT1) textures can be uploaded as they are
+extern bool hasS3TC;
+
+// true when depth textures can be rendered to and compared against (framebuffer objects, ARB_shadow)
+extern bool hasShadowMaps;
+
+// true when linked programs can be read back and loaded again as binaries (the driver offers at least one format)
+extern bool hasProgramBinaries;
+
+// function used to look up entry points, glutGetProcAddress unless a headless context replaces it
+typedef void* (*ProcLoader)(const char* name);
+void setGLProcLoader(ProcLoader loader);
+
+// looks up every entry point above, must be called with a current context
+void loadGLExtensions();
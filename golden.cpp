@@ -0,0 +1,144 @@
+#include <math.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "platform.h"
+#include "golden.h"
+
+using namespace std;
+
+// the largest YIQ difference, between black and white
+#define YIQ_MAX_DELTA 35215.0
+
+string goldenImagePath(const string& directory, size_t view) {
+    stringstream path;
+    path << directory << "/view" << view << ".ppm";
+    return path.str();
+}
+
+string goldenDiffPath(const string& directory, size_t view) {
+    stringstream path;
+    path << directory << "/view" << view << "-diff.ppm";
+    return path.str();
+}
+
+string goldenManifestPath(const string& directory) {
+    return directory + "/golden.txt";
+}
+
+void makeGoldenDirectory(const string& directory) {
+    makeDirectory(directory.c_str());
+}
+
+bool saveGoldenManifest(const string& path, const GoldenManifest& manifest) {
+    ofstream file(path.c_str());
+    if (!file) {
+        cerr << "golden: cannot write " << path << endl;
+        return false;
+    }
+
+    file << "# written by --golden-record, one view per line: eye x y z and the median frame time in ms\n";
+    file << "size " << manifest.width << " " << manifest.height << "\n";
+    file << "frames " << manifest.frames << "\n";
+    file << "path " << manifest.renderPath << "\n";
+    for (size_t i = 0; i < manifest.views.size(); i++) {
+        const GoldenView& view = manifest.views[i];
+        file << "view " << view.eye[0] << " " << view.eye[1] << " " << view.eye[2] << " " << view.medianMs << "\n";
+    }
+    return true;
+}
+
+bool loadGoldenManifest(const string& path, GoldenManifest& manifest) {
+    ifstream file(path.c_str());
+    if (!file) {
+        cerr << "golden: cannot read " << path << ", record it with --golden-record first" << endl;
+        return false;
+    }
+
+    manifest = GoldenManifest();
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        stringstream parser(line);
+        string keyword;
+        if (!(parser >> keyword) || keyword[0] == '#')
+            continue;
+
+        bool valid = true;
+        if (keyword == "size")
+            valid = (bool)(parser >> manifest.width >> manifest.height);
+        else if (keyword == "frames")
+            valid = (bool)(parser >> manifest.frames);
+        else if (keyword == "path")
+            valid = (bool)(parser >> manifest.renderPath);
+        else if (keyword == "view") {
+            GoldenView view;
+            valid = (bool)(parser >> view.eye[0] >> view.eye[1] >> view.eye[2] >> view.medianMs);
+            if (valid)
+                manifest.views.push_back(view);
+        }
+        else
+            valid = false;
+
+        if (!valid) {
+            cerr << path << ":" << lineNumber << ": cannot read \"" << line << "\"" << endl;
+            return false;
+        }
+    }
+
+    if (manifest.width <= 0 || manifest.height <= 0 || manifest.views.empty()) {
+        cerr << "golden: " << path << " has no size or no views" << endl;
+        return false;
+    }
+    return true;
+}
+
+// the brightness and the two chroma axes of NTSC, as pixelmatch weighs them
+static void rgbToYiq(const unsigned char* rgb, double yiq[3]) {
+    double r = rgb[0], g = rgb[1], b = rgb[2];
+    yiq[0] = r * 0.29889531 + g * 0.58662247 + b * 0.11448223;
+    yiq[1] = r * 0.59597799 - g * 0.27417610 - b * 0.32180189;
+    yiq[2] = r * 0.21147017 - g * 0.52261711 + b * 0.31114694;
+}
+
+// This function is responsible for counting the pixels whose perceived difference is above the tolerance
+ImageDifference compareImages(const unsigned char* expected, const unsigned char* actual, int width, int height, double tolerance, vector<unsigned char>* diff) {
+    ImageDifference result = { 0, (long)width * height, 0.0 };
+    // the deltas are squared distances, so the threshold is too
+    double threshold = tolerance * tolerance * YIQ_MAX_DELTA;
+
+    if (diff)
+        diff->resize((size_t)width * height * 3);
+
+    for (long i = 0; i < result.pixels; i++) {
+        const unsigned char* a = expected + i * 3;
+        const unsigned char* b = actual + i * 3;
+        double delta = 0.0;
+
+        if (a[0] != b[0] || a[1] != b[1] || a[2] != b[2]) {
+            double p[3], q[3];
+            rgbToYiq(a, p);
+            rgbToYiq(b, q);
+            double y = p[0] - q[0], ii = p[1] - q[1], qq = p[2] - q[2];
+            delta = 0.5053 * y * y + 0.299 * ii * ii + 0.1957 * qq * qq;
+        }
+
+        double normalized = sqrt(delta / YIQ_MAX_DELTA);
+        if (normalized > result.maxDelta)
+            result.maxDelta = normalized;
+        bool different = delta > threshold;
+        if (different)
+            result.differentPixels++;
+
+        if (diff) {
+            // the expected image faded to grey underneath, so the differences stand out
+            unsigned char* out = &(*diff)[i * 3];
+            unsigned char grey = (unsigned char)(255 - (255 - (a[0] * 77 + a[1] * 150 + a[2] * 29) / 256) / 4);
+            out[0] = different ? 255 : grey;
+            out[1] = different ? 0 : grey;
+            out[2] = different ? 0 : grey;
+        }
+    }
+    return result;
+}
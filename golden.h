@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+    Golden images and frame-time baselines
+
+    --golden-record renders the scene from a fixed set of viewer positions and stores
+    each frame as a PPM next to a manifest that holds the size, the render path and the
+    median frame time of every view. --golden-check renders the same views again and
+    fails when an image or a frame time moved too far from what was stored.
+
+    Exact equality would fail on any driver update, so images are compared perceptually,
+    the way pixelmatch does: each pixel's difference is measured in YIQ, which weights
+    brightness over hue roughly like the eye does, and only counts when it is above the
+    tolerance (0 to 1, the share of the largest possible difference). A view passes
+    while few enough pixels count. A frame time fails when its median is slower than the
+    baseline by more than the allowed share.
+*/
+
+struct GoldenView {
+    float eye[3];
+    double medianMs; // frame time baseline
+};
+
+struct GoldenManifest {
+    int width = 0;
+    int height = 0;
+    int frames = 0;
+    std::string renderPath; // renderPathName() when recorded, timings only compare on the same path
+    std::vector<GoldenView> views;
+};
+
+// how two images of the same size differ
+struct ImageDifference {
+    long differentPixels; // pixels above the tolerance
+    long pixels;
+    double maxDelta; // largest pixel difference, 0 to 1 like the tolerance
+};
+
+// name of the image of one view inside the golden directory
+std::string goldenImagePath(const std::string& directory, size_t view);
+
+// where a failed check leaves the visualised differences of that view
+std::string goldenDiffPath(const std::string& directory, size_t view);
+
+std::string goldenManifestPath(const std::string& directory);
+
+// creates the directory a record writes into; one that already exists is left as it is
+void makeGoldenDirectory(const std::string& directory);
+
+bool saveGoldenManifest(const std::string& path, const GoldenManifest& manifest);
+
+bool loadGoldenManifest(const std::string& path, GoldenManifest& manifest);
+
+// compares two RGB images pixel by pixel, writing a visualisation of the differences into diff
+// (grey where the pixels agree, red where they differ) when it is not NULL
+ImageDifference compareImages(const unsigned char* expected, const unsigned char* actual, int width, int height, double tolerance, std::vector<unsigned char>* diff);
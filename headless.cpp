@@ -0,0 +1,129 @@
+#include <iostream>
+#include <GL/glut.h>
+#include "headless.h"
+#include "glloader.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLConfig config;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+
+static void* eglLoader(const char* name) {
+    return (void*)eglGetProcAddress(name);
+}
+
+// prefers Mesa's surfaceless platform, which needs neither X11 nor a GPU device
+static EGLDisplay openDisplay() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if (getPlatformDisplay) {
+        EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (surfaceless != EGL_NO_DISPLAY)
+            return surfaceless;
+    }
+#endif
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool createSurface(int width, int height) {
+    EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+
+    surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE) {
+        cerr << "headless: eglCreatePbufferSurface failed (0x" << hex << eglGetError() << dec << ")" << endl;
+        return false;
+    }
+    return eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+}
+
+bool createHeadlessContext(int width, int height, int* argc, char** argv) {
+    display = openDisplay();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        cerr << "headless: no EGL display available" << endl;
+        return false;
+    }
+
+    EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLint count = 0;
+
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &count) || count == 0) {
+        cerr << "headless: no pbuffer capable OpenGL config" << endl;
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+    if (context == EGL_NO_CONTEXT) {
+        cerr << "headless: eglCreateContext failed" << endl;
+        return false;
+    }
+
+    if (!createSurface(width, height))
+        return false;
+
+    setGLProcLoader(eglLoader);
+    return true;
+}
+
+bool resizeHeadlessSurface(int width, int height) {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+    if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    return createSurface(width, height);
+}
+
+void destroyHeadlessContext() {
+    if (display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    if (context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+}
+
+#else
+
+static int window = 0;
+
+bool createHeadlessContext(int width, int height, int* argc, char** argv) {
+    glutInit(argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+    glutInitWindowSize(width, height);
+    window = glutCreateWindow("Basic 3D Scene in OpenGL (headless)");
+    glutHideWindow();
+    return window != 0;
+}
+
+bool resizeHeadlessSurface(int width, int height) {
+    glutReshapeWindow(width, height);
+    return true;
+}
+
+void destroyHeadlessContext() {
+    if (window)
+        glutDestroyWindow(window);
+    window = 0;
+}
+
+#endif
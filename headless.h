@@ -0,0 +1,17 @@
+#pragma once
+
+/*
+    Offscreen rendering without a window.
+
+    On Linux this creates an EGL pbuffer with a desktop OpenGL (compatibility profile)
+    context, which Mesa provides through llvmpipe on machines without a GPU. Windows has
+    no EGL, so there the context comes from a hidden GLUT window instead.
+*/
+
+// creates the context and makes it current, false if no context could be made
+bool createHeadlessContext(int width, int height, int* argc, char** argv);
+
+// resizes the offscreen surface, the context stays the same
+bool resizeHeadlessSurface(int width, int height);
+
+void destroyHeadlessContext();
@@ -0,0 +1,300 @@
+#include <math.h>
+#include <string>
+#include "glloader.h"
+#include "shaders.h"
+#include "instancing.h"
+#include "pixelshading.h"
+#include "vertexpack.h"
+#include "framestats.h"
+#include "instrument.h"
+
+// attribute locations, position is 0 so it aliases gl_Vertex
+#define ATTRIBUTE_POSITION 0
+#define ATTRIBUTE_NORMAL 1
+#define ATTRIBUTE_PLACEMENT 2
+#define ATTRIBUTE_ORIENTATION 3
+
+using namespace std;
+
+// LIGHT_COUNT is defined in front of the source, a constant loop bound is much cheaper
+// than breaking out of the loop on a uniform with the software rasterizers; PER_PIXEL
+// leaves the lighting to pixelFragmentSource and hands it the eye space position and normal
+static const char* vertexSource =
+    "attribute vec3 position;\n"
+    "attribute vec3 normal;\n"
+    "attribute vec4 placement;\n"
+    "attribute vec4 orientation;\n"
+    "uniform vec3 positionScale;\n"
+    "uniform vec3 positionOffset;\n"
+    "uniform int packedNormal;\n"
+    "uniform int batchMaterial;\n"
+    "uniform int paintMaterial;\n"
+    "uniform vec4 materialAmbient[8];\n"
+    "uniform vec4 materialDiffuse[8];\n"
+    "uniform vec4 materialSpecular[8];\n"
+    "uniform float materialShininess[8];\n"
+    "varying float fogDepth;\n"
+    "varying vec3 eyePosition;\n"
+    "varying vec3 eyeNormal;\n"
+    "varying float normalLength;\n"
+    "varying float material;\n"
+    // a packed mesh's normal is folded onto the octahedron, see vertexpack.h
+    "vec3 meshNormal() {\n"
+    "    if (packedNormal == 0)\n"
+    "        return normal;\n"
+    "    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));\n"
+    "    if (n.z < 0.0)\n"
+    "        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+    "    return normalize(n);\n"
+    "}\n"
+    "void main() {\n"
+    "    float c = orientation.x;\n"
+    "    float s = orientation.y;\n"
+    "    vec3 p = (position * positionScale + positionOffset) * placement.w;\n"
+    "    vec3 local = meshNormal();\n"
+    "    vec4 world = vec4(c * p.x + s * p.z + placement.x, p.y + placement.y, c * p.z - s * p.x + placement.z, 1.0);\n"
+    "    vec4 eye = gl_ModelViewMatrix * world;\n"
+    // the fixed-function path scales its normals with the object and never renormalizes
+    // them (GL_NORMALIZE is off), so the same is done here to light both paths alike
+    "    vec3 n = gl_NormalMatrix * vec3(c * local.x + s * local.z, local.y, c * local.z - s * local.x) / placement.w;\n"
+    "    int m = (batchMaterial == paintMaterial && orientation.z >= 0.0) ? int(orientation.z) : batchMaterial;\n"
+    "#ifdef PER_PIXEL\n"
+    "    eyePosition = eye.xyz;\n"
+    "    eyeNormal = n;\n"
+    "    normalLength = length(n);\n"
+    "    material = float(m);\n"
+    "#else\n"
+    "    vec4 color = gl_LightModel.ambient * materialAmbient[m];\n"
+    "    for (int i = 0; i < LIGHT_COUNT; i++) {\n"
+    "        vec4 lp = gl_LightSource[i].position;\n"
+    "        vec3 l = normalize(lp.w == 0.0 ? lp.xyz : lp.xyz - eye.xyz);\n"
+    "        float diffuse = dot(n, l);\n"
+    "        color += gl_LightSource[i].ambient * materialAmbient[m];\n"
+    "        if (diffuse > 0.0) {\n"
+    "            float specular = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+    "            color += gl_LightSource[i].diffuse * materialDiffuse[m] * diffuse;\n"
+    "            color += gl_LightSource[i].specular * materialSpecular[m] * pow(specular, materialShininess[m]);\n"
+    "        }\n"
+    "    }\n"
+    "    gl_FrontColor = vec4(clamp(color.rgb, 0.0, 1.0), materialDiffuse[m].a);\n"
+    "    fogDepth = abs(eye.z);\n"
+    "#endif\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "}\n";
+
+static const char* fragmentSource =
+    "#version 120\n"
+    "uniform int fogEnabled;\n"
+    "varying float fogDepth;\n"
+    "void main() {\n"
+    "    vec4 color = gl_Color;\n"
+    "    if (fogEnabled != 0) {\n"
+    "        float f = clamp(exp(-pow(gl_Fog.density * fogDepth, 2.0)), 0.0, 1.0);\n"
+    "        color.rgb = mix(gl_Fog.color.rgb, color.rgb, f);\n"
+    "    }\n"
+    "    gl_FragColor = color;\n"
+    "}\n";
+
+// the per-pixel fragment stage, after pixelShadingFunctions(); the material index is the same at
+// every vertex of an instance, so interpolating it gives it back up to rounding
+static const char* pixelFragmentSource =
+    "uniform vec4 materialAmbient[8];\n"
+    "uniform vec4 materialDiffuse[8];\n"
+    "uniform vec4 materialSpecular[8];\n"
+    "uniform float materialShininess[8];\n"
+    "varying vec3 eyePosition;\n"
+    "varying vec3 eyeNormal;\n"
+    "varying float normalLength;\n"
+    "varying float material;\n"
+    "void main() {\n"
+    "    int m = int(material + 0.5);\n"
+    "    vec3 n = eyeNormal * (normalLength / max(length(eyeNormal), 0.000001));\n"
+    "    vec4 color = shadeFragment(n, eyePosition, materialAmbient[m], materialDiffuse[m], materialSpecular[m], materialShininess[m]);\n"
+    "    gl_FragColor = vec4(applyFog(color.rgb, eyePosition), color.a);\n"
+    "}\n";
+
+// one program per number of enabled lights, and per fog for the per-pixel ones, built when first needed
+struct InstancingProgram {
+    GLuint program;
+    GLint positionScale, positionOffset, packedNormal;
+    GLint batchMaterial, paintMaterial, fogEnabled;
+    GLint ambient, diffuse, specular, shininess;
+    PixelFogUniforms fog;
+};
+
+static InstancingProgram programs[9];
+static InstancingProgram pixelPrograms[PIXEL_FOGS][9];
+static InstancingProgram* current = NULL;
+static bool supported = false;
+
+static const Material* materials = NULL;
+static int materialCount = 0;
+
+// This function is responsible for building the program for the given number of lights, lit per vertex
+// or per pixel with the given fog
+static bool buildInstancingProgram(int lightCount, bool perPixel, PixelFog fog, InstancingProgram& p) {
+    const ShaderAttribute attributes[] = {
+        { ATTRIBUTE_POSITION, "position" },
+        { ATTRIBUTE_NORMAL, "normal" },
+        { ATTRIBUTE_PLACEMENT, "placement" },
+        { ATTRIBUTE_ORIENTATION, "orientation" }
+    };
+
+    if (perPixel) {
+        string defines = pixelShadingDefines(lightCount, fog);
+        string vertex = defines + "#define PER_PIXEL\n" + vertexSource;
+        string fragment = defines + pixelShadingFunctions() + pixelFragmentSource;
+        p.program = buildProgram("instancing-per-pixel", vertex.c_str(), fragment.c_str(), attributes, 4);
+    }
+    else {
+        string source = "#version 120\n#define LIGHT_COUNT " + to_string(lightCount) + "\n" + vertexSource;
+        p.program = buildProgram("instancing", source.c_str(), fragmentSource, attributes, 4);
+    }
+    if (p.program == 0)
+        return false;
+
+    p.positionScale = pglGetUniformLocation(p.program, "positionScale");
+    p.positionOffset = pglGetUniformLocation(p.program, "positionOffset");
+    p.packedNormal = pglGetUniformLocation(p.program, "packedNormal");
+    p.batchMaterial = pglGetUniformLocation(p.program, "batchMaterial");
+    p.paintMaterial = pglGetUniformLocation(p.program, "paintMaterial");
+    p.fogEnabled = pglGetUniformLocation(p.program, "fogEnabled");
+    p.ambient = pglGetUniformLocation(p.program, "materialAmbient");
+    p.diffuse = pglGetUniformLocation(p.program, "materialDiffuse");
+    p.specular = pglGetUniformLocation(p.program, "materialSpecular");
+    p.shininess = pglGetUniformLocation(p.program, "materialShininess");
+    findPixelFogUniforms(p.program, p.fog);
+    return true;
+}
+
+bool initInstancing() {
+    supported = false;
+    if (!hasInstancing)
+        return false;
+
+    // built up front for the current lights so a shader error shows at start-up
+    int lights = enabledLightCount();
+    supported = buildInstancingProgram(lights, false, PIXEL_FOG_NONE, programs[lights]);
+    return supported;
+}
+
+bool instancingAvailable() {
+    return supported;
+}
+
+void setInstanceMaterials(const Material* table, int count) {
+    materials = table;
+    materialCount = count < INSTANCE_MATERIALS ? count : INSTANCE_MATERIALS;
+}
+
+void makeInstance(const GLfloat position[3], GLfloat scale, GLfloat rotation, int material, InstanceData& instance) {
+    GLfloat angle = rotation * 3.14159265f / 180.0f;
+
+    instance.placement[0] = position[0];
+    instance.placement[1] = position[1];
+    instance.placement[2] = position[2];
+    instance.placement[3] = scale;
+    instance.orientation[0] = cosf(angle);
+    instance.orientation[1] = sinf(angle);
+    instance.orientation[2] = (GLfloat)material;
+    instance.orientation[3] = 0.0f;
+}
+
+// This function is responsible for loading the state the instancing program reads into its uniforms
+void beginInstancedDraw(bool perPixel) {
+    GLfloat ambient[INSTANCE_MATERIALS * 4], diffuse[INSTANCE_MATERIALS * 4], specular[INSTANCE_MATERIALS * 4];
+    GLfloat shininess[INSTANCE_MATERIALS];
+
+    for (int i = 0; i < materialCount; i++) {
+        for (int k = 0; k < 4; k++) {
+            ambient[i * 4 + k] = materials[i].ambient[k];
+            diffuse[i * 4 + k] = materials[i].diffuse[k];
+            specular[i * 4 + k] = materials[i].specular[k];
+        }
+        shininess[i] = materials[i].shininess;
+    }
+
+    int lights = enabledLightCount();
+    PixelFog fog = currentPixelFog();
+    current = perPixel ? &pixelPrograms[fog][lights] : &programs[lights];
+    if (current->program == 0)
+        buildInstancingProgram(lights, perPixel, fog, *current);
+
+    pglUseProgram(current->program);
+    if (perPixel)
+        loadPixelFogUniforms(current->fog);
+    else
+        pglUniform1i(current->fogEnabled, glIsEnabled(GL_FOG) ? 1 : 0);
+    if (materialCount > 0) {
+        pglUniform4fv(current->ambient, materialCount, ambient);
+        pglUniform4fv(current->diffuse, materialCount, diffuse);
+        pglUniform4fv(current->specular, materialCount, specular);
+        pglUniform1fv(current->shininess, materialCount, shininess);
+    }
+
+    pglEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    pglEnableVertexAttribArray(ATTRIBUTE_NORMAL);
+    pglEnableVertexAttribArray(ATTRIBUTE_PLACEMENT);
+    pglEnableVertexAttribArray(ATTRIBUTE_ORIENTATION);
+    pglVertexAttribDivisor(ATTRIBUTE_PLACEMENT, 1);
+    pglVertexAttribDivisor(ATTRIBUTE_ORIENTATION, 1);
+}
+
+void endInstancedDraw() {
+    pglVertexAttribDivisor(ATTRIBUTE_PLACEMENT, 0);
+    pglVertexAttribDivisor(ATTRIBUTE_ORIENTATION, 0);
+    pglDisableVertexAttribArray(ATTRIBUTE_ORIENTATION);
+    pglDisableVertexAttribArray(ATTRIBUTE_PLACEMENT);
+    pglDisableVertexAttribArray(ATTRIBUTE_NORMAL);
+    pglDisableVertexAttribArray(ATTRIBUTE_POSITION);
+
+    pglBindBuffer(GL_ARRAY_BUFFER, 0);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    pglUseProgram(0);
+}
+
+// This function is responsible for drawing all instances of a mesh, one instanced draw per material batch
+void drawInstances(const Mesh& mesh, InstanceList& list, int paintMaterial) {
+    if (list.instances.empty() || mesh.vertexBuffer == 0 || current->program == 0)
+        return;
+
+    GLsizei count = (GLsizei)list.instances.size();
+
+    // the list is rebuilt every frame, so the whole buffer is respecified instead of updated in place
+    if (list.buffer == 0)
+        pglGenBuffers(1, &list.buffer);
+    pglBindBuffer(GL_ARRAY_BUFFER, list.buffer);
+    pglBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), &list.instances[0], GL_STREAM_DRAW);
+    pglVertexAttribPointer(ATTRIBUTE_PLACEMENT, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, placement));
+    pglVertexAttribPointer(ATTRIBUTE_ORIENTATION, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, orientation));
+
+    pglBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    if (mesh.packed) {
+        // the integers go in unnormalized, positionScale and positionOffset map them back
+        pglVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex), (const void*)offsetof(PackedVertex, position));
+        pglVertexAttribPointer(ATTRIBUTE_NORMAL, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (const void*)offsetof(PackedVertex, normal));
+    }
+    else {
+        pglVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, position));
+        pglVertexAttribPointer(ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, normal));
+    }
+    pglUniform3fv(current->positionScale, 1, mesh.packedScale);
+    pglUniform3fv(current->positionOffset, 1, mesh.packedOffset);
+    pglUniform1i(current->packedNormal, mesh.packed ? 1 : 0);
+
+    pglUniform1i(current->paintMaterial, paintMaterial);
+    for (size_t i = 0; i < mesh.batches.size(); i++) {
+        const MeshBatch& batch = mesh.batches[i];
+        pglUniform1i(current->batchMaterial, batch.material);
+        pglDrawElementsInstanced(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT, (const void*)(batch.firstIndex * sizeof(GLuint)), count);
+        countDraw((long)batch.indexCount / 3 * count);
+    }
+}
+
+void deleteInstanceList(InstanceList& list) {
+    if (list.buffer)
+        pglDeleteBuffers(1, &list.buffer);
+    list.buffer = 0;
+    list.instances.clear();
+}
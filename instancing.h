@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <GL/glut.h>
+#include "meshcache.h"
+#include "renderstate.h"
+
+/*
+    Instanced renderer
+
+    Every copy of a mesh is described by a small record (placement and material) kept in
+    an instance list. drawInstances() streams the list into a buffer object and draws all
+    copies with one glDrawElementsInstanced call per material batch, so the number of
+    draw calls no longer grows with the number of objects.
+
+    The instance attributes are read by a GLSL program that does the same per-vertex
+    lighting and fog as the fixed-function pipeline: it reads the enabled lights and the
+    fog from the OpenGL state, and the materials from the same table bindMaterial() uses.
+    A second set of programs does the same per fragment with the functions of
+    pixelshading.h.
+*/
+
+#define INSTANCE_MATERIALS 8
+
+// per-instance attributes, two vec4s
+struct InstanceData {
+    GLfloat placement[4]; // translation, then uniform scale
+    GLfloat orientation[4]; // cosine and sine of the rotation about y, material (-1 keeps the mesh's), unused
+};
+
+struct InstanceList {
+    std::vector<InstanceData> instances;
+    GLuint buffer = 0;
+};
+
+// builds the program, false when instancing is not supported by the context
+bool initInstancing();
+bool instancingAvailable();
+
+// the material table, read again at every beginInstancedDraw()
+void setInstanceMaterials(const Material* table, int count);
+
+// fills in an instance record, rotation is in degrees about the y axis
+void makeInstance(const GLfloat position[3], GLfloat scale, GLfloat rotation, int material, InstanceData& instance);
+
+// binds the program and loads the lights, fog and materials, must wrap the drawInstances() calls;
+// perPixel lights and fogs every fragment, see pixelshading.h
+void beginInstancedDraw(bool perPixel);
+void endInstancedDraw();
+
+// draws every instance of the mesh, batches using paintMaterial take the instance's material instead
+void drawInstances(const Mesh& mesh, InstanceList& list, int paintMaterial);
+
+void deleteInstanceList(InstanceList& list);
@@ -0,0 +1,184 @@
+#ifdef SCENE_INSTRUMENT
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "glloader.h"
+#include "benchmark.h"
+#include "instrument.h"
+
+using namespace std;
+
+// events kept for the trace, the oldest are overwritten
+#define TRACE_EVENTS 16384
+#define TRACE_FRAMES 1024
+
+// frames a GPU result is left before it is read, so the query has finished by then
+#define GPU_LATENCY 2
+
+struct TraceEvent {
+    const char* name;
+    long frame;
+    double cpuStart; // milliseconds
+    double cpuEnd;
+    GLuint queries[2]; // GL_TIMESTAMP at the start and end, 0 without timer queries
+    bool gpuPending;
+    GLuint64Value gpuStart; // nanoseconds
+    GLuint64Value gpuEnd;
+};
+
+struct TraceFrame {
+    long frame;
+    double cpuStart;
+    InstrumentCounters counters;
+};
+
+InstrumentCounters instrumentCounters = { 0, 0, 0, 0, 0, 0 };
+
+static TraceEvent events[TRACE_EVENTS];
+static size_t eventCount = 0; // every event ever recorded, events[n % TRACE_EVENTS]
+static size_t unresolved = 0; // first event whose GPU times may still be pending
+
+static TraceFrame frames[TRACE_FRAMES];
+static long frameCount = 0;
+
+static bool useTimerQueries() {
+    return hasTimerQueries;
+}
+
+// reads the timestamps of an event, waiting for them when wait is set
+static bool resolveEvent(TraceEvent& event, bool wait) {
+    if (!event.gpuPending)
+        return true;
+
+    if (!wait) {
+        GLint available = 0;
+        pglGetQueryObjectiv(event.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    pglGetQueryObjectui64v(event.queries[0], GL_QUERY_RESULT, &event.gpuStart);
+    pglGetQueryObjectui64v(event.queries[1], GL_QUERY_RESULT, &event.gpuEnd);
+    event.gpuPending = false;
+    return true;
+}
+
+// collects the GPU results of events older than the frame, in order
+static void resolveEvents(long beforeFrame, bool wait) {
+    if (eventCount - unresolved > TRACE_EVENTS)
+        unresolved = eventCount - TRACE_EVENTS;
+
+    while (unresolved < eventCount) {
+        TraceEvent& event = events[unresolved % TRACE_EVENTS];
+        if (event.frame >= beforeFrame || !resolveEvent(event, wait))
+            break;
+        unresolved++;
+    }
+}
+
+size_t instrumentBegin(const char* name) {
+    size_t slot = eventCount++ % TRACE_EVENTS;
+    TraceEvent& event = events[slot];
+
+    // a slot being reused may still hold queries that were never read
+    if (event.gpuPending)
+        resolveEvent(event, true);
+
+    event.name = name;
+    event.frame = frameCount;
+    event.gpuPending = false;
+
+    if (useTimerQueries()) {
+        if (event.queries[0] == 0)
+            pglGenQueries(2, event.queries);
+        pglQueryCounter(event.queries[0], GL_TIMESTAMP);
+    }
+    event.cpuStart = nowMilliseconds();
+    event.cpuEnd = event.cpuStart;
+    return slot;
+}
+
+void instrumentEnd(size_t slot) {
+    TraceEvent& event = events[slot];
+    event.cpuEnd = nowMilliseconds();
+    if (useTimerQueries() && event.queries[0] != 0) {
+        pglQueryCounter(event.queries[1], GL_TIMESTAMP);
+        event.gpuPending = true;
+    }
+}
+
+void instrumentFrameBegin() {
+    InstrumentCounters zero = { 0, 0, 0, 0, 0, 0 };
+    instrumentCounters = zero;
+
+    TraceFrame& frame = frames[frameCount % TRACE_FRAMES];
+    frame.frame = frameCount;
+    frame.cpuStart = nowMilliseconds();
+}
+
+void instrumentFrameEnd() {
+    frames[frameCount % TRACE_FRAMES].counters = instrumentCounters;
+    frameCount++;
+    if (useTimerQueries())
+        resolveEvents(frameCount - GPU_LATENCY, false);
+}
+
+// This function is responsible for writing the ring buffer as Chrome trace events: CPU
+// scopes on thread 1, GPU scopes on thread 2 and the per-frame GL call counters
+bool writeInstrumentTrace(const char* path) {
+    if (useTimerQueries())
+        resolveEvents(frameCount + 1, true);
+
+    size_t first = eventCount > TRACE_EVENTS ? eventCount - TRACE_EVENTS : 0;
+    long firstFrame = frameCount > TRACE_FRAMES ? frameCount - TRACE_FRAMES : 0;
+
+    // GPU timestamps have their own zero, they are lined up with the CPU at the first event that has both
+    double gpuOffset = 0.0;
+    for (size_t i = first; i < eventCount; i++) {
+        const TraceEvent& event = events[i % TRACE_EVENTS];
+        if (event.queries[0] != 0 && !event.gpuPending) {
+            gpuOffset = event.cpuStart - event.gpuStart / 1.0e6;
+            break;
+        }
+    }
+
+    ofstream file(path);
+    if (!file) {
+        cerr << "instrument: cannot write " << path << endl;
+        return false;
+    }
+
+    // times are written relative to the oldest event, in microseconds with nanosecond digits
+    double origin = eventCount > first ? events[first % TRACE_EVENTS].cpuStart : 0.0;
+    file << fixed << setprecision(3);
+
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+    for (size_t i = first; i < eventCount; i++) {
+        const TraceEvent& event = events[i % TRACE_EVENTS];
+        file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << (event.cpuStart - origin) * 1000.0
+            << ",\"dur\":" << (event.cpuEnd - event.cpuStart) * 1000.0 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        if (event.queries[0] != 0 && !event.gpuPending && event.gpuEnd >= event.gpuStart) {
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":" << (event.gpuStart / 1.0e6 + gpuOffset - origin) * 1000.0
+                << ",\"dur\":" << (event.gpuEnd - event.gpuStart) / 1000.0 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        }
+    }
+
+    for (long f = firstFrame; f < frameCount; f++) {
+        const TraceFrame& frame = frames[f % TRACE_FRAMES];
+        file << ",\n{\"name\":\"gl calls\",\"ph\":\"C\",\"pid\":1,\"ts\":" << (frame.cpuStart - origin) * 1000.0 << ",\"args\":{"
+            << "\"calls\":" << frame.counters.calls << ",\"vertices\":" << frame.counters.vertices
+            << ",\"state changes\":" << frame.counters.stateChanges << ",\"matrix ops\":" << frame.counters.matrixOps << "}}";
+        file << ",\n{\"name\":\"frame arena\",\"ph\":\"C\",\"pid\":1,\"ts\":" << (frame.cpuStart - origin) * 1000.0 << ",\"args\":{"
+            << "\"allocations\":" << frame.counters.arenaAllocations << ",\"bytes\":" << frame.counters.arenaBytes << "}}";
+    }
+
+    file << "\n]}\n";
+    cout << "instrument: wrote " << (eventCount - first) << " scopes over " << (frameCount - firstFrame) << " frames to " << path << endl;
+    return true;
+}
+
+#endif
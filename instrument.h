@@ -0,0 +1,116 @@
+#pragma once
+
+/*
+    Opt-in instrumentation, compiled in only when SCENE_INSTRUMENT is defined
+    (add it to the preprocessor definitions, or -DSCENE_INSTRUMENT).
+
+    When enabled:
+    - the GL calls the frame issues are wrapped by the macros at the end of this file,
+      which count calls, vertices, state changes and matrix operations per frame;
+    - INSTRUMENT_SCOPE("name") times the rest of the enclosing block on the CPU and,
+      when timer queries are available, on the GPU with a pair of GL_TIMESTAMP queries;
+    - INSTRUMENT_FRAME_BEGIN() / INSTRUMENT_FRAME_END() bracket a frame and record its
+      counters, INSTRUMENT_ARENA() adds how much the frame took from its arena;
+    - everything goes to a fixed-size ring buffer that writeInstrumentTrace() dumps as a
+      Chrome trace (load it in chrome://tracing or ui.perfetto.dev). GPU results are
+      collected a couple of frames late so reading them never stalls the frame.
+
+    When disabled every macro expands to nothing and writeInstrumentTrace() returns false.
+
+    Include this header after every other header: the wrappers are function-like macros
+    with the same names as the GL functions, so they must not touch the declarations.
+*/
+
+#ifdef SCENE_INSTRUMENT
+
+#include <stddef.h>
+
+struct InstrumentCounters {
+    long calls;
+    long vertices;
+    long stateChanges;
+    long matrixOps;
+    long arenaAllocations; // frame arena use, set once per frame by INSTRUMENT_ARENA
+    long arenaBytes;
+};
+
+extern InstrumentCounters instrumentCounters;
+
+// ring buffer slot of an open scope
+size_t instrumentBegin(const char* name);
+void instrumentEnd(size_t slot);
+
+void instrumentFrameBegin();
+void instrumentFrameEnd();
+
+// writes every event still in the ring buffer as Chrome trace JSON, false when it cannot
+bool writeInstrumentTrace(const char* path);
+
+class InstrumentScope {
+public:
+    explicit InstrumentScope(const char* name) : slot(instrumentBegin(name)) {}
+    ~InstrumentScope() { instrumentEnd(slot); }
+private:
+    size_t slot;
+};
+
+#define INSTRUMENT_JOIN2(a, b) a##b
+#define INSTRUMENT_JOIN(a, b) INSTRUMENT_JOIN2(a, b)
+#define INSTRUMENT_SCOPE(name) InstrumentScope INSTRUMENT_JOIN(instrumentScope, __LINE__)(name)
+#define INSTRUMENT_FRAME_BEGIN() instrumentFrameBegin()
+#define INSTRUMENT_FRAME_END() instrumentFrameEnd()
+#define INSTRUMENT_ARENA(allocations, bytes) (instrumentCounters.arenaAllocations = (allocations), instrumentCounters.arenaBytes = (bytes))
+
+// counting wrappers, each one is a comma expression that ends in the real call
+#define INSTRUMENT_CALL(count) (instrumentCounters.calls++, instrumentCounters.vertices += (count))
+#define INSTRUMENT_STATE() (instrumentCounters.calls++, instrumentCounters.stateChanges++)
+#define INSTRUMENT_MATRIX() (instrumentCounters.calls++, instrumentCounters.matrixOps++)
+
+#define glBegin(...) (INSTRUMENT_CALL(0), glBegin(__VA_ARGS__))
+#define glEnd() (INSTRUMENT_CALL(0), glEnd())
+#define glVertex3f(...) (INSTRUMENT_CALL(1), glVertex3f(__VA_ARGS__))
+#define glVertex3fv(...) (INSTRUMENT_CALL(1), glVertex3fv(__VA_ARGS__))
+#define glNormal3f(...) (INSTRUMENT_CALL(0), glNormal3f(__VA_ARGS__))
+#define glTexCoord2d(...) (INSTRUMENT_CALL(0), glTexCoord2d(__VA_ARGS__))
+#define glClear(...) (INSTRUMENT_CALL(0), glClear(__VA_ARGS__))
+#define glCallList(...) (INSTRUMENT_CALL(0), glCallList(__VA_ARGS__))
+#define glDrawElements(mode, count, ...) (INSTRUMENT_CALL(count), glDrawElements(mode, count, __VA_ARGS__))
+#define pglDrawElementsInstanced(mode, count, type, indices, instances) \
+    (INSTRUMENT_CALL((long)(count) * (instances)), pglDrawElementsInstanced(mode, count, type, indices, instances))
+
+#define glEnable(...) (INSTRUMENT_STATE(), glEnable(__VA_ARGS__))
+#define glDisable(...) (INSTRUMENT_STATE(), glDisable(__VA_ARGS__))
+#define glBindTexture(...) (INSTRUMENT_STATE(), glBindTexture(__VA_ARGS__))
+#define glMaterialf(...) (INSTRUMENT_STATE(), glMaterialf(__VA_ARGS__))
+#define glMaterialfv(...) (INSTRUMENT_STATE(), glMaterialfv(__VA_ARGS__))
+#define glEnableClientState(...) (INSTRUMENT_STATE(), glEnableClientState(__VA_ARGS__))
+#define glDisableClientState(...) (INSTRUMENT_STATE(), glDisableClientState(__VA_ARGS__))
+#define glVertexPointer(...) (INSTRUMENT_STATE(), glVertexPointer(__VA_ARGS__))
+#define glNormalPointer(...) (INSTRUMENT_STATE(), glNormalPointer(__VA_ARGS__))
+#define pglBindBuffer(...) (INSTRUMENT_STATE(), pglBindBuffer(__VA_ARGS__))
+#define pglBufferData(...) (INSTRUMENT_STATE(), pglBufferData(__VA_ARGS__))
+#define pglUseProgram(...) (INSTRUMENT_STATE(), pglUseProgram(__VA_ARGS__))
+#define pglUniform1i(...) (INSTRUMENT_STATE(), pglUniform1i(__VA_ARGS__))
+#define pglUniform1fv(...) (INSTRUMENT_STATE(), pglUniform1fv(__VA_ARGS__))
+#define pglUniform3fv(...) (INSTRUMENT_STATE(), pglUniform3fv(__VA_ARGS__))
+#define pglUniform4fv(...) (INSTRUMENT_STATE(), pglUniform4fv(__VA_ARGS__))
+#define pglVertexAttribPointer(...) (INSTRUMENT_STATE(), pglVertexAttribPointer(__VA_ARGS__))
+
+#define glPushMatrix() (INSTRUMENT_MATRIX(), glPushMatrix())
+#define glPopMatrix() (INSTRUMENT_MATRIX(), glPopMatrix())
+#define glLoadIdentity() (INSTRUMENT_MATRIX(), glLoadIdentity())
+#define glLoadMatrixf(...) (INSTRUMENT_MATRIX(), glLoadMatrixf(__VA_ARGS__))
+#define glTranslatef(...) (INSTRUMENT_MATRIX(), glTranslatef(__VA_ARGS__))
+#define glRotatef(...) (INSTRUMENT_MATRIX(), glRotatef(__VA_ARGS__))
+#define glScaled(...) (INSTRUMENT_MATRIX(), glScaled(__VA_ARGS__))
+
+#else
+
+#define INSTRUMENT_SCOPE(name)
+#define INSTRUMENT_FRAME_BEGIN()
+#define INSTRUMENT_FRAME_END()
+#define INSTRUMENT_ARENA(allocations, bytes)
+
+inline bool writeInstrumentTrace(const char*) { return false; }
+
+#endif
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <math.h>
+#include "threadpool.h"
+#include "benchmark.h"
+#include "lightbake.h"
+
+using namespace std;
+
+#define BAKE_CHUNK 256
+#define BAKE_PI 3.14159265f
+
+struct LightBakerData {
+    Bvh occluders;
+    SoftLighting lighting;
+    vector<SceneLight> lights; // as given, in eye space
+    vector<Material> materials;
+    vector<GLfloat> toLight; // per light in world space: the direction of a directional light, the position of a point light
+    GLfloat view[16];
+    int occlusionRays;
+    GLfloat occlusionDistance;
+};
+
+// the work of one thread
+struct BakeCounters {
+    long occlusion = 0;
+    long shadow = 0;
+};
+
+LightBaker::LightBaker() : data(new LightBakerData()), pool(new ThreadPool(hardwareThreads())) {
+    data->lighting = SoftLighting();
+    for (int i = 0; i < 16; i++)
+        data->view[i] = i % 5 == 0 ? 1.0f : 0.0f;
+    data->occlusionRays = 32;
+    data->occlusionDistance = 2.0f;
+}
+
+LightBaker::~LightBaker() {
+    delete pool;
+    delete data;
+}
+
+void LightBaker::setThreads(int threads) {
+    if (threads != pool->size()) {
+        delete pool;
+        pool = new ThreadPool(max(threads, 1));
+    }
+}
+
+int LightBaker::threads() const {
+    return pool->size();
+}
+
+void LightBaker::clear() {
+    data->occluders.clear();
+}
+
+void LightBaker::addOccluder(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3]) {
+    data->occluders.addTriangle(a, b, c);
+}
+
+void LightBaker::build() {
+    data->occluders.build();
+}
+
+int LightBaker::occluders() const {
+    return data->occluders.triangles();
+}
+
+void LightBaker::setLighting(const SoftLighting& lighting, const GLfloat view[16]) {
+    data->lighting = lighting;
+    data->lights.assign(lighting.lights, lighting.lights + lighting.lightCount);
+    data->materials.assign(lighting.materials, lighting.materials + lighting.materialCount);
+    data->lighting.lights = data->lights.empty() ? NULL : &data->lights[0];
+    data->lighting.materials = data->materials.empty() ? NULL : &data->materials[0];
+    copy(view, view + 16, data->view);
+
+    // shadow rays are cast in world space; the view is a rotation and a translation,
+    // its inverse rotation is the transpose
+    data->toLight.assign(data->lights.size() * 3, 0.0f);
+    for (size_t i = 0; i < data->lights.size(); i++) {
+        const GLfloat* position = data->lights[i].position;
+        GLfloat eye[3] = { position[0], position[1], position[2] };
+        if (position[3] != 0.0f) {
+            for (int k = 0; k < 3; k++)
+                eye[k] = eye[k] / position[3] - view[12 + k];
+        }
+        for (int k = 0; k < 3; k++)
+            data->toLight[i * 3 + k] = view[k * 4] * eye[0] + view[k * 4 + 1] * eye[1] + view[k * 4 + 2] * eye[2];
+    }
+}
+
+void LightBaker::setOcclusion(int rays, GLfloat distance) {
+    data->occlusionRays = max(rays, 0);
+    data->occlusionDistance = distance;
+}
+
+
+
+// geometry helpers
+
+static void transformPoint(const GLfloat m[16], const GLfloat v[3], GLfloat out[3]) {
+    for (int k = 0; k < 3; k++)
+        out[k] = m[k] * v[0] + m[4 + k] * v[1] + m[8 + k] * v[2] + m[12 + k];
+}
+
+// the inverse transpose of the upper 3x3, rows of the result
+static void normalMatrix(const GLfloat m[16], GLfloat n[9]) {
+    GLfloat a = m[0], b = m[4], c = m[8];
+    GLfloat d = m[1], e = m[5], f = m[9];
+    GLfloat g = m[2], h = m[6], k = m[10];
+
+    GLfloat cofactor[9] = {
+        e * k - f * h, f * g - d * k, d * h - e * g,
+        c * h - b * k, a * k - c * g, b * g - a * h,
+        b * f - c * e, c * d - a * f, a * e - b * d
+    };
+    GLfloat determinant = a * cofactor[0] + b * cofactor[1] + c * cofactor[2];
+    GLfloat inverse = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+    for (int i = 0; i < 9; i++)
+        n[i] = cofactor[i] * inverse;
+}
+
+static void transformNormal(const GLfloat n[9], const GLfloat v[3], GLfloat out[3]) {
+    out[0] = n[0] * v[0] + n[1] * v[1] + n[2] * v[2];
+    out[1] = n[3] * v[0] + n[4] * v[1] + n[5] * v[2];
+    out[2] = n[6] * v[0] + n[7] * v[1] + n[8] * v[2];
+}
+
+static GLfloat dot3(const GLfloat a[3], const GLfloat b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void normalize3(GLfloat v[3]) {
+    GLfloat length = sqrtf(dot3(v, v));
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+// two unit vectors that make an orthonormal basis with the unit normal
+static void tangentBasis(const GLfloat n[3], GLfloat t[3], GLfloat b[3]) {
+    GLfloat axis[3] = { 0.0f, 0.0f, 0.0f };
+    axis[fabsf(n[0]) < 0.6f ? 0 : (fabsf(n[1]) < 0.6f ? 1 : 2)] = 1.0f;
+    t[0] = axis[1] * n[2] - axis[2] * n[1];
+    t[1] = axis[2] * n[0] - axis[0] * n[2];
+    t[2] = axis[0] * n[1] - axis[1] * n[0];
+    normalize3(t);
+    b[0] = n[1] * t[2] - n[2] * t[1];
+    b[1] = n[2] * t[0] - n[0] * t[2];
+    b[2] = n[0] * t[1] - n[1] * t[0];
+}
+
+// integer hash of the vertex index, spreads neighbouring indices over the whole range
+static uint32_t hashIndex(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static GLfloat radicalInverse(uint32_t bits) {
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+    bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+    bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+    return (GLfloat)bits * 2.3283064e-10f;
+}
+
+
+
+// baking one vertex
+
+// This function is responsible for the share of the hemisphere around a world-space vertex that is open
+static GLfloat openSky(const LightBakerData& data, BakeCounters& counters, const GLfloat position[3], const GLfloat normal[3], GLfloat bias, uint32_t seed) {
+    int rays = data.occlusionRays;
+    if (rays == 0)
+        return 1.0f;
+
+    GLfloat tangent[3], bitangent[3];
+    tangentBasis(normal, tangent, bitangent);
+
+    GLfloat origin[3];
+    for (int k = 0; k < 3; k++)
+        origin[k] = position[k] + normal[k] * bias;
+
+    // a Hammersley set, cosine weighted, turned and shifted by the vertex so neighbours
+    // do not band; the same vertex always gets the same rays
+    GLfloat turn = (GLfloat)(seed & 0xffff) / 65536.0f;
+    GLfloat shift = (GLfloat)(seed >> 16) / 65536.0f;
+    int open = 0;
+
+    for (int i = 0; i < rays; i++) {
+        GLfloat u = (i + shift) / rays;
+        u -= floorf(u);
+        GLfloat angle = 2.0f * BAKE_PI * (radicalInverse((uint32_t)i) + turn);
+        GLfloat radius = sqrtf(u);
+        GLfloat x = radius * cosf(angle), y = radius * sinf(angle), z = sqrtf(max(1.0f - u, 0.0f));
+
+        GLfloat direction[3];
+        for (int k = 0; k < 3; k++)
+            direction[k] = tangent[k] * x + bitangent[k] * y + normal[k] * z;
+
+        if (!data.occluders.occluded(origin, direction, data.occlusionDistance))
+            open++;
+    }
+    counters.occlusion += rays;
+    return (GLfloat)open / rays;
+}
+
+// This function is responsible for whether a world-space vertex can see a light
+static bool seesLight(const LightBakerData& data, BakeCounters& counters, int light, const GLfloat position[3], const GLfloat normal[3], GLfloat bias) {
+    const GLfloat* toLight = &data.toLight[light * 3];
+    GLfloat direction[3] = { toLight[0], toLight[1], toLight[2] };
+    GLfloat distance = 1e30f;
+
+    if (data.lights[light].position[3] != 0.0f) {
+        for (int k = 0; k < 3; k++)
+            direction[k] -= position[k];
+        distance = sqrtf(dot3(direction, direction));
+    }
+    normalize3(direction);
+
+    // facing away, the diffuse term is 0 anyway
+    if (dot3(direction, normal) <= 0.0f)
+        return false;
+
+    GLfloat origin[3];
+    for (int k = 0; k < 3; k++)
+        origin[k] = position[k] + normal[k] * bias;
+
+    counters.shadow++;
+    return !data.occluders.occluded(origin, direction, distance);
+}
+
+// This function is responsible for the fixed-function lighting equation, with ambient occlusion
+// and each light's visibility folded in; eye and normal are in eye space like OpenGL's
+static void bakeVertex(const LightBakerData& data, const Material& material, const GLfloat eye[3], const GLfloat normal[3], GLfloat sky, const char* visible, GLfloat color[3]) {
+    const SoftLighting& lighting = data.lighting;
+    for (int c = 0; c < 3; c++)
+        color[c] = material.ambient[c] * lighting.globalAmbient[c] * sky;
+
+    for (int i = 0; i < lighting.lightCount; i++) {
+        const SceneLight& light = lighting.lights[i];
+
+        for (int c = 0; c < 3; c++)
+            color[c] += material.ambient[c] * light.ambient[c] * sky;
+        if (!visible[i])
+            continue;
+
+        GLfloat toLight[3];
+        if (light.position[3] != 0.0f) {
+            for (int c = 0; c < 3; c++)
+                toLight[c] = light.position[c] / light.position[3] - eye[c];
+        } else {
+            for (int c = 0; c < 3; c++)
+                toLight[c] = light.position[c];
+        }
+        normalize3(toLight);
+
+        GLfloat diffuse = dot3(normal, toLight);
+        if (diffuse <= 0.0f)
+            continue;
+
+        // non-local viewer, the half vector is taken against (0, 0, 1)
+        GLfloat specular = 0.0f;
+        GLfloat half[3] = { toLight[0], toLight[1], toLight[2] + 1.0f };
+        normalize3(half);
+        GLfloat angle = dot3(normal, half);
+        if (angle > 0.0f)
+            specular = material.shininess > 0.0f ? powf(angle, material.shininess) : 1.0f;
+
+        for (int c = 0; c < 3; c++)
+            color[c] += diffuse * material.diffuse[c] * light.diffuse[c] + specular * material.specular[c] * light.specular[c];
+    }
+
+    for (int c = 0; c < 3; c++)
+        color[c] = min(max(color[c], 0.0f), 1.0f);
+}
+
+static uint32_t packColor(const GLfloat color[3], GLfloat alpha) {
+    uint32_t r = (uint32_t)(color[0] * 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(color[1] * 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(color[2] * 255.0f + 0.5f);
+    uint32_t a = (uint32_t)(min(max(alpha, 0.0f), 1.0f) * 255.0f + 0.5f);
+
+    // RGBA in memory order, as glColorPointer reads GL_UNSIGNED_BYTE
+    const uint32_t probe = 1;
+    if (*(const unsigned char*)&probe)
+        return r | g << 8 | b << 16 | a << 24;
+    return r << 24 | g << 16 | b << 8 | a;
+}
+
+
+
+// baking a mesh
+
+// This function is responsible for baking the colour of every vertex of a mesh across the pool
+BakeStats LightBaker::bake(const Mesh& mesh, const GLfloat model[16], int paintFrom, int paintTo, vector<uint32_t>& colors) {
+    const LightBakerData& bakeData = *data;
+    size_t count = mesh.vertices.size();
+    colors.assign(count, 0xffffffffu);
+
+    // every vertex belongs to the primitives of one material, so one batch decides its material
+    vector<int> vertexMaterial(count, -1);
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const MeshBatch& batch = mesh.batches[b];
+        int material = batch.material == paintFrom && paintTo >= 0 ? paintTo : batch.material;
+        for (GLsizei i = 0; i < batch.indexCount; i++)
+            vertexMaterial[mesh.indices[batch.firstIndex + i]] = material;
+    }
+
+    GLfloat modelview[16];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            modelview[c * 4 + r] = 0.0f;
+            for (int k = 0; k < 4; k++)
+                modelview[c * 4 + r] += data->view[k * 4 + r] * model[c * 4 + k];
+        }
+    }
+    GLfloat eyeNormals[9], worldNormals[9];
+    normalMatrix(modelview, eyeNormals);
+    normalMatrix(model, worldNormals);
+
+    // rays leave a little above the surface, so a vertex does not hit its own triangle
+    GLfloat bias = max(mesh.radius * 1e-3f, 1e-4f);
+
+    Material white = Material();
+    for (int c = 0; c < 3; c++)
+        white.ambient[c] = white.diffuse[c] = 1.0f;
+    white.ambient[3] = white.diffuse[3] = 1.0f;
+
+    vector<BakeCounters> counters(pool->size());
+    int chunks = (int)((count + BAKE_CHUNK - 1) / BAKE_CHUNK);
+
+    double start = nowMilliseconds();
+    pool->parallelFor(chunks, [&](int chunk, int worker) {
+        vector<char> visible(max(bakeData.lighting.lightCount, 1));
+        size_t end = min(count, (size_t)(chunk + 1) * BAKE_CHUNK);
+
+        for (size_t i = (size_t)chunk * BAKE_CHUNK; i < end; i++) {
+            const MeshVertex& vertex = mesh.vertices[i];
+            int index = vertexMaterial[i];
+            const Material& material = index >= 0 && index < bakeData.lighting.materialCount ? bakeData.lighting.materials[index] : white;
+
+            GLfloat world[3], worldNormal[3], eye[3], eyeNormal[3];
+            transformPoint(model, vertex.position, world);
+            transformPoint(modelview, vertex.position, eye);
+            transformNormal(worldNormals, vertex.normal, worldNormal);
+            normalize3(worldNormal);
+            // like OpenGL without GL_NORMALIZE, the eye-space normal keeps the scale
+            transformNormal(eyeNormals, vertex.normal, eyeNormal);
+
+            for (int l = 0; l < bakeData.lighting.lightCount; l++)
+                visible[l] = seesLight(bakeData, counters[worker], l, world, worldNormal, bias);
+            GLfloat sky = openSky(bakeData, counters[worker], world, worldNormal, bias, hashIndex((uint32_t)i));
+
+            GLfloat color[3];
+            bakeVertex(bakeData, material, eye, eyeNormal, sky, &visible[0], color);
+            colors[i] = packColor(color, material.diffuse[3]);
+        }
+    });
+
+    BakeStats stats = { (long)count, 0, 0, nowMilliseconds() - start };
+    for (size_t i = 0; i < counters.size(); i++) {
+        stats.occlusionRays += counters[i].occlusion;
+        stats.shadowRays += counters[i].shadow;
+    }
+    return stats;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <GL/glut.h>
+#include "meshcache.h"
+#include "softraster.h"
+#include "bvh.h"
+
+/*
+    Static lighting bake
+
+    Objects that never move do not need the lighting equation evaluated for them every
+    frame. bake() evaluates it once per vertex, with the same lights and material table
+    as the OpenGL path (ambient, diffuse and the non-local-viewer specular, clamped like
+    fixed-function lighting), and stores the result as an RGBA colour per vertex that is
+    drawn with lighting off.
+
+    Two terms the per-frame path cannot afford are added while at it:
+
+    - ambient occlusion: rays over the hemisphere around each vertex normal, against the
+      occluders, darken the ambient terms by the share that is blocked nearby;
+    - shadows: a ray towards every light decides whether that light's diffuse and
+      specular terms reach the vertex at all.
+
+    The lights of this scene sit in eye space (they follow the camera), so a bake holds
+    for the view it was made with, like the lit image does. The vertices are shared out
+    over the work-stealing ThreadPool; every vertex takes its rays from its own index, so
+    the result does not depend on the thread count.
+*/
+
+// what one bake() did
+struct BakeStats {
+    long vertices;
+    long occlusionRays;
+    long shadowRays;
+    double milliseconds;
+};
+
+struct LightBakerData;
+class ThreadPool;
+
+class LightBaker {
+
+public:
+
+    LightBaker();
+
+    ~LightBaker();
+
+    LightBaker(const LightBaker&) = delete;
+
+    LightBaker& operator=(const LightBaker&) = delete;
+
+
+
+    // threads used by bake(), the calling thread included
+    void setThreads(int threads);
+
+    int threads() const;
+
+
+
+    // the triangles that occlude and shadow the baked vertices, in world space;
+    // build() must be called after the last add
+    void clear();
+
+    void addOccluder(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3]);
+
+    void build();
+
+    int occluders() const;
+
+
+
+    // lights in eye space as the OpenGL path stores them, view is the camera matrix that maps world to eye space
+    void setLighting(const SoftLighting& lighting, const GLfloat view[16]);
+
+    // hemisphere rays per vertex and how far an occluder still darkens the vertex, 0 rays for no occlusion
+    void setOcclusion(int rays, GLfloat distance);
+
+
+
+    // the colour of every vertex of the mesh drawn with a column-major model matrix, as RGBA bytes;
+    // batches using paintFrom get paintTo, -1 for no paint
+    BakeStats bake(const Mesh& mesh, const GLfloat model[16], int paintFrom, int paintTo, std::vector<uint32_t>& colors);
+
+private:
+
+    LightBakerData* data;
+
+    ThreadPool* pool;
+
+};
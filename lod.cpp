@@ -0,0 +1,37 @@
+#include <math.h>
+#include "lod.h"
+
+// pixels per model unit for levels 1..3, level 0 is whatever the draw functions ask for
+static const GLfloat levelDensity[LOD_LEVELS] = { 0.0f, 64.0f, 24.0f, 8.0f };
+
+static vector3 lodEye(7.0, 7.0, 7.0);
+static GLfloat lodProjectionScale = 1.5f;
+static int lodViewportHeight = 500;
+
+GLfloat lodPixelsPerUnit(int level) {
+    return levelDensity[level];
+}
+
+void setLodView(const vector3& eye, GLfloat projectionScale, int viewportHeight) {
+    lodEye = eye;
+    lodProjectionScale = projectionScale;
+    lodViewportHeight = viewportHeight;
+}
+
+// This function is responsible for turning the distance to the object into a level
+int selectLod(const GLfloat center[3], GLfloat radius, GLfloat scale) {
+    vector3 worldCenter(center[0], center[1], center[2]);
+
+    // the nearest point of the bounding sphere decides, so no part of the object is under-tessellated
+    GLfloat distance = lodEye.distance(worldCenter) - radius;
+    if (distance < 0.01f)
+        return 0;
+
+    // pixels covered by one model unit at that distance
+    GLfloat density = lodProjectionScale * (lodViewportHeight * 0.5f) / distance * scale;
+
+    int level = 0;
+    while (level + 1 < LOD_LEVELS && levelDensity[level + 1] >= density)
+        level++;
+    return level;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <GL/glut.h>
+#include "vector3.h"
+
+/*
+    Level of detail for the composite objects.
+
+    Every object is captured LOD_LEVELS times. Level 0 uses the slices and stacks the draw
+    functions ask for; each coarser level is tessellated for a lower screen density (pixels
+    per model unit), so every cylinder and sphere gets as many segments as its own size
+    needs at that density: a thin bench leg drops to a handful of slices long before a
+    foliage sphere does. Each frame an object picks the coarsest level that is still built
+    for at least its current projected density.
+*/
+
+#define LOD_LEVELS 4
+
+// screen density a level is built for, 0 for level 0 (full detail)
+GLfloat lodPixelsPerUnit(int level);
+
+// camera parameters for the projected size, projectionScale is element [5] of the projection matrix
+void setLodView(const vector3& eye, GLfloat projectionScale, int viewportHeight);
+
+// picks the level for an object with the given world space bounding sphere, drawn with a uniform scale
+int selectLod(const GLfloat center[3], GLfloat radius, GLfloat scale);
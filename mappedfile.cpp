@@ -0,0 +1,82 @@
+#include "platform.h"
+#include "mappedfile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool mapFile(const char* filename, MappedFile& file) {
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    file.data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (file.data == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+    file.size = (size_t)size.QuadPart;
+    file.fileHandle = handle;
+    file.mappingHandle = mapping;
+    return true;
+}
+
+void unmapFile(MappedFile& file) {
+    if (file.data)
+        UnmapViewOfFile(file.data);
+    if (file.mappingHandle)
+        CloseHandle(file.mappingHandle);
+    if (file.fileHandle)
+        CloseHandle(file.fileHandle);
+    file = MappedFile();
+}
+
+#else
+
+bool mapFile(const char* filename, MappedFile& file) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+    file.data = (const unsigned char*)data;
+    file.size = (size_t)info.st_size;
+    return true;
+}
+
+void unmapFile(MappedFile& file) {
+    if (file.data)
+        munmap((void*)file.data, file.size);
+    file = MappedFile();
+}
+
+#endif
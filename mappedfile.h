@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+    Read-only memory mapping of a whole file (MapViewOfFile on Windows, mmap elsewhere),
+    used by the loaders that read straight out of the file instead of copying it.
+*/
+
+struct MappedFile {
+    const unsigned char* data = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = NULL;
+    void* mappingHandle = NULL;
+#endif
+};
+
+// maps the whole file, false if it cannot be opened or is empty
+bool mapFile(const char* filename, MappedFile& file);
+
+void unmapFile(MappedFile& file);
@@ -0,0 +1,523 @@
+#include <math.h>
+#include <string.h>
+#include <map>
+#include "meshcache.h"
+#include "meshgen.h"
+#include "vertexpack.h"
+#include "glloader.h"
+#include "framestats.h"
+#include "instrument.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// column-major 4x4 matrix, the same layout OpenGL uses
+struct Matrix4 {
+    GLfloat m[16];
+};
+
+// capture state, one per thread so several meshes can be captured at once
+static thread_local Mesh* captureMesh = NULL;
+static thread_local int captureMaterial = -1;
+static thread_local std::map<int, std::vector<GLuint> > captureIndices; // triangles grouped by material
+static thread_local std::vector<Matrix4> matrixStack;
+
+// current primitive
+static thread_local GLenum primitiveMode;
+static thread_local std::vector<GLuint> primitiveVertices;
+static thread_local GLfloat currentNormal[3] = { 0.0f, 0.0f, 1.0f };
+
+// the arrays the cylinders, spheres and boxes are generated into, reused from shape to shape
+static thread_local ShapeArrays shapeArrays;
+
+// level of detail, see setMeshDetail()
+static thread_local GLfloat detailPixelsPerUnit = 0.0f;
+static const GLfloat pixelsPerSegment = 6.0f;
+
+static Matrix4 identity() {
+    Matrix4 r;
+    memset(r.m, 0, sizeof(r.m));
+    r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+    return r;
+}
+
+static Matrix4 multiply(const Matrix4& a, const Matrix4& b) {
+    Matrix4 r;
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            GLfloat sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += a.m[k * 4 + row] * b.m[col * 4 + k];
+            r.m[col * 4 + row] = sum;
+        }
+    }
+    return r;
+}
+
+// bounding sphere around the centre of the axis aligned box, tight enough for culling and LOD
+static void computeBounds(Mesh& mesh) {
+    if (mesh.vertices.empty())
+        return;
+
+    GLfloat low[3], high[3];
+    for (int k = 0; k < 3; k++)
+        low[k] = high[k] = mesh.vertices[0].position[k];
+
+    for (size_t i = 1; i < mesh.vertices.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            GLfloat p = mesh.vertices[i].position[k];
+            if (p < low[k]) low[k] = p;
+            if (p > high[k]) high[k] = p;
+        }
+    }
+
+    GLfloat radiusSquared = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        mesh.boundsMin[k] = low[k];
+        mesh.boundsMax[k] = high[k];
+        mesh.center[k] = (low[k] + high[k]) * 0.5f;
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const GLfloat* p = mesh.vertices[i].position;
+        GLfloat dx = p[0] - mesh.center[0], dy = p[1] - mesh.center[1], dz = p[2] - mesh.center[2];
+        GLfloat d = dx * dx + dy * dy + dz * dz;
+        if (d > radiusSquared)
+            radiusSquared = d;
+    }
+    mesh.radius = sqrtf(radiusSquared);
+}
+
+void setMeshDetail(GLfloat pixelsPerUnit) {
+    detailPixelsPerUnit = pixelsPerUnit;
+}
+
+// segments needed for a length of the given size at the current detail, never more than asked for
+static GLint detailSegments(GLdouble length, GLint requested, GLint minimum) {
+    if (detailPixelsPerUnit <= 0.0f)
+        return requested;
+
+    GLint segments = (GLint)ceil(length * detailPixelsPerUnit / pixelsPerSegment);
+    if (segments < minimum)
+        segments = minimum;
+    return segments < requested ? segments : requested;
+}
+
+void beginMeshCapture(Mesh* mesh) {
+    captureMesh = mesh;
+    captureMaterial = -1;
+    captureIndices.clear();
+    matrixStack.assign(1, identity());
+
+    mesh->vertices.clear();
+    mesh->indices.clear();
+    mesh->batches.clear();
+}
+
+// This function is responsible for merging the per material triangle lists into the final index buffer
+void endMeshCapture() {
+    std::map<int, std::vector<GLuint> >::iterator it;
+
+    for (it = captureIndices.begin(); it != captureIndices.end(); ++it) {
+        if (it->second.empty())
+            continue;
+
+        MeshBatch batch;
+        batch.material = it->first;
+        batch.firstIndex = (GLuint)captureMesh->indices.size();
+        batch.indexCount = (GLsizei)it->second.size();
+        captureMesh->batches.push_back(batch);
+        captureMesh->indices.insert(captureMesh->indices.end(), it->second.begin(), it->second.end());
+    }
+
+    captureIndices.clear();
+    computeBounds(*captureMesh);
+    captureMesh = NULL;
+}
+
+bool isCapturingMesh() {
+    return captureMesh != NULL;
+}
+
+void meshMaterial(int material) {
+    captureMaterial = material;
+}
+
+void meshBegin(GLenum mode) {
+    if (!captureMesh) {
+        glBegin(mode);
+        return;
+    }
+    primitiveMode = mode;
+    primitiveVertices.clear();
+}
+
+// This function is responsible for turning the recorded primitive into triangles of the current material
+void meshEnd() {
+    if (!captureMesh) {
+        glEnd();
+        return;
+    }
+
+    std::vector<GLuint>& out = captureIndices[captureMaterial];
+    const std::vector<GLuint>& v = primitiveVertices;
+    size_t n = v.size();
+    size_t i;
+
+    switch (primitiveMode) {
+    case GL_TRIANGLES:
+        for (i = 0; i + 2 < n; i += 3) {
+            out.push_back(v[i]); out.push_back(v[i + 1]); out.push_back(v[i + 2]);
+        }
+        break;
+    case GL_QUADS:
+        for (i = 0; i + 3 < n; i += 4) {
+            out.push_back(v[i]); out.push_back(v[i + 1]); out.push_back(v[i + 2]);
+            out.push_back(v[i]); out.push_back(v[i + 2]); out.push_back(v[i + 3]);
+        }
+        break;
+    case GL_QUAD_STRIP:
+        for (i = 0; i + 3 < n; i += 2) {
+            out.push_back(v[i]); out.push_back(v[i + 1]); out.push_back(v[i + 3]);
+            out.push_back(v[i]); out.push_back(v[i + 3]); out.push_back(v[i + 2]);
+        }
+        break;
+    case GL_TRIANGLE_STRIP:
+        for (i = 0; i + 2 < n; i++) {
+            if (i % 2 == 0) {
+                out.push_back(v[i]); out.push_back(v[i + 1]); out.push_back(v[i + 2]);
+            }
+            else {
+                out.push_back(v[i + 1]); out.push_back(v[i]); out.push_back(v[i + 2]);
+            }
+        }
+        break;
+    case GL_TRIANGLE_FAN:
+    case GL_POLYGON:
+        for (i = 1; i + 1 < n; i++) {
+            out.push_back(v[0]); out.push_back(v[i]); out.push_back(v[i + 1]);
+        }
+        break;
+    default:
+        break;
+    }
+
+    primitiveVertices.clear();
+}
+
+void meshNormal3f(GLfloat x, GLfloat y, GLfloat z) {
+    if (!captureMesh) {
+        glNormal3f(x, y, z);
+        return;
+    }
+    currentNormal[0] = x;
+    currentNormal[1] = y;
+    currentNormal[2] = z;
+}
+
+// This function is responsible for transforming a vertex and its normal by the capture matrix stack and storing it
+static GLuint captureVertex(GLfloat x, GLfloat y, GLfloat z, const GLfloat normal[3]) {
+    const GLfloat* m = matrixStack.back().m;
+    MeshVertex vertex;
+
+    vertex.position[0] = m[0] * x + m[4] * y + m[8] * z + m[12];
+    vertex.position[1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+    vertex.position[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+
+    // the captured objects only use rotations and translations, so the upper 3x3 is the normal matrix
+    GLfloat nx = m[0] * normal[0] + m[4] * normal[1] + m[8] * normal[2];
+    GLfloat ny = m[1] * normal[0] + m[5] * normal[1] + m[9] * normal[2];
+    GLfloat nz = m[2] * normal[0] + m[6] * normal[1] + m[10] * normal[2];
+    GLfloat length = sqrtf(nx * nx + ny * ny + nz * nz);
+    if (length > 0.0f) {
+        nx /= length;
+        ny /= length;
+        nz /= length;
+    }
+    vertex.normal[0] = nx;
+    vertex.normal[1] = ny;
+    vertex.normal[2] = nz;
+
+    captureMesh->vertices.push_back(vertex);
+    return (GLuint)(captureMesh->vertices.size() - 1);
+}
+
+void meshVertex3f(GLfloat x, GLfloat y, GLfloat z) {
+    if (!captureMesh) {
+        glVertex3f(x, y, z);
+        return;
+    }
+    primitiveVertices.push_back(captureVertex(x, y, z, currentNormal));
+}
+
+void meshVertex3fv(const GLfloat* v) {
+    if (!captureMesh) {
+        glVertex3fv(v);
+        return;
+    }
+    meshVertex3f(v[0], v[1], v[2]);
+}
+
+void meshPushMatrix() {
+    if (!captureMesh) {
+        glPushMatrix();
+        return;
+    }
+    matrixStack.push_back(matrixStack.back());
+}
+
+void meshPopMatrix() {
+    if (!captureMesh) {
+        glPopMatrix();
+        return;
+    }
+    if (matrixStack.size() > 1)
+        matrixStack.pop_back();
+}
+
+void meshTranslatef(GLfloat x, GLfloat y, GLfloat z) {
+    if (!captureMesh) {
+        glTranslatef(x, y, z);
+        return;
+    }
+    Matrix4 t = identity();
+    t.m[12] = x;
+    t.m[13] = y;
+    t.m[14] = z;
+    matrixStack.back() = multiply(matrixStack.back(), t);
+}
+
+void meshRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+    if (!captureMesh) {
+        glRotatef(angle, x, y, z);
+        return;
+    }
+
+    GLfloat length = sqrtf(x * x + y * y + z * z);
+    if (length == 0.0f)
+        return;
+    x /= length;
+    y /= length;
+    z /= length;
+
+    GLfloat radians = (GLfloat)(angle * M_PI / 180.0);
+    GLfloat c = cosf(radians);
+    GLfloat s = sinf(radians);
+    GLfloat t = 1.0f - c;
+
+    // same matrix glRotate builds
+    Matrix4 r = identity();
+    r.m[0] = x * x * t + c;
+    r.m[1] = y * x * t + z * s;
+    r.m[2] = x * z * t - y * s;
+    r.m[4] = x * y * t - z * s;
+    r.m[5] = y * y * t + c;
+    r.m[6] = y * z * t + x * s;
+    r.m[8] = x * z * t + y * s;
+    r.m[9] = y * z * t - x * s;
+    r.m[10] = z * z * t + c;
+    matrixStack.back() = multiply(matrixStack.back(), r);
+}
+
+// This function is responsible for adding a generated shape to the capture, or drawing it as triangles outside of one
+static void emitShape(const ShapeArrays& shape, size_t vertexCount, size_t indexCount) {
+    if (!captureMesh) {
+        glBegin(GL_TRIANGLES);
+        for (size_t i = 0; i < indexCount; i++) {
+            GLuint v = shape.indices[i];
+            glNormal3f(shape.nx[v], shape.ny[v], shape.nz[v]);
+            glVertex3f(shape.x[v], shape.y[v], shape.z[v]);
+        }
+        glEnd();
+        return;
+    }
+
+    GLuint base = (GLuint)captureMesh->vertices.size();
+    captureMesh->vertices.reserve(base + vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        const GLfloat normal[3] = { shape.nx[v], shape.ny[v], shape.nz[v] };
+        captureVertex(shape.x[v], shape.y[v], shape.z[v], normal);
+    }
+
+    std::vector<GLuint>& out = captureIndices[captureMaterial];
+    size_t first = out.size();
+    out.resize(first + indexCount);
+    for (size_t i = 0; i < indexCount; i++)
+        out[first + i] = base + shape.indices[i];
+}
+
+// the cylinder gluCylinder draws, along the +z axis
+void meshCylinder(GLdouble baseRadius, GLdouble topRadius, GLdouble height, GLint slices, GLint stacks) {
+    GLdouble widest = baseRadius > topRadius ? baseRadius : topRadius;
+    slices = detailSegments(2.0 * M_PI * widest, slices, 4);
+    stacks = detailSegments(height / 4.0, stacks, 1); // the side is straight, stacks only help the shading
+
+    ShapeSize size = cylinderSize(slices, stacks);
+    shapeArrays.resize(size.vertices, size.indices);
+    generateCylinder(baseRadius, topRadius, height, slices, stacks, shapeArrays, 0, 0);
+    emitShape(shapeArrays, size.vertices, size.indices);
+}
+
+// the sphere glutSolidSphere draws, centred on the origin; freeglut would not draw its own without a GLUT window (headless mode)
+void meshSphere(GLdouble radius, GLint slices, GLint stacks) {
+    slices = detailSegments(2.0 * M_PI * radius, slices, 6);
+    stacks = detailSegments(M_PI * radius, stacks, 4);
+
+    ShapeSize size = sphereSize(slices, stacks);
+    shapeArrays.resize(size.vertices, size.indices);
+    generateSphere(radius, slices, stacks, shapeArrays, 0, 0);
+    emitShape(shapeArrays, size.vertices, size.indices);
+}
+
+void meshBox(GLfloat width, GLfloat height, GLfloat depth) {
+    ShapeSize size = boxSize();
+    shapeArrays.resize(size.vertices, size.indices);
+    generateBox(width, height, depth, shapeArrays, 0, 0);
+    emitShape(shapeArrays, size.vertices, size.indices);
+}
+
+void uploadMesh(Mesh& mesh, bool packed) {
+    if (!hasBufferObjects || mesh.vertices.empty())
+        return;
+
+    pglGenBuffers(1, &mesh.vertexBuffer);
+    pglBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    if (packed) {
+        std::vector<PackedVertex> vertices;
+        packedPositionMapping(mesh, mesh.packedScale, mesh.packedOffset);
+        packVertices(mesh, mesh.packedScale, mesh.packedOffset, vertices);
+        pglBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), &vertices[0], GL_STATIC_DRAW);
+    }
+    else
+        pglBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(MeshVertex), &mesh.vertices[0], GL_STATIC_DRAW);
+    mesh.packed = packed;
+    pglBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    pglGenBuffers(1, &mesh.indexBuffer);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    pglBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint), &mesh.indices[0], GL_STATIC_DRAW);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void deleteMesh(Mesh& mesh) {
+    if (mesh.vertexBuffer)
+        pglDeleteBuffers(1, &mesh.vertexBuffer);
+    if (mesh.indexBuffer)
+        pglDeleteBuffers(1, &mesh.indexBuffer);
+    mesh.vertexBuffer = 0;
+    mesh.indexBuffer = 0;
+    mesh.packed = false;
+}
+
+void bindMesh(const Mesh& mesh) {
+    // without buffer objects the arrays are read straight from client memory
+    const GLubyte* vertexBase = NULL;
+
+    // fixed-function lighting needs whole normals, a packed mesh is lit from its floats
+    bool clientVertices = mesh.vertexBuffer == 0 || mesh.packed;
+
+    if (hasBufferObjects) {
+        pglBindBuffer(GL_ARRAY_BUFFER, clientVertices ? 0 : mesh.vertexBuffer);
+        pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    }
+    if (clientVertices)
+        vertexBase = (const GLubyte*)&mesh.vertices[0];
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), vertexBase + offsetof(MeshVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), vertexBase + offsetof(MeshVertex, normal));
+}
+
+void drawMeshBatch(const Mesh& mesh, size_t batch) {
+    const MeshBatch& range = mesh.batches[batch];
+    const GLubyte* indexBase = mesh.indexBuffer ? NULL : (const GLubyte*)&mesh.indices[0];
+
+    glDrawElements(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, indexBase + range.firstIndex * sizeof(GLuint));
+    countDraw(range.indexCount / 3);
+}
+
+void unbindMesh() {
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    if (hasBufferObjects) {
+        pglBindBuffer(GL_ARRAY_BUFFER, 0);
+        pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+// This function is responsible for drawing a cached mesh, one glDrawElements per material batch
+void drawMesh(const Mesh& mesh, void (*applyMaterial)(int)) {
+    if (mesh.vertices.empty())
+        return;
+
+    bindMesh(mesh);
+    for (size_t i = 0; i < mesh.batches.size(); i++) {
+        applyMaterial(mesh.batches[i].material);
+        drawMeshBatch(mesh, i);
+    }
+    unbindMesh();
+}
+
+// sets up the positions for the unlit draws; a packed mesh's quantized positions are read as
+// they are and mapped back by the modelview matrix, pushed here and popped by unbindPositions()
+static void bindPositions(const Mesh& mesh) {
+    if (!mesh.packed) {
+        bindMesh(mesh);
+        return;
+    }
+
+    pglBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_SHORT, sizeof(PackedVertex), (const GLubyte*)NULL + offsetof(PackedVertex, position));
+
+    glPushMatrix();
+    glTranslatef(mesh.packedOffset[0], mesh.packedOffset[1], mesh.packedOffset[2]);
+    glScalef(mesh.packedScale[0], mesh.packedScale[1], mesh.packedScale[2]);
+}
+
+static void unbindPositions(const Mesh& mesh) {
+    if (!mesh.packed) {
+        unbindMesh();
+        return;
+    }
+
+    glPopMatrix();
+    glDisableClientState(GL_VERTEX_ARRAY);
+    pglBindBuffer(GL_ARRAY_BUFFER, 0);
+    pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// the batches lie back to back in the index buffer, so without materials they are one draw
+void drawMeshDepth(const Mesh& mesh) {
+    if (mesh.indices.empty())
+        return;
+
+    const GLubyte* indexBase = mesh.indexBuffer ? NULL : (const GLubyte*)&mesh.indices[0];
+    bindPositions(mesh);
+    glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, indexBase);
+    countDraw((long)mesh.indices.size() / 3);
+    unbindPositions(mesh);
+}
+
+void drawMeshBaked(const Mesh& mesh, GLuint colorBuffer, const GLubyte* colors) {
+    if (mesh.indices.empty())
+        return;
+
+    const GLubyte* indexBase = mesh.indexBuffer ? NULL : (const GLubyte*)&mesh.indices[0];
+    bindPositions(mesh);
+
+    // glColorPointer takes the buffer bound when it is called, the other arrays keep theirs
+    if (hasBufferObjects)
+        pglBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, colorBuffer ? NULL : colors);
+
+    glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, indexBase);
+    countDraw((long)mesh.indices.size() / 3);
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    unbindPositions(mesh);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <GL/glut.h>
+
+/*
+    Mesh cache
+
+    The composite objects are written against the mesh* drawing calls below instead of
+    calling glBegin/glVertex directly. Outside of a capture those calls forward straight
+    to OpenGL, so the same draw function can still be compiled into a display list.
+    Between beginMeshCapture() and endMeshCapture() they are recorded instead: every
+    primitive is transformed by a CPU-side matrix stack, turned into indexed triangles
+    and grouped by material, so the whole object can later be drawn with one
+    glDrawElements call per material. The capture state belongs to the calling thread,
+    so different threads can capture different meshes at the same time.
+
+    The cylinders, spheres and boxes come from the generators in meshgen.h on both paths.
+*/
+
+// interleaved vertex layout, position followed by normal
+struct MeshVertex {
+    GLfloat position[3];
+    GLfloat normal[3];
+};
+
+// a range of the index buffer that is drawn with a single material
+struct MeshBatch {
+    int material;
+    GLuint firstIndex;
+    GLsizei indexCount;
+};
+
+struct Mesh {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<MeshBatch> batches;
+
+    // bounding box and sphere of the vertices, filled in by endMeshCapture()
+    GLfloat boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+    GLfloat boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+    GLfloat center[3] = { 0.0f, 0.0f, 0.0f };
+    GLfloat radius = 0.0f;
+
+    // buffer objects, 0 when the mesh is drawn from client memory
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+
+    // true when vertexBuffer holds PackedVertex (see vertexpack.h), whose positions
+    // map back as q * packedScale + packedOffset
+    bool packed = false;
+    GLfloat packedScale[3] = { 1.0f, 1.0f, 1.0f };
+    GLfloat packedOffset[3] = { 0.0f, 0.0f, 0.0f };
+};
+
+// recording
+void beginMeshCapture(Mesh* mesh);
+void endMeshCapture();
+bool isCapturingMesh();
+void meshMaterial(int material);
+
+// screen density (pixels per model unit) the cylinders and spheres are tessellated for,
+// 0 keeps the slices and stacks the caller asks for; applies to both paths, on the calling thread
+void setMeshDetail(GLfloat pixelsPerUnit);
+
+// drawing calls shared by the display list and the mesh cache paths
+void meshBegin(GLenum mode);
+void meshEnd();
+void meshNormal3f(GLfloat x, GLfloat y, GLfloat z);
+void meshVertex3f(GLfloat x, GLfloat y, GLfloat z);
+void meshVertex3fv(const GLfloat* v);
+void meshPushMatrix();
+void meshPopMatrix();
+void meshTranslatef(GLfloat x, GLfloat y, GLfloat z);
+void meshRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+void meshCylinder(GLdouble baseRadius, GLdouble topRadius, GLdouble height, GLint slices, GLint stacks);
+void meshSphere(GLdouble radius, GLint slices, GLint stacks);
+void meshBox(GLfloat width, GLfloat height, GLfloat depth);
+
+// uploads the captured data into vertex and index buffers when they are available, the
+// vertices as PackedVertex when packed is true
+void uploadMesh(Mesh& mesh, bool packed = false);
+void deleteMesh(Mesh& mesh);
+
+// draws every material batch of the mesh, applyMaterial is called before each batch
+void drawMesh(const Mesh& mesh, void (*applyMaterial)(int));
+
+// the same in pieces, so batches of different meshes can be drawn in any order: bindMesh()
+// sets up the vertex arrays, drawMeshBatch() draws one batch of the bound mesh. Fixed-function
+// lighting cannot unpack normals, so a packed mesh would be drawn from the floats in client
+// memory; upload the mesh as floats for these paths instead
+void bindMesh(const Mesh& mesh);
+void drawMeshBatch(const Mesh& mesh, size_t batch);
+void unbindMesh();
+
+// draws all batches with one call and no materials, for depth-only passes
+void drawMeshDepth(const Mesh& mesh);
+
+// draws all batches with one call, coloured by one RGBA byte colour per vertex instead of
+// materials, for meshes whose lighting is baked; the colours come from colorBuffer, or from
+// colors when it is 0. Lighting should be off
+void drawMeshBaked(const Mesh& mesh, GLuint colorBuffer, const GLubyte* colors);
@@ -0,0 +1,221 @@
+#include <math.h>
+#include "meshgen.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void ShapeArrays::resize(size_t vertexCount, size_t indexCount) {
+    x.resize(vertexCount);
+    y.resize(vertexCount);
+    z.resize(vertexCount);
+    nx.resize(vertexCount);
+    ny.resize(vertexCount);
+    nz.resize(vertexCount);
+    indices.resize(indexCount);
+}
+
+
+
+// compile-time sine and cosine
+
+// pi / 2 in three parts, so an angle can be reduced by a multiple of it without losing the low bits
+static constexpr long double HALF_PI_1 = 1.5707963267948966;
+static constexpr long double HALF_PI_2 = 6.123233995736766e-17;
+static constexpr long double HALF_PI_3 = -1.4973849048591698e-33;
+
+// the Taylor series, for |x| <= pi / 4 where a dozen terms are more than enough
+static constexpr long double seriesSine(long double x) {
+    long double term = x, sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr long double seriesCosine(long double x) {
+    long double term = 1.0L, sum = 1.0L;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+// This function is responsible for sin (cosine false) or cos (cosine true) of a non-negative angle
+static constexpr double tableFunction(double angle, bool cosine) {
+    // the nearest multiple of pi / 2, then the rest in [-pi / 4, pi / 4]
+    int quadrant = (int)(angle / (double)HALF_PI_1 + 0.5);
+    long double rest = (((long double)angle - quadrant * HALF_PI_1) - quadrant * HALF_PI_2) - quadrant * HALF_PI_3;
+
+    // cos(x) = sin(x + pi / 2)
+    if (cosine)
+        quadrant++;
+    switch (quadrant % 4) {
+    case 0: return (double)seriesSine(rest);
+    case 1: return (double)seriesCosine(rest);
+    case 2: return (double)-seriesSine(rest);
+    default: return (double)-seriesCosine(rest);
+    }
+}
+
+// one row per segment count, [segments * (segments - 1) / 2, + segments)
+#define ANGLE_TABLE_SIZE (MESHGEN_TABLE_SEGMENTS * (MESHGEN_TABLE_SEGMENTS + 1) / 2)
+
+static constexpr int tableRow(int segments) {
+    return segments * (segments - 1) / 2;
+}
+
+struct AngleTable {
+    double sines[ANGLE_TABLE_SIZE];
+    double cosines[ANGLE_TABLE_SIZE];
+
+    constexpr AngleTable() : sines(), cosines() {
+        for (int segments = 1; segments <= MESHGEN_TABLE_SEGMENTS; segments++) {
+            for (int step = 0; step < segments; step++) {
+                // the angle as the generators always computed it, in double
+                double angle = 2.0 * M_PI * step / segments;
+                sines[tableRow(segments) + step] = tableFunction(angle, false);
+                cosines[tableRow(segments) + step] = tableFunction(angle, true);
+            }
+        }
+    }
+};
+
+static constexpr AngleTable angleTable;
+
+double segmentSine(GLint segments, GLint step) {
+    if (segments > MESHGEN_TABLE_SEGMENTS)
+        return sin(2.0 * M_PI * step / segments);
+    return angleTable.sines[tableRow(segments) + step];
+}
+
+double segmentCosine(GLint segments, GLint step) {
+    if (segments > MESHGEN_TABLE_SEGMENTS)
+        return cos(2.0 * M_PI * step / segments);
+    return angleTable.cosines[tableRow(segments) + step];
+}
+
+
+
+// shapes
+
+ShapeSize cylinderSize(GLint slices, GLint stacks) {
+    ShapeSize size = { (size_t)stacks * (slices + 1) * 2, (size_t)stacks * slices * 6 };
+    return size;
+}
+
+ShapeSize sphereSize(GLint slices, GLint stacks) {
+    return cylinderSize(slices, stacks);
+}
+
+ShapeSize boxSize() {
+    ShapeSize size = { 24, 36 };
+    return size;
+}
+
+static void setVertex(ShapeArrays& out, size_t v, GLfloat x, GLfloat y, GLfloat z, GLfloat nx, GLfloat ny, GLfloat nz) {
+    out.x[v] = x;
+    out.y[v] = y;
+    out.z[v] = z;
+    out.nx[v] = nx;
+    out.ny[v] = ny;
+    out.nz[v] = nz;
+}
+
+// This function is responsible for the two triangles of every quad between consecutive vertex pairs of each ring
+static void ringIndices(GLint slices, GLint stacks, ShapeArrays& out, size_t firstVertex, size_t firstIndex) {
+    GLuint* index = &out.indices[firstIndex];
+    for (GLint j = 0; j < stacks; j++) {
+        GLuint ring = (GLuint)(firstVertex + (size_t)j * (slices + 1) * 2);
+        for (GLint i = 0; i < slices; i++) {
+            GLuint a = ring + i * 2, b = a + 1, c = a + 2, d = a + 3;
+            index[0] = a; index[1] = b; index[2] = d;
+            index[3] = a; index[4] = d; index[5] = c;
+            index += 6;
+        }
+    }
+}
+
+void generateCylinder(GLdouble baseRadius, GLdouble topRadius, GLdouble height, GLint slices, GLint stacks,
+    ShapeArrays& out, size_t firstVertex, size_t firstIndex) {
+
+    // smooth normals tilted by the slope of the side, like GLU does for cones
+    GLdouble deltaRadius = baseRadius - topRadius;
+    GLdouble length = sqrt(deltaRadius * deltaRadius + height * height);
+    GLfloat zNormal = (GLfloat)(deltaRadius / length);
+    GLfloat xyNormalRatio = (GLfloat)(height / length);
+
+    size_t v = firstVertex;
+    for (GLint j = 0; j < stacks; j++) {
+        GLdouble z0 = height * j / stacks;
+        GLdouble z1 = height * (j + 1) / stacks;
+        GLdouble r0 = baseRadius - deltaRadius * j / stacks;
+        GLdouble r1 = baseRadius - deltaRadius * (j + 1) / stacks;
+
+        for (GLint i = 0; i <= slices; i++) {
+            GLint step = i == slices ? 0 : i;
+            GLfloat s = (GLfloat)segmentSine(slices, step);
+            GLfloat c = (GLfloat)segmentCosine(slices, step);
+
+            setVertex(out, v++, (GLfloat)(r0 * s), (GLfloat)(r0 * c), (GLfloat)z0, s * xyNormalRatio, c * xyNormalRatio, zNormal);
+            setVertex(out, v++, (GLfloat)(r1 * s), (GLfloat)(r1 * c), (GLfloat)z1, s * xyNormalRatio, c * xyNormalRatio, zNormal);
+        }
+    }
+    ringIndices(slices, stacks, out, firstVertex, firstIndex);
+}
+
+void generateCone(GLdouble radius, GLdouble height, GLint slices, GLint stacks, ShapeArrays& out, size_t firstVertex, size_t firstIndex) {
+    generateCylinder(radius, 0.0, height, slices, stacks, out, firstVertex, firstIndex);
+}
+
+void generateSphere(GLdouble radius, GLint slices, GLint stacks, ShapeArrays& out, size_t firstVertex, size_t firstIndex) {
+    size_t v = firstVertex;
+    for (GLint j = 0; j < stacks; j++) {
+        // pi * j / stacks is a whole turn split into twice the stacks
+        double sinPhi0 = segmentSine(stacks * 2, j), cosPhi0 = segmentCosine(stacks * 2, j);
+        double sinPhi1 = segmentSine(stacks * 2, j + 1), cosPhi1 = segmentCosine(stacks * 2, j + 1);
+
+        for (GLint i = 0; i <= slices; i++) {
+            GLint step = i == slices ? 0 : i;
+            double sinTheta = segmentSine(slices, step), cosTheta = segmentCosine(slices, step);
+            GLfloat x0 = (GLfloat)(cosTheta * sinPhi0), y0 = (GLfloat)(sinTheta * sinPhi0), z0 = (GLfloat)cosPhi0;
+            GLfloat x1 = (GLfloat)(cosTheta * sinPhi1), y1 = (GLfloat)(sinTheta * sinPhi1), z1 = (GLfloat)cosPhi1;
+
+            setVertex(out, v++, (GLfloat)(x0 * radius), (GLfloat)(y0 * radius), (GLfloat)(z0 * radius), x0, y0, z0);
+            setVertex(out, v++, (GLfloat)(x1 * radius), (GLfloat)(y1 * radius), (GLfloat)(z1 * radius), x1, y1, z1);
+        }
+    }
+    ringIndices(slices, stacks, out, firstVertex, firstIndex);
+}
+
+// This function is responsible for the six faces of a box, four vertices each so every face keeps its own normal
+void generateBox(GLfloat width, GLfloat height, GLfloat depth, ShapeArrays& out, size_t firstVertex, size_t firstIndex) {
+    GLfloat w = width / 2;
+    GLfloat h = height / 2;
+    GLfloat d = depth / 2;
+
+    // front, back, left, right, top, bottom; the corners run counter-clockwise seen from outside
+    static const GLfloat normals[6][3] = { { 0, 0, 1 }, { 0, 0, -1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 } };
+    static const GLfloat corners[6][4][3] = {
+        { { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } },
+        { { -1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 }, { 1, -1, -1 } },
+        { { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, 1 }, { -1, 1, -1 } },
+        { { 1, -1, -1 }, { 1, 1, -1 }, { 1, 1, 1 }, { 1, -1, 1 } },
+        { { -1, 1, -1 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } },
+        { { -1, -1, -1 }, { 1, -1, -1 }, { 1, -1, 1 }, { -1, -1, 1 } }
+    };
+
+    GLuint* index = &out.indices[firstIndex];
+    for (int face = 0; face < 6; face++) {
+        GLuint first = (GLuint)(firstVertex + face * 4);
+        for (int k = 0; k < 4; k++) {
+            const GLfloat* corner = corners[face][k];
+            setVertex(out, first + k, corner[0] * w, corner[1] * h, corner[2] * d, normals[face][0], normals[face][1], normals[face][2]);
+        }
+        index[0] = first; index[1] = first + 1; index[2] = first + 2;
+        index[3] = first; index[4] = first + 2; index[5] = first + 3;
+        index += 6;
+    }
+}
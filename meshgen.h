@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <GL/glut.h>
+
+/*
+    Procedural shapes
+
+    Parametric generators for the cylinders, cones, spheres and boxes the composite
+    objects are built from, in place of gluCylinder and glutSolidSphere. A shape is
+    written as indexed triangles into structure-of-arrays vertex arrays (one array per
+    coordinate), which the caller sizes beforehand with the *Size() functions, so a
+    generator never allocates and can fill its part of a larger set of arrays from any
+    thread.
+
+    The cylinders and spheres take their sines and cosines from tables computed at
+    compile time, one per slice count up to MESHGEN_TABLE_SEGMENTS, instead of calling
+    sin() and cos() per vertex. The tables hold the correctly rounded values of the
+    same angles the old code passed to sin() and cos(); the C library is off by one
+    unit in the last place for a few of them, so a handful of vertices move by that
+    much. Larger counts fall back to the library functions.
+
+    The vertex and triangle order is the one the mesh capture produced from the old
+    quad strips: a cylinder is stacks rings of slices + 1 vertex pairs with its axis
+    along +z, as gluCylinder draws it, and a sphere is stacks rings from +z to -z.
+*/
+
+#define MESHGEN_TABLE_SEGMENTS 64
+
+struct ShapeArrays {
+    std::vector<GLfloat> x, y, z;
+    std::vector<GLfloat> nx, ny, nz;
+    std::vector<GLuint> indices;
+
+    void resize(size_t vertexCount, size_t indexCount);
+
+    size_t vertices() const { return x.size(); }
+};
+
+// what a shape needs in the arrays
+struct ShapeSize {
+    size_t vertices;
+    size_t indices;
+};
+
+ShapeSize cylinderSize(GLint slices, GLint stacks);
+
+ShapeSize sphereSize(GLint slices, GLint stacks);
+
+ShapeSize boxSize();
+
+// Each generator writes its vertices from firstVertex and its indices from firstIndex, the
+// indices already offset by firstVertex
+
+// a cone when topRadius is 0
+void generateCylinder(GLdouble baseRadius, GLdouble topRadius, GLdouble height, GLint slices, GLint stacks,
+    ShapeArrays& out, size_t firstVertex, size_t firstIndex);
+
+void generateCone(GLdouble radius, GLdouble height, GLint slices, GLint stacks, ShapeArrays& out, size_t firstVertex, size_t firstIndex);
+
+void generateSphere(GLdouble radius, GLint slices, GLint stacks, ShapeArrays& out, size_t firstVertex, size_t firstIndex);
+
+// centred on the origin, with outward normals and counter-clockwise faces
+void generateBox(GLfloat width, GLfloat height, GLfloat depth, ShapeArrays& out, size_t firstVertex, size_t firstIndex);
+
+// sin and cos of 2 * pi * step / segments, from the tables when they cover segments
+double segmentSine(GLint segments, GLint step);
+
+double segmentCosine(GLint segments, GLint step);
@@ -0,0 +1,329 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "meshopt.h"
+
+using namespace std;
+
+// a vertex as the welding compares it, bit for bit
+struct WeldKey {
+    GLfloat values[6];
+
+    bool operator==(const WeldKey& other) const {
+        return memcmp(values, other.values, sizeof(values)) == 0;
+    }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey& key) const {
+        // FNV-1a over the bytes
+        const unsigned char* bytes = (const unsigned char*)key.values;
+        size_t hash = (size_t)2166136261u;
+        for (size_t i = 0; i < sizeof(key.values); i++)
+            hash = (hash ^ bytes[i]) * (size_t)16777619u;
+        return hash;
+    }
+};
+
+// This function is responsible for giving each batch one vertex per distinct position and normal
+int weldMeshVertices(Mesh& mesh) {
+    vector<MeshVertex> welded;
+    welded.reserve(mesh.vertices.size());
+    unordered_map<WeldKey, GLuint, WeldKeyHash> seen;
+
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const MeshBatch& batch = mesh.batches[b];
+        seen.clear();
+
+        for (GLsizei i = 0; i < batch.indexCount; i++) {
+            GLuint& index = mesh.indices[batch.firstIndex + i];
+            const MeshVertex& vertex = mesh.vertices[index];
+
+            // adding 0 turns -0 into 0, so the two compare equal
+            WeldKey key;
+            for (int k = 0; k < 3; k++) {
+                key.values[k] = vertex.position[k] + 0.0f;
+                key.values[3 + k] = vertex.normal[k] + 0.0f;
+            }
+
+            unordered_map<WeldKey, GLuint, WeldKeyHash>::iterator found = seen.find(key);
+            if (found == seen.end()) {
+                found = seen.insert(make_pair(key, (GLuint)welded.size())).first;
+                welded.push_back(vertex);
+            }
+            index = found->second;
+        }
+    }
+
+    int removed = (int)(mesh.vertices.size() - welded.size());
+    mesh.vertices.swap(welded);
+    return removed;
+}
+
+
+
+// vertex cache order
+
+// Forsyth's score of a vertex from its place in the LRU cache, -1 when outside
+static GLfloat cacheScore(int position) {
+    if (position < 0)
+        return 0.0f;
+    // the triangle just drawn used the first three, taking it again gains nothing
+    if (position < 3)
+        return 0.75f;
+    GLfloat scale = 1.0f / (MESHOPT_CACHE_SIZE - 3);
+    return powf(1.0f - (position - 3) * scale, 1.5f);
+}
+
+// vertices with few triangles left are taken first, so they do not linger as isolated leftovers
+static GLfloat valenceScore(int remaining) {
+    return 2.0f / sqrtf((GLfloat)remaining);
+}
+
+static GLfloat vertexScore(int remaining, int position) {
+    if (remaining == 0)
+        return -1.0f;
+    return cacheScore(position) + valenceScore(remaining);
+}
+
+// This function is responsible for reordering the triangles of one batch for the post-transform cache
+static void optimizeBatchCache(GLuint* indices, int triangles, size_t vertexCount) {
+    if (triangles < 2)
+        return;
+
+    // each vertex's triangles not drawn yet, in one array: [start[v], start[v] + remaining[v])
+    vector<int> remaining(vertexCount, 0), start(vertexCount + 1, 0), cachePosition(vertexCount, -1);
+    for (int i = 0; i < triangles * 3; i++)
+        remaining[indices[i]]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        start[v + 1] = start[v] + remaining[v];
+    vector<int> adjacency(start[vertexCount]);
+    {
+        vector<int> fill(start.begin(), start.end() - 1);
+        for (int i = 0; i < triangles * 3; i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    vector<GLfloat> score(vertexCount, 0.0f);
+    for (int i = 0; i < triangles * 3; i++)
+        score[indices[i]] = vertexScore(remaining[indices[i]], -1);
+
+    vector<GLfloat> triangleScore(triangles);
+    vector<char> emitted(triangles, 0);
+    for (int t = 0; t < triangles; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    vector<GLuint> order;
+    order.reserve(triangles * 3);
+    vector<GLuint> cache, nextCache;
+    int best = -1;
+
+    for (int drawn = 0; drawn < triangles; drawn++) {
+        // nothing in the cache has triangles left, start over from the best anywhere
+        if (best < 0) {
+            GLfloat bestScore = -1e30f;
+            for (int t = 0; t < triangles; t++) {
+                if (!emitted[t] && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        const GLuint* corner = &indices[best * 3];
+        emitted[best] = 1;
+        for (int k = 0; k < 3; k++) {
+            GLuint v = corner[k];
+            order.push_back(v);
+
+            // swap the triangle out of the live part of the vertex's list
+            int* list = &adjacency[start[v]];
+            for (int j = 0; j < remaining[v]; j++) {
+                if (list[j] == best) {
+                    swap(list[j], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // the triangle's vertices move to the front of the LRU cache
+        nextCache.assign(corner, corner + 3);
+        for (size_t i = 0; i < cache.size(); i++) {
+            if (cache[i] != corner[0] && cache[i] != corner[1] && cache[i] != corner[2])
+                nextCache.push_back(cache[i]);
+        }
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            GLuint v = nextCache[i];
+            cachePosition[v] = i < MESHOPT_CACHE_SIZE ? (int)i : -1;
+            score[v] = vertexScore(remaining[v], cachePosition[v]);
+        }
+
+        // only triangles around the changed vertices changed score, the next one is taken from them
+        best = -1;
+        GLfloat bestScore = -1e30f;
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            GLuint v = nextCache[i];
+            for (int j = 0; j < remaining[v]; j++) {
+                int t = adjacency[start[v] + j];
+                const GLuint* other = &indices[t * 3];
+                triangleScore[t] = score[other[0]] + score[other[1]] + score[other[2]];
+                if (cachePosition[v] >= 0 && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (nextCache.size() > MESHOPT_CACHE_SIZE)
+            nextCache.resize(MESHOPT_CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+
+    memcpy(indices, &order[0], order.size() * sizeof(GLuint));
+}
+
+void optimizeVertexCache(Mesh& mesh) {
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const MeshBatch& batch = mesh.batches[b];
+        optimizeBatchCache(&mesh.indices[batch.firstIndex], batch.indexCount / 3, mesh.vertices.size());
+    }
+}
+
+
+
+// overdraw order
+
+// a run of triangles that starts with a cold cache
+struct Cluster {
+    int first;
+    int count;
+    GLfloat key; // how far the cluster faces out from the mesh centre
+};
+
+static bool clusterOrder(const Cluster& a, const Cluster& b) {
+    return a.key > b.key;
+}
+
+// This function is responsible for sorting the clusters of one batch so outward-facing ones are drawn first
+static int optimizeBatchOverdraw(const Mesh& mesh, GLuint* indices, int triangles) {
+    if (triangles < 2)
+        return triangles;
+
+    // a triangle that misses with all three vertices gains nothing from what came before,
+    // so moving the run it starts costs no cache hits
+    vector<Cluster> clusters;
+    vector<int> entered(mesh.vertices.size(), -MESHOPT_CACHE_SIZE - 1);
+    int misses = 0;
+    for (int t = 0; t < triangles; t++) {
+        int missed = 0;
+        for (int k = 0; k < 3; k++) {
+            GLuint v = indices[t * 3 + k];
+            if (misses - entered[v] > MESHOPT_CACHE_SIZE) {
+                entered[v] = misses++;
+                missed++;
+            }
+        }
+        if (missed == 3 || clusters.empty()) {
+            Cluster cluster = { t, 0, 0.0f };
+            clusters.push_back(cluster);
+        }
+        clusters.back().count++;
+    }
+    if (clusters.size() < 2)
+        return (int)clusters.size();
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = clusters[c];
+        GLfloat centroid[3] = { 0.0f, 0.0f, 0.0f }, normal[3] = { 0.0f, 0.0f, 0.0f }, area = 0.0f;
+
+        for (int t = cluster.first; t < cluster.first + cluster.count; t++) {
+            const GLfloat* a = mesh.vertices[indices[t * 3]].position;
+            const GLfloat* b = mesh.vertices[indices[t * 3 + 1]].position;
+            const GLfloat* p = mesh.vertices[indices[t * 3 + 2]].position;
+            GLfloat u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            GLfloat w[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            GLfloat n[3] = { u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0] };
+            GLfloat weight = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            // both are weighted by the triangle's area, the cross product's length is twice that
+            for (int k = 0; k < 3; k++) {
+                centroid[k] += (a[k] + b[k] + p[k]) * weight;
+                normal[k] += n[k];
+            }
+            area += weight;
+        }
+
+        GLfloat length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area > 0.0f && length > 0.0f) {
+            for (int k = 0; k < 3; k++)
+                cluster.key += (centroid[k] / (3.0f * area) - mesh.center[k]) * normal[k] / length;
+        }
+    }
+
+    stable_sort(clusters.begin(), clusters.end(), clusterOrder);
+
+    vector<GLuint> order;
+    order.reserve(triangles * 3);
+    for (size_t c = 0; c < clusters.size(); c++)
+        order.insert(order.end(), indices + clusters[c].first * 3, indices + (clusters[c].first + clusters[c].count) * 3);
+    memcpy(indices, &order[0], order.size() * sizeof(GLuint));
+    return (int)clusters.size();
+}
+
+int optimizeOverdraw(Mesh& mesh) {
+    int clusters = 0;
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const MeshBatch& batch = mesh.batches[b];
+        clusters += optimizeBatchOverdraw(mesh, &mesh.indices[batch.firstIndex], batch.indexCount / 3);
+    }
+    return clusters;
+}
+
+
+
+// vertex fetch order and measuring
+
+void optimizeVertexFetch(Mesh& mesh) {
+    const GLuint unused = (GLuint)-1;
+    vector<GLuint> remap(mesh.vertices.size(), unused);
+    vector<MeshVertex> ordered;
+    ordered.reserve(mesh.vertices.size());
+
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+        GLuint& index = mesh.indices[i];
+        if (remap[index] == unused) {
+            remap[index] = (GLuint)ordered.size();
+            ordered.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(ordered);
+}
+
+void optimizeMesh(Mesh& mesh) {
+    if (mesh.indices.empty())
+        return;
+    weldMeshVertices(mesh);
+    optimizeVertexCache(mesh);
+    optimizeOverdraw(mesh);
+    optimizeVertexFetch(mesh);
+}
+
+GLfloat meshAcmr(const Mesh& mesh, int cacheSize) {
+    size_t triangles = mesh.indices.size() / 3;
+    if (triangles == 0)
+        return 0.0f;
+
+    // a vertex is still in the FIFO while fewer than cacheSize misses came after its own
+    vector<long> entered(mesh.vertices.size(), -(long)cacheSize - 1);
+    long misses = 0;
+    for (size_t i = 0; i < triangles * 3; i++) {
+        GLuint v = mesh.indices[i];
+        if (misses - entered[v] > cacheSize)
+            entered[v] = misses++;
+    }
+    return (GLfloat)misses / triangles;
+}
@@ -0,0 +1,183 @@
+#include <string>
+#include "glloader.h"
+#include "shaders.h"
+#include "pixelshading.h"
+#include "instrument.h"
+
+using namespace std;
+
+// the lighting and fog shared with the instanced renderer's per-pixel programs
+static const char* functionsSource =
+    "uniform vec4 worldHeight;\n"
+    "uniform float fogFalloff;\n"
+    "vec4 shadeFragment(vec3 n, vec3 eye, vec4 ambient, vec4 diffuse, vec4 specular, float shininess) {\n"
+    "    vec4 color = gl_LightModel.ambient * ambient;\n"
+    "    for (int i = 0; i < LIGHT_COUNT; i++) {\n"
+    "        vec4 lp = gl_LightSource[i].position;\n"
+    "        vec3 l = normalize(lp.w == 0.0 ? lp.xyz : lp.xyz - eye);\n"
+    "        float d = dot(n, l);\n"
+    "        color += gl_LightSource[i].ambient * ambient;\n"
+    "        if (d > 0.0) {\n"
+    "            float s = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+    "            color += gl_LightSource[i].diffuse * diffuse * d;\n"
+    "            color += gl_LightSource[i].specular * specular * pow(s, shininess);\n"
+    "        }\n"
+    "    }\n"
+    "    return vec4(clamp(color.rgb, 0.0, 1.0), diffuse.a);\n"
+    "}\n"
+    "vec3 applyFog(vec3 color, vec3 eye) {\n"
+    "#if FOG_MODE == 1\n"
+    "    float f = exp(-pow(gl_Fog.density * abs(eye.z), 2.0));\n"
+    "#elif FOG_MODE == 2\n"
+    // worldHeight.xyz turns an eye space offset into a world height difference, worldHeight.w is the
+    // camera's height; the density D exp(-falloff y) integrates along the ray to
+    // D exp(-falloff y0) distance (1 - exp(-k)) / k, with k = falloff times the rise to the fragment
+    "    float k = fogFalloff * dot(worldHeight.xyz, eye);\n"
+    "    float along = abs(k) > 0.0001 ? (1.0 - exp(-k)) / k : 1.0;\n"
+    "    float f = exp(-gl_Fog.density * exp(-fogFalloff * worldHeight.w) * length(eye) * along);\n"
+    "#else\n"
+    "    float f = 1.0;\n"
+    "#endif\n"
+    "    return mix(gl_Fog.color.rgb, color, clamp(f, 0.0, 1.0));\n"
+    "}\n";
+
+// SURFACE is a PixelSurface; ftransform() puts the fragments exactly where the fixed-function
+// pipeline does, so the shadow passes that draw the land again still meet it in the depth test
+static const char* vertexSource =
+    "varying vec3 eyePosition;\n"
+    "varying vec3 eyeNormal;\n"
+    "varying float normalLength;\n"
+    "void main() {\n"
+    "    eyePosition = (gl_ModelViewMatrix * gl_Vertex).xyz;\n"
+    "#if SURFACE == 1\n"
+    "    eyeNormal = gl_NormalMatrix * gl_Normal;\n"
+    "    normalLength = length(eyeNormal);\n"
+    "#elif SURFACE == 2\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "#endif\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+static const char* fragmentSource =
+    "uniform sampler2D image;\n"
+    "varying vec3 eyePosition;\n"
+    "varying vec3 eyeNormal;\n"
+    "varying float normalLength;\n"
+    "void main() {\n"
+    "#if SURFACE == 1\n"
+    // interpolation shortens the normal between vertices; it is put back to the length the
+    // fixed-function pipeline would have lit the vertices with, GL_NORMALIZE being off
+    "    vec3 n = eyeNormal * (normalLength / max(length(eyeNormal), 0.000001));\n"
+    "    vec4 color = shadeFragment(n, eyePosition, gl_FrontMaterial.ambient, gl_FrontMaterial.diffuse,\n"
+    "        gl_FrontMaterial.specular, gl_FrontMaterial.shininess);\n"
+    "#elif SURFACE == 2\n"
+    "    vec4 color = texture2D(image, gl_TexCoord[0].st);\n"
+    "#else\n"
+    "    vec4 color = gl_Color;\n"
+    "#endif\n"
+    "    gl_FragColor = vec4(applyFog(color.rgb, eyePosition), color.a);\n"
+    "}\n";
+
+struct PixelProgram {
+    GLuint program;
+    bool built; // tried, program stays 0 when it failed
+    PixelFogUniforms fog;
+};
+
+static PixelProgram programs[PIXEL_SURFACES][9][PIXEL_FOGS];
+static bool supported = false;
+
+static bool heightFog = false;
+static GLfloat heightFalloff = 0.2f;
+static GLfloat worldHeight[4] = { 0.0f, 1.0f, 0.0f, 0.0f };
+
+// This function is responsible for building one variant, once; later calls return what the first one built
+static PixelProgram& pixelProgram(PixelSurface surface, int lights, PixelFog fog) {
+    PixelProgram& p = programs[surface][lights][fog];
+    if (p.built)
+        return p;
+    p.built = true;
+
+    string defines = pixelShadingDefines(lights, fog) + "#define SURFACE " + to_string((int)surface) + "\n";
+    string vertex = defines + vertexSource;
+    string fragment = defines + functionsSource + fragmentSource;
+    p.program = buildProgram("pixel-shading", vertex.c_str(), fragment.c_str(), NULL, 0);
+    if (p.program != 0)
+        findPixelFogUniforms(p.program, p.fog);
+    return p;
+}
+
+bool initPixelShading() {
+    supported = false;
+    if (!hasShaders)
+        return false;
+
+    // built up front for the current lights so a shader error shows at start-up
+    supported = pixelProgram(PIXEL_LIT, enabledLightCount(), currentPixelFog()).program != 0;
+    return supported;
+}
+
+bool pixelShadingAvailable() {
+    return supported;
+}
+
+void setHeightFog(bool enabled, GLfloat falloff) {
+    heightFog = enabled;
+    heightFalloff = falloff;
+}
+
+PixelFog currentPixelFog() {
+    if (!glIsEnabled(GL_FOG))
+        return PIXEL_FOG_NONE;
+    return heightFog ? PIXEL_FOG_HEIGHT : PIXEL_FOG_EXP2;
+}
+
+int enabledLightCount() {
+    int count = 0;
+    while (count < 8 && glIsEnabled(GL_LIGHT0 + count))
+        count++;
+    return count;
+}
+
+// compiled in rather than passed as uniforms, so no variant branches on its light count or fog
+string pixelShadingDefines(int lights, PixelFog fog) {
+    return "#version 120\n#define LIGHT_COUNT " + to_string(lights) + "\n#define FOG_MODE " + to_string((int)fog) + "\n";
+}
+
+const char* pixelShadingFunctions() {
+    return functionsSource;
+}
+
+void findPixelFogUniforms(GLuint program, PixelFogUniforms& uniforms) {
+    uniforms.worldHeight = pglGetUniformLocation(program, "worldHeight");
+    uniforms.falloff = pglGetUniformLocation(program, "fogFalloff");
+}
+
+void loadPixelFogUniforms(const PixelFogUniforms& uniforms) {
+    // -1 when the variant has no height fog and the compiler dropped them
+    if (uniforms.worldHeight >= 0)
+        pglUniform4fv(uniforms.worldHeight, 1, worldHeight);
+    if (uniforms.falloff >= 0)
+        pglUniform1fv(uniforms.falloff, 1, &heightFalloff);
+}
+
+// This function is responsible for keeping the row of the inverse view that gives a world height
+void setPixelView(const GLfloat view[16]) {
+    // gluLookAt makes a rotation R and a translation t, whose inverse is R transposed and -R^T t;
+    // its second row is the second column of R, and the camera's height
+    for (int k = 0; k < 3; k++)
+        worldHeight[k] = view[4 + k];
+    worldHeight[3] = -(view[4] * view[12] + view[5] * view[13] + view[6] * view[14]);
+}
+
+void bindPixelShading(PixelSurface surface) {
+    PixelProgram& p = pixelProgram(surface, enabledLightCount(), currentPixelFog());
+    pglUseProgram(p.program);
+    if (p.program != 0)
+        loadPixelFogUniforms(p.fog);
+}
+
+void unbindPixelShading() {
+    pglUseProgram(0);
+}
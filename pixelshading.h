@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <GL/glut.h>
+
+/*
+    Per-pixel lighting and fog
+
+    The fixed-function pipeline lights each vertex and interpolates the colours, so a
+    highlight that falls inside a large triangle (the land is two) is lost, and the
+    fog is at best evaluated per vertex too. This path draws the same surfaces with
+    GLSL programs that light and fog every fragment instead.
+
+    The programs read everything from the OpenGL state the fixed-function path already
+    sets up: the enabled lights from gl_LightSource, the material bindMaterial() last
+    sent from gl_FrontMaterial, the fog from gl_Fog. Nothing else has to change for
+    them, and the display lists draw with them as well. The lighting equation is the
+    fixed-function one, non-local viewer and unnormalized normals included, so the
+    two paths only differ where the per-vertex colours were interpolated.
+
+    The fog is GL_EXP2 on the eye depth like the fixed-function fog, or height fog:
+    the density falls off exponentially with the world height and is integrated along
+    the view ray, so low ground fogs over while the tops of the objects stay clear.
+
+    Every combination of surface, number of lights and fog is its own program, with the
+    choices compiled in as #defines; they are built when first drawn with and kept as
+    program binaries when shaders.h has a program cache.
+*/
+
+// what a surface is drawn with
+enum PixelSurface {
+    PIXEL_UNLIT, // the vertex colours, for the baked objects
+    PIXEL_LIT, // the lights and the current material
+    PIXEL_TEXTURED, // the texture on unit 0 as it is (GL_REPLACE), for the background
+    PIXEL_SURFACES
+};
+
+enum PixelFog {
+    PIXEL_FOG_NONE,
+    PIXEL_FOG_EXP2,
+    PIXEL_FOG_HEIGHT,
+    PIXEL_FOGS
+};
+
+// builds the lit program for the current lights, false when GLSL is not available
+bool initPixelShading();
+bool pixelShadingAvailable();
+
+// GL_FOG fogs by height instead of GL_EXP2 while enabled; the density at world height 0 is
+// GL_FOG_DENSITY and falls by a factor e every 1 / falloff units up
+void setHeightFog(bool enabled, GLfloat falloff);
+
+// the fog the programs apply: none while GL_FOG is disabled, else as setHeightFog() chose
+PixelFog currentPixelFog();
+
+// the lights are enabled in order from GL_LIGHT0
+int enabledLightCount();
+
+// the #version and #defines in front of a variant's sources; the functions of pixelShadingFunctions() need them
+std::string pixelShadingDefines(int lights, PixelFog fog);
+
+// GLSL for both stages of any program: shadeFragment() lights a fragment like the fixed-function pipeline
+// lights a vertex, applyFog() fogs a colour; they read the uniforms of PixelFogUniforms
+const char* pixelShadingFunctions();
+
+// the uniforms of a program that uses applyFog()
+struct PixelFogUniforms {
+    GLint worldHeight, falloff;
+};
+
+void findPixelFogUniforms(GLuint program, PixelFogUniforms& uniforms);
+
+// loads the view set by setPixelView() and the falloff into the bound program
+void loadPixelFogUniforms(const PixelFogUniforms& uniforms);
+
+// the camera of the frame (the modelview with only gluLookAt in it), for the height fog
+void setPixelView(const GLfloat view[16]);
+
+// binds the program for the surface, the enabled lights and the fog
+void bindPixelShading(PixelSurface surface);
+
+// back to the fixed-function pipeline
+void unbindPixelShading();
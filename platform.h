@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+    Platform glue so the scene also builds on the Linux/Mesa boxes used for headless runs.
+    On Windows this is just windows.h; elsewhere it provides the few Win32 types and CRT
+    functions the scene uses. makeDirectory(path) creates a directory on both.
+*/
+
+#ifdef _WIN32
+
+#include "windows.h"
+#include <direct.h>
+
+#define makeDirectory(path) _mkdir(path)
+
+#else
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define makeDirectory(path) mkdir(path, 0755)
+
+#pragma pack(push, 2)
+
+typedef struct tagBITMAPFILEHEADER {
+    uint16_t bfType;
+    uint32_t bfSize;
+    uint16_t bfReserved1;
+    uint16_t bfReserved2;
+    uint32_t bfOffBits;
+} BITMAPFILEHEADER;
+
+typedef struct tagBITMAPINFOHEADER {
+    uint32_t biSize;
+    int32_t biWidth;
+    int32_t biHeight;
+    uint16_t biPlanes;
+    uint16_t biBitCount;
+    uint32_t biCompression;
+    uint32_t biSizeImage;
+    int32_t biXPelsPerMeter;
+    int32_t biYPelsPerMeter;
+    uint32_t biClrUsed;
+    uint32_t biClrImportant;
+} BITMAPINFOHEADER;
+
+typedef struct tagRGBTRIPLE {
+    uint8_t rgbtBlue;
+    uint8_t rgbtGreen;
+    uint8_t rgbtRed;
+} RGBTRIPLE;
+
+#pragma pack(pop)
+
+#define BI_RGB 0
+#define BI_BITFIELDS 3
+
+inline int fopen_s(FILE** file, const char* filename, const char* mode) {
+    *file = fopen(filename, mode);
+    return *file == NULL;
+}
+
+#endif
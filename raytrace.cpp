@@ -0,0 +1,411 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "raytrace.h"
+#include "bvh.h"
+#include "threadpool.h"
+#include "vector3.h"
+#include "benchmark.h"
+
+using namespace std;
+
+#define RAY_TILE_SIZE 16
+#define RAY_EPSILON 1e-4f
+
+struct RayShading {
+    GLfloat normals[3][3];
+    GLfloat texcoords[3][2];
+    int material;
+    const SoftTexture* texture; // unlit and casting no shadow when set
+};
+
+// rays traced by one worker during a pass
+struct RayCounters {
+    long primary = 0;
+    long shadow = 0;
+    long reflection = 0;
+};
+
+// the masks of the triangles in the hierarchy, textured quads are left out of shadow rays
+#define RAY_CASTS_SHADOW 1u
+#define RAY_UNLIT 2u
+
+struct RayTracerData {
+    Bvh bvh;
+    vector<RayShading> shading; // by triangle index
+
+    vector3 eye;
+    vector3 forward;
+    vector3 side;
+    vector3 upward;
+    GLfloat halfWidth = 1.0f;
+    GLfloat halfHeight = 1.0f;
+    GLfloat zNear = 1.0f;
+
+    SoftLighting lighting;
+    vector<SceneLight> lights; // world space
+    vector<Material> materials;
+    vector<GLfloat> reflectivity;
+    int maxDepth = 2;
+
+    int width = 0;
+    int height = 0;
+    int passes = 0;
+    vector<GLfloat> accumulation; // RGB sums of all passes
+    vector<uint32_t> pixels;
+    vector<RayCounters> counters;
+};
+
+
+
+// building
+
+static void addTriangle(RayTracerData& data, const GLfloat* corners[3], const GLfloat* normals[3], const GLfloat* texcoords[3], int material, const SoftTexture* texture) {
+    RayShading shading;
+
+    for (int i = 0; i < 3; i++) {
+        memcpy(shading.normals[i], normals[i], sizeof(shading.normals[i]));
+        shading.texcoords[i][0] = texcoords ? texcoords[i][0] : 0.0f;
+        shading.texcoords[i][1] = texcoords ? texcoords[i][1] : 0.0f;
+    }
+    shading.material = material;
+    shading.texture = texture;
+
+    data.bvh.addTriangle(corners[0], corners[1], corners[2], texture ? RAY_UNLIT : RAY_CASTS_SHADOW);
+    data.shading.push_back(shading);
+}
+
+// tracing
+
+static const Material& rayMaterial(const RayTracerData& data, int material) {
+    static const Material white = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.0f };
+    if (material < 0 || material >= (int)data.materials.size())
+        return white;
+    return data.materials[material];
+}
+
+// This function is responsible for the color seen along a ray, recursing for reflections
+static void shadeRay(const RayTracerData& data, RayCounters& counters, vector3 origin, vector3 direction, int depth, GLfloat color[3], GLfloat* hitDistance) {
+    GLfloat o[3] = { origin.x, origin.y, origin.z };
+    GLfloat d[3] = { direction.x, direction.y, direction.z };
+    BvhHit hit;
+
+    color[0] = color[1] = color[2] = 0.0f; // the clear color
+    if (hitDistance)
+        *hitDistance = -1.0f;
+    if (!data.bvh.raycast(o, d, 1e30f, hit))
+        return;
+    if (hitDistance)
+        *hitDistance = hit.t;
+
+    const RayShading& surface = data.shading[hit.triangle];
+    GLfloat w = 1.0f - hit.u - hit.v;
+
+    if (surface.texture) {
+        GLfloat u = w * surface.texcoords[0][0] + hit.u * surface.texcoords[1][0] + hit.v * surface.texcoords[2][0];
+        GLfloat v = w * surface.texcoords[0][1] + hit.u * surface.texcoords[1][1] + hit.v * surface.texcoords[2][1];
+        sampleSoftTexture(*surface.texture, u, v, color);
+        return;
+    }
+
+    vector3 normal(
+        w * surface.normals[0][0] + hit.u * surface.normals[1][0] + hit.v * surface.normals[2][0],
+        w * surface.normals[0][1] + hit.u * surface.normals[1][1] + hit.v * surface.normals[2][1],
+        w * surface.normals[0][2] + hit.u * surface.normals[1][2] + hit.v * surface.normals[2][2]);
+    normal = normal.normalize();
+    if (normal.dot(direction) > 0.0f)
+        normal = normal.scalar(-1.0f);
+
+    vector3 point = origin.add(direction.scalar(hit.t));
+    vector3 offsetPoint = point.add(normal.scalar(RAY_EPSILON * 10.0f));
+    vector3 toViewer = direction.scalar(-1.0f);
+    const Material& material = rayMaterial(data, surface.material);
+
+    for (int c = 0; c < 3; c++)
+        color[c] = material.ambient[c] * data.lighting.globalAmbient[c];
+
+    for (size_t i = 0; i < data.lights.size(); i++) {
+        const SceneLight& light = data.lights[i];
+        vector3 toLight;
+        GLfloat lightDistance = 1e30f;
+
+        if (light.position[3] != 0.0f) {
+            vector3 position(light.position[0] / light.position[3], light.position[1] / light.position[3], light.position[2] / light.position[3]);
+            lightDistance = point.distance(position);
+            toLight = position.subtract(point).normalize();
+        } else {
+            toLight = vector3(light.position[0], light.position[1], light.position[2]).normalize();
+        }
+
+        for (int c = 0; c < 3; c++)
+            color[c] += material.ambient[c] * light.ambient[c];
+
+        GLfloat diffuse = normal.dot(toLight);
+        if (diffuse <= 0.0f)
+            continue;
+
+        counters.shadow++;
+        GLfloat so[3] = { offsetPoint.x, offsetPoint.y, offsetPoint.z };
+        GLfloat sd[3] = { toLight.x, toLight.y, toLight.z };
+        if (data.bvh.occluded(so, sd, lightDistance, RAY_CASTS_SHADOW))
+            continue;
+
+        GLfloat specular = 0.0f;
+        vector3 half = toLight.add(toViewer).normalize();
+        GLfloat angle = normal.dot(half);
+        if (angle > 0.0f)
+            specular = material.shininess > 0.0f ? powf(angle, material.shininess) : 1.0f;
+
+        for (int c = 0; c < 3; c++)
+            color[c] += diffuse * material.diffuse[c] * light.diffuse[c] + specular * material.specular[c] * light.specular[c];
+    }
+
+    GLfloat reflectivity = surface.material >= 0 && surface.material < (int)data.reflectivity.size() ? data.reflectivity[surface.material] : 0.0f;
+    if (reflectivity > 0.0f && depth < data.maxDepth) {
+        counters.reflection++;
+        GLfloat reflected[3];
+        shadeRay(data, counters, offsetPoint, direction.reflect(normal), depth + 1, reflected, NULL);
+        for (int c = 0; c < 3; c++)
+            color[c] = (1.0f - reflectivity) * color[c] + reflectivity * reflected[c];
+    }
+
+    for (int c = 0; c < 3; c++)
+        color[c] = min(max(color[c], 0.0f), 1.0f);
+}
+
+// a repeatable value in [0, 1) for the jitter of a pixel in a pass
+static GLfloat jitter(uint32_t x, uint32_t y, uint32_t pass, uint32_t salt) {
+    uint32_t h = x * 73856093u ^ y * 19349663u ^ pass * 83492791u ^ salt * 2654435761u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// This function is responsible for adding one sample to every pixel of a tile
+static void renderTile(RayTracerData& data, RayCounters& counters, int tile, int pass) {
+    int tilesX = (data.width + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    int left = (tile % tilesX) * RAY_TILE_SIZE;
+    int bottom = (tile / tilesX) * RAY_TILE_SIZE;
+    int right = min(left + RAY_TILE_SIZE, data.width);
+    int top = min(bottom + RAY_TILE_SIZE, data.height);
+    const SceneFog& fog = data.lighting.fog;
+
+    for (int y = bottom; y < top; y++) {
+        for (int x = left; x < right; x++) {
+            GLfloat sx = pass == 0 ? 0.5f : jitter(x, y, pass, 0);
+            GLfloat sy = pass == 0 ? 0.5f : jitter(x, y, pass, 1);
+
+            // the point on the near plane the pixel covers, as glFrustum maps it
+            GLfloat ndcX = (x + sx) / data.width * 2.0f - 1.0f;
+            GLfloat ndcY = (y + sy) / data.height * 2.0f - 1.0f;
+            vector3 direction = data.side.scalar(ndcX * data.halfWidth).add(data.upward.scalar(ndcY * data.halfHeight)).add(data.forward.scalar(data.zNear)).normalize();
+
+            counters.primary++;
+            GLfloat color[3], distance;
+            shadeRay(data, counters, data.eye, direction, 0, color, &distance);
+
+            // EXP2 fog on the eye-space depth of the primary hit, the background stays clear
+            if (fog.enabled && distance > 0.0f) {
+                GLfloat depth = fog.density * distance * direction.dot(data.forward);
+                GLfloat factor = min(max(expf(-depth * depth), 0.0f), 1.0f);
+                for (int c = 0; c < 3; c++)
+                    color[c] = factor * color[c] + (1.0f - factor) * fog.color[c];
+            }
+
+            size_t pixel = (size_t)y * data.width + x;
+            GLfloat* sum = &data.accumulation[pixel * 3];
+            uint32_t packed = 0xff000000u;
+            for (int c = 0; c < 3; c++) {
+                sum[c] += color[c];
+                GLfloat average = min(sum[c] / (pass + 1), 1.0f);
+                packed |= (uint32_t)(average * 255.0f + 0.5f) << (c * 8);
+            }
+            data.pixels[pixel] = packed;
+        }
+    }
+}
+
+
+
+// the ray tracer
+
+RayTracer::RayTracer() : data(new RayTracerData()), pool(new ThreadPool(1)) {
+    memset(&data->lighting, 0, sizeof(data->lighting));
+}
+
+RayTracer::~RayTracer() {
+    delete pool;
+    delete data;
+}
+
+void RayTracer::setThreads(int threads) {
+    if (threads < 1)
+        threads = 1;
+    if (threads == pool->size())
+        return;
+    delete pool;
+    pool = new ThreadPool(threads);
+}
+
+int RayTracer::threads() const {
+    return pool->size();
+}
+
+void RayTracer::clear() {
+    data->bvh.clear();
+    data->shading.clear();
+}
+
+void RayTracer::addMesh(const Mesh& mesh, const GLfloat model[16], int paintFrom, int paintTo) {
+    vector<GLfloat> positions(mesh.vertices.size() * 3);
+    vector<GLfloat> normals(mesh.vertices.size() * 3);
+
+    // normals take the inverse transpose, for the rotations and uniform scales of the scene a rescale is enough
+    GLfloat scale = sqrtf(model[0] * model[0] + model[1] * model[1] + model[2] * model[2]);
+    GLfloat normalScale = scale > 0.0f ? 1.0f / (scale * scale) : 1.0f;
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const GLfloat* p = mesh.vertices[i].position;
+        const GLfloat* n = mesh.vertices[i].normal;
+        for (int k = 0; k < 3; k++) {
+            positions[i * 3 + k] = model[k] * p[0] + model[4 + k] * p[1] + model[8 + k] * p[2] + model[12 + k];
+            normals[i * 3 + k] = (model[k] * n[0] + model[4 + k] * n[1] + model[8 + k] * n[2]) * normalScale;
+        }
+    }
+
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const MeshBatch& batch = mesh.batches[b];
+        int material = batch.material == paintFrom && paintTo >= 0 ? paintTo : batch.material;
+
+        for (GLsizei i = 0; i + 2 < batch.indexCount; i += 3) {
+            const GLuint* index = &mesh.indices[batch.firstIndex + i];
+            const GLfloat* corners[3] = { &positions[index[0] * 3], &positions[index[1] * 3], &positions[index[2] * 3] };
+            const GLfloat* cornerNormals[3] = { &normals[index[0] * 3], &normals[index[1] * 3], &normals[index[2] * 3] };
+            addTriangle(*data, corners, cornerNormals, NULL, material, NULL);
+        }
+    }
+}
+
+void RayTracer::addQuad(const GLfloat corners[4][3], const GLfloat normal[3], int material) {
+    const GLfloat* first[3] = { corners[0], corners[1], corners[2] };
+    const GLfloat* second[3] = { corners[0], corners[2], corners[3] };
+    const GLfloat* normals[3] = { normal, normal, normal };
+    addTriangle(*data, first, normals, NULL, material, NULL);
+    addTriangle(*data, second, normals, NULL, material, NULL);
+}
+
+void RayTracer::addTexturedQuad(const GLfloat corners[4][3], const GLfloat texcoords[4][2], const SoftTexture& texture) {
+    static const GLfloat facing[3] = { 0.0f, 0.0f, 1.0f };
+    const GLfloat* first[3] = { corners[0], corners[1], corners[2] };
+    const GLfloat* second[3] = { corners[0], corners[2], corners[3] };
+    const GLfloat* firstTexcoords[3] = { texcoords[0], texcoords[1], texcoords[2] };
+    const GLfloat* secondTexcoords[3] = { texcoords[0], texcoords[2], texcoords[3] };
+    const GLfloat* normals[3] = { facing, facing, facing };
+    addTriangle(*data, first, normals, firstTexcoords, -1, &texture);
+    addTriangle(*data, second, normals, secondTexcoords, -1, &texture);
+}
+
+void RayTracer::build() {
+    data->bvh.build();
+}
+
+long RayTracer::triangles() const {
+    return data->bvh.triangles();
+}
+
+int RayTracer::nodes() const {
+    return data->bvh.nodes();
+}
+
+void RayTracer::setCamera(const GLfloat eye[3], const GLfloat center[3], const GLfloat up[3], GLfloat halfWidth, GLfloat halfHeight, GLfloat zNear) {
+    data->eye = vector3(eye[0], eye[1], eye[2]);
+    data->forward = vector3(center[0] - eye[0], center[1] - eye[1], center[2] - eye[2]).normalize();
+    data->side = data->forward.cross(vector3(up[0], up[1], up[2])).normalize();
+    data->upward = data->side.cross(data->forward);
+    data->halfWidth = halfWidth;
+    data->halfHeight = halfHeight;
+    data->zNear = zNear;
+}
+
+// This function is responsible for moving the eye-space lights into world space with the inverse of the view
+void RayTracer::setLighting(const SoftLighting& lighting, const GLfloat view[16]) {
+    data->lighting = lighting;
+    data->lights.assign(lighting.lights, lighting.lights + lighting.lightCount);
+    data->materials.assign(lighting.materials, lighting.materials + lighting.materialCount);
+
+    // the view is a rotation and a translation, its inverse rotation is the transpose
+    for (size_t i = 0; i < data->lights.size(); i++) {
+        GLfloat* position = data->lights[i].position;
+        GLfloat eye[3] = { position[0], position[1], position[2] };
+        if (position[3] != 0.0f) {
+            for (int k = 0; k < 3; k++)
+                eye[k] = eye[k] / position[3] - view[12 + k];
+        }
+        for (int k = 0; k < 3; k++)
+            position[k] = view[k * 4] * eye[0] + view[k * 4 + 1] * eye[1] + view[k * 4 + 2] * eye[2];
+        if (position[3] != 0.0f)
+            position[3] = 1.0f;
+    }
+
+    data->lighting.lights = data->lights.empty() ? NULL : &data->lights[0];
+    data->lighting.materials = data->materials.empty() ? NULL : &data->materials[0];
+}
+
+void RayTracer::setReflectivity(const GLfloat* reflectivity, int count) {
+    data->reflectivity.assign(reflectivity, reflectivity + count);
+}
+
+void RayTracer::setMaxDepth(int depth) {
+    data->maxDepth = depth;
+}
+
+void RayTracer::beginImage(int width, int height) {
+    data->width = width;
+    data->height = height;
+    data->passes = 0;
+    data->accumulation.assign((size_t)width * height * 3, 0.0f);
+    data->pixels.assign((size_t)width * height, 0xff000000u);
+}
+
+// This function is responsible for tracing one more sample per pixel across the pool
+RayPassStats RayTracer::renderPass() {
+    int tilesX = (data->width + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    int tilesY = (data->height + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    int pass = data->passes;
+
+    data->counters.assign(pool->size(), RayCounters());
+
+    double start = nowMilliseconds();
+    pool->parallelFor(tilesX * tilesY, [&](int tile, int worker) {
+        renderTile(*data, data->counters[worker], tile, pass);
+    });
+
+    RayPassStats stats = { 0, 0, 0, nowMilliseconds() - start };
+    for (size_t i = 0; i < data->counters.size(); i++) {
+        stats.primaryRays += data->counters[i].primary;
+        stats.shadowRays += data->counters[i].shadow;
+        stats.reflectionRays += data->counters[i].reflection;
+    }
+    data->passes++;
+    return stats;
+}
+
+int RayTracer::passes() const {
+    return data->passes;
+}
+
+const uint32_t* RayTracer::pixels() const {
+    return data->pixels.data();
+}
+
+int RayTracer::width() const {
+    return data->width;
+}
+
+int RayTracer::height() const {
+    return data->height;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <GL/glut.h>
+#include "meshcache.h"
+#include "softraster.h"
+
+/*
+    Ray-traced render mode
+
+    An offline renderer for the same scene, for the reflective materials the rasterizers
+    cannot show. addMesh() and the quad calls copy every placed object's triangles into
+    world space, build() puts a bounding volume hierarchy over all of them, and each pass
+    traces, for every pixel, a primary ray, one shadow ray per light and, on reflective
+    materials, a reflection ray per bounce (vector3::reflect) up to setMaxDepth().
+
+    Shading uses the material table and lights of the OpenGL path, evaluated per pixel,
+    with EXP2 fog on the primary ray. Textured quads are unlit (GL_REPLACE) and do not
+    cast shadows, so the background does not darken the scene.
+
+    The image is cut into 16x16 pixel tiles that the work-stealing ThreadPool shares out.
+    renderPass() adds one sample per pixel to an accumulation buffer: the first pass hits
+    the pixel centres and later ones are jittered inside the pixel. The image is usable
+    after any pass and gets smoother (antialiased) the longer it runs.
+*/
+
+// what one pass traced and how long it took
+struct RayPassStats {
+    long primaryRays;
+    long shadowRays;
+    long reflectionRays;
+    double milliseconds;
+};
+
+struct RayTracerData;
+class ThreadPool;
+
+class RayTracer {
+
+public:
+
+    RayTracer();
+
+    ~RayTracer();
+
+    RayTracer(const RayTracer&) = delete;
+
+    RayTracer& operator=(const RayTracer&) = delete;
+
+
+
+    // threads used by renderPass(), the calling thread included
+    void setThreads(int threads);
+
+    int threads() const;
+
+
+
+    // the scene, in world space; build() must be called after the last add
+
+    void clear();
+
+    // the mesh drawn with a column-major model matrix, batches using paintFrom get paintTo, -1 for no paint
+    void addMesh(const Mesh& mesh, const GLfloat model[16], int paintFrom, int paintTo);
+
+    // a lit quad with one normal, corners in GL_QUADS order
+    void addQuad(const GLfloat corners[4][3], const GLfloat normal[3], int material);
+
+    // an unlit textured quad, the texture must stay alive while rendering
+    void addTexturedQuad(const GLfloat corners[4][3], const GLfloat texcoords[4][2], const SoftTexture& texture);
+
+    void build();
+
+    long triangles() const;
+
+    int nodes() const;
+
+
+
+    // camera and lighting
+
+    // the view gluLookAt builds and the near plane of a symmetric glFrustum
+    void setCamera(const GLfloat eye[3], const GLfloat center[3], const GLfloat up[3], GLfloat halfWidth, GLfloat halfHeight, GLfloat zNear);
+
+    // lights in eye space as the OpenGL path stores them, view is the matrix that maps world to eye space
+    void setLighting(const SoftLighting& lighting, const GLfloat view[16]);
+
+    // share of a material's color taken from the reflected ray, 0 for none
+    void setReflectivity(const GLfloat* reflectivity, int count);
+
+    // reflection bounces after the primary hit
+    void setMaxDepth(int depth);
+
+
+
+    // progressive rendering
+
+    // clears the accumulated image
+    void beginImage(int width, int height);
+
+    RayPassStats renderPass();
+
+    int passes() const;
+
+    // the average of all passes, RGBA with rows bottom first like glReadPixels
+    const uint32_t* pixels() const;
+
+    int width() const;
+
+    int height() const;
+
+private:
+
+    RayTracerData* data;
+
+    ThreadPool* pool;
+
+};
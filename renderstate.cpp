@@ -0,0 +1,97 @@
+#include "renderstate.h"
+#include "framestats.h"
+#include "instrument.h"
+
+// enables the tracker keeps, more are passed straight through
+#define TRACKED_CAPABILITIES 8
+
+static const Material* materialTable = NULL;
+static int materialCount = 0;
+static int currentMaterial = -1;
+static bool materialKnown = false;
+
+static GLuint currentTexture = 0;
+static bool textureKnown = false;
+
+// the capability states are -1 while unknown
+static GLenum capabilities[TRACKED_CAPABILITIES];
+static int capabilityStates[TRACKED_CAPABILITIES];
+static int capabilityCount = 0;
+
+static const Material white = {
+    { 1.0f, 1.0f, 1.0f, 1.0f },
+    { 1.0f, 1.0f, 1.0f, 1.0f },
+    { 1.0f, 1.0f, 1.0f, 1.0f },
+    1.0f
+};
+
+void setMaterialTable(const Material* table, int count) {
+    materialTable = table;
+    materialCount = count;
+    materialKnown = false;
+}
+
+void bindMaterial(int handle) {
+    if (handle < 0 || handle >= materialCount)
+        handle = -1;
+
+    if (materialKnown && handle == currentMaterial) {
+        frameStats.stateChangesSkipped++;
+        return;
+    }
+
+    const Material& material = handle >= 0 ? materialTable[handle] : white;
+    glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, material.shininess);
+
+    currentMaterial = handle;
+    materialKnown = true;
+    frameStats.stateChanges++;
+}
+
+void bindTexture(GLuint texture) {
+    if (textureKnown && texture == currentTexture) {
+        frameStats.stateChangesSkipped++;
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    currentTexture = texture;
+    textureKnown = true;
+    frameStats.stateChanges++;
+}
+
+void setCapability(GLenum capability, bool enabled) {
+    int slot = 0;
+    while (slot < capabilityCount && capabilities[slot] != capability)
+        slot++;
+
+    if (slot == capabilityCount && capabilityCount < TRACKED_CAPABILITIES) {
+        capabilities[slot] = capability;
+        capabilityStates[slot] = -1;
+        capabilityCount++;
+    }
+
+    if (slot < capabilityCount && capabilityStates[slot] == (enabled ? 1 : 0)) {
+        frameStats.stateChangesSkipped++;
+        return;
+    }
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+
+    if (slot < capabilityCount)
+        capabilityStates[slot] = enabled ? 1 : 0;
+    frameStats.stateChanges++;
+}
+
+void invalidateRenderState() {
+    materialKnown = false;
+    textureKnown = false;
+    for (int i = 0; i < capabilityCount; i++)
+        capabilityStates[i] = -1;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <GL/glut.h>
+
+/*
+    Render state tracker
+
+    Materials live in a table and are selected by integer handle. bindMaterial(),
+    bindTexture() and setCapability() remember what was last sent to OpenGL and skip
+    calls that would not change anything; every change issued and every change skipped
+    is counted in frameStats.
+
+    The tracker only knows about changes made through it. Anything else that changes
+    the same state (a display list being called, for instance) has to be followed by
+    invalidateRenderState(), and while a display list is compiled the state it sets is
+    not the live state, so compile each list between two invalidateRenderState() calls.
+*/
+
+struct Material {
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[4];
+    GLfloat shininess;
+};
+
+// the table handles index into, handles outside it select plain white
+void setMaterialTable(const Material* table, int count);
+
+void bindMaterial(int handle);
+
+// binds a GL_TEXTURE_2D texture
+void bindTexture(GLuint texture);
+
+// glEnable / glDisable
+void setCapability(GLenum capability, bool enabled);
+
+// forgets everything, the next call of each kind is always issued
+void invalidateRenderState();
@@ -0,0 +1,451 @@
+#include <iostream>
+#include <sstream>
+#include "platform.h"
+#include "scenefile.h"
+#include "mappedfile.h"
+#include "benchmark.h"
+
+using namespace std;
+
+static const char binaryMagic[4] = { 'S', 'C', 'N', 'B' };
+static const uint32_t binaryVersion = 2;
+
+// all fields are 4 bytes wide, so the records have no padding and the file is the memory layout
+struct SceneBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    float viewer[3];
+    SceneFog fog;
+    uint32_t lightCount;
+    uint32_t materialCount;
+    uint32_t instanceCount;
+};
+
+
+
+// text parsing, straight over the mapped file
+
+struct TextCursor {
+    const char* p;
+    const char* end;
+    int line;
+};
+
+static void skipSpaces(TextCursor& c) {
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\r'))
+        c.p++;
+}
+
+static bool atLineEnd(TextCursor& c) {
+    skipSpaces(c);
+    return c.p >= c.end || *c.p == '\n' || *c.p == '#';
+}
+
+static void skipLine(TextCursor& c) {
+    while (c.p < c.end && *c.p != '\n')
+        c.p++;
+    if (c.p < c.end)
+        c.p++;
+    c.line++;
+}
+
+static string readWord(TextCursor& c) {
+    skipSpaces(c);
+    const char* start = c.p;
+    while (c.p < c.end && *c.p != ' ' && *c.p != '\t' && *c.p != '\r' && *c.p != '\n' && *c.p != '#')
+        c.p++;
+    return string(start, c.p);
+}
+
+// decimal number with optional fraction and exponent, without strtof's locale and terminator needs
+static bool readFloat(TextCursor& c, float& value) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+    skipSpaces(c);
+    const char* p = c.p;
+    bool negative = false;
+    if (p < c.end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+
+    for (; p < c.end && *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 18) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                digits++;
+        }
+        else {
+            exponent++;
+        }
+    }
+    if (p < c.end && *p == '.') {
+        for (p++; p < c.end && *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 18) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return false;
+
+    if (p < c.end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < c.end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        int e = 0;
+        bool anyExponent = false;
+        for (; q < c.end && *q >= '0' && *q <= '9'; q++, anyExponent = true)
+            e = e < 1000 ? e * 10 + (*q - '0') : e;
+        if (anyExponent) {
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = (double)mantissa;
+    while (exponent > 18) {
+        result *= 1e18;
+        exponent -= 18;
+    }
+    while (exponent < -18) {
+        result /= 1e18;
+        exponent += 18;
+    }
+    result = exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+
+    value = (float)(negative ? -result : result);
+    c.p = p;
+    return true;
+}
+
+static bool readFloats(TextCursor& c, float* values, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!readFloat(c, values[i]))
+            return false;
+    }
+    return true;
+}
+
+static int lookup(const string& name, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (name == names[i])
+            return i;
+    }
+    return -1;
+}
+
+static bool parseError(const char* filename, int line, const string& message) {
+    cerr << filename << ":" << line << ": " << message << endl;
+    return false;
+}
+
+// This function is responsible for parsing a text scene in one pass over the mapped file
+bool loadSceneText(const char* filename, const SceneVocabulary& vocabulary, Scene& scene) {
+    MappedFile file;
+    if (!mapFile(filename, file))
+        return parseError(filename, 0, "cannot open");
+
+    TextCursor c = { (const char*)file.data, (const char*)file.data + file.size, 1 };
+    Scene loaded;
+    memcpy(loaded.viewer, scene.viewer, sizeof(loaded.viewer));
+    loaded.fog = scene.fog;
+
+    // roughly one instance per line, so reserve from the file size instead of growing
+    loaded.instances.reserve(file.size / 24);
+
+    bool ok = true;
+    while (ok && c.p < c.end) {
+        if (atLineEnd(c)) {
+            skipLine(c);
+            continue;
+        }
+
+        string keyword = readWord(c);
+
+        if (keyword == "object") {
+            SceneInstance instance;
+            string model = readWord(c);
+            instance.model = lookup(model, vocabulary.models, vocabulary.modelCount);
+            instance.scale = 1.0f;
+            instance.rotation = 0.0f;
+            instance.material = -1;
+
+            if (instance.model < 0)
+                ok = parseError(filename, c.line, "unknown model '" + model + "'");
+            else if (!readFloats(c, instance.position, 3))
+                ok = parseError(filename, c.line, "object needs a position");
+            else if (!atLineEnd(c) && !readFloat(c, instance.scale))
+                ok = parseError(filename, c.line, "invalid scale");
+            else if (!atLineEnd(c) && !readFloat(c, instance.rotation))
+                ok = parseError(filename, c.line, "invalid rotation");
+            else if (!atLineEnd(c)) {
+                string paint = readWord(c);
+                instance.material = lookup(paint, vocabulary.materials, vocabulary.materialCount);
+                if (instance.material < 0)
+                    ok = parseError(filename, c.line, "unknown material '" + paint + "'");
+            }
+
+            if (ok)
+                loaded.instances.push_back(instance);
+        }
+        else if (keyword == "light") {
+            SceneLight light;
+            bool read = readFloats(c, light.position, 4) && readFloats(c, light.ambient, 3)
+                && readFloats(c, light.diffuse, 3) && readFloats(c, light.specular, 3);
+            light.ambient[3] = light.diffuse[3] = light.specular[3] = 1.0f;
+            if (!read)
+                ok = parseError(filename, c.line, "light needs a position (x y z w) and ambient, diffuse and specular colours");
+            else
+                loaded.lights.push_back(light);
+        }
+        else if (keyword == "material") {
+            SceneMaterial material;
+            string name = readWord(c);
+            material.material = lookup(name, vocabulary.materials, vocabulary.materialCount);
+            bool read = readFloats(c, material.ambient, 3) && readFloats(c, material.diffuse, 3)
+                && readFloats(c, material.specular, 3) && readFloat(c, material.shininess);
+            material.ambient[3] = material.diffuse[3] = material.specular[3] = 1.0f;
+            if (material.material < 0)
+                ok = parseError(filename, c.line, "unknown material '" + name + "'");
+            else if (!read)
+                ok = parseError(filename, c.line, "material needs ambient, diffuse and specular colours and a shininess");
+            else
+                loaded.materials.push_back(material);
+        }
+        else if (keyword == "fog") {
+            string mode = readWord(c);
+            if (mode == "off") {
+                loaded.fog.enabled = 0;
+            }
+            else {
+                TextCursor value = { mode.c_str(), mode.c_str() + mode.size(), c.line };
+                loaded.fog.enabled = 1;
+                loaded.fog.color[3] = 1.0f;
+                if (!readFloat(value, loaded.fog.density) || !readFloats(c, loaded.fog.color, 3))
+                    ok = parseError(filename, c.line, "fog needs a density and a colour, or 'off'");
+            }
+        }
+        else if (keyword == "viewer") {
+            if (!readFloats(c, loaded.viewer, 3))
+                ok = parseError(filename, c.line, "viewer needs a position");
+        }
+        else {
+            ok = parseError(filename, c.line, "unknown entry '" + keyword + "'");
+        }
+
+        if (ok && !atLineEnd(c))
+            ok = parseError(filename, c.line, "unexpected text after '" + keyword + "'");
+        skipLine(c);
+    }
+
+    unmapFile(file);
+    if (ok)
+        scene = loaded;
+    return ok;
+}
+
+// This function is responsible for loading a binary scene, one memcpy per array; the ids are then checked
+// against the vocabulary, as the text loader checks the names
+bool loadSceneBinary(const char* filename, const SceneVocabulary& vocabulary, Scene& scene) {
+    MappedFile file;
+    if (!mapFile(filename, file))
+        return parseError(filename, 0, "cannot open");
+
+    SceneBinaryHeader header;
+    bool ok = file.size >= sizeof(header);
+    if (ok) {
+        memcpy(&header, file.data, sizeof(header));
+        ok = memcmp(header.magic, binaryMagic, 4) == 0 && header.version == binaryVersion;
+    }
+
+    size_t lightBytes = ok ? (size_t)header.lightCount * sizeof(SceneLight) : 0;
+    size_t materialBytes = ok ? (size_t)header.materialCount * sizeof(SceneMaterial) : 0;
+    size_t instanceBytes = ok ? (size_t)header.instanceCount * sizeof(SceneInstance) : 0;
+    if (ok)
+        ok = file.size == sizeof(header) + lightBytes + materialBytes + instanceBytes;
+
+    if (!ok) {
+        unmapFile(file);
+        return parseError(filename, 0, "not a version 2 binary scene, or truncated");
+    }
+
+    Scene loaded;
+    const unsigned char* p = file.data + sizeof(header);
+    memcpy(loaded.viewer, header.viewer, sizeof(loaded.viewer));
+    loaded.fog = header.fog;
+
+    loaded.lights.resize(header.lightCount);
+    if (lightBytes)
+        memcpy(&loaded.lights[0], p, lightBytes);
+    p += lightBytes;
+
+    loaded.materials.resize(header.materialCount);
+    if (materialBytes)
+        memcpy(&loaded.materials[0], p, materialBytes);
+    p += materialBytes;
+
+    loaded.instances.resize(header.instanceCount);
+    if (instanceBytes)
+        memcpy(&loaded.instances[0], p, instanceBytes);
+    unmapFile(file);
+
+    for (size_t i = 0; i < loaded.materials.size(); i++) {
+        int material = loaded.materials[i].material;
+        if (material < 0 || material >= vocabulary.materialCount)
+            return parseError(filename, 0, "material " + to_string(i) + " has unknown id " + to_string(material));
+    }
+    for (size_t i = 0; i < loaded.instances.size(); i++) {
+        const SceneInstance& instance = loaded.instances[i];
+        if (instance.model < 0 || instance.model >= vocabulary.modelCount)
+            return parseError(filename, 0, "object " + to_string(i) + " has unknown model id " + to_string(instance.model));
+        if (instance.material < -1 || instance.material >= vocabulary.materialCount)
+            return parseError(filename, 0, "object " + to_string(i) + " has unknown material id " + to_string(instance.material));
+    }
+
+    scene = loaded;
+    return true;
+}
+
+bool loadScene(const char* filename, const SceneVocabulary& vocabulary, Scene& scene) {
+    MappedFile file;
+    bool binary = false;
+    if (mapFile(filename, file)) {
+        binary = file.size >= 4 && memcmp(file.data, binaryMagic, 4) == 0;
+        unmapFile(file);
+    }
+    return binary ? loadSceneBinary(filename, vocabulary, scene) : loadSceneText(filename, vocabulary, scene);
+}
+
+bool saveSceneText(const char* filename, const SceneVocabulary& vocabulary, const Scene& scene) {
+    FILE* file;
+    if (fopen_s(&file, filename, "w") != 0)
+        return parseError(filename, 0, "cannot write");
+
+    fprintf(file, "viewer %g %g %g\n", scene.viewer[0], scene.viewer[1], scene.viewer[2]);
+    if (scene.fog.enabled)
+        fprintf(file, "fog %g %g %g %g\n", scene.fog.density, scene.fog.color[0], scene.fog.color[1], scene.fog.color[2]);
+    else
+        fprintf(file, "fog off\n");
+
+    for (size_t i = 0; i < scene.lights.size(); i++) {
+        const SceneLight& l = scene.lights[i];
+        fprintf(file, "light %g %g %g %g  %g %g %g  %g %g %g  %g %g %g\n", l.position[0], l.position[1], l.position[2], l.position[3],
+            l.ambient[0], l.ambient[1], l.ambient[2], l.diffuse[0], l.diffuse[1], l.diffuse[2], l.specular[0], l.specular[1], l.specular[2]);
+    }
+    for (size_t i = 0; i < scene.materials.size(); i++) {
+        const SceneMaterial& m = scene.materials[i];
+        fprintf(file, "material %s  %g %g %g  %g %g %g  %g %g %g  %g\n", vocabulary.materials[m.material],
+            m.ambient[0], m.ambient[1], m.ambient[2], m.diffuse[0], m.diffuse[1], m.diffuse[2], m.specular[0], m.specular[1], m.specular[2], m.shininess);
+    }
+    for (size_t i = 0; i < scene.instances.size(); i++) {
+        const SceneInstance& o = scene.instances[i];
+        fprintf(file, "object %s %g %g %g %g %g", vocabulary.models[o.model], o.position[0], o.position[1], o.position[2], o.scale, o.rotation);
+        fprintf(file, o.material >= 0 ? " %s\n" : "\n", o.material >= 0 ? vocabulary.materials[o.material] : "");
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool saveSceneBinary(const char* filename, const Scene& scene) {
+    FILE* file;
+    if (fopen_s(&file, filename, "wb") != 0)
+        return parseError(filename, 0, "cannot write");
+
+    SceneBinaryHeader header;
+    memcpy(header.magic, binaryMagic, 4);
+    header.version = binaryVersion;
+    memcpy(header.viewer, scene.viewer, sizeof(header.viewer));
+    header.fog = scene.fog;
+    header.lightCount = (uint32_t)scene.lights.size();
+    header.materialCount = (uint32_t)scene.materials.size();
+    header.instanceCount = (uint32_t)scene.instances.size();
+
+    fwrite(&header, sizeof(header), 1, file);
+    if (!scene.lights.empty())
+        fwrite(&scene.lights[0], sizeof(SceneLight), scene.lights.size(), file);
+    if (!scene.materials.empty())
+        fwrite(&scene.materials[0], sizeof(SceneMaterial), scene.materials.size(), file);
+    if (!scene.instances.empty())
+        fwrite(&scene.instances[0], sizeof(SceneInstance), scene.instances.size(), file);
+
+    fclose(file);
+    return true;
+}
+
+static size_t fileSize(const char* filename) {
+    MappedFile file;
+    size_t size = 0;
+    if (mapFile(filename, file))
+        size = file.size;
+    unmapFile(file);
+    return size;
+}
+
+void generateTown(const SceneVocabulary& vocabulary, const Scene& base, int count, float spacing, Scene& town) {
+    town = base;
+    town.instances.clear();
+    town.instances.reserve(count);
+    int side = 1;
+    while (side * side < count)
+        side++;
+
+    // a linear congruential generator, so every run and platform gets the same town
+    unsigned int seed = 12345;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        SceneInstance instance;
+        instance.model = (int32_t)((seed >> 16) % vocabulary.modelCount);
+        instance.position[0] = (i % side - (side - 1) * 0.5f) * spacing;
+        instance.position[1] = 0.0f;
+        instance.position[2] = (i / side - (side - 1) * 0.5f) * spacing;
+        instance.scale = 0.75f + (seed % 100) / 200.0f;
+        instance.rotation = (float)((seed >> 8) % 360);
+        instance.material = (seed >> 24) % 4 ? -1 : (int32_t)((seed >> 4) % vocabulary.materialCount);
+        town.instances.push_back(instance);
+    }
+}
+
+// This function is responsible for timing both loaders on a generated town of count instances
+int runSceneBenchmark(const SceneVocabulary& vocabulary, const Scene& base, int count, const char* jsonPath) {
+    const char* textName = "bench_scene.scene";
+    const char* binaryName = "bench_scene.sceneb";
+
+    Scene generated;
+    generateTown(vocabulary, base, count, 3.0f, generated);
+
+    if (!saveSceneText(textName, vocabulary, generated) || !saveSceneBinary(binaryName, generated))
+        return EXIT_FAILURE;
+
+    const char* names[] = { "text", "binary" };
+    const char* files[] = { textName, binaryName };
+    stringstream json;
+    json << "{\n  \"benchmark\": \"scene_loader\",\n  \"instances\": " << count << ",\n  \"results\": [";
+
+    for (int f = 0; f < 2; f++) {
+        vector<double> timings;
+        bool ok = true;
+        for (int run = 0; run < 5; run++) {
+            Scene loaded = base;
+            double start = nowMilliseconds();
+            ok = ok && loadScene(files[f], vocabulary, loaded) && loaded.instances.size() == (size_t)count;
+            timings.push_back(nowMilliseconds() - start);
+        }
+        TimingSummary summary = summarizeTimings(timings);
+        json << (f ? "," : "") << "\n    { \"format\": \"" << names[f] << "\", \"ok\": " << (ok ? "true" : "false")
+            << ", \"bytes\": " << fileSize(files[f]) << ", \"best_ms\": " << summary.min << ", \"median_ms\": " << summary.median
+            << ", \"instances_per_ms\": " << count / summary.min << " }";
+    }
+    json << "\n  ]\n}";
+
+    remove(textName);
+    remove(binaryName);
+    return writeReport(jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
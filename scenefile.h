@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+    Scene description files.
+
+    The text format (.scene) is for authoring, one entry per line, '#' starts a comment:
+
+        viewer   x y z
+        fog      density r g b              (or "fog off")
+        light    x y z w  ar ag ab  dr dg db  sr sg sb
+        material name  ar ag ab  dr dg db  sr sg sb  shininess
+        object   model x y z [scale [rotation [paint]]]
+
+    rotation is in degrees about the y axis, paint is a material name that replaces the
+    model's main material for this object. A "material" line redefines one of the named
+    materials, "light" lines are numbered GL_LIGHT0, GL_LIGHT1, ... in file order.
+
+    The binary format (.sceneb) is the same data as fixed-size records behind a small
+    header, written by saveSceneBinary(). Loading it maps the file and copies each array
+    with a single memcpy. Both loaders make one pass over the file and fill contiguous
+    arrays that render() walks directly.
+*/
+
+struct SceneInstance {
+    int32_t model;
+    float position[3];
+    float scale;
+    float rotation;
+    int32_t material; // paint material, -1 for the model's own
+};
+
+struct SceneLight {
+    float position[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+};
+
+struct SceneMaterial {
+    int32_t material;
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float shininess;
+};
+
+struct SceneFog {
+    int32_t enabled;
+    float density;
+    float color[4];
+};
+
+struct Scene {
+    float viewer[3];
+    SceneFog fog;
+    std::vector<SceneLight> lights;
+    std::vector<SceneMaterial> materials;
+    std::vector<SceneInstance> instances;
+};
+
+// names the loader accepts for models and materials, the index is the id stored in the scene
+struct SceneVocabulary {
+    const char* const* models;
+    int modelCount;
+    const char* const* materials;
+    int materialCount;
+};
+
+// loads either format (the binary one is recognised by its header), the scene keeps its
+// current viewer and fog when the file has none; false with a message on error
+bool loadScene(const char* filename, const SceneVocabulary& vocabulary, Scene& scene);
+
+bool loadSceneText(const char* filename, const SceneVocabulary& vocabulary, Scene& scene);
+bool loadSceneBinary(const char* filename, const SceneVocabulary& vocabulary, Scene& scene);
+
+bool saveSceneText(const char* filename, const SceneVocabulary& vocabulary, const Scene& scene);
+bool saveSceneBinary(const char* filename, const Scene& scene);
+
+// fills town with base's lights and fog and a deterministic grid of count objects spaced
+// spacing apart around the origin, with varied models, scales, rotations and paint
+void generateTown(const SceneVocabulary& vocabulary, const Scene& base, int count, float spacing, Scene& town);
+
+// load times of both formats for a generated scene with count instances, writes JSON
+int runSceneBenchmark(const SceneVocabulary& vocabulary, const Scene& base, int count, const char* jsonPath);
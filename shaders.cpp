@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "platform.h"
+#include "glloader.h"
+#include "benchmark.h"
+#include "shaders.h"
+
+using namespace std;
+
+// "SPRG", followed by the binary's format and length, then the binary
+#define PROGRAM_FILE_MAGIC 0x47525053u
+
+struct ProgramFileHeader {
+    unsigned int magic;
+    GLenum format;
+    GLint length;
+};
+
+static string cacheDirectory;
+static ProgramBuildStats buildStats = { 0, 0, 0, 0.0 };
+
+// prints the info log of a shader or program
+static void printLog(const char* name, const char* stage, GLuint object, bool program) {
+    GLint length = 0;
+    if (program)
+        pglGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    else
+        pglGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+
+    vector<char> log(length > 1 ? length : 1, '\0');
+    if (length > 1) {
+        if (program)
+            pglGetProgramInfoLog(object, length, NULL, &log[0]);
+        else
+            pglGetShaderInfoLog(object, length, NULL, &log[0]);
+    }
+    cerr << name << ": " << stage << " failed" << (length > 1 ? ":\n" : "") << &log[0] << endl;
+}
+
+static GLuint compileShader(const char* name, GLenum type, const char* source) {
+    GLuint shader = pglCreateShader(type);
+    pglShaderSource(shader, 1, &source, NULL);
+    pglCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    pglGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        printLog(name, type == GL_VERTEX_SHADER ? "vertex shader" : "fragment shader", shader, false);
+        pglDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// FNV-1a over a string and the terminator, so "ab" + "c" and "a" + "bc" differ
+static void hashText(unsigned long long& hash, const char* text) {
+    do {
+        hash ^= (unsigned char)*text;
+        hash *= 1099511628211ULL;
+    } while (*text++);
+}
+
+// This function is responsible for naming the cache file of a program after everything its binary depends on
+static string cacheFile(const char* name, const char* vertexSource, const char* fragmentSource,
+    const ShaderAttribute* attributes, int attributeCount) {
+
+    unsigned long long hash = 14695981039346656037ULL;
+    const GLenum driver[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (int i = 0; i < 3; i++) {
+        const char* text = (const char*)glGetString(driver[i]);
+        hashText(hash, text ? text : "");
+    }
+    hashText(hash, vertexSource);
+    hashText(hash, fragmentSource);
+    for (int i = 0; i < attributeCount; i++) {
+        hashText(hash, attributes[i].name);
+        hashText(hash, to_string(attributes[i].location).c_str());
+    }
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", hash);
+    return cacheDirectory + "/" + name + "-" + hex + ".bin";
+}
+
+// a program from a cached binary, 0 when there is none or the driver does not take it
+static GLuint loadCachedProgram(const string& path) {
+    ifstream file(path.c_str(), ios::binary);
+    ProgramFileHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_FILE_MAGIC || header.length <= 0)
+        return 0;
+    vector<char> binary(header.length);
+    if (!file.read(&binary[0], header.length))
+        return 0;
+
+    GLuint program = pglCreateProgram();
+    pglProgramBinary(program, header.format, &binary[0], header.length);
+    GLint status = GL_FALSE;
+    pglGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        pglDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void storeProgram(GLuint program, const string& path) {
+    GLint length = 0;
+    pglGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    vector<char> binary(length);
+    ProgramFileHeader header = { PROGRAM_FILE_MAGIC, 0, 0 };
+    pglGetProgramBinary(program, length, &header.length, &header.format, &binary[0]);
+    if (header.length <= 0)
+        return;
+
+    ofstream file(path.c_str(), ios::binary);
+    file.write((const char*)&header, sizeof(header));
+    file.write(&binary[0], header.length);
+    if (file)
+        buildStats.stored++;
+    else
+        cerr << path << ": could not write the program binary" << endl;
+}
+
+static GLuint compileProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+    const ShaderAttribute* attributes, int attributeCount, bool retrievable) {
+
+    GLuint vertexShader = compileShader(name, GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = compileShader(name, GL_FRAGMENT_SHADER, fragmentSource);
+    if (vertexShader == 0 || fragmentShader == 0) {
+        if (vertexShader)
+            pglDeleteShader(vertexShader);
+        if (fragmentShader)
+            pglDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = pglCreateProgram();
+    pglAttachShader(program, vertexShader);
+    pglAttachShader(program, fragmentShader);
+    for (int i = 0; i < attributeCount; i++)
+        pglBindAttribLocation(program, attributes[i].location, attributes[i].name);
+    // the driver may only keep a binary it can hand back when asked before linking
+    if (retrievable)
+        pglProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    pglLinkProgram(program);
+
+    // the program keeps the compiled code, the shader objects go once it is linked
+    pglDeleteShader(vertexShader);
+    pglDeleteShader(fragmentShader);
+
+    GLint status = GL_FALSE;
+    pglGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        printLog(name, "link", program, true);
+        pglDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+    const ShaderAttribute* attributes, int attributeCount) {
+
+    if (!hasShaders)
+        return 0;
+
+    double start = nowMilliseconds();
+    bool cached = !cacheDirectory.empty() && hasProgramBinaries;
+    string path = cached ? cacheFile(name, vertexSource, fragmentSource, attributes, attributeCount) : string();
+
+    GLuint program = cached ? loadCachedProgram(path) : 0;
+    if (program != 0)
+        buildStats.loaded++;
+    else {
+        program = compileProgram(name, vertexSource, fragmentSource, attributes, attributeCount, cached);
+        if (program != 0) {
+            buildStats.compiled++;
+            if (cached)
+                storeProgram(program, path);
+        }
+    }
+
+    buildStats.milliseconds += nowMilliseconds() - start;
+    return program;
+}
+
+void deleteProgram(GLuint program) {
+    if (program != 0)
+        pglDeleteProgram(program);
+}
+
+void setProgramCache(const string& directory) {
+    cacheDirectory = directory;
+    if (!directory.empty())
+        makeDirectory(directory.c_str());
+}
+
+ProgramBuildStats programBuildStats() {
+    return buildStats;
+}
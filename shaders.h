@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <GL/glut.h>
+
+/*
+    Helpers for building GLSL programs through the entry points in glloader.h.
+
+    Attributes are bound to fixed locations before linking, so the drawing code can set
+    up its vertex arrays without looking anything up. Compile and link errors are
+    printed with the program's name and the driver's log.
+
+    With a program cache set, every linked program is also saved as the driver's binary,
+    in a file named after a hash of the driver, the sources and the attribute bindings.
+    The next start loads that instead of compiling; a binary the driver turns down (after
+    a driver update, say) is compiled again and replaced.
+*/
+
+struct ShaderAttribute {
+    GLuint location;
+    const char* name;
+};
+
+// compiles and links a program, 0 on failure (or when GLSL is not available)
+GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+    const ShaderAttribute* attributes, int attributeCount);
+
+void deleteProgram(GLuint program);
+
+// the directory buildProgram() keeps binaries in, created when missing; empty (the default) always compiles
+void setProgramCache(const std::string& directory);
+
+// what buildProgram() has done since the start
+struct ProgramBuildStats {
+    int compiled; // from source
+    int loaded; // from a cached binary
+    int stored; // binaries written
+    double milliseconds; // spent building, both ways
+};
+
+ProgramBuildStats programBuildStats();
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "glloader.h"
+#include "renderstate.h"
+#include "shadowmap.h"
+
+using namespace std;
+
+// FNV-1a, enough to notice that anything about a light's casters changed
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void normalize3(GLfloat v[3]) {
+    GLfloat length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+static void cross3(const GLfloat a[3], const GLfloat b[3], GLfloat out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static GLfloat dot3(const GLfloat a[3], const GLfloat b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+ShadowMaps::ShadowMaps() : framebuffer(0), lightCount(0), mapSize(0), savedEnvironment(GL_MODULATE) {
+    memset(maps, 0, sizeof(maps));
+}
+
+// This function is responsible for creating the depth textures and the framebuffer they are rendered through
+bool ShadowMaps::init(int lights, int size) {
+    release();
+    if (!hasShadowMaps || lights <= 0)
+        return false;
+
+    lightCount = min(lights, SHADOW_MAX_LIGHTS);
+    mapSize = size;
+
+    for (int i = 0; i < lightCount; i++) {
+        glGenTextures(1, &maps[i].texture);
+        glBindTexture(GL_TEXTURE_2D, maps[i].texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+
+        // linear filtering of a compared depth texture gives 2x2 percentage-closer filtering
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_TEXTURE_MODE, GL_ALPHA); // 1 where lit, 0 in shadow
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    invalidateRenderState(); // the texture binding changed behind the tracker
+
+    // a depth-only framebuffer, the depth texture is attached when a map is rendered
+    pglGenFramebuffers(1, &framebuffer);
+    pglBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    pglFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, maps[0].texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    bool complete = pglCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    pglBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete) {
+        release();
+        return false;
+    }
+    invalidate();
+    return true;
+}
+
+void ShadowMaps::release() {
+    for (int i = 0; i < lightCount; i++) {
+        if (maps[i].texture)
+            glDeleteTextures(1, &maps[i].texture);
+    }
+    if (framebuffer)
+        pglDeleteFramebuffers(1, &framebuffer);
+    memset(maps, 0, sizeof(maps));
+    framebuffer = 0;
+    lightCount = 0;
+}
+
+void ShadowMaps::invalidate() {
+    for (int i = 0; i < lightCount; i++)
+        maps[i].rendered = false;
+}
+
+// This function is responsible for setting up the light space of a light around the receivers
+void ShadowMaps::beginCasters(int light, const GLfloat direction[3], const GLfloat receiverLow[3], const GLfloat receiverHigh[3]) {
+    LightMap& map = maps[light];
+
+    memcpy(map.toward, direction, sizeof(map.toward));
+    normalize3(map.toward);
+
+    // any up vector that is not parallel to the light will do
+    GLfloat up[3] = { 0.0f, 1.0f, 0.0f };
+    if (fabsf(map.toward[1]) > 0.99f) {
+        up[0] = 1.0f;
+        up[1] = 0.0f;
+    }
+    cross3(up, map.toward, map.right);
+    normalize3(map.right);
+    cross3(map.toward, map.right, map.up);
+
+    // the receiver box in light space
+    for (int k = 0; k < 3; k++) {
+        map.low[k] = 1e30f;
+        map.high[k] = -1e30f;
+    }
+    for (int corner = 0; corner < 8; corner++) {
+        GLfloat p[3] = {
+            (corner & 1) ? receiverHigh[0] : receiverLow[0],
+            (corner & 2) ? receiverHigh[1] : receiverLow[1],
+            (corner & 4) ? receiverHigh[2] : receiverLow[2]
+        };
+        GLfloat l[3] = { dot3(map.right, p), dot3(map.up, p), dot3(map.toward, p) };
+        for (int k = 0; k < 3; k++) {
+            map.low[k] = min(map.low[k], l[k]);
+            map.high[k] = max(map.high[k], l[k]);
+        }
+    }
+
+    map.hash = hashBytes(1469598103934665603ull, map.toward, sizeof(map.toward));
+    map.hash = hashBytes(map.hash, map.low, sizeof(map.low));
+    map.hash = hashBytes(map.hash, map.high, sizeof(map.high));
+}
+
+bool ShadowMaps::addCaster(int light, const GLfloat center[3], GLfloat radius, const void* state, size_t stateSize) {
+    LightMap& map = maps[light];
+    GLfloat x = dot3(map.right, center), y = dot3(map.up, center), z = dot3(map.toward, center);
+
+    // the light is parallel to light space z, so a shadow stays inside the caster's x/y extent,
+    // and a caster entirely on the far side of the receivers cannot reach them
+    if (x + radius < map.low[0] || x - radius > map.high[0] || y + radius < map.low[1] || y - radius > map.high[1])
+        return false;
+    if (z + radius < map.low[2])
+        return false;
+
+    map.high[2] = max(map.high[2], z + radius);
+    map.hash = hashBytes(map.hash, center, sizeof(GLfloat) * 3);
+    map.hash = hashBytes(map.hash, &radius, sizeof(radius));
+    map.hash = hashBytes(map.hash, state, stateSize);
+    return true;
+}
+
+bool ShadowMaps::endCasters(int light) {
+    LightMap& map = maps[light];
+    GLfloat width = max(map.high[0] - map.low[0], 1e-3f);
+    GLfloat height = max(map.high[1] - map.low[1], 1e-3f);
+    GLfloat depth = max(map.high[2] - map.low[2], 1e-3f);
+
+    // rows of the world to shadow texture matrix: s and t across the receivers, r is the depth
+    // the orthographic projection writes, 0 on the light's side
+    for (int k = 0; k < 3; k++) {
+        map.matrix[k] = map.right[k] / width;
+        map.matrix[4 + k] = map.up[k] / height;
+        map.matrix[8 + k] = -map.toward[k] / depth;
+        map.matrix[12 + k] = 0.0f;
+    }
+    map.matrix[3] = -map.low[0] / width;
+    map.matrix[7] = -map.low[1] / height;
+    map.matrix[11] = map.high[2] / depth;
+    map.matrix[15] = 1.0f;
+
+    return !map.rendered || map.renderedHash != map.hash;
+}
+
+// column-major matrices for glLoadMatrixf, the view turns world space into light space
+void ShadowMaps::lightMatrices(const LightMap& map, GLfloat projection[16], GLfloat view[16]) const {
+    memset(view, 0, sizeof(GLfloat) * 16);
+    for (int k = 0; k < 3; k++) {
+        view[k * 4 + 0] = map.right[k];
+        view[k * 4 + 1] = map.up[k];
+        view[k * 4 + 2] = map.toward[k];
+    }
+    view[15] = 1.0f;
+
+    // glOrtho with near and far as distances in front of the light
+    GLfloat left = map.low[0], right = map.high[0], bottom = map.low[1], top = map.high[1];
+    GLfloat zNear = -map.high[2], zFar = -map.low[2];
+    memset(projection, 0, sizeof(GLfloat) * 16);
+    projection[0] = 2.0f / max(right - left, 1e-3f);
+    projection[5] = 2.0f / max(top - bottom, 1e-3f);
+    projection[10] = -2.0f / max(zFar - zNear, 1e-3f);
+    projection[12] = -(right + left) / max(right - left, 1e-3f);
+    projection[13] = -(top + bottom) / max(top - bottom, 1e-3f);
+    projection[14] = -(zFar + zNear) / max(zFar - zNear, 1e-3f);
+    projection[15] = 1.0f;
+}
+
+void ShadowMaps::beginRender(int light) {
+    const LightMap& map = maps[light];
+
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_POLYGON_BIT);
+    pglBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    pglFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, map.texture, 0);
+    glViewport(0, 0, mapSize, mapSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // depth only, pushed back a little so lit surfaces do not shadow themselves
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_FOG);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    GLfloat projection[16], view[16];
+    lightMatrices(map, projection, view);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadMatrixf(projection);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadMatrixf(view);
+}
+
+void ShadowMaps::endRender(int light) {
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+
+    pglBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glPopAttrib();
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+
+    maps[light].renderedHash = maps[light].hash;
+    maps[light].rendered = true;
+}
+
+// This function is responsible for setting up the pass that takes a light's contribution back out of shadowed receivers
+void ShadowMaps::beginReceivers(int light) {
+    const LightMap& map = maps[light];
+    const GLfloat black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_LIGHTING_BIT | GL_FOG_BIT);
+
+    // only this light's diffuse and specular terms
+    for (int i = 0; i < SHADOW_MAX_LIGHTS; i++) {
+        if (i != light)
+            glDisable(GL_LIGHT0 + i);
+    }
+    glLightfv(GL_LIGHT0 + light, GL_AMBIENT, black);
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, black);
+    glFogfv(GL_FOG_COLOR, black);
+
+    // the same surfaces again, subtracted by how much of the texel is in shadow
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_ONE);
+    pglBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+
+    // the planes are given in world space and OpenGL moves them into eye space with the current modelview
+    setCapability(GL_TEXTURE_2D, true);
+    bindTexture(map.texture);
+    glGetTexEnviv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, &savedEnvironment);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    const GLenum coordinates[4] = { GL_S, GL_T, GL_R, GL_Q };
+    const GLenum generators[4] = { GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R, GL_TEXTURE_GEN_Q };
+    for (int i = 0; i < 4; i++) {
+        glTexGeni(coordinates[i], GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+        glTexGenfv(coordinates[i], GL_EYE_PLANE, map.matrix + i * 4);
+        glEnable(generators[i]);
+    }
+}
+
+void ShadowMaps::endReceivers(int light) {
+    (void)light;
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, savedEnvironment);
+    pglBlendEquation(GL_FUNC_ADD);
+    glPopAttrib();
+
+    // the pop restored the enables behind the tracker's back
+    invalidateRenderState();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glut.h>
+
+/*
+    Shadow maps for directional lights
+
+    Each light gets a depth texture rendered from the light with an orthographic frustum
+    fitted tightly around the receivers (the ground), so every texel lands on something
+    that can show a shadow. A caster is only drawn into a light's map when its bounding
+    sphere can reach the receivers along the light: anything outside the receiver
+    rectangle in light space, or behind it, is culled, and the depth range is stretched
+    just far enough towards the light to hold the casters that remain.
+
+    The maps are cached. Every frame the casters are listed again and hashed together
+    with the light direction and the receivers; a map is only rendered when that hash
+    changes, so a still scene pays for its shadows once.
+
+    Fixed-function OpenGL cannot attenuate a single light per pixel, so receivers are
+    shadowed with one extra pass per light: the receiver is drawn again lit by that light
+    alone, and where the depth comparison says it is hidden from the light, the result is
+    subtracted from the frame (GL_FUNC_REVERSE_SUBTRACT). The fog colour is black during
+    that pass, so the subtracted amount is fogged exactly like the first pass.
+*/
+
+#define SHADOW_MAX_LIGHTS 8
+
+class ShadowMaps {
+
+public:
+
+    ShadowMaps();
+
+    // creates a size x size depth map per light, false when the context cannot render shadow maps
+    bool init(int lights, int size);
+
+    void release();
+
+    bool ready() const { return lightCount > 0; }
+
+    int lights() const { return lightCount; }
+
+    // forgets the cached maps, every light is rendered again next time
+    void invalidate();
+
+
+
+    // listing the casters, every frame
+
+    // direction points towards the light in world space, the box holds everything that can be shadowed
+    void beginCasters(int light, const GLfloat direction[3], const GLfloat receiverLow[3], const GLfloat receiverHigh[3]);
+
+    // false when the bounding sphere cannot shadow a receiver; state is whatever places the caster,
+    // hashed to notice when it moves
+    bool addCaster(int light, const GLfloat center[3], GLfloat radius, const void* state, size_t stateSize);
+
+    // fits the light's frustum to the casters, true when the map is out of date and has to be rendered
+    bool endCasters(int light);
+
+
+
+    // rendering a map: draw the casters between these two with their model transforms, in world space
+    void beginRender(int light);
+
+    void endRender(int light);
+
+
+
+    // the receiver pass: draw the receivers again between these two, lit as in the first pass, with
+    // the camera's view in the modelview matrix
+    void beginReceivers(int light);
+
+    void endReceivers(int light);
+
+private:
+
+    struct LightMap {
+        GLuint texture;
+        GLfloat right[3], up[3], toward[3]; // light space axes in world space
+        GLfloat low[3], high[3]; // receiver bounds in light space, high[2] grows with the casters
+        uint64_t hash;
+        uint64_t renderedHash; // hash of the contents of the texture
+        bool rendered;
+        GLfloat matrix[16]; // world to shadow texture coordinates
+    };
+
+    void lightMatrices(const LightMap& map, GLfloat projection[16], GLfloat view[16]) const;
+
+    LightMap maps[SHADOW_MAX_LIGHTS];
+    GLuint framebuffer;
+    int lightCount;
+    int mapSize;
+    GLint savedViewport[4];
+    GLint savedEnvironment;
+
+};
@@ -0,0 +1,719 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "softraster.h"
+#include "threadpool.h"
+#include "cpufeatures.h"
+
+#ifdef SCENE_X86
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+#define SOFT_TILE_SIZE 64
+#define SOFT_MAX_CHUNKS 64
+
+enum SoftCommandType {
+    SOFT_MESH,
+    SOFT_QUAD,
+    SOFT_TEXTURED_QUAD
+};
+
+struct SoftCommand {
+    SoftCommandType type;
+    GLfloat modelview[16];
+    const Mesh* mesh;
+    int paintFrom;
+    int paintTo;
+    GLfloat corners[4][3];
+    GLfloat texcoords[4][2];
+    GLfloat normal[3];
+    int material;
+    const SoftTexture* texture;
+};
+
+// a vertex after lighting, in clip space
+struct SoftVertex {
+    GLfloat position[4];
+    GLfloat color[3];
+    GLfloat fogDepth;
+    GLfloat texcoord[2];
+};
+
+// the values interpolated across a triangle, divided by w except for depth
+enum {
+    PLANE_DEPTH,
+    PLANE_INVERSE_W,
+    PLANE_RED,
+    PLANE_GREEN,
+    PLANE_BLUE,
+    PLANE_FOG,
+    PLANE_U,
+    PLANE_V,
+    PLANE_COUNT
+};
+
+// a screen-space triangle ready for the tiles, everything is relative to its first vertex
+struct SoftTriangle {
+    GLfloat originX, originY;
+    // edge function i is edgeX[i] * dx + edgeY[i] * dy + edgeOrigin[i], inside when >= 0
+    GLfloat edgeX[3], edgeY[3], edgeOrigin[3];
+    // plane i is planeX[i] * dx + planeY[i] * dy + planeOrigin[i]
+    GLfloat planeX[PLANE_COUNT], planeY[PLANE_COUNT], planeOrigin[PLANE_COUNT];
+    int minX, minY, maxX, maxY;
+    const SoftTexture* texture;
+};
+
+// one slice of the command list with the triangles it produced and their tile bins
+struct SoftChunk {
+    vector<SoftTriangle> triangles;
+    vector<vector<uint32_t> > bins;
+
+    // per-vertex scratch space for the mesh being set up
+    vector<GLfloat> eyePositions;
+    vector<GLfloat> eyeNormals;
+    vector<SoftVertex> vertices;
+    vector<int> litBatch;
+};
+
+struct SoftFrameData {
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    GLfloat clearColor[4];
+    GLfloat projection[16];
+    SoftLighting lighting;
+    vector<SceneLight> lights;
+    vector<Material> materials;
+    vector<SoftCommand> commands;
+    vector<SoftChunk> chunks;
+    vector<uint32_t> color;
+    vector<GLfloat> depth;
+    long triangles = 0;
+};
+
+
+
+// matrices
+
+static void transformPoint(const GLfloat m[16], const GLfloat p[3], GLfloat out[4]) {
+    for (int i = 0; i < 4; i++)
+        out[i] = m[i] * p[0] + m[4 + i] * p[1] + m[8 + i] * p[2] + m[12 + i];
+}
+
+// the inverse transpose of the upper 3x3, which OpenGL uses for normals
+static void normalMatrix(const GLfloat m[16], GLfloat n[9]) {
+    GLfloat a = m[0], b = m[4], c = m[8];
+    GLfloat d = m[1], e = m[5], f = m[9];
+    GLfloat g = m[2], h = m[6], k = m[10];
+
+    GLfloat cofactor[9] = {
+        e * k - f * h, f * g - d * k, d * h - e * g,
+        c * h - b * k, a * k - c * g, b * g - a * h,
+        b * f - c * e, c * d - a * f, a * e - b * d
+    };
+    GLfloat determinant = a * cofactor[0] + b * cofactor[1] + c * cofactor[2];
+    GLfloat inverse = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+    // row r of the inverse transpose is row r of the cofactor matrix over the determinant
+    for (int i = 0; i < 9; i++)
+        n[i] = cofactor[i] * inverse;
+}
+
+static void transformNormal(const GLfloat n[9], const GLfloat v[3], GLfloat out[3]) {
+    out[0] = n[0] * v[0] + n[1] * v[1] + n[2] * v[2];
+    out[1] = n[3] * v[0] + n[4] * v[1] + n[5] * v[2];
+    out[2] = n[6] * v[0] + n[7] * v[1] + n[8] * v[2];
+}
+
+void softFrustumMatrix(GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar, GLfloat matrix[16]) {
+    memset(matrix, 0, sizeof(GLfloat) * 16);
+    matrix[0] = 2.0f * zNear / (right - left);
+    matrix[5] = 2.0f * zNear / (top - bottom);
+    matrix[8] = (right + left) / (right - left);
+    matrix[9] = (top + bottom) / (top - bottom);
+    matrix[10] = -(zFar + zNear) / (zFar - zNear);
+    matrix[11] = -1.0f;
+    matrix[14] = -2.0f * zFar * zNear / (zFar - zNear);
+}
+
+static void normalize3(GLfloat v[3]) {
+    GLfloat length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+void softLookAtMatrix(const GLfloat eye[3], const GLfloat center[3], const GLfloat up[3], GLfloat matrix[16]) {
+    GLfloat forward[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    normalize3(forward);
+
+    GLfloat side[3] = {
+        forward[1] * up[2] - forward[2] * up[1],
+        forward[2] * up[0] - forward[0] * up[2],
+        forward[0] * up[1] - forward[1] * up[0]
+    };
+    normalize3(side);
+
+    GLfloat upward[3] = {
+        side[1] * forward[2] - side[2] * forward[1],
+        side[2] * forward[0] - side[0] * forward[2],
+        side[0] * forward[1] - side[1] * forward[0]
+    };
+
+    for (int i = 0; i < 3; i++) {
+        matrix[i * 4 + 0] = side[i];
+        matrix[i * 4 + 1] = upward[i];
+        matrix[i * 4 + 2] = -forward[i];
+        matrix[i * 4 + 3] = 0.0f;
+    }
+    matrix[12] = -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2]);
+    matrix[13] = -(upward[0] * eye[0] + upward[1] * eye[1] + upward[2] * eye[2]);
+    matrix[14] = forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2];
+    matrix[15] = 1.0f;
+}
+
+
+
+// vertex stage
+
+// This function is responsible for the fixed-function lighting equation for one vertex
+static void lightVertex(const SoftLighting& lighting, const Material& material, const GLfloat eye[3], const GLfloat normal[3], GLfloat color[3]) {
+    for (int c = 0; c < 3; c++)
+        color[c] = material.ambient[c] * lighting.globalAmbient[c];
+
+    for (int i = 0; i < lighting.lightCount; i++) {
+        const SceneLight& light = lighting.lights[i];
+
+        GLfloat toLight[3];
+        if (light.position[3] != 0.0f) {
+            for (int c = 0; c < 3; c++)
+                toLight[c] = light.position[c] / light.position[3] - eye[c];
+        } else {
+            for (int c = 0; c < 3; c++)
+                toLight[c] = light.position[c];
+        }
+        normalize3(toLight);
+
+        GLfloat diffuse = normal[0] * toLight[0] + normal[1] * toLight[1] + normal[2] * toLight[2];
+        GLfloat specular = 0.0f;
+
+        if (diffuse > 0.0f) {
+            // non-local viewer, the half vector is taken against (0, 0, 1)
+            GLfloat half[3] = { toLight[0], toLight[1], toLight[2] + 1.0f };
+            normalize3(half);
+            GLfloat angle = normal[0] * half[0] + normal[1] * half[1] + normal[2] * half[2];
+            if (angle > 0.0f)
+                specular = material.shininess > 0.0f ? powf(angle, material.shininess) : 1.0f;
+        } else {
+            diffuse = 0.0f;
+        }
+
+        for (int c = 0; c < 3; c++)
+            color[c] += material.ambient[c] * light.ambient[c] + diffuse * material.diffuse[c] * light.diffuse[c] + specular * material.specular[c] * light.specular[c];
+    }
+
+    for (int c = 0; c < 3; c++)
+        color[c] = min(max(color[c], 0.0f), 1.0f);
+}
+
+// This function is responsible for projecting a clipped triangle to the screen and adding it to the chunk
+static void setupTriangle(const SoftFrameData& frame, SoftChunk& chunk, const SoftVertex* a, const SoftVertex* b, const SoftVertex* c, const SoftTexture* texture) {
+    const SoftVertex* corner[3] = { a, b, c };
+    GLfloat x[3], y[3], z[3], inverseW[3];
+
+    for (int i = 0; i < 3; i++) {
+        inverseW[i] = 1.0f / corner[i]->position[3];
+        x[i] = (corner[i]->position[0] * inverseW[i] * 0.5f + 0.5f) * frame.width;
+        y[i] = (corner[i]->position[1] * inverseW[i] * 0.5f + 0.5f) * frame.height;
+        z[i] = corner[i]->position[2] * inverseW[i] * 0.5f + 0.5f;
+    }
+
+    GLfloat area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (!(area != 0.0f))
+        return;
+
+    // both windings are drawn, so clockwise triangles are turned around
+    if (area < 0.0f) {
+        swap(corner[1], corner[2]);
+        swap(x[1], x[2]);
+        swap(y[1], y[2]);
+        swap(z[1], z[2]);
+        swap(inverseW[1], inverseW[2]);
+        area = -area;
+    }
+
+    SoftTriangle triangle;
+    triangle.minX = max(0, (int)floorf(min(x[0], min(x[1], x[2]))));
+    triangle.minY = max(0, (int)floorf(min(y[0], min(y[1], y[2]))));
+    triangle.maxX = min(frame.width - 1, (int)ceilf(max(x[0], max(x[1], x[2]))));
+    triangle.maxY = min(frame.height - 1, (int)ceilf(max(y[0], max(y[1], y[2]))));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return;
+
+    triangle.originX = x[0];
+    triangle.originY = y[0];
+    triangle.texture = texture;
+
+    // edge i lies opposite vertex i, its function is the barycentric weight of i times the area
+    for (int i = 0; i < 3; i++) {
+        int from = (i + 1) % 3;
+        int to = (i + 2) % 3;
+        triangle.edgeX[i] = -(y[to] - y[from]);
+        triangle.edgeY[i] = x[to] - x[from];
+        triangle.edgeOrigin[i] = triangle.edgeX[i] * (x[0] - x[from]) + triangle.edgeY[i] * (y[0] - y[from]);
+    }
+
+    GLfloat values[PLANE_COUNT][3];
+    for (int i = 0; i < 3; i++) {
+        const SoftVertex* v = corner[i];
+        values[PLANE_DEPTH][i] = z[i];
+        values[PLANE_INVERSE_W][i] = inverseW[i];
+        values[PLANE_RED][i] = v->color[0] * inverseW[i];
+        values[PLANE_GREEN][i] = v->color[1] * inverseW[i];
+        values[PLANE_BLUE][i] = v->color[2] * inverseW[i];
+        values[PLANE_FOG][i] = v->fogDepth * inverseW[i];
+        values[PLANE_U][i] = v->texcoord[0] * inverseW[i];
+        values[PLANE_V][i] = v->texcoord[1] * inverseW[i];
+    }
+
+    GLfloat inverseArea = 1.0f / area;
+    for (int p = 0; p < PLANE_COUNT; p++) {
+        triangle.planeX[p] = (values[p][0] * triangle.edgeX[0] + values[p][1] * triangle.edgeX[1] + values[p][2] * triangle.edgeX[2]) * inverseArea;
+        triangle.planeY[p] = (values[p][0] * triangle.edgeY[0] + values[p][1] * triangle.edgeY[1] + values[p][2] * triangle.edgeY[2]) * inverseArea;
+        triangle.planeOrigin[p] = values[p][0];
+    }
+
+    uint32_t index = (uint32_t)chunk.triangles.size();
+    chunk.triangles.push_back(triangle);
+
+    for (int tileY = triangle.minY / SOFT_TILE_SIZE; tileY <= triangle.maxY / SOFT_TILE_SIZE; tileY++)
+        for (int tileX = triangle.minX / SOFT_TILE_SIZE; tileX <= triangle.maxX / SOFT_TILE_SIZE; tileX++)
+            chunk.bins[tileY * frame.tilesX + tileX].push_back(index);
+}
+
+static void interpolateVertex(const SoftVertex& a, const SoftVertex& b, GLfloat t, SoftVertex& out) {
+    for (int i = 0; i < 4; i++)
+        out.position[i] = a.position[i] + (b.position[i] - a.position[i]) * t;
+    for (int i = 0; i < 3; i++)
+        out.color[i] = a.color[i] + (b.color[i] - a.color[i]) * t;
+    out.fogDepth = a.fogDepth + (b.fogDepth - a.fogDepth) * t;
+    for (int i = 0; i < 2; i++)
+        out.texcoord[i] = a.texcoord[i] + (b.texcoord[i] - a.texcoord[i]) * t;
+}
+
+// This function is responsible for clipping a triangle to the near and far planes before setup
+static void clipTriangle(const SoftFrameData& frame, SoftChunk& chunk, const SoftVertex& a, const SoftVertex& b, const SoftVertex& c, const SoftTexture* texture) {
+    // the common case, the whole triangle lies between the planes
+    const SoftVertex* corner[3] = { &a, &b, &c };
+    bool inside = true;
+    for (int i = 0; i < 3 && inside; i++)
+        inside = corner[i]->position[2] >= -corner[i]->position[3] && corner[i]->position[2] <= corner[i]->position[3];
+    if (inside) {
+        setupTriangle(frame, chunk, &a, &b, &c, texture);
+        return;
+    }
+
+    // each plane adds at most one vertex
+    SoftVertex polygon[2][5];
+    int count = 3;
+    polygon[0][0] = a;
+    polygon[0][1] = b;
+    polygon[0][2] = c;
+
+    for (int plane = 0; plane < 2; plane++) {
+        const SoftVertex* in = polygon[plane];
+        SoftVertex* out = polygon[plane ^ 1];
+        GLfloat sign = plane == 0 ? 1.0f : -1.0f;
+        int outCount = 0;
+
+        for (int i = 0; i < count; i++) {
+            const SoftVertex& current = in[i];
+            const SoftVertex& next = in[(i + 1) % count];
+            // w + z >= 0 for the near plane, w - z >= 0 for the far one
+            GLfloat currentDistance = current.position[3] + sign * current.position[2];
+            GLfloat nextDistance = next.position[3] + sign * next.position[2];
+
+            if (currentDistance >= 0.0f)
+                out[outCount++] = current;
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                interpolateVertex(current, next, currentDistance / (currentDistance - nextDistance), out[outCount++]);
+        }
+
+        count = outCount;
+        if (count < 3)
+            return;
+    }
+
+    // two planes leave the result back in the first polygon
+    for (int i = 1; i + 1 < count; i++)
+        setupTriangle(frame, chunk, &polygon[0][0], &polygon[0][i], &polygon[0][i + 1], texture);
+}
+
+static const Material& frameMaterial(const SoftFrameData& frame, int material) {
+    static const Material white = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.0f };
+    if (material < 0 || material >= (int)frame.materials.size())
+        return white;
+    return frame.materials[material];
+}
+
+// This function is responsible for transforming, lighting and clipping the triangles of a mesh
+static void setupMesh(const SoftFrameData& frame, SoftChunk& chunk, const SoftCommand& command) {
+    const Mesh& mesh = *command.mesh;
+    size_t count = mesh.vertices.size();
+
+    GLfloat normals[9];
+    normalMatrix(command.modelview, normals);
+
+    chunk.eyePositions.resize(count * 3);
+    chunk.eyeNormals.resize(count * 3);
+    chunk.vertices.resize(count);
+    chunk.litBatch.assign(count, -1);
+
+    for (size_t i = 0; i < count; i++) {
+        GLfloat eye[4];
+        transformPoint(command.modelview, mesh.vertices[i].position, eye);
+        transformNormal(normals, mesh.vertices[i].normal, &chunk.eyeNormals[i * 3]);
+        memcpy(&chunk.eyePositions[i * 3], eye, sizeof(GLfloat) * 3);
+
+        SoftVertex& vertex = chunk.vertices[i];
+        transformPoint(frame.projection, eye, vertex.position);
+        vertex.fogDepth = fabsf(eye[2]);
+        vertex.texcoord[0] = vertex.texcoord[1] = 0.0f;
+    }
+
+    // vertices are lit once per batch that uses them, the material comes from the batch
+    for (size_t b = 0; b < mesh.batches.size(); b++) {
+        const MeshBatch& batch = mesh.batches[b];
+        int material = batch.material == command.paintFrom && command.paintTo >= 0 ? command.paintTo : batch.material;
+        const Material& surface = frameMaterial(frame, material);
+        const GLuint* indices = &mesh.indices[batch.firstIndex];
+
+        for (GLsizei i = 0; i + 2 < batch.indexCount; i += 3) {
+            for (int k = 0; k < 3; k++) {
+                GLuint index = indices[i + k];
+                if (chunk.litBatch[index] != (int)b) {
+                    lightVertex(frame.lighting, surface, &chunk.eyePositions[index * 3], &chunk.eyeNormals[index * 3], chunk.vertices[index].color);
+                    chunk.litBatch[index] = (int)b;
+                }
+            }
+            clipTriangle(frame, chunk, chunk.vertices[indices[i]], chunk.vertices[indices[i + 1]], chunk.vertices[indices[i + 2]], NULL);
+        }
+    }
+}
+
+static void setupQuad(const SoftFrameData& frame, SoftChunk& chunk, const SoftCommand& command) {
+    SoftVertex vertices[4];
+    bool textured = command.type == SOFT_TEXTURED_QUAD;
+
+    GLfloat normals[9];
+    GLfloat normal[3];
+    normalMatrix(command.modelview, normals);
+    transformNormal(normals, command.normal, normal);
+
+    for (int i = 0; i < 4; i++) {
+        GLfloat eye[4];
+        transformPoint(command.modelview, command.corners[i], eye);
+        transformPoint(frame.projection, eye, vertices[i].position);
+        vertices[i].fogDepth = fabsf(eye[2]);
+
+        if (textured) {
+            vertices[i].color[0] = vertices[i].color[1] = vertices[i].color[2] = 1.0f;
+            vertices[i].texcoord[0] = command.texcoords[i][0];
+            vertices[i].texcoord[1] = command.texcoords[i][1];
+        } else {
+            lightVertex(frame.lighting, frameMaterial(frame, command.material), eye, normal, vertices[i].color);
+            vertices[i].texcoord[0] = vertices[i].texcoord[1] = 0.0f;
+        }
+    }
+
+    const SoftTexture* texture = textured ? command.texture : NULL;
+    clipTriangle(frame, chunk, vertices[0], vertices[1], vertices[2], texture);
+    clipTriangle(frame, chunk, vertices[0], vertices[2], vertices[3], texture);
+}
+
+
+
+// pixel stage
+
+static uint32_t packColor(const GLfloat color[3]) {
+    uint32_t r = (uint32_t)(min(max(color[0], 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(min(max(color[1], 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(min(max(color[2], 0.0f), 1.0f) * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | 0xff000000u;
+}
+
+void sampleSoftTexture(const SoftTexture& texture, GLfloat u, GLfloat v, GLfloat color[3]) {
+    GLfloat x = u * texture.width - 0.5f;
+    GLfloat y = v * texture.height - 0.5f;
+    GLfloat left = floorf(x);
+    GLfloat bottom = floorf(y);
+    GLfloat fx = x - left;
+    GLfloat fy = y - bottom;
+
+    int x0 = (int)left % texture.width;
+    int y0 = (int)bottom % texture.height;
+    if (x0 < 0)
+        x0 += texture.width;
+    if (y0 < 0)
+        y0 += texture.height;
+    int x1 = x0 + 1 == texture.width ? 0 : x0 + 1;
+    int y1 = y0 + 1 == texture.height ? 0 : y0 + 1;
+
+    const uint32_t texels[4] = {
+        texture.texels[y0 * texture.width + x0], texture.texels[y0 * texture.width + x1],
+        texture.texels[y1 * texture.width + x0], texture.texels[y1 * texture.width + x1]
+    };
+    const GLfloat weights[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+
+    for (int c = 0; c < 3; c++) {
+        GLfloat sum = 0.0f;
+        for (int i = 0; i < 4; i++)
+            sum += weights[i] * ((texels[i] >> (c * 8)) & 0xff);
+        color[c] = sum / 255.0f;
+    }
+}
+
+// This function is responsible for the depth test and shading of one covered pixel
+static void shadePixel(SoftFrameData& frame, const SoftTriangle& triangle, int x, int y) {
+    GLfloat dx = x + 0.5f - triangle.originX;
+    GLfloat dy = y + 0.5f - triangle.originY;
+
+#define PLANE(p) (triangle.planeX[p] * dx + triangle.planeY[p] * dy + triangle.planeOrigin[p])
+
+    GLfloat depth = PLANE(PLANE_DEPTH);
+    size_t pixel = (size_t)y * frame.width + x;
+    if (!(depth < frame.depth[pixel]) || depth < 0.0f)
+        return;
+    frame.depth[pixel] = depth;
+
+    GLfloat w = 1.0f / PLANE(PLANE_INVERSE_W);
+    GLfloat color[3];
+
+    if (triangle.texture)
+        sampleSoftTexture(*triangle.texture, PLANE(PLANE_U) * w, PLANE(PLANE_V) * w, color);
+    else {
+        color[0] = PLANE(PLANE_RED) * w;
+        color[1] = PLANE(PLANE_GREEN) * w;
+        color[2] = PLANE(PLANE_BLUE) * w;
+    }
+
+    const SceneFog& fog = frame.lighting.fog;
+    if (fog.enabled) {
+        GLfloat distance = fog.density * PLANE(PLANE_FOG) * w;
+        GLfloat factor = min(max(expf(-distance * distance), 0.0f), 1.0f);
+        for (int c = 0; c < 3; c++)
+            color[c] = factor * color[c] + (1.0f - factor) * fog.color[c];
+    }
+
+#undef PLANE
+
+    frame.color[pixel] = packColor(color);
+}
+
+// This function is responsible for finding the pixels of a tile a triangle covers, four at a time
+SIMD_TARGET("sse2")
+static void rasterizeTriangle(SoftFrameData& frame, const SoftTriangle& triangle, int tileLeft, int tileBottom, int tileRight, int tileTop) {
+    int left = max(triangle.minX, tileLeft);
+    int right = min(triangle.maxX, tileRight);
+    int bottom = max(triangle.minY, tileBottom);
+    int top = min(triangle.maxY, tileTop);
+
+    for (int y = bottom; y <= top; y++) {
+        GLfloat dy = y + 0.5f - triangle.originY;
+        GLfloat dx = left + 0.5f - triangle.originX;
+
+#ifdef SCENE_X86
+        __m128 steps = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        __m128 edge[3], stride[3];
+        for (int i = 0; i < 3; i++) {
+            __m128 edgeX = _mm_set1_ps(triangle.edgeX[i]);
+            __m128 start = _mm_set1_ps(triangle.edgeX[i] * dx + triangle.edgeY[i] * dy + triangle.edgeOrigin[i]);
+            edge[i] = _mm_add_ps(start, _mm_mul_ps(edgeX, steps));
+            stride[i] = _mm_mul_ps(edgeX, _mm_set1_ps(4.0f));
+        }
+        __m128 zero = _mm_setzero_ps();
+
+        for (int x = left; x <= right; x += 4) {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge[0], zero), _mm_cmpge_ps(edge[1], zero)), _mm_cmpge_ps(edge[2], zero));
+            int mask = _mm_movemask_ps(inside);
+
+            for (int lane = 0; mask != 0 && lane < 4 && x + lane <= right; lane++, mask >>= 1)
+                if (mask & 1)
+                    shadePixel(frame, triangle, x + lane, y);
+
+            for (int i = 0; i < 3; i++)
+                edge[i] = _mm_add_ps(edge[i], stride[i]);
+        }
+#else
+        GLfloat edge[3];
+        for (int i = 0; i < 3; i++)
+            edge[i] = triangle.edgeX[i] * dx + triangle.edgeY[i] * dy + triangle.edgeOrigin[i];
+
+        for (int x = left; x <= right; x++) {
+            if (edge[0] >= 0.0f && edge[1] >= 0.0f && edge[2] >= 0.0f)
+                shadePixel(frame, triangle, x, y);
+            for (int i = 0; i < 3; i++)
+                edge[i] += triangle.edgeX[i];
+        }
+#endif
+    }
+}
+
+
+
+// the rasterizer
+
+SoftRasterizer::SoftRasterizer() : frame(new SoftFrameData()), pool(new ThreadPool(1)) {}
+
+SoftRasterizer::~SoftRasterizer() {
+    delete pool;
+    delete frame;
+}
+
+void SoftRasterizer::setThreads(int threads) {
+    if (threads < 1)
+        threads = 1;
+    if (threads == pool->size())
+        return;
+    delete pool;
+    pool = new ThreadPool(threads);
+}
+
+int SoftRasterizer::threads() const {
+    return pool->size();
+}
+
+void SoftRasterizer::beginFrame(int width, int height, const GLfloat clearColor[4], const GLfloat projection[16], const SoftLighting& lighting) {
+    frame->width = width;
+    frame->height = height;
+    frame->tilesX = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    frame->tilesY = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    memcpy(frame->clearColor, clearColor, sizeof(frame->clearColor));
+    memcpy(frame->projection, projection, sizeof(frame->projection));
+
+    // copies, so the caller's tables may change while the frame is recorded
+    frame->lights.assign(lighting.lights, lighting.lights + lighting.lightCount);
+    frame->materials.assign(lighting.materials, lighting.materials + lighting.materialCount);
+    frame->lighting = lighting;
+    frame->lighting.lights = frame->lights.data();
+    frame->lighting.materials = frame->materials.data();
+
+    frame->commands.clear();
+    frame->color.resize((size_t)width * height);
+    frame->depth.resize((size_t)width * height);
+}
+
+void SoftRasterizer::drawMesh(const Mesh& mesh, const GLfloat modelview[16], int paintFrom, int paintTo) {
+    SoftCommand command;
+    command.type = SOFT_MESH;
+    memcpy(command.modelview, modelview, sizeof(command.modelview));
+    command.mesh = &mesh;
+    command.paintFrom = paintFrom;
+    command.paintTo = paintTo;
+    command.material = -1;
+    command.texture = NULL;
+    frame->commands.push_back(command);
+}
+
+void SoftRasterizer::drawQuad(const GLfloat corners[4][3], const GLfloat normal[3], const GLfloat modelview[16], int material) {
+    SoftCommand command;
+    command.type = SOFT_QUAD;
+    memcpy(command.modelview, modelview, sizeof(command.modelview));
+    command.mesh = NULL;
+    memcpy(command.corners, corners, sizeof(command.corners));
+    memcpy(command.normal, normal, sizeof(command.normal));
+    command.material = material;
+    command.texture = NULL;
+    frame->commands.push_back(command);
+}
+
+void SoftRasterizer::drawTexturedQuad(const GLfloat corners[4][3], const GLfloat texcoords[4][2], const GLfloat modelview[16], const SoftTexture& texture) {
+    SoftCommand command;
+    command.type = SOFT_TEXTURED_QUAD;
+    memcpy(command.modelview, modelview, sizeof(command.modelview));
+    command.mesh = NULL;
+    memcpy(command.corners, corners, sizeof(command.corners));
+    memcpy(command.texcoords, texcoords, sizeof(command.texcoords));
+    command.normal[0] = command.normal[1] = 0.0f;
+    command.normal[2] = 1.0f;
+    command.material = -1;
+    command.texture = &texture;
+    frame->commands.push_back(command);
+}
+
+// This function is responsible for binning the recorded commands and rasterizing the tiles in parallel
+void SoftRasterizer::endFrame() {
+    SoftFrameData& data = *frame;
+    int tileCount = data.tilesX * data.tilesY;
+    int commandCount = (int)data.commands.size();
+    int chunkCount = min(commandCount, SOFT_MAX_CHUNKS);
+
+    if ((int)data.chunks.size() < chunkCount)
+        data.chunks.resize(chunkCount);
+
+    // pass 1: vertex processing and binning, the chunking only depends on the command count
+    pool->parallelFor(chunkCount, [&](int index, int) {
+        SoftChunk& chunk = data.chunks[index];
+        chunk.triangles.clear();
+        chunk.bins.resize(tileCount);
+        for (int tile = 0; tile < tileCount; tile++)
+            chunk.bins[tile].clear();
+
+        int first = (int)((long)commandCount * index / chunkCount);
+        int last = (int)((long)commandCount * (index + 1) / chunkCount);
+        for (int i = first; i < last; i++) {
+            const SoftCommand& command = data.commands[i];
+            if (command.type == SOFT_MESH)
+                setupMesh(data, chunk, command);
+            else
+                setupQuad(data, chunk, command);
+        }
+    });
+
+    // pass 2: every tile owns its pixels, so the tiles need no locking
+    uint32_t clear = packColor(data.clearColor);
+    pool->parallelFor(tileCount, [&](int tile, int) {
+        int left = (tile % data.tilesX) * SOFT_TILE_SIZE;
+        int bottom = (tile / data.tilesX) * SOFT_TILE_SIZE;
+        int right = min(left + SOFT_TILE_SIZE, data.width) - 1;
+        int top = min(bottom + SOFT_TILE_SIZE, data.height) - 1;
+
+        for (int y = bottom; y <= top; y++) {
+            size_t row = (size_t)y * data.width;
+            fill(data.color.begin() + row + left, data.color.begin() + row + right + 1, clear);
+            fill(data.depth.begin() + row + left, data.depth.begin() + row + right + 1, 1.0f);
+        }
+
+        for (int c = 0; c < chunkCount; c++) {
+            const SoftChunk& chunk = data.chunks[c];
+            const vector<uint32_t>& bin = chunk.bins[tile];
+            for (size_t i = 0; i < bin.size(); i++)
+                rasterizeTriangle(data, chunk.triangles[bin[i]], left, bottom, right, top);
+        }
+    });
+
+    data.triangles = 0;
+    for (int c = 0; c < chunkCount; c++)
+        data.triangles += (long)data.chunks[c].triangles.size();
+}
+
+int SoftRasterizer::width() const {
+    return frame->width;
+}
+
+int SoftRasterizer::height() const {
+    return frame->height;
+}
+
+const uint32_t* SoftRasterizer::pixels() const {
+    return frame->color.data();
+}
+
+long SoftRasterizer::triangles() const {
+    return frame->triangles;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <GL/glut.h>
+#include "meshcache.h"
+#include "renderstate.h"
+#include "scenefile.h"
+
+/*
+    CPU rasterizer backend
+
+    Draws the same Mesh data the mesh cache captures, without any OpenGL context, for
+    machines that have no GPU. A frame is recorded with the draw* calls and rendered by
+    endFrame() in two parallel passes:
+
+    1. the draw commands are split into a fixed number of chunks; each chunk transforms
+       and lights its vertices, clips the triangles to the near and far planes and bins
+       them into the 64x64 pixel screen tiles they touch;
+    2. the tiles are rasterized independently, each one walking the chunks' bins in
+       submission order, with the edge functions evaluated four pixels at a time (SSE).
+
+    Because the chunks do not depend on the number of threads, the image is the same for
+    any thread count.
+
+    Shading follows the fixed-function state the OpenGL path sets up: per-vertex lighting
+    with the same light model (ambient, diffuse and Blinn-Phong specular with a
+    non-local viewer, normals not renormalized), perspective-correct Gouraud
+    interpolation, GL_REPLACE texturing with bilinear filtering and GL_REPEAT, and
+    GL_EXP2 fog on the eye-space depth. There is no face culling, as in the scene.
+*/
+
+// an RGBA texture, rows bottom first as glTexImage2D takes them
+struct SoftTexture {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> texels;
+};
+
+// bilinear filtering with GL_REPEAT, texel centres sit at half coordinates like in OpenGL
+void sampleSoftTexture(const SoftTexture& texture, GLfloat u, GLfloat v, GLfloat color[3]);
+
+// the lighting and fog state, light positions are in eye space like the ones OpenGL stores
+struct SoftLighting {
+    const SceneLight* lights;
+    int lightCount;
+    GLfloat globalAmbient[4];
+    const Material* materials;
+    int materialCount;
+    SceneFog fog;
+};
+
+struct SoftFrameData;
+class ThreadPool;
+
+class SoftRasterizer {
+
+public:
+
+    SoftRasterizer();
+
+    ~SoftRasterizer();
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+
+    SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+
+
+    // threads used by endFrame(), the calling thread included
+    void setThreads(int threads);
+
+    int threads() const;
+
+
+
+    // recording a frame, the matrices are column major like OpenGL's
+
+    void beginFrame(int width, int height, const GLfloat clearColor[4], const GLfloat projection[16], const SoftLighting& lighting);
+
+    // batches using paintFrom are drawn with paintTo instead, -1 for no paint
+    void drawMesh(const Mesh& mesh, const GLfloat modelview[16], int paintFrom, int paintTo);
+
+    // a lit quad with one normal, corners in GL_QUADS order
+    void drawQuad(const GLfloat corners[4][3], const GLfloat normal[3], const GLfloat modelview[16], int material);
+
+    // an unlit textured quad (GL_REPLACE), the texture must stay alive until endFrame()
+    void drawTexturedQuad(const GLfloat corners[4][3], const GLfloat texcoords[4][2], const GLfloat modelview[16], const SoftTexture& texture);
+
+    // renders everything recorded since beginFrame()
+    void endFrame();
+
+
+
+    // the finished frame, RGBA with rows bottom first like glReadPixels
+
+    int width() const;
+
+    int height() const;
+
+    const uint32_t* pixels() const;
+
+    // triangles set up in the last frame, after clipping
+    long triangles() const;
+
+private:
+
+    SoftFrameData* frame;
+
+    ThreadPool* pool;
+
+};
+
+// the matrices glFrustum and gluLookAt build, column major
+void softFrustumMatrix(GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar, GLfloat matrix[16]);
+void softLookAtMatrix(const GLfloat eye[3], const GLfloat center[3], const GLfloat up[3], GLfloat matrix[16]);
@@ -0,0 +1,603 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include "platform.h"
+#include "glloader.h"
+#include "bmploader.h"
+#include "mappedfile.h"
+#include "cpufeatures.h"
+#include "benchmark.h"
+#include "texcook.h"
+
+#ifdef SCENE_X86
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+static const uint32_t TEXTURE_MAGIC = 0x58455443; // "CTEX"
+static const uint32_t TEXTURE_VERSION = 1;
+static const int MAX_TEXTURE_LEVELS = 32;
+static const int KAISER_TAPS = 8;
+
+static int halve(int size) {
+    return size > 1 ? size / 2 : 1;
+}
+
+static size_t levelSize(TextureFormat format, int width, int height) {
+    if (format == TEXTURE_BC1)
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+    return (size_t)width * height * 4;
+}
+
+
+
+// mip filters
+
+// 2x2 average with rounding, a side that is already 1 texel only averages along the other one
+static void boxDownsample(const unsigned char* source, int width, int height, unsigned char* destination) {
+    int dw = halve(width), dh = halve(height);
+
+    for (int y = 0; y < dh; y++) {
+        const unsigned char* row0 = source + (size_t)width * 4 * min(2 * y, height - 1);
+        const unsigned char* row1 = source + (size_t)width * 4 * min(2 * y + 1, height - 1);
+        unsigned char* out = destination + (size_t)dw * 4 * y;
+        int x = 0;
+
+#ifdef SCENE_X86
+        // two output texels from four input texels of each row, summed in 16 bits
+        if (width > 1) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i round = _mm_set1_epi16(2);
+            for (; x + 2 <= dw; x += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+                __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+                __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+                high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+                __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(low, high), round), 2);
+                _mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+            }
+        }
+#endif
+        for (; x < dw; x++) {
+            int x0 = min(2 * x, width - 1) * 4, x1 = min(2 * x + 1, width - 1) * 4;
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+static double besselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 20; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// taps of a half-band sinc under a Kaiser window (beta 4), at source offsets -3.5 .. 3.5
+static void kaiserWeights(float weights[KAISER_TAPS]) {
+    const double pi = 3.14159265358979323846;
+    const double beta = 4.0, radius = KAISER_TAPS / 2;
+    double total = 0;
+    for (int i = 0; i < KAISER_TAPS; i++) {
+        double d = i - (KAISER_TAPS - 1) / 2.0;
+        double x = pi * d / 2;
+        double sinc = sin(x) / x;
+        double r = d / radius;
+        double window = besselI0(beta * sqrt(max(0.0, 1 - r * r))) / besselI0(beta);
+        weights[i] = (float)(sinc * window);
+        total += weights[i];
+    }
+    for (int i = 0; i < KAISER_TAPS; i++)
+        weights[i] = (float)(weights[i] / total);
+}
+
+// one output texel from KAISER_TAPS float RGBA texels step floats apart, edges clamp
+static inline void kaiserTap(const float* source, int index, int size, size_t step, const float weights[KAISER_TAPS], float out[4]) {
+    float sum[4] = { 0, 0, 0, 0 };
+    for (int t = 0; t < KAISER_TAPS; t++) {
+        const float* texel = source + step * min(max(index + t, 0), size - 1);
+        for (int c = 0; c < 4; c++)
+            sum[c] += weights[t] * texel[c];
+    }
+    for (int c = 0; c < 4; c++)
+        out[c] = sum[c];
+}
+
+#ifdef SCENE_X86
+static inline __m128 kaiserTapSSE(const float* source, int index, int size, size_t step, const float weights[KAISER_TAPS]) {
+    __m128 sum = _mm_setzero_ps();
+    for (int t = 0; t < KAISER_TAPS; t++) {
+        const float* texel = source + step * min(max(index + t, 0), size - 1);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(texel)));
+    }
+    return sum;
+}
+#endif
+
+// separable: rows into a float buffer first, then columns, each output texel centred between two inputs
+static void kaiserDownsample(const unsigned char* source, int width, int height, unsigned char* destination) {
+    int dw = halve(width), dh = halve(height);
+    float weights[KAISER_TAPS];
+    kaiserWeights(weights);
+    const int first = -(KAISER_TAPS / 2 - 1);
+
+    vector<float> input((size_t)width * height * 4);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = source[i];
+
+    // a side of 1 texel is copied instead of filtered
+    vector<float> rows((size_t)dw * height * 4);
+    for (int y = 0; y < height; y++) {
+        const float* in = &input[(size_t)width * 4 * y];
+        float* out = &rows[(size_t)dw * 4 * y];
+        for (int x = 0; x < dw; x++) {
+            if (width == 1)
+                copy(in, in + 4, out);
+            else {
+#ifdef SCENE_X86
+                _mm_storeu_ps(out + x * 4, kaiserTapSSE(in, 2 * x + first, width, 4, weights));
+#else
+                kaiserTap(in, 2 * x + first, width, 4, weights, out + x * 4);
+#endif
+            }
+        }
+    }
+
+    for (int y = 0; y < dh; y++) {
+        unsigned char* out = destination + (size_t)dw * 4 * y;
+        for (int x = 0; x < dw; x++) {
+            const float* column = &rows[(size_t)x * 4];
+            float texel[4];
+            if (height == 1)
+                copy(column, column + 4, texel);
+            else {
+#ifdef SCENE_X86
+                _mm_storeu_ps(texel, kaiserTapSSE(column, 2 * y + first, height, (size_t)dw * 4, weights));
+#else
+                kaiserTap(column, 2 * y + first, height, (size_t)dw * 4, weights, texel);
+#endif
+            }
+            // the negative lobes can overshoot
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (unsigned char)min(max(texel[c] + 0.5f, 0.0f), 255.0f);
+        }
+    }
+}
+
+// This function is responsible for building every mip level of an RGBA image down to 1x1
+void buildMipChain(const unsigned char* rgba, int width, int height, MipFilter filter, vector<TextureLevel>& levels) {
+    levels.clear();
+    levels.push_back({ width, height, vector<unsigned char>(rgba, rgba + (size_t)width * height * 4) });
+
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const TextureLevel& previous = levels.back();
+        TextureLevel level = { halve(previous.width), halve(previous.height), vector<unsigned char>() };
+        level.data.resize((size_t)level.width * level.height * 4);
+        if (filter == MIP_KAISER)
+            kaiserDownsample(&previous.data[0], previous.width, previous.height, &level.data[0]);
+        else
+            boxDownsample(&previous.data[0], previous.width, previous.height, &level.data[0]);
+        levels.push_back(move(level));
+    }
+}
+
+
+
+// BC1
+
+static uint16_t packRGB565(const float color[3]) {
+    int r = (int)min(max(color[0] * 31.0f / 255.0f + 0.5f, 0.0f), 31.0f);
+    int g = (int)min(max(color[1] * 63.0f / 255.0f + 0.5f, 0.0f), 63.0f);
+    int b = (int)min(max(color[2] * 31.0f / 255.0f + 0.5f, 0.0f), 31.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int color[3]) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// the four colors of a block, the two interpolated ones only when c0 > c1
+static void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+// endpoints at the extremes of the block's principal axis, then every texel takes the closest of the four colors
+static void compressBlock(const unsigned char texels[16][4], unsigned char block[8]) {
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += texels[i][c] / 16.0f;
+
+    float covariance[6] = { 0, 0, 0, 0, 0, 0 }; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        float r = texels[i][0] - mean[0], g = texels[i][1] - mean[1], b = texels[i][2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+
+    // a few power iterations are enough to find the dominant direction
+    float axis[3] = { 1, 1, 1 };
+    for (int k = 0; k < 8; k++) {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        float length = max(fabs(next[0]), max(fabs(next[1]), fabs(next[2])));
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float lowest = 1e30f, highest = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float d = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+        lowest = min(lowest, d);
+        highest = max(highest, d);
+    }
+    float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float start[3], end[3];
+    for (int c = 0; c < 3; c++) {
+        start[c] = mean[c] + axis[c] * highest / lengthSquared;
+        end[c] = mean[c] + axis[c] * lowest / lengthSquared;
+    }
+
+    uint16_t c0 = packRGB565(start), c1 = packRGB565(end);
+    if (c0 < c1)
+        swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        bc1Palette(c0, c1, palette);
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    block[0] = (unsigned char)c0;
+    block[1] = (unsigned char)(c0 >> 8);
+    block[2] = (unsigned char)c1;
+    block[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        block[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+void compressBC1(const unsigned char* rgba, int width, int height, vector<unsigned char>& blocks) {
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    blocks.resize((size_t)blocksWide * blocksHigh * 8);
+
+    for (int by = 0; by < blocksHigh; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            unsigned char texels[16][4];
+            for (int i = 0; i < 16; i++) {
+                int x = min(bx * 4 + i % 4, width - 1), y = min(by * 4 + i / 4, height - 1);
+                memcpy(texels[i], rgba + ((size_t)y * width + x) * 4, 4);
+            }
+            compressBlock(texels, &blocks[((size_t)by * blocksWide + bx) * 8]);
+        }
+    }
+}
+
+void decompressBC1(const unsigned char* blocks, int width, int height, vector<unsigned char>& rgba) {
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    rgba.resize((size_t)width * height * 4);
+
+    for (int by = 0; by < blocksHigh; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            const unsigned char* block = blocks + ((size_t)by * blocksWide + bx) * 8;
+            uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8)), c1 = (uint16_t)(block[2] | (block[3] << 8));
+            uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+            int palette[4][3];
+            bc1Palette(c0, c1, palette);
+
+            for (int i = 0; i < 16; i++) {
+                int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                if (x >= width || y >= height)
+                    continue;
+                int p = (indices >> (2 * i)) & 3;
+                unsigned char* out = &rgba[((size_t)y * width + x) * 4];
+                out[0] = (unsigned char)palette[p][0];
+                out[1] = (unsigned char)palette[p][1];
+                out[2] = (unsigned char)palette[p][2];
+                out[3] = (c0 <= c1 && p == 3) ? 0 : 255;
+            }
+        }
+    }
+}
+
+
+
+// the file
+
+static bool fail(const char* filename, const char* reason) {
+    cerr << filename << ": " << reason << endl;
+    return false;
+}
+
+static void putU32(vector<unsigned char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+static uint32_t readU32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// the levels in their final format, for the benchmark as well as the file
+static void encodeLevels(vector<TextureLevel>& levels, TextureFormat format) {
+    if (format != TEXTURE_BC1)
+        return;
+    for (size_t i = 0; i < levels.size(); i++) {
+        vector<unsigned char> blocks;
+        compressBC1(&levels[i].data[0], levels[i].width, levels[i].height, blocks);
+        levels[i].data.swap(blocks);
+    }
+}
+
+static bool writeTexture(const char* texturePath, TextureFormat format, const vector<TextureLevel>& levels) {
+    vector<unsigned char> file;
+    putU32(file, TEXTURE_MAGIC);
+    putU32(file, TEXTURE_VERSION);
+    putU32(file, (uint32_t)format);
+    putU32(file, (uint32_t)levels[0].width);
+    putU32(file, (uint32_t)levels[0].height);
+    putU32(file, (uint32_t)levels.size());
+
+    size_t offset = file.size() + levels.size() * 16;
+    for (size_t i = 0; i < levels.size(); i++) {
+        offset = (offset + 15) & ~(size_t)15;
+        putU32(file, (uint32_t)levels[i].width);
+        putU32(file, (uint32_t)levels[i].height);
+        putU32(file, (uint32_t)offset);
+        putU32(file, (uint32_t)levels[i].data.size());
+        offset += levels[i].data.size();
+    }
+    for (size_t i = 0; i < levels.size(); i++) {
+        file.resize((file.size() + 15) & ~(size_t)15, 0);
+        file.insert(file.end(), levels[i].data.begin(), levels[i].data.end());
+    }
+
+    FILE* out;
+    if (fopen_s(&out, texturePath, "wb") != 0)
+        return fail(texturePath, "cannot write");
+    bool written = fwrite(&file[0], 1, file.size(), out) == file.size();
+    written = fclose(out) == 0 && written;
+    return written || fail(texturePath, "write failed");
+}
+
+// This function is responsible for turning a BMP into a texture file with all of its mip levels
+bool cookTexture(const char* bmpPath, const char* texturePath, TextureFormat format, MipFilter filter) {
+    BmpImage image;
+    if (!loadBmp(bmpPath, image, true))
+        return false;
+
+    vector<TextureLevel> levels;
+    buildMipChain(image.pixels, image.width, image.height, filter, levels);
+    releaseBmp(image);
+    encodeLevels(levels, format);
+    return writeTexture(texturePath, format, levels);
+}
+
+// This function is responsible for validating a texture file and describing its levels
+bool openCookedTexture(const char* texturePath, CookedTexture& texture) {
+    texture = CookedTexture();
+    if (!mapFile(texturePath, texture.file))
+        return false;
+
+    const unsigned char* data = texture.file.data;
+    size_t fileSize = texture.file.size;
+    const char* error = NULL;
+    uint32_t format = 0, width = 0, height = 0, levels = 0;
+
+    if (fileSize < 24 || readU32(data) != TEXTURE_MAGIC)
+        error = "not a texture file";
+    else if (readU32(data + 4) != TEXTURE_VERSION)
+        error = "unsupported texture file version";
+    else {
+        format = readU32(data + 8);
+        width = readU32(data + 12);
+        height = readU32(data + 16);
+        levels = readU32(data + 20);
+        if (format != TEXTURE_RGBA8 && format != TEXTURE_BC1)
+            error = "unknown texture format";
+        else if (width == 0 || height == 0 || width > 1 << 16 || height > 1 << 16 || levels == 0 || levels > MAX_TEXTURE_LEVELS)
+            error = "invalid texture dimensions";
+        else if (fileSize < 24 + (size_t)levels * 16)
+            error = "file too small for the level table";
+        else if (format == TEXTURE_BC1 && !hasS3TC)
+            error = "BC1 textures are not supported by this OpenGL";
+    }
+
+    // every level must be where the table says, with the size its dimensions need
+    int w = (int)width, h = (int)height;
+    for (uint32_t i = 0; !error && i < levels; i++) {
+        const unsigned char* entry = data + 24 + i * 16;
+        size_t offset = readU32(entry + 8), size = readU32(entry + 12);
+        if ((int)readU32(entry) != w || (int)readU32(entry + 4) != h || size != levelSize((TextureFormat)format, w, h))
+            error = "level table does not match the texture size";
+        else if (offset > fileSize || size > fileSize - offset)
+            error = "level data runs past the end of the file";
+        else
+            texture.levels.push_back({ w, h, data + offset, size });
+        w = halve(w);
+        h = halve(h);
+    }
+
+    if (error) {
+        closeCookedTexture(texture);
+        return fail(texturePath, error);
+    }
+    texture.format = (TextureFormat)format;
+    return true;
+}
+
+void uploadCookedLevel(const CookedTexture& texture, int level) {
+    const CookedTexture::Level& l = texture.levels[level];
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (texture.format == TEXTURE_BC1)
+        pglCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, l.width, l.height, 0, (GLsizei)l.size, l.data);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, l.data);
+}
+
+void closeCookedTexture(CookedTexture& texture) {
+    unmapFile(texture.file);
+    texture = CookedTexture();
+}
+
+bool loadCookedTexture(const char* texturePath) {
+    CookedTexture texture;
+    if (!openCookedTexture(texturePath, texture))
+        return false;
+
+    int levels = (int)texture.levels.size();
+    for (int i = 0; i < levels; i++)
+        uploadCookedLevel(texture, i);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+    // OpenGL has its own copy now
+    closeCookedTexture(texture);
+    return true;
+}
+
+
+// benchmark
+
+static size_t chainBytes(const vector<TextureLevel>& levels) {
+    size_t total = 0;
+    for (size_t i = 0; i < levels.size(); i++)
+        total += levels[i].data.size();
+    return total;
+}
+
+static double psnr(const unsigned char* a, const unsigned char* b, size_t texels) {
+    double error = 0;
+    for (size_t i = 0; i < texels; i++) {
+        for (int c = 0; c < 3; c++) {
+            double d = (double)a[i * 4 + c] - b[i * 4 + c];
+            error += d * d;
+        }
+    }
+    error /= texels * 3.0;
+    return error > 0 ? 10 * log10(255.0 * 255.0 / error) : 99.0;
+}
+
+// best of a few runs of an upload into a fresh texture, glFinish so the driver's copy is included
+template <typename Upload>
+static double timeUpload(Upload upload) {
+    vector<double> timings;
+    for (int run = 0; run < 5; run++) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        double start = nowMilliseconds();
+        upload();
+        glFinish();
+        timings.push_back(nowMilliseconds() - start);
+        glDeleteTextures(1, &texture);
+    }
+    return summarizeTimings(timings).min;
+}
+
+template <typename Work>
+static double timeCook(Work work) {
+    double start = nowMilliseconds();
+    work();
+    return nowMilliseconds() - start;
+}
+
+// This function is responsible for comparing the BMP upload with the cooked RGBA and BC1 mip chains
+int runTextureBenchmark(const char* bmpPath, const char* jsonPath) {
+    const char* rgbaPath = "bench_texture_rgba.ctex";
+    const char* bc1Path = "bench_texture_bc1.ctex";
+
+    BmpImage image, rgba;
+    if (!loadBmp(bmpPath, image) || !loadBmp(bmpPath, rgba, true)) {
+        releaseBmp(image);
+        return EXIT_FAILURE;
+    }
+    int width = image.width, height = image.height;
+
+    vector<TextureLevel> box, kaiser, bc1;
+    double boxTime = timeCook([&]() { buildMipChain(rgba.pixels, width, height, MIP_BOX, box); });
+    double kaiserTime = timeCook([&]() { buildMipChain(rgba.pixels, width, height, MIP_KAISER, kaiser); });
+    bc1 = kaiser;
+    double bc1Time = timeCook([&]() { encodeLevels(bc1, TEXTURE_BC1); });
+
+    vector<unsigned char> decoded;
+    decompressBC1(&bc1[0].data[0], width, height, decoded);
+    double bc1Psnr = psnr(rgba.pixels, &decoded[0], (size_t)width * height);
+    releaseBmp(rgba);
+
+    if (!writeTexture(rgbaPath, TEXTURE_RGBA8, kaiser) || !writeTexture(bc1Path, TEXTURE_BC1, bc1)) {
+        releaseBmp(image);
+        return EXIT_FAILURE;
+    }
+
+    double bmpUpload = timeUpload([&]() {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, image.rowAlignment);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, image.format, GL_UNSIGNED_BYTE, image.pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    });
+    // what a runtime without a cooker would do to get mipmaps
+    double bmpMipmapUpload = timeUpload([&]() {
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, image.rowAlignment);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, image.format, GL_UNSIGNED_BYTE, image.pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    });
+    double rgbaUpload = timeUpload([&]() { loadCookedTexture(rgbaPath); });
+    double bc1Upload = hasS3TC ? timeUpload([&]() { loadCookedTexture(bc1Path); }) : 0;
+    releaseBmp(image);
+    remove(rgbaPath);
+    remove(bc1Path);
+
+    size_t level0Bytes = (size_t)width * height * 4, mipBytes = chainBytes(kaiser), bc1Bytes = chainBytes(bc1);
+
+    stringstream json;
+    json << "{\n  \"benchmark\": \"texture\",\n  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n";
+    json << "  \"width\": " << width << ",\n  \"height\": " << height << ",\n  \"levels\": " << kaiser.size() << ",\n";
+    json << "  \"cook_ms\": { \"box_mips\": " << boxTime << ", \"kaiser_mips\": " << kaiserTime << ", \"bc1_encode\": " << bc1Time << " },\n";
+    json << "  \"bc1_psnr_db\": " << bc1Psnr << ",\n  \"s3tc\": " << (hasS3TC ? "true" : "false") << ",\n";
+    json << "  \"results\": [";
+    json << "\n    { \"name\": \"bmp_level0\", \"gpu_bytes\": " << level0Bytes << ", \"upload_ms\": " << bmpUpload << " },";
+    json << "\n    { \"name\": \"bmp_generate_mipmap\", \"gpu_bytes\": " << mipBytes << ", \"upload_ms\": " << bmpMipmapUpload << " },";
+    json << "\n    { \"name\": \"cooked_rgba_mips\", \"gpu_bytes\": " << mipBytes << ", \"upload_ms\": " << rgbaUpload << " }";
+    if (hasS3TC)
+        json << ",\n    { \"name\": \"cooked_bc1_mips\", \"gpu_bytes\": " << bc1Bytes << ", \"upload_ms\": " << bc1Upload << " }";
+    json << "\n  ],\n  \"bc1_bytes_saved\": " << (long)(mipBytes - bc1Bytes) << ",\n  \"bc1_saved_percent\": " << 100.0 * (mipBytes - bc1Bytes) / mipBytes << "\n}";
+
+    return writeReport(jsonPath, json.str()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
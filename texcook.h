@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <GL/glut.h>
+#include "mappedfile.h"
+
+/*
+    Texture cooker
+
+    Turns a BMP into a texture file (.ctex) the runtime can hand to OpenGL as it is: the
+    whole mip chain is built offline, optionally block-compressed to BC1 (DXT1, 4 bits
+    per texel), and stored in upload order. Loading maps the file and passes each level
+    straight to glTexImage2D or glCompressedTexImage2D, with no conversion.
+
+    Mip levels are made either with a 2x2 box filter (SSE2, exact rounding) or with a
+    separable 8-tap Kaiser-windowed sinc, which keeps distant detail sharper; that one
+    filters four channels at a time in SSE registers.
+
+    The file is little endian:
+
+        header   "CTEX"  version  format  width  height  levels      (uint32 each)
+        levels x { width  height  offset  size }                     (uint32 each)
+        data     every level starting on a 16-byte boundary
+
+    Rows go bottom first as glTexImage2D takes them; BC1 blocks are 8 bytes each, in rows
+    of 4x4 texel blocks.
+*/
+
+enum TextureFormat {
+    TEXTURE_RGBA8 = 0,
+    TEXTURE_BC1 = 1
+};
+
+enum MipFilter {
+    MIP_BOX,
+    MIP_KAISER
+};
+
+struct TextureLevel {
+    int width;
+    int height;
+    std::vector<unsigned char> data;
+};
+
+// the full chain down to 1x1 from RGBA texels, level 0 included
+void buildMipChain(const unsigned char* rgba, int width, int height, MipFilter filter, std::vector<TextureLevel>& levels);
+
+// compresses RGBA texels into BC1 blocks, partial blocks at the edges repeat the last row and column
+void compressBC1(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& blocks);
+
+// decodes BC1 blocks back to RGBA, for measuring the compression error
+void decompressBC1(const unsigned char* blocks, int width, int height, std::vector<unsigned char>& rgba);
+
+// reads the BMP, cooks it and writes the texture file; false with a message on error
+bool cookTexture(const char* bmpPath, const char* texturePath, TextureFormat format, MipFilter filter);
+
+// a validated texture file, its levels point into the mapping
+struct CookedTexture {
+    struct Level {
+        int width;
+        int height;
+        const unsigned char* data;
+        size_t size;
+    };
+
+    TextureFormat format = TEXTURE_RGBA8;
+    std::vector<Level> levels;
+    MappedFile file;
+};
+
+// maps and validates a texture file without touching OpenGL, so it can run on any thread;
+// false with a message when the file is malformed or its format cannot be uploaded here
+bool openCookedTexture(const char* texturePath, CookedTexture& texture);
+
+// uploads one level into the bound GL_TEXTURE_2D
+void uploadCookedLevel(const CookedTexture& texture, int level);
+
+void closeCookedTexture(CookedTexture& texture);
+
+// uploads every level of a texture file into the bound GL_TEXTURE_2D and switches it to trilinear
+// filtering; false when the file is missing, malformed or its format is not supported here
+bool loadCookedTexture(const char* texturePath);
+
+// cooking times, memory and upload times of the cooked formats against uploading the BMP,
+// needs a current context; writes JSON like the other benchmarks
+int runTextureBenchmark(const char* bmpPath, const char* jsonPath);
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include "threadpool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads) : task(NULL), busyWorkers(0), generation(0), stopping(false) {
+    for (int i = 0; i < max(threads, 1); i++)
+        ranges.push_back(unique_ptr<WorkRange>(new WorkRange()));
+    for (int i = 1; i < threads; i++)
+        workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+bool ThreadPool::takeTask(int worker, int& index) {
+    WorkRange& range = *ranges[worker];
+    lock_guard<mutex> lock(range.lock);
+    if (range.begin >= range.end)
+        return false;
+    index = range.begin++;
+    return true;
+}
+
+// This function is responsible for moving the back half of the fullest other range to this worker
+bool ThreadPool::stealTasks(int worker) {
+    int threads = (int)ranges.size();
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int victim = -1;
+        int largest = 0;
+        for (int i = 1; i < threads; i++) {
+            int other = (worker + i) % threads;
+            lock_guard<mutex> lock(ranges[other]->lock);
+            if (ranges[other]->end - ranges[other]->begin > largest) {
+                largest = ranges[other]->end - ranges[other]->begin;
+                victim = other;
+            }
+        }
+        if (victim < 0)
+            return false;
+
+        int begin, end;
+        {
+            // the victim may have moved on since it was picked, so the range is read again
+            lock_guard<mutex> lock(ranges[victim]->lock);
+            WorkRange& range = *ranges[victim];
+            if (range.begin >= range.end)
+                continue;
+            end = range.end;
+            begin = range.begin + (range.end - range.begin) / 2;
+            range.end = begin;
+        }
+
+        lock_guard<mutex> lock(ranges[worker]->lock);
+        ranges[worker]->begin = begin;
+        ranges[worker]->end = end;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::runTasks(int worker) {
+    int index;
+    do {
+        while (takeTask(worker, index))
+            (*task)(index, worker);
+    } while (stealTasks(worker));
+}
+
+void ThreadPool::workerLoop(int worker) {
+    long seen = 0;
+
+    for (;;) {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runTasks(worker);
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            busyWorkers--;
+        }
+        done.notify_one();
+    }
+}
+
+// This function is responsible for running a loop across the pool and waiting for every index to finish
+void ThreadPool::parallelFor(int count, const function<void(int, int)>& work) {
+    if (count <= 0)
+        return;
+
+    if (workers.empty() || count == 1) {
+        for (int i = 0; i < count; i++)
+            work(i, 0);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+        task = &work;
+
+        // contiguous ranges of nearly equal size, the workers cannot touch them yet
+        int threads = (int)ranges.size();
+        for (int i = 0; i < threads; i++) {
+            ranges[i]->begin = (int)((long)count * i / threads);
+            ranges[i]->end = (int)((long)count * (i + 1) / threads);
+        }
+
+        busyWorkers = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(0);
+
+    // the workers still hold a pointer to the task until they report back
+    unique_lock<mutex> lock(stateMutex);
+    done.wait(lock, [&] { return busyWorkers == 0; });
+    task = NULL;
+}
+
+int hardwareThreads() {
+    unsigned int threads = thread::hardware_concurrency();
+    return threads > 0 ? (int)threads : 1;
+}
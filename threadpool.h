@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    A fixed set of worker threads for data-parallel loops.
+
+    parallelFor(count, task) calls task(index, worker) once for every index below count
+    and returns when all of them are done. The indices are dealt out as one contiguous
+    range per thread, which each thread works through from the front, so neighbouring
+    tiles stay on the same core. A thread that runs out steals the back half of the
+    range of another thread, so uneven work (tiles with more triangles, say) still
+    balances itself. The calling thread works too, as worker 0, so a pool of one thread
+    runs everything inline.
+*/
+
+class ThreadPool {
+
+public:
+
+    explicit ThreadPool(int threads);
+
+    ~ThreadPool();
+
+    // total threads taking part in a loop, the caller included
+    int size() const { return (int)workers.size() + 1; }
+
+    void parallelFor(int count, const std::function<void(int index, int worker)>& task);
+
+private:
+
+    void workerLoop(int worker);
+
+    void runTasks(int worker);
+
+    bool takeTask(int worker, int& index);
+
+    bool stealTasks(int worker);
+
+    // the part of the current loop a thread still has to run, [begin, end)
+    struct WorkRange {
+        std::mutex lock;
+        int begin = 0;
+        int end = 0;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkRange> > ranges;
+
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(int, int)>* task;
+    int busyWorkers;
+    long generation;
+    bool stopping;
+
+};
+
+// threads the hardware runs at once, at least 1
+int hardwareThreads();
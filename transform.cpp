@@ -0,0 +1,139 @@
+#include <math.h>
+#include <string.h>
+#include "transform.h"
+#include "cpufeatures.h"
+
+#ifdef SCENE_X86
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+static const GLfloat identityMatrix[16] = {
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+};
+
+// This function is responsible for multiplying two column-major matrices, a column of the result at a time
+void multiplyMatrices(const GLfloat a[16], const GLfloat b[16], GLfloat out[16]) {
+#ifdef SCENE_X86
+    // each column of the result is a's columns weighted by one column of b
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for (int column = 0; column < 4; column++) {
+        const GLfloat* c = b + column * 4;
+        __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(c[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+        _mm_storeu_ps(out + column * 4, sum);
+    }
+#else
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            GLfloat sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            out[column * 4 + row] = sum;
+        }
+    }
+#endif
+}
+
+TransformHierarchy::TransformHierarchy() : viewValid(false) {
+    memcpy(lastView, identityMatrix, sizeof(lastView));
+}
+
+void TransformHierarchy::clear() {
+    parents.clear();
+    locals.clear();
+    localMatrices.clear();
+    worlds.clear();
+    modelviews.clear();
+    dirty.clear();
+    stale.clear();
+    viewValid = false;
+}
+
+int TransformHierarchy::addNode(int parent) {
+    int node = (int)parents.size();
+    LocalTransform local = { { 0.0f, 0.0f, 0.0f }, 0.0f, 1.0f };
+
+    parents.push_back(parent < node ? parent : -1);
+    locals.push_back(local);
+    localMatrices.insert(localMatrices.end(), identityMatrix, identityMatrix + 16);
+    worlds.insert(worlds.end(), identityMatrix, identityMatrix + 16);
+    modelviews.insert(modelviews.end(), identityMatrix, identityMatrix + 16);
+    dirty.push_back(1);
+    stale.push_back(1);
+    return node;
+}
+
+void TransformHierarchy::setLocal(int node, const GLfloat position[3], GLfloat rotation, GLfloat scale) {
+    LocalTransform& local = locals[node];
+    if (local.position[0] == position[0] && local.position[1] == position[1] && local.position[2] == position[2]
+        && local.rotation == rotation && local.scale == scale)
+        return;
+
+    memcpy(local.position, position, sizeof(local.position));
+    local.rotation = rotation;
+    local.scale = scale;
+
+    GLfloat angle = rotation * 3.14159265f / 180.0f;
+    GLfloat c = cosf(angle) * scale, s = sinf(angle) * scale;
+    GLfloat* m = &localMatrices[node * 16];
+    const GLfloat matrix[16] = {
+        c, 0.0f, -s, 0.0f,
+        0.0f, scale, 0.0f, 0.0f,
+        s, 0.0f, c, 0.0f,
+        position[0], position[1], position[2], 1.0f
+    };
+    memcpy(m, matrix, sizeof(matrix));
+    dirty[node] = 1;
+}
+
+// This function is responsible for bringing the world matrices of the changed subtrees up to date
+int TransformHierarchy::update() {
+    // parents come first, so one forward walk carries a change down to every descendant
+    work.clear();
+    for (int node = 0; node < size(); node++) {
+        int parent = parents[node];
+        if (parent >= 0 && dirty[parent])
+            dirty[node] = 1;
+        if (dirty[node])
+            work.push_back(node);
+    }
+
+    for (size_t i = 0; i < work.size(); i++) {
+        int node = work[i];
+        int parent = parents[node];
+        if (parent < 0)
+            memcpy(&worlds[node * 16], &localMatrices[node * 16], 16 * sizeof(GLfloat));
+        else
+            multiplyMatrices(&worlds[parent * 16], &localMatrices[node * 16], &worlds[node * 16]);
+    }
+
+    // the flags are cleared after the walk, a child needed its parent's flag
+    for (size_t i = 0; i < work.size(); i++) {
+        dirty[work[i]] = 0;
+        stale[work[i]] = 1;
+    }
+    return (int)work.size();
+}
+
+int TransformHierarchy::concatenate(const GLfloat view[16]) {
+    bool newView = !viewValid || memcmp(view, lastView, sizeof(lastView)) != 0;
+    memcpy(lastView, view, sizeof(lastView));
+    viewValid = true;
+
+    int recomputed = 0;
+    for (int node = 0; node < size(); node++) {
+        if (!newView && !stale[node])
+            continue;
+        multiplyMatrices(view, &worlds[node * 16], &modelviews[node * 16]);
+        stale[node] = 0;
+        recomputed++;
+    }
+    return recomputed;
+}
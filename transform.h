@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <GL/glut.h>
+
+/*
+    Transform hierarchy
+
+    The scene graph the frame places its objects with, instead of rebuilding every
+    object's matrix with glPushMatrix/glTranslatef/glRotatef/glScaled each frame. Nodes
+    live in flat arrays in the order they were added, and a parent is always added
+    before its children, so one forward walk visits every parent before its children
+    and no recursion or pointer chasing is needed.
+
+    Each node has a local transform (translation, rotation about y and uniform scale,
+    the same ones SceneInstance holds) and two cached matrices:
+
+    - world = parent's world * local, recomputed by update() only for the nodes whose
+      local transform changed and their descendants;
+    - modelview = view * world, recomputed by concatenate() for those same nodes, or for
+      all of them when the view changed.
+
+    A still subtree therefore costs nothing after the first frame. The matrix products
+    are done in one pass over the changed nodes, four columns at a time with SSE where
+    the CPU has it. The matrices are column major and can be handed to glLoadMatrixf
+    as they are.
+*/
+
+class TransformHierarchy {
+
+public:
+
+    TransformHierarchy();
+
+    void clear();
+
+    // adds a node under parent (-1 for a root) and returns its index, the parent must already exist
+    int addNode(int parent);
+
+    int size() const { return (int)parents.size(); }
+
+    int parent(int node) const { return parents[node]; }
+
+    // the same transform glTranslatef(position), glRotatef(rotation, 0, 1, 0) and glScalef(scale)
+    // build; the node is only marked changed when the values differ from the current ones
+    void setLocal(int node, const GLfloat position[3], GLfloat rotation, GLfloat scale);
+
+
+
+    // recomputes the world matrices of the changed nodes and their descendants, returns how many
+    int update();
+
+    // recomputes the modelview matrices that update() or a new view made stale, returns how many
+    int concatenate(const GLfloat view[16]);
+
+    const GLfloat* world(int node) const { return &worlds[node * 16]; }
+
+    const GLfloat* modelview(int node) const { return &modelviews[node * 16]; }
+
+private:
+
+    struct LocalTransform {
+        GLfloat position[3];
+        GLfloat rotation;
+        GLfloat scale;
+    };
+
+    std::vector<int> parents;
+    std::vector<LocalTransform> locals;
+    std::vector<GLfloat> localMatrices; // 16 floats per node, like the two below
+    std::vector<GLfloat> worlds;
+    std::vector<GLfloat> modelviews;
+    std::vector<uint8_t> dirty; // local changed since the last update()
+    std::vector<uint8_t> stale; // world changed since the last concatenate()
+    std::vector<int> work; // the nodes one pass recomputes, parents first
+
+    GLfloat lastView[16];
+    bool viewValid;
+
+};
+
+// out = a * b for column-major 4x4 matrices, out must not alias either
+void multiplyMatrices(const GLfloat a[16], const GLfloat b[16], GLfloat out[16]);
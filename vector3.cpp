@@ -4,6 +4,10 @@
 
 
 
+vector3::vector3() : x(0.0), y(0.0), z(0.0) {}
+
+
+
 vector3 vector3::normalize() {
 
 	float length = sqrt((x * x) + (y * y) + (z * z));
@@ -1,3 +1,5 @@
+#pragma once
+
 class vector3 {
 
 public:
@@ -0,0 +1,580 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "vector3batch.h"
+#include "cpufeatures.h"
+#include "benchmark.h"
+
+#ifdef SCENE_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static vector3BatchISA supportedISA() {
+#ifdef SCENE_X86
+	if (cpuHasAVX2())
+		return BATCH_AVX2;
+	return BATCH_SSE;
+#else
+	return BATCH_SCALAR;
+#endif
+}
+
+static vector3BatchISA activeISA = supportedISA();
+
+vector3BatchISA getVector3BatchISA() {
+	return activeISA;
+}
+
+void setVector3BatchISA(vector3BatchISA isa) {
+	activeISA = isa < supportedISA() ? isa : supportedISA();
+}
+
+
+
+// storage
+
+vector3Batch::vector3Batch() : x(NULL), y(NULL), z(NULL), count(0), padded(0), block(NULL) {}
+
+vector3Batch::vector3Batch(size_t count) : x(NULL), y(NULL), z(NULL), count(0), padded(0), block(NULL) {
+	resize(count);
+}
+
+vector3Batch::vector3Batch(const vector3Batch& v) : x(NULL), y(NULL), z(NULL), count(0), padded(0), block(NULL) {
+	*this = v;
+}
+
+vector3Batch& vector3Batch::operator=(const vector3Batch& v) {
+	if (this != &v) {
+		resize(v.count);
+		memcpy(x, v.x, padded * sizeof(float));
+		memcpy(y, v.y, padded * sizeof(float));
+		memcpy(z, v.z, padded * sizeof(float));
+	}
+	return *this;
+}
+
+vector3Batch::~vector3Batch() {
+	free(block);
+}
+
+// one allocation holds all three components, each starting on a 32 byte boundary
+void vector3Batch::resize(size_t n) {
+	if (n == count && block != NULL)
+		return;
+
+	free(block);
+	count = n;
+	padded = (n + 7) & ~(size_t)7;
+	if (padded == 0)
+		padded = 8;
+
+	block = calloc(3 * padded * sizeof(float) + 32, 1);
+	if (block == NULL) {
+		count = padded = 0;
+		x = y = z = NULL;
+		throw bad_alloc();
+	}
+	float* aligned = (float*)(((size_t)block + 31) & ~(size_t)31);
+	x = aligned;
+	y = aligned + padded;
+	z = aligned + 2 * padded;
+}
+
+
+
+// scalar kernels, also the reference for the SIMD ones
+
+static void addScalar(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		r.x[i] = a.x[i] + b.x[i];
+		r.y[i] = a.y[i] + b.y[i];
+		r.z[i] = a.z[i] + b.z[i];
+	}
+}
+
+static void subtractScalar(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		r.x[i] = a.x[i] - b.x[i];
+		r.y[i] = a.y[i] - b.y[i];
+		r.z[i] = a.z[i] - b.z[i];
+	}
+}
+
+static void scalarScalar(const vector3Batch& a, float f, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		r.x[i] = a.x[i] * f;
+		r.y[i] = a.y[i] * f;
+		r.z[i] = a.z[i] * f;
+	}
+}
+
+static inline float dotAt(const vector3Batch& a, const vector3Batch& b, size_t i) {
+	return a.x[i] * b.x[i] + a.y[i] * b.y[i] + a.z[i] * b.z[i];
+}
+
+static void dotScalar(const vector3Batch& a, const vector3Batch& b, float* r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		r[i] = dotAt(a, b, i);
+}
+
+static void crossScalar(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		float x1 = a.y[i] * b.z[i] - a.z[i] * b.y[i];
+		float y1 = a.z[i] * b.x[i] - a.x[i] * b.z[i];
+		float z1 = a.x[i] * b.y[i] - a.y[i] * b.x[i];
+		r.x[i] = x1;
+		r.y[i] = y1;
+		r.z[i] = z1;
+	}
+}
+
+static void normalizeScalar(const vector3Batch& a, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		float length = sqrtf(a.x[i] * a.x[i] + a.y[i] * a.y[i] + a.z[i] * a.z[i]);
+		float keep = length >= 0.01f ? 1.0f : 0.0f;
+		float divisor = length >= 0.01f ? length : 1.0f;
+		r.x[i] = keep * a.x[i] / divisor;
+		r.y[i] = keep * a.y[i] / divisor;
+		r.z[i] = keep * a.z[i] / divisor;
+	}
+}
+
+// everything is read before r is written, r may be a or norm
+static void reflectScalar(const vector3Batch& a, const vector3Batch& norm, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		float length = sqrtf(a.x[i] * a.x[i] + a.y[i] * a.y[i] + a.z[i] * a.z[i]);
+		float keep = length >= 0.01f ? 1.0f : 0.0f;
+		float divisor = length >= 0.01f ? length : 1.0f;
+		float x = keep * a.x[i] / divisor;
+		float y = keep * a.y[i] / divisor;
+		float z = keep * a.z[i] / divisor;
+		float nx = norm.x[i], ny = norm.y[i], nz = norm.z[i];
+		float term1 = 2 * (x * nx + y * ny + z * nz);
+		r.x[i] = x - nx * term1;
+		r.y[i] = y - ny * term1;
+		r.z[i] = z - nz * term1;
+	}
+}
+
+static inline float distanceAt(const vector3Batch& a, const vector3Batch& b, size_t i) {
+	float dx = b.x[i] - a.x[i];
+	float dy = b.y[i] - a.y[i];
+	float dz = b.z[i] - a.z[i];
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static void distanceScalar(const vector3Batch& a, const vector3Batch& b, float* r, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		r[i] = distanceAt(a, b, i);
+}
+
+
+
+#ifdef SCENE_X86
+
+// SSE kernels, 4 elements per step
+
+static void addSSE(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 4) {
+		_mm_store_ps(r.x + i, _mm_add_ps(_mm_load_ps(a.x + i), _mm_load_ps(b.x + i)));
+		_mm_store_ps(r.y + i, _mm_add_ps(_mm_load_ps(a.y + i), _mm_load_ps(b.y + i)));
+		_mm_store_ps(r.z + i, _mm_add_ps(_mm_load_ps(a.z + i), _mm_load_ps(b.z + i)));
+	}
+}
+
+static void subtractSSE(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 4) {
+		_mm_store_ps(r.x + i, _mm_sub_ps(_mm_load_ps(a.x + i), _mm_load_ps(b.x + i)));
+		_mm_store_ps(r.y + i, _mm_sub_ps(_mm_load_ps(a.y + i), _mm_load_ps(b.y + i)));
+		_mm_store_ps(r.z + i, _mm_sub_ps(_mm_load_ps(a.z + i), _mm_load_ps(b.z + i)));
+	}
+}
+
+static void scalarSSE(const vector3Batch& a, float f, vector3Batch& r, size_t n) {
+	__m128 s = _mm_set1_ps(f);
+	for (size_t i = 0; i < n; i += 4) {
+		_mm_store_ps(r.x + i, _mm_mul_ps(_mm_load_ps(a.x + i), s));
+		_mm_store_ps(r.y + i, _mm_mul_ps(_mm_load_ps(a.y + i), s));
+		_mm_store_ps(r.z + i, _mm_mul_ps(_mm_load_ps(a.z + i), s));
+	}
+}
+
+static inline __m128 dot4(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+static void dotSSE(const vector3Batch& a, const vector3Batch& b, float* r, size_t n) {
+	for (size_t i = 0; i < n; i += 4) {
+		__m128 d = dot4(_mm_load_ps(a.x + i), _mm_load_ps(a.y + i), _mm_load_ps(a.z + i),
+			_mm_load_ps(b.x + i), _mm_load_ps(b.y + i), _mm_load_ps(b.z + i));
+		_mm_storeu_ps(r + i, d);
+	}
+}
+
+static void crossSSE(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 4) {
+		__m128 ax = _mm_load_ps(a.x + i), ay = _mm_load_ps(a.y + i), az = _mm_load_ps(a.z + i);
+		__m128 bx = _mm_load_ps(b.x + i), by = _mm_load_ps(b.y + i), bz = _mm_load_ps(b.z + i);
+		_mm_store_ps(r.x + i, _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+		_mm_store_ps(r.y + i, _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+		_mm_store_ps(r.z + i, _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+	}
+}
+
+// lengths below 0.01 give zero like vector3::normalize, done with a mask instead of a branch
+static inline void normalize4(__m128& x, __m128& y, __m128& z) {
+	__m128 length = _mm_sqrt_ps(dot4(x, y, z, x, y, z));
+	__m128 keep = _mm_cmpge_ps(length, _mm_set1_ps(0.01f));
+	x = _mm_and_ps(_mm_div_ps(x, length), keep);
+	y = _mm_and_ps(_mm_div_ps(y, length), keep);
+	z = _mm_and_ps(_mm_div_ps(z, length), keep);
+}
+
+static void normalizeSSE(const vector3Batch& a, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 4) {
+		__m128 x = _mm_load_ps(a.x + i), y = _mm_load_ps(a.y + i), z = _mm_load_ps(a.z + i);
+		normalize4(x, y, z);
+		_mm_store_ps(r.x + i, x);
+		_mm_store_ps(r.y + i, y);
+		_mm_store_ps(r.z + i, z);
+	}
+}
+
+static void reflectSSE(const vector3Batch& a, const vector3Batch& norm, vector3Batch& r, size_t n) {
+	__m128 two = _mm_set1_ps(2.0f);
+	for (size_t i = 0; i < n; i += 4) {
+		__m128 x = _mm_load_ps(a.x + i), y = _mm_load_ps(a.y + i), z = _mm_load_ps(a.z + i);
+		__m128 nx = _mm_load_ps(norm.x + i), ny = _mm_load_ps(norm.y + i), nz = _mm_load_ps(norm.z + i);
+		normalize4(x, y, z);
+		__m128 term1 = _mm_mul_ps(two, dot4(x, y, z, nx, ny, nz));
+		_mm_store_ps(r.x + i, _mm_sub_ps(x, _mm_mul_ps(nx, term1)));
+		_mm_store_ps(r.y + i, _mm_sub_ps(y, _mm_mul_ps(ny, term1)));
+		_mm_store_ps(r.z + i, _mm_sub_ps(z, _mm_mul_ps(nz, term1)));
+	}
+}
+
+static void distanceSSE(const vector3Batch& a, const vector3Batch& b, float* r, size_t n) {
+	for (size_t i = 0; i < n; i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_load_ps(b.x + i), _mm_load_ps(a.x + i));
+		__m128 dy = _mm_sub_ps(_mm_load_ps(b.y + i), _mm_load_ps(a.y + i));
+		__m128 dz = _mm_sub_ps(_mm_load_ps(b.z + i), _mm_load_ps(a.z + i));
+		_mm_storeu_ps(r + i, _mm_sqrt_ps(dot4(dx, dy, dz, dx, dy, dz)));
+	}
+}
+
+
+
+// AVX2 kernels, 8 elements per step
+
+SIMD_TARGET("avx2")
+static void addAVX2(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		_mm256_store_ps(r.x + i, _mm256_add_ps(_mm256_load_ps(a.x + i), _mm256_load_ps(b.x + i)));
+		_mm256_store_ps(r.y + i, _mm256_add_ps(_mm256_load_ps(a.y + i), _mm256_load_ps(b.y + i)));
+		_mm256_store_ps(r.z + i, _mm256_add_ps(_mm256_load_ps(a.z + i), _mm256_load_ps(b.z + i)));
+	}
+}
+
+SIMD_TARGET("avx2")
+static void subtractAVX2(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		_mm256_store_ps(r.x + i, _mm256_sub_ps(_mm256_load_ps(a.x + i), _mm256_load_ps(b.x + i)));
+		_mm256_store_ps(r.y + i, _mm256_sub_ps(_mm256_load_ps(a.y + i), _mm256_load_ps(b.y + i)));
+		_mm256_store_ps(r.z + i, _mm256_sub_ps(_mm256_load_ps(a.z + i), _mm256_load_ps(b.z + i)));
+	}
+}
+
+SIMD_TARGET("avx2")
+static void scalarAVX2(const vector3Batch& a, float f, vector3Batch& r, size_t n) {
+	__m256 s = _mm256_set1_ps(f);
+	for (size_t i = 0; i < n; i += 8) {
+		_mm256_store_ps(r.x + i, _mm256_mul_ps(_mm256_load_ps(a.x + i), s));
+		_mm256_store_ps(r.y + i, _mm256_mul_ps(_mm256_load_ps(a.y + i), s));
+		_mm256_store_ps(r.z + i, _mm256_mul_ps(_mm256_load_ps(a.z + i), s));
+	}
+}
+
+SIMD_TARGET("avx2")
+static inline __m256 dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+
+SIMD_TARGET("avx2")
+static void dotAVX2(const vector3Batch& a, const vector3Batch& b, float* r, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 d = dot8(_mm256_load_ps(a.x + i), _mm256_load_ps(a.y + i), _mm256_load_ps(a.z + i),
+			_mm256_load_ps(b.x + i), _mm256_load_ps(b.y + i), _mm256_load_ps(b.z + i));
+		_mm256_storeu_ps(r + i, d);
+	}
+}
+
+SIMD_TARGET("avx2")
+static void crossAVX2(const vector3Batch& a, const vector3Batch& b, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 ax = _mm256_load_ps(a.x + i), ay = _mm256_load_ps(a.y + i), az = _mm256_load_ps(a.z + i);
+		__m256 bx = _mm256_load_ps(b.x + i), by = _mm256_load_ps(b.y + i), bz = _mm256_load_ps(b.z + i);
+		_mm256_store_ps(r.x + i, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+		_mm256_store_ps(r.y + i, _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)));
+		_mm256_store_ps(r.z + i, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx)));
+	}
+}
+
+SIMD_TARGET("avx2")
+static inline void normalize8(__m256& x, __m256& y, __m256& z) {
+	__m256 length = _mm256_sqrt_ps(dot8(x, y, z, x, y, z));
+	__m256 keep = _mm256_cmp_ps(length, _mm256_set1_ps(0.01f), _CMP_GE_OQ);
+	x = _mm256_and_ps(_mm256_div_ps(x, length), keep);
+	y = _mm256_and_ps(_mm256_div_ps(y, length), keep);
+	z = _mm256_and_ps(_mm256_div_ps(z, length), keep);
+}
+
+SIMD_TARGET("avx2")
+static void normalizeAVX2(const vector3Batch& a, vector3Batch& r, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 x = _mm256_load_ps(a.x + i), y = _mm256_load_ps(a.y + i), z = _mm256_load_ps(a.z + i);
+		normalize8(x, y, z);
+		_mm256_store_ps(r.x + i, x);
+		_mm256_store_ps(r.y + i, y);
+		_mm256_store_ps(r.z + i, z);
+	}
+}
+
+SIMD_TARGET("avx2")
+static void reflectAVX2(const vector3Batch& a, const vector3Batch& norm, vector3Batch& r, size_t n) {
+	__m256 two = _mm256_set1_ps(2.0f);
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 x = _mm256_load_ps(a.x + i), y = _mm256_load_ps(a.y + i), z = _mm256_load_ps(a.z + i);
+		__m256 nx = _mm256_load_ps(norm.x + i), ny = _mm256_load_ps(norm.y + i), nz = _mm256_load_ps(norm.z + i);
+		normalize8(x, y, z);
+		__m256 term1 = _mm256_mul_ps(two, dot8(x, y, z, nx, ny, nz));
+		_mm256_store_ps(r.x + i, _mm256_sub_ps(x, _mm256_mul_ps(nx, term1)));
+		_mm256_store_ps(r.y + i, _mm256_sub_ps(y, _mm256_mul_ps(ny, term1)));
+		_mm256_store_ps(r.z + i, _mm256_sub_ps(z, _mm256_mul_ps(nz, term1)));
+	}
+}
+
+SIMD_TARGET("avx2")
+static void distanceAVX2(const vector3Batch& a, const vector3Batch& b, float* r, size_t n) {
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_load_ps(b.x + i), _mm256_load_ps(a.x + i));
+		__m256 dy = _mm256_sub_ps(_mm256_load_ps(b.y + i), _mm256_load_ps(a.y + i));
+		__m256 dz = _mm256_sub_ps(_mm256_load_ps(b.z + i), _mm256_load_ps(a.z + i));
+		_mm256_storeu_ps(r + i, _mm256_sqrt_ps(dot8(dx, dy, dz, dx, dy, dz)));
+	}
+}
+
+// picks the kernel for the active instruction set
+#define DISPATCH(kernel, ...) \
+	switch (activeISA) { \
+	case BATCH_AVX2: kernel##AVX2(__VA_ARGS__); break; \
+	case BATCH_SSE: kernel##SSE(__VA_ARGS__); break; \
+	default: kernel##Scalar(__VA_ARGS__); break; \
+	}
+
+#else
+
+#define DISPATCH(kernel, ...) kernel##Scalar(__VA_ARGS__);
+
+#endif
+
+
+
+// methods
+
+// the kernels read every padded lane of both operands, so they must have the same number of elements
+static void requireSameSize(const vector3Batch& a, const vector3Batch& b, const char* method) {
+	if (a.size() != b.size())
+		throw invalid_argument(string("vector3Batch::") + method + ": operand has " + to_string(b.size())
+			+ " elements, expected " + to_string(a.size()));
+}
+
+void vector3Batch::normalize(vector3Batch& result) const {
+	result.resize(count);
+	DISPATCH(normalize, *this, result, padded)
+}
+
+void vector3Batch::add(const vector3Batch& v, vector3Batch& result) const {
+	requireSameSize(*this, v, "add");
+	result.resize(count);
+	DISPATCH(add, *this, v, result, padded)
+}
+
+void vector3Batch::subtract(const vector3Batch& v, vector3Batch& result) const {
+	requireSameSize(*this, v, "subtract");
+	result.resize(count);
+	DISPATCH(subtract, *this, v, result, padded)
+}
+
+void vector3Batch::scalar(float f, vector3Batch& result) const {
+	result.resize(count);
+	DISPATCH(scalar, *this, f, result, padded)
+}
+
+// the kernels run over the whole blocks of 8, the rest is done one by one so only count results are written
+void vector3Batch::dot(const vector3Batch& v, float* result) const {
+	requireSameSize(*this, v, "dot");
+	size_t blocks = count & ~(size_t)7;
+	DISPATCH(dot, *this, v, result, blocks)
+	for (size_t i = blocks; i < count; i++)
+		result[i] = dotAt(*this, v, i);
+}
+
+void vector3Batch::cross(const vector3Batch& v, vector3Batch& result) const {
+	requireSameSize(*this, v, "cross");
+	result.resize(count);
+	DISPATCH(cross, *this, v, result, padded)
+}
+
+void vector3Batch::reflect(const vector3Batch& norm, vector3Batch& result) const {
+	requireSameSize(*this, norm, "reflect");
+	result.resize(count);
+	DISPATCH(reflect, *this, norm, result, padded)
+}
+
+void vector3Batch::distance(const vector3Batch& v, float* result) const {
+	requireSameSize(*this, v, "distance");
+	size_t blocks = count & ~(size_t)7;
+	DISPATCH(distance, *this, v, result, blocks)
+	for (size_t i = blocks; i < count; i++)
+		result[i] = distanceAt(*this, v, i);
+}
+
+
+
+// benchmark
+
+static const char* isaName(vector3BatchISA isa) {
+	return isa == BATCH_AVX2 ? "avx2" : isa == BATCH_SSE ? "sse" : "scalar";
+}
+
+// runs one operation a few times and returns the best time in nanoseconds per element
+template <typename Operation>
+static double nsPerElement(size_t count, Operation operation) {
+	vector<double> timings;
+	for (int run = 0; run < 7; run++) {
+		double start = nowMilliseconds();
+		operation();
+		timings.push_back(nowMilliseconds() - start);
+	}
+	return summarizeTimings(timings).min * 1e6 / count;
+}
+
+// the largest difference between the batch results and the vector3 ones, relative to their size from 1 up
+static float largestError(const vector<vector3>& expected, const vector3Batch& batch) {
+	float error = 0.0f;
+	for (size_t i = 0; i < expected.size(); i++) {
+		const float want[3] = { expected[i].x, expected[i].y, expected[i].z };
+		const float got[3] = { batch.x[i], batch.y[i], batch.z[i] };
+		for (int k = 0; k < 3; k++)
+			error = max(error, fabsf(got[k] - want[k]) / max(1.0f, fabsf(want[k])));
+	}
+	return error;
+}
+
+static float largestError(const vector<float>& expected, const vector<float>& batch) {
+	float error = 0.0f;
+	for (size_t i = 0; i < expected.size(); i++)
+		error = max(error, fabsf(batch[i] - expected[i]) / max(1.0f, fabsf(expected[i])));
+	return error;
+}
+
+// runs operation op of the benchmark on the batches
+static void runBatchOperation(int op, const vector3Batch& a, const vector3Batch& b, vector3Batch& out, float* scalars) {
+	switch (op) {
+	case 0: a.add(b, out); break;
+	case 1: a.subtract(b, out); break;
+	case 2: a.scalar(1.5f, out); break;
+	case 3: a.dot(b, scalars); break;
+	case 4: a.cross(b, out); break;
+	case 5: a.normalize(out); break;
+	case 6: a.reflect(b, out); break;
+	default: a.distance(b, scalars); break;
+	}
+}
+
+// This function is responsible for timing every operation through vector3 and through each batch instruction set
+int runVector3Benchmark(size_t count, const char* jsonPath) {
+	vector<vector3> a, b, out(count);
+	vector<float> scalars(count);
+	vector3Batch batchA(count), batchB(count), batchOut(count);
+	vector<float> batchScalars(count);
+
+	for (size_t i = 0; i < count; i++) {
+		vector3 va((float)(i % 97) - 48.0f, (float)(i % 31) * 0.5f, (float)(i % 13) - 6.0f);
+		vector3 vb((float)(i % 7) + 0.5f, (float)(i % 11) - 5.0f, (float)(i % 5) * 2.0f);
+		a.push_back(va);
+		b.push_back(vb);
+		batchA.set(i, va);
+		batchB.set(i, vb);
+	}
+
+	const char* names[] = { "add", "subtract", "scalar", "dot", "cross", "normalize", "reflect", "distance" };
+	const int operations = 8;
+	vector3BatchISA best = getVector3BatchISA();
+	bool matches = true;
+
+	stringstream json;
+	json << "{\n  \"benchmark\": \"vector3_batch\",\n  \"elements\": " << count << ",\n  \"results\": [";
+
+	for (int op = 0; op < operations; op++) {
+		// the existing per-element methods, operands passed by value
+		double methodNs = nsPerElement(count, [&]() {
+			for (size_t i = 0; i < count; i++) {
+				switch (op) {
+				case 0: out[i] = a[i].add(b[i]); break;
+				case 1: out[i] = a[i].subtract(b[i]); break;
+				case 2: out[i] = a[i].scalar(1.5f); break;
+				case 3: scalars[i] = a[i].dot(b[i]); break;
+				case 4: out[i] = a[i].cross(b[i]); break;
+				case 5: out[i] = a[i].normalize(); break;
+				case 6: out[i] = a[i].reflect(b[i]); break;
+				default: scalars[i] = a[i].distance(b[i]); break;
+				}
+			}
+		});
+
+		json << (op ? "," : "") << "\n    { \"operation\": \"" << names[op] << "\", \"ns_per_element\": { \"vector3\": " << methodNs;
+
+		for (int isa = BATCH_SCALAR; isa <= best; isa++) {
+			setVector3BatchISA((vector3BatchISA)isa);
+			double batchNs = nsPerElement(count, [&]() {
+				runBatchOperation(op, batchA, batchB, batchOut, &batchScalars[0]);
+			});
+			json << ", \"batch_" << isaName((vector3BatchISA)isa) << "\": " << batchNs;
+
+			// the timings only count when the kernel gives the same results as the methods, to within rounding
+			bool scalarResult = op == 3 || op == 7;
+			float error = scalarResult ? largestError(scalars, batchScalars) : largestError(out, batchOut);
+			if (error > 1e-5f) {
+				cerr << "vector3 batch: " << names[op] << " (" << isaName((vector3BatchISA)isa)
+					<< ") differs from vector3 by " << error << endl;
+				matches = false;
+			}
+
+			// the result may be one of the operands: the same again, written over a copy of each in turn
+			for (int operand = 0; operand < 2 && !scalarResult; operand++) {
+				vector3Batch aliased = operand == 0 ? batchA : batchB;
+				runBatchOperation(op, operand == 0 ? aliased : batchA, operand == 0 ? batchB : aliased, aliased, NULL);
+				error = largestError(out, aliased);
+				if (error > 1e-5f) {
+					cerr << "vector3 batch: " << names[op] << " (" << isaName((vector3BatchISA)isa)
+						<< ") written over its " << (operand == 0 ? "first" : "second") << " operand differs from vector3 by " << error << endl;
+					matches = false;
+				}
+			}
+		}
+		json << " } }";
+	}
+	setVector3BatchISA(best);
+
+	json << "\n  ],\n  \"results_match\": " << (matches ? "true" : "false") << "\n}";
+	return writeReport(jsonPath, json.str()) && matches ? EXIT_SUCCESS : EXIT_FAILURE;
+}
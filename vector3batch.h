@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include "vector3.h"
+
+/*
+	Structure-of-arrays counterpart of vector3 for whole vertex streams.
+
+	The x, y and z components live in three separate 32 byte aligned arrays whose length
+	is rounded up to a multiple of 8, so the kernels always work on full SSE/AVX2 registers
+	and never need a tail loop. The padding lanes are zero. The methods mirror vector3 and
+	give the same results (normalize still returns zero for lengths below 0.01), but each
+	call processes every element. result may be one of the operands. The operands of a
+	method must have as many elements as the batch it is called on, a mismatch throws
+	std::invalid_argument.
+*/
+
+enum vector3BatchISA {
+	BATCH_SCALAR,
+	BATCH_SSE,
+	BATCH_AVX2
+};
+
+class vector3Batch {
+
+public:
+
+	// constructors
+
+	vector3Batch();
+
+	explicit vector3Batch(size_t count);
+
+	vector3Batch(const vector3Batch& v);
+
+	vector3Batch& operator=(const vector3Batch& v);
+
+	~vector3Batch();
+
+
+
+	// element access
+
+	// a new size loses the contents and starts them at zero; throws std::bad_alloc when the memory is not there
+	void resize(size_t count);
+
+	size_t size() const { return count; }
+
+	// number of floats allocated per component
+	size_t paddedSize() const { return padded; }
+
+	vector3 get(size_t i) const { return vector3(x[i], y[i], z[i]); }
+
+	void set(size_t i, vector3 v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+
+
+
+	// methods - vector, applied element by element
+
+	void normalize(vector3Batch& result) const;
+
+	void add(const vector3Batch& v, vector3Batch& result) const;
+
+	void subtract(const vector3Batch& v, vector3Batch& result) const;
+
+	void scalar(float f, vector3Batch& result) const;
+
+	// writes size() floats to result
+	void dot(const vector3Batch& v, float* result) const;
+
+	void cross(const vector3Batch& v, vector3Batch& result) const;
+
+	void reflect(const vector3Batch& norm, vector3Batch& result) const;
+
+
+
+	// method - geometry
+
+	// writes size() floats to result
+	void distance(const vector3Batch& v, float* result) const;
+
+
+
+	// data elements
+
+	float* x;
+
+	float* y;
+
+	float* z;
+
+private:
+
+	size_t count;
+
+	size_t padded;
+
+	void* block;
+
+};
+
+// the instruction set used by the kernels, the best supported one unless forced lower
+vector3BatchISA getVector3BatchISA();
+
+// forces a lower instruction set (for benchmarks), requests above what the CPU has are clamped
+void setVector3BatchISA(vector3BatchISA isa);
+
+// compares the batch kernels with the vector3 methods on count elements, writes JSON; fails when a
+// kernel's results differ from the methods'
+int runVector3Benchmark(size_t count, const char* jsonPath);
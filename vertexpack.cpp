@@ -0,0 +1,72 @@
+#include <math.h>
+#include "vertexpack.h"
+
+using namespace std;
+
+void packedPositionMapping(const Mesh& mesh, GLfloat scale[3], GLfloat offset[3]) {
+    for (int k = 0; k < 3; k++) {
+        GLfloat half = (mesh.boundsMax[k] - mesh.boundsMin[k]) * 0.5f;
+        offset[k] = (mesh.boundsMax[k] + mesh.boundsMin[k]) * 0.5f;
+        // a flat axis still gets a usable scale, every position on it quantizes to 0
+        scale[k] = (half > 1e-6f ? half : 1e-6f) / PACKED_POSITION_RANGE;
+    }
+}
+
+static GLshort quantize(GLfloat value) {
+    if (value > 1.0f)
+        value = 1.0f;
+    if (value < -1.0f)
+        value = -1.0f;
+    return (GLshort)floorf(value * PACKED_POSITION_RANGE + 0.5f);
+}
+
+static GLfloat signOf(GLfloat value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// This function is responsible for folding a unit normal onto the octahedron and storing the square coordinates
+void encodeOctahedral(const GLfloat normal[3], GLshort out[2]) {
+    GLfloat length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (length == 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+
+    GLfloat x = normal[0] / length, y = normal[1] / length;
+    // the lower half is folded over the diagonals into the corners
+    if (normal[2] < 0.0f) {
+        GLfloat folded = (1.0f - fabsf(y)) * signOf(x);
+        y = (1.0f - fabsf(x)) * signOf(y);
+        x = folded;
+    }
+    out[0] = quantize(x);
+    out[1] = quantize(y);
+}
+
+// the same unfolding the instancing shader does
+void decodeOctahedral(const GLshort in[2], GLfloat normal[3]) {
+    GLfloat x = (GLfloat)in[0] / PACKED_POSITION_RANGE, y = (GLfloat)in[1] / PACKED_POSITION_RANGE;
+    GLfloat z = 1.0f - fabsf(x) - fabsf(y);
+    if (z < 0.0f) {
+        GLfloat unfolded = (1.0f - fabsf(y)) * signOf(x);
+        y = (1.0f - fabsf(x)) * signOf(y);
+        x = unfolded;
+    }
+
+    GLfloat length = sqrtf(x * x + y * y + z * z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+void packVertices(const Mesh& mesh, const GLfloat scale[3], const GLfloat offset[3], vector<PackedVertex>& out) {
+    out.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const MeshVertex& vertex = mesh.vertices[i];
+        PackedVertex& packed = out[i];
+        for (int k = 0; k < 3; k++)
+            packed.position[k] = quantize((vertex.position[k] - offset[k]) / (scale[k] * PACKED_POSITION_RANGE));
+        packed.position[3] = 0;
+        encodeOctahedral(vertex.normal, packed.normal);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <GL/glut.h>
+#include "meshcache.h"
+
+/*
+    Packed vertex format
+
+    MeshVertex is six floats, 24 bytes. On the GPU a vertex of the mesh cache can be 12:
+
+    - the position as three 16-bit integers over the mesh's bounding box, so the step is
+      1/65534 of the box's size on each axis; a scale and an offset per mesh map the
+      integers back (position = q * scale + offset), by the modelview matrix for the
+      fixed-function draws and by the shader for the instanced ones;
+    - the normal in octahedral form: the unit sphere folded onto the square [-1, 1]^2 and
+      stored as two signed normalized 16-bit values, about 0.003 degrees apart.
+
+    The CPU side keeps its floats, the CPU renderers, the hierarchy and the baker read
+    those. Fixed-function lighting cannot unfold an octahedral normal, so the lit draws
+    without the shader read the floats from client memory while a mesh is packed.
+*/
+
+struct PackedVertex {
+    GLshort position[4]; // the fourth is padding, so the normal starts on a 4-byte boundary
+    GLshort normal[2];
+};
+
+#define PACKED_POSITION_RANGE 32767
+
+// the mapping from the quantized positions back to the mesh's space, fitted to the mesh's bounding box
+void packedPositionMapping(const Mesh& mesh, GLfloat scale[3], GLfloat offset[3]);
+
+void encodeOctahedral(const GLfloat normal[3], GLshort out[2]);
+
+void decodeOctahedral(const GLshort in[2], GLfloat normal[3]);
+
+// packs every vertex of the mesh with the mapping above
+void packVertices(const Mesh& mesh, const GLfloat scale[3], const GLfloat offset[3], std::vector<PackedVertex>& out);